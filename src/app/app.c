@@ -7,18 +7,34 @@
 #include <Source/clk.h>
 
 #include "logging.h"
+#include "mem.h"
 
 #include "vfs/vfs_app.h"
+#include "vfs/vfs_bench_fatfs.h"
+#include "vfs/vfs_bench_littlefs.h"
+#include "vfs/vfs_bench_mem.h"
+#include "vfs/vfs_bench_spiffs.h"
 #include "vfs/vfs_test_fatfs.h"
 #include "vfs/vfs_test_inter.h"
+#include "vfs/vfs_test_littlefs.h"
+#include "vfs/vfs_test_logfile.h"
+#include "vfs/vfs_test_mem.h"
+#include "vfs/vfs_test_ramdisk.h"
 #include "vfs/vfs_test_spiffs.h"
+#include "vfs/vfs_test_stream.h"
+#include "vfs/vfs_tune.h"
 
 LOG_MODULE_REGISTER(app, LOG_LEVEL_DBG);
 
 #if defined(serial_console) && defined(serial_log)
 int _write(int fd, char *buf, int count) {
-  for (; count != 0; --count) {
-    serial_poll_out(serial_console, *buf++);
+  /* interrupts and early boot still go out by polling */
+  int ret = serial_async_write(serial_console, buf, count, SERIAL_FOREVER);
+  if (ret >= 0) {
+    return ret;
+  }
+  for (int i = 0; i < count; i++) {
+    serial_poll_out(serial_console, buf[i]);
   }
   return count;
 }
@@ -34,6 +50,9 @@ void app_init(void) {
 
   serial_init(serial_console);
   serial_init(serial_log);
+  serial_async_enable(serial_console);
+
+  log_init();
 
   int ret = app_vfs_init();
   LOG_DBG("app_vfs_init=%d", ret);
@@ -47,7 +66,23 @@ void app_init(void) {
 void app_task(void *p_arg) {
   LOG_INF("App task starting");
 
+  test_vfs_mem();
+  test_vfs_ramdisk();
   test_vfs_fatfs();
   test_vfs_spiffs();
   test_vfs_inter();
+  test_vfs_littlefs();
+  test_vfs_stream();
+  test_vfs_logfile();
+
+  bench_vfs_spiffs();
+  bench_vfs_fatfs();
+  bench_vfs_littlefs();
+  bench_vfs_mem();
+
+  mem_stats_print();
+
+#if CONFIG_VFS_TUNE
+  tune_vfs();
+#endif
 }
\ No newline at end of file
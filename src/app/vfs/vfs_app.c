@@ -1,5 +1,8 @@
 #include "fatfs/fatfs_vfs.h"
+#include "littlefs/littlefs_vfs.h"
+#include "logfile.h"
 #include "spiffs/spiffs_vfs.h"
+#include "maint.h"
 #include "vfs.h"
 
 #include "vfs_app.h"
@@ -16,5 +19,11 @@ int app_vfs_init() {
   if ((ret = spiffs_vfs_init())) {
     return ret;
   }
+  if ((ret = vfs_maint_init())) {
+    return ret;
+  }
+  if ((ret = vfs_logfile_init())) {
+    return ret;
+  }
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,27 @@
+#ifndef UC_VFS_VFS_BENCH_H
+#define UC_VFS_VFS_BENCH_H
+
+#include <os.h>
+
+#include "inttypes.h"
+#include "logging.h"
+
+static const struct log_module _log_module;
+
+static inline void print_bench_banner(const char *banner) {
+  LOG_INF("======================== %s ========================", banner);
+}
+
+static inline OS_TICK bench_ticks(void) {
+  OS_ERR err;
+
+  return OSTimeGet(&err);
+}
+
+static inline void print_bench_result(const char *bench_name, OS_TICK ticks,
+                                      uint32_t ops, uint32_t bytes) {
+  LOG_INF("%s: %u ops, %u bytes in %u ms", bench_name, (unsigned)ops,
+          (unsigned)bytes, (unsigned)(ticks * 1000u / OS_CFG_TICK_RATE_HZ));
+}
+
+#endif
@@ -0,0 +1,121 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+
+#include "logging.h"
+
+#include "fatfs/fatfs_vfs.h"
+#include "vfs.h"
+
+#include "vfs_bench.h"
+#include "vfs_bench_fatfs.h"
+
+#define MNT_PATH "/bench"
+#define FNAME (MNT_PATH "/RANDOM.BIN")
+#define CHUNK_SIZE (512u)
+#define N_READS (128u)
+
+LOG_MODULE_REGISTER(bench_fatfs, LOG_LEVEL_INF);
+
+static fatfs_desc_t fatfs;
+
+static vfs_mount_t _bench_vfs_mount = {
+    .mount_point = MNT_PATH,
+    .fs = &fatfs_file_system,
+    .private_data = (void *)&fatfs,
+    .dno = 0,
+};
+
+/* the seek cost grows with the length of the chain */
+static const uint32_t _file_sizes[] = {16u * 1024u, 64u * 1024u, 256u * 1024u};
+
+static uint8_t _buf[CHUNK_SIZE];
+
+/* same sequence for every run */
+static uint32_t _rand(uint32_t *state) {
+  *state = *state * 1103515245u + 12345u;
+  return *state >> 8;
+}
+
+/* every byte holds the low bits of its own offset */
+static int _fill(uint32_t file_size) {
+  int fd = vfs_open(FNAME, O_WRONLY | O_CREAT | O_TRUNC, 0);
+  if (fd < 0) {
+    return fd;
+  }
+  for (uint32_t off = 0; off < file_size; off += CHUNK_SIZE) {
+    for (uint32_t i = 0; i < CHUNK_SIZE; i++) {
+      _buf[i] = (uint8_t)(off + i);
+    }
+    if (vfs_write(fd, _buf, CHUNK_SIZE) != CHUNK_SIZE) {
+      vfs_close(fd);
+      return -EIO;
+    }
+  }
+  return vfs_close(fd);
+}
+
+static void _random_reads(const char *bench_name, uint32_t file_size,
+                          int flags) {
+  uint32_t seed = 1;
+  uint32_t bad = 0;
+
+  int fd = vfs_open(FNAME, O_RDONLY | flags, 0);
+  if (fd < 0) {
+    LOG_INF("%s: open=%d", bench_name, fd);
+    return;
+  }
+
+  OS_TICK start = bench_ticks();
+  for (uint32_t i = 0; i < N_READS; i++) {
+    uint32_t off = _rand(&seed) % (file_size - CHUNK_SIZE);
+    if (vfs_lseek(fd, off, SEEK_SET) != (off_t)off ||
+        vfs_read(fd, _buf, CHUNK_SIZE) != CHUNK_SIZE ||
+        _buf[0] != (uint8_t)off ||
+        _buf[CHUNK_SIZE - 1] != (uint8_t)(off + CHUNK_SIZE - 1)) {
+      bad++;
+    }
+  }
+  OS_TICK end = bench_ticks();
+  vfs_close(fd);
+
+  LOG_INF("%s: file size %u", bench_name, (unsigned)file_size);
+  print_bench_result(bench_name, end - start, N_READS, N_READS * CHUNK_SIZE);
+  if (bad) {
+    LOG_INF("%s: %u bad reads", bench_name, (unsigned)bad);
+  }
+}
+
+void bench_vfs_fatfs(void) {
+  int ret;
+
+  print_bench_banner("FatFS VFS Benchmarks");
+  fatfs_vfs_desc_init(&fatfs);
+
+  if ((ret = vfs_format(&_bench_vfs_mount)) ||
+      (ret = vfs_mount(&_bench_vfs_mount))) {
+    LOG_INF("bench_fatfs: setup=%d", ret);
+    return;
+  }
+
+  for (unsigned i = 0; i < ARRAY_SIZE(_file_sizes); i++) {
+    /* cluster allocation, see FF_FAT_BITMAP and FF_FAT_CACHE */
+    OS_TICK start = bench_ticks();
+    ret = _fill(_file_sizes[i]);
+    print_bench_result("bench_append_512", bench_ticks() - start,
+                       _file_sizes[i] / CHUNK_SIZE, _file_sizes[i]);
+    if (ret == 0) {
+      /* built by the first long seek or when the file is opened, build with
+       * FF_USE_FASTSEEK 0 for the plain chain walk */
+      _random_reads("bench_random_512__clmt_lazy", _file_sizes[i], 0);
+      _random_reads("bench_random_512__clmt_open", _file_sizes[i],
+                    VFS_O_RANDOM);
+      vfs_unlink(FNAME);
+    } else {
+      LOG_INF("bench_fatfs: fill=%d", ret);
+      break;
+    }
+  }
+
+  vfs_umount(&_bench_vfs_mount, false);
+}
@@ -0,0 +1,6 @@
+#ifndef UC_VFS_VFS_BENCH_FATFS_H
+#define UC_VFS_VFS_BENCH_FATFS_H
+
+void bench_vfs_fatfs(void);
+
+#endif
@@ -0,0 +1,254 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "logging.h"
+
+#include "littlefs/littlefs_vfs.h"
+#include "ramdisk.h"
+#include "vfs.h"
+
+#include "vfs_bench.h"
+#include "vfs_bench_littlefs.h"
+
+#define MNT_PATH "/bench"
+#define FNAME_SEQ (MNT_PATH "/SEQ.BIN")
+#define FNAME_LOG (MNT_PATH "/LOG.BIN")
+#define FILE_SIZE (64u * 1024u)
+#define CHUNK_SIZE (512u)
+#define RECORD_SIZE (16u)
+#define N_RECORDS (1024u)
+#define N_META_FILES (64u)
+#define CRC_ROUNDS (256u)
+
+LOG_MODULE_REGISTER(bench_littlefs, LOG_LEVEL_INF);
+
+static littlefs2_desc_t littlefs;
+
+static vfs_mount_t _bench_vfs_mount = {
+    .mount_point = MNT_PATH,
+    .fs = &littlefs2_file_system,
+    .private_data = (void *)&littlefs,
+    .dno = 1,
+};
+
+/* cache size of the mount, every open file gets one as well */
+static const uint32_t _cache_sizes[] = {64u, 128u, 256u, 512u};
+
+/* block geometries for the metadata workload, 0 keeps the default */
+typedef struct {
+  const char *name;
+  lfs_size_t block_size;
+  lfs_size_t metadata_max;
+  lfs_size_t compact_thresh;
+} _geometry_t;
+
+static const _geometry_t _geometries[] = {
+    {"block_512", 512u, 0, 0},
+    {"block_2k", 2048u, 0, 0},
+    {"block_2k__metadata_1k", 2048u, 1024u, 0},
+    {"block_2k__compact_1k", 2048u, 0, 1024u},
+    {"block_4k", 4096u, 0, 0},
+};
+
+static uint8_t _buf[CHUNK_SIZE];
+
+static void _set_geometry(const _geometry_t *g) {
+  littlefs.config.block_size = g ? g->block_size : 0;
+  littlefs.config.block_count = 0;
+  littlefs.config.metadata_max = g ? g->metadata_max : 0;
+  littlefs.config.compact_thresh = g ? g->compact_thresh : 0;
+  littlefs.config.inline_max = 0;
+  littlefs.config.cache_size = 0;
+}
+
+static void _seq_write(void) {
+  int fd = vfs_open(FNAME_SEQ, O_WRONLY | O_CREAT | O_TRUNC, 0);
+  if (fd < 0) {
+    LOG_INF("bench_seq_write_512: open=%d", fd);
+    return;
+  }
+
+  OS_TICK start = bench_ticks();
+  for (uint32_t off = 0; off < FILE_SIZE; off += CHUNK_SIZE) {
+    memset(_buf, (uint8_t)(off / CHUNK_SIZE), CHUNK_SIZE);
+    if (vfs_write(fd, _buf, CHUNK_SIZE) != CHUNK_SIZE) {
+      LOG_INF("bench_seq_write_512: write failed at %u", (unsigned)off);
+      break;
+    }
+  }
+  vfs_close(fd);
+  print_bench_result("bench_seq_write_512", bench_ticks() - start,
+                     FILE_SIZE / CHUNK_SIZE, FILE_SIZE);
+}
+
+static void _seq_read(void) {
+  uint32_t bad = 0;
+
+  int fd = vfs_open(FNAME_SEQ, O_RDONLY, 0);
+  if (fd < 0) {
+    LOG_INF("bench_seq_read_512: open=%d", fd);
+    return;
+  }
+
+  OS_TICK start = bench_ticks();
+  for (uint32_t off = 0; off < FILE_SIZE; off += CHUNK_SIZE) {
+    if (vfs_read(fd, _buf, CHUNK_SIZE) != CHUNK_SIZE ||
+        _buf[0] != (uint8_t)(off / CHUNK_SIZE) ||
+        _buf[CHUNK_SIZE - 1] != (uint8_t)(off / CHUNK_SIZE)) {
+      bad++;
+    }
+  }
+  OS_TICK end = bench_ticks();
+  vfs_close(fd);
+
+  print_bench_result("bench_seq_read_512", end - start, FILE_SIZE / CHUNK_SIZE,
+                     FILE_SIZE);
+  if (bad) {
+    LOG_INF("bench_seq_read_512: %u bad reads", (unsigned)bad);
+  }
+}
+
+/* log style records, each one smaller than the smallest cache */
+static void _append(void) {
+  int fd = vfs_open(FNAME_LOG, O_WRONLY | O_CREAT | O_APPEND, 0);
+  if (fd < 0) {
+    LOG_INF("bench_append_16: open=%d", fd);
+    return;
+  }
+
+  OS_TICK start = bench_ticks();
+  for (uint32_t i = 0; i < N_RECORDS; i++) {
+    memset(_buf, (uint8_t)i, RECORD_SIZE);
+    if (vfs_write(fd, _buf, RECORD_SIZE) != RECORD_SIZE) {
+      LOG_INF("bench_append_16: write failed at %u", (unsigned)i);
+      break;
+    }
+  }
+  vfs_close(fd);
+  print_bench_result("bench_append_16", bench_ticks() - start, N_RECORDS,
+                     N_RECORDS * RECORD_SIZE);
+}
+
+static void _meta_name(char *buf, size_t len, const char *prefix,
+                       uint32_t i) {
+  snprintf(buf, len, "%s/%s%02u", MNT_PATH, prefix, (unsigned)i);
+}
+
+/* many small files, every step is a metadata commit */
+static void _metadata(void) {
+  char name[24], to[24];
+  struct stat st;
+  uint32_t bad = 0;
+
+  OS_TICK start = bench_ticks();
+  for (uint32_t i = 0; i < N_META_FILES; i++) {
+    _meta_name(name, sizeof(name), "F", i);
+    int fd = vfs_open(name, O_WRONLY | O_CREAT | O_TRUNC, 0);
+    if (fd < 0 || vfs_write(fd, &i, sizeof(i)) != sizeof(i)) {
+      bad++;
+    }
+    vfs_close(fd);
+  }
+  print_bench_result("bench_meta_create", bench_ticks() - start, N_META_FILES,
+                     N_META_FILES * sizeof(uint32_t));
+
+  start = bench_ticks();
+  for (uint32_t i = 0; i < N_META_FILES; i++) {
+    _meta_name(name, sizeof(name), "F", i);
+    bad += vfs_stat(name, &st) != 0;
+  }
+  print_bench_result("bench_meta_stat", bench_ticks() - start, N_META_FILES,
+                     0);
+
+  start = bench_ticks();
+  for (uint32_t i = 0; i < N_META_FILES; i++) {
+    _meta_name(name, sizeof(name), "F", i);
+    _meta_name(to, sizeof(to), "R", i);
+    bad += vfs_rename(name, to) != 0;
+  }
+  print_bench_result("bench_meta_rename", bench_ticks() - start, N_META_FILES,
+                     0);
+
+  start = bench_ticks();
+  bad += vfs_gc(&_bench_vfs_mount, &(vfs_gc_t){0}) < 0;
+  print_bench_result("bench_meta_gc", bench_ticks() - start, 1, 0);
+
+  start = bench_ticks();
+  for (uint32_t i = 0; i < N_META_FILES; i++) {
+    _meta_name(to, sizeof(to), "R", i);
+    bad += vfs_unlink(to) != 0;
+  }
+  print_bench_result("bench_meta_unlink", bench_ticks() - start, N_META_FILES,
+                     0);
+  if (bad) {
+    LOG_INF("bench_meta: %u failed operations", (unsigned)bad);
+  }
+}
+
+/* raw checksum throughput, littlefs runs it over every metadata commit */
+static void _crc(void) {
+  static uint8_t buf[4096];
+  volatile uint32_t crc = 0xffffffff;
+
+  for (unsigned i = 0; i < sizeof(buf); i++) {
+    buf[i] = (uint8_t)i;
+  }
+
+  OS_TICK start = bench_ticks();
+  for (unsigned i = 0; i < CRC_ROUNDS; i++) {
+    crc = lfs_crc(crc, buf, sizeof(buf));
+  }
+  print_bench_result("bench_crc_4k", bench_ticks() - start, CRC_ROUNDS,
+                     CRC_ROUNDS * sizeof(buf));
+  LOG_INF("bench_crc_4k: impl %d", LFS_CRC_IMPL);
+}
+
+void bench_vfs_littlefs(void) {
+  int ret;
+
+  print_bench_banner("LittleFS VFS Benchmarks");
+  littlefs_vfs_desc_init(&littlefs);
+
+  _crc();
+
+  for (unsigned i = 0; i < ARRAY_SIZE(_geometries); i++) {
+    /* the block size is part of the on-disk format */
+    _set_geometry(&_geometries[i]);
+    if ((ret = vfs_format(&_bench_vfs_mount)) ||
+        (ret = vfs_mount(&_bench_vfs_mount))) {
+      LOG_INF("bench_littlefs: %s setup=%d", _geometries[i].name, ret);
+      continue;
+    }
+    LOG_INF("bench_littlefs: %s", _geometries[i].name);
+    _metadata();
+    vfs_umount(&_bench_vfs_mount, false);
+  }
+
+  /* every cache size starts from the same freshly formatted image */
+  ramdisk_t *disk = ramdisk_open(_bench_vfs_mount.dno);
+  _set_geometry(NULL);
+  if ((ret = vfs_format(&_bench_vfs_mount)) ||
+      (ret = ramdisk_snapshot(disk))) {
+    LOG_INF("bench_littlefs: setup=%d", ret);
+    return;
+  }
+
+  for (unsigned i = 0; i < ARRAY_SIZE(_cache_sizes); i++) {
+    /* the cache size is not part of the on-disk format */
+    littlefs.config.cache_size = _cache_sizes[i];
+    if ((ret = ramdisk_restore(disk)) ||
+        (ret = vfs_mount(&_bench_vfs_mount))) {
+      LOG_INF("bench_littlefs: mount=%d", ret);
+      continue;
+    }
+    LOG_INF("bench_littlefs: cache size %u", (unsigned)_cache_sizes[i]);
+    _seq_write();
+    _seq_read();
+    _append();
+    vfs_umount(&_bench_vfs_mount, false);
+  }
+  ramdisk_snapshot_drop(disk);
+  littlefs.config.cache_size = 0;
+}
@@ -0,0 +1,6 @@
+#ifndef UC_VFS_VFS_BENCH_LITTLEFS_H
+#define UC_VFS_VFS_BENCH_LITTLEFS_H
+
+void bench_vfs_littlefs(void);
+
+#endif
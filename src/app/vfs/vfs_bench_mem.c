@@ -0,0 +1,76 @@
+#include <string.h>
+
+#include "logging.h"
+
+#include "common.h"
+#include "memops.h"
+#include "printf.h"
+
+#include "vfs_bench.h"
+#include "vfs_bench_mem.h"
+
+#define MAX_SIZE (4096u)
+#define TOTAL_BYTES (512u * 1024u)
+
+LOG_MODULE_REGISTER(bench_mem, LOG_LEVEL_INF);
+
+/* word aligned, offsets below give the misalignment */
+static uint32_t _src[(MAX_SIZE + 8u) / sizeof(uint32_t)];
+static uint32_t _dst[(MAX_SIZE + 8u) / sizeof(uint32_t)];
+
+static const size_t _sizes[] = {16, 64, 512, MAX_SIZE};
+
+/* dst/src offsets, 64 byte littlefs transfers often land on the odd ones */
+static const uint8_t _align[][2] = {{0, 0}, {1, 0}, {0, 1}, {3, 2}};
+
+typedef void *(*_copy_fn_t)(void *dst, const void *src, size_t n);
+typedef void *(*_fill_fn_t)(void *dst, int c, size_t n);
+
+static void _bench_copy(const char *name, _copy_fn_t copy, size_t size,
+                        unsigned d_off, unsigned s_off) {
+  char bench_name[40];
+  uint8_t *dst = (uint8_t *)_dst + d_off;
+  const uint8_t *src = (const uint8_t *)_src + s_off;
+  uint32_t ops = TOTAL_BYTES / size;
+
+  snprintf_(bench_name, sizeof(bench_name), "%s_%u_%u/%u", name,
+            (unsigned)size, d_off, s_off);
+  OS_TICK start = bench_ticks();
+  for (uint32_t i = 0; i < ops; i++) {
+    copy(dst, src, size);
+  }
+  print_bench_result(bench_name, bench_ticks() - start, ops, ops * size);
+}
+
+static void _bench_fill(const char *name, _fill_fn_t fill, size_t size,
+                        unsigned d_off) {
+  char bench_name[40];
+  uint8_t *dst = (uint8_t *)_dst + d_off;
+  uint32_t ops = TOTAL_BYTES / size;
+
+  snprintf_(bench_name, sizeof(bench_name), "%s_%u_%u", name, (unsigned)size,
+            d_off);
+  OS_TICK start = bench_ticks();
+  for (uint32_t i = 0; i < ops; i++) {
+    fill(dst, 0xFF, size);
+  }
+  print_bench_result(bench_name, bench_ticks() - start, ops, ops * size);
+}
+
+void bench_vfs_mem(void) {
+  print_bench_banner("VFS Memops Benchmarks");
+
+  memset(_src, 0xA5, sizeof(_src));
+
+  for (unsigned i = 0; i < ARRAY_SIZE(_sizes); i++) {
+    for (unsigned j = 0; j < ARRAY_SIZE(_align); j++) {
+      _bench_copy("memcpy", memcpy, _sizes[i], _align[j][0], _align[j][1]);
+      _bench_copy("vfs_memcpy", vfs_memcpy, _sizes[i], _align[j][0],
+                  _align[j][1]);
+    }
+    for (unsigned d_off = 0; d_off < 2; d_off++) {
+      _bench_fill("memset", memset, _sizes[i], d_off);
+      _bench_fill("vfs_memset", vfs_memset, _sizes[i], d_off);
+    }
+  }
+}
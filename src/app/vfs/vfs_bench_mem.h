@@ -0,0 +1,6 @@
+#ifndef UC_VFS_VFS_BENCH_MEM_H
+#define UC_VFS_VFS_BENCH_MEM_H
+
+void bench_vfs_mem(void);
+
+#endif
@@ -0,0 +1,162 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+
+#include "logging.h"
+
+#include "printf.h"
+#include "spiffs/spiffs_vfs.h"
+#include "stream.h"
+#include "vfs.h"
+
+#include "vfs_bench.h"
+#include "vfs_bench_spiffs.h"
+
+#define MNT_PATH "/bench"
+#define FNAME (MNT_PATH "/RANDOM.BIN")
+#define FILE_SIZE (256u * 1024u)
+#define CHUNK_SIZE (4u * 1024u)
+#define N_READS (128u)
+#define LOG_NAME (MNT_PATH "/LOG.TXT")
+#define N_RECORDS (2048u)
+
+LOG_MODULE_REGISTER(bench_spiffs, LOG_LEVEL_INF);
+
+static spiffs_desc_t spiffs_desc;
+
+static vfs_mount_t _bench_vfs_mount = {
+    .mount_point = MNT_PATH,
+    .fs = &spiffs_file_system,
+    .private_data = (void *)&spiffs_desc,
+    .dno = 1,
+};
+
+static uint8_t _buf[CHUNK_SIZE];
+
+/* same sequence for every run */
+static uint32_t _rand(uint32_t *state) {
+  *state = *state * 1103515245u + 12345u;
+  return *state >> 8;
+}
+
+/* every byte holds the low bits of its own offset */
+static int _fill(void) {
+  int fd = vfs_open(FNAME, O_WRONLY | O_CREAT | O_TRUNC, 0);
+  if (fd < 0) {
+    return fd;
+  }
+  for (uint32_t off = 0; off < FILE_SIZE; off += CHUNK_SIZE) {
+    for (uint32_t i = 0; i < CHUNK_SIZE; i++) {
+      _buf[i] = (uint8_t)(off + i);
+    }
+    if (vfs_write(fd, _buf, CHUNK_SIZE) != CHUNK_SIZE) {
+      vfs_close(fd);
+      return -EIO;
+    }
+  }
+  return vfs_close(fd);
+}
+
+static void _random_reads(const char *bench_name, int flags) {
+  uint32_t seed = 1;
+  uint32_t bad = 0;
+
+  int fd = vfs_open(FNAME, O_RDONLY | flags, 0);
+  if (fd < 0) {
+    LOG_INF("%s: open=%d", bench_name, fd);
+    return;
+  }
+
+  OS_TICK start = bench_ticks();
+  for (uint32_t i = 0; i < N_READS; i++) {
+    uint32_t off = _rand(&seed) % (FILE_SIZE - CHUNK_SIZE);
+    if (vfs_lseek(fd, off, SEEK_SET) != (off_t)off ||
+        vfs_read(fd, _buf, CHUNK_SIZE) != CHUNK_SIZE ||
+        _buf[0] != (uint8_t)off ||
+        _buf[CHUNK_SIZE - 1] != (uint8_t)(off + CHUNK_SIZE - 1)) {
+      bad++;
+    }
+  }
+  OS_TICK end = bench_ticks();
+  vfs_close(fd);
+
+  print_bench_result(bench_name, end - start, N_READS, N_READS * CHUNK_SIZE);
+  if (bad) {
+    LOG_INF("%s: %u bad reads", bench_name, (unsigned)bad);
+  }
+}
+
+/* many short log records, as written by application code */
+static void _records_raw(void) {
+  char line[32];
+  uint32_t bytes = 0;
+
+  int fd = vfs_open(LOG_NAME, O_WRONLY | O_CREAT | O_TRUNC, 0);
+  if (fd < 0) {
+    LOG_INF("bench_records__raw: open=%d", fd);
+    return;
+  }
+
+  OS_TICK start = bench_ticks();
+  for (uint32_t i = 0; i < N_RECORDS; i++) {
+    int len = snprintf_(line, sizeof(line), "rec %u val %u\n", (unsigned)i,
+                        (unsigned)(i * 7u));
+    if (vfs_write(fd, line, len) == len) {
+      bytes += len;
+    }
+  }
+  vfs_close(fd);
+  OS_TICK end = bench_ticks();
+
+  print_bench_result("bench_records__raw", end - start, N_RECORDS, bytes);
+}
+
+static void _records_stream(void) {
+  uint32_t bytes = 0;
+
+  vfs_stream_t *s = vfs_fopen(LOG_NAME, "w");
+  if (s == NULL) {
+    LOG_INF("bench_records__stream: fopen failed");
+    return;
+  }
+
+  OS_TICK start = bench_ticks();
+  for (uint32_t i = 0; i < N_RECORDS; i++) {
+    int len = vfs_fprintf(s, "rec %u val %u\n", (unsigned)i,
+                          (unsigned)(i * 7u));
+    if (len > 0) {
+      bytes += len;
+    }
+  }
+  vfs_fclose(s);
+  OS_TICK end = bench_ticks();
+
+  print_bench_result("bench_records__stream", end - start, N_RECORDS, bytes);
+}
+
+void bench_vfs_spiffs(void) {
+  int ret;
+
+  print_bench_banner("SPIFFS VFS Benchmarks");
+  spiffs_vfs_desc_init(&spiffs_desc);
+
+  if ((ret = vfs_format(&_bench_vfs_mount)) ||
+      (ret = vfs_mount(&_bench_vfs_mount))) {
+    LOG_INF("bench_spiffs: setup=%d", ret);
+    return;
+  }
+
+  if ((ret = _fill()) == 0) {
+    _random_reads("bench_random_4k__no_map", 0);
+    _random_reads("bench_random_4k__ix_map", VFS_O_RANDOM);
+    vfs_unlink(FNAME);
+  } else {
+    LOG_INF("bench_spiffs: fill=%d", ret);
+  }
+
+  _records_raw();
+  _records_stream();
+  vfs_unlink(LOG_NAME);
+
+  vfs_umount(&_bench_vfs_mount, false);
+}
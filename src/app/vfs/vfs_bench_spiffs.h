@@ -0,0 +1,6 @@
+#ifndef UC_VFS_VFS_BENCH_SPIFFS_H
+#define UC_VFS_VFS_BENCH_SPIFFS_H
+
+void bench_vfs_spiffs(void);
+
+#endif
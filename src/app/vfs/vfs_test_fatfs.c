@@ -5,6 +5,7 @@
 #include "logging.h"
 
 #include "fatfs/fatfs_vfs.h"
+#include "ramdisk.h"
 #include "vfs.h"
 
 #include "vfs_test.h"
@@ -20,6 +21,12 @@
 #define FULL_FNAME_RNMD (MNT_PATH "/" FNAME_RNMD)
 #define FULL_FNAME_NXIST (MNT_PATH "/" FNAME_NXIST)
 #define DIR_NAME "SOMEDIR"
+#define FULL_FNAME_FRAG1 (MNT_PATH "/FRAG1.BIN")
+#define FULL_FNAME_FRAG2 (MNT_PATH "/FRAG2.BIN")
+#define FRAG_CHUNK (512u)
+#define FRAG_CHUNKS (16u)
+#define MNT_PATH2 "/test2"
+#define FULL_FNAME1_VOL2 (MNT_PATH2 "/" FNAME1)
 
 static const char test_txt[] = "the test file content 123 abc";
 static const char test_txt2[] = "another text";
@@ -36,8 +43,20 @@ static vfs_mount_t _test_vfs_mount = {
     .dno = 0,
 };
 
+static fatfs_desc_t fatfs2;
+
+static vfs_mount_t _test_vfs_mount2 = {
+    .mount_point = MNT_PATH2,
+    .fs = &fatfs_file_system,
+    .private_data = (void *)&fatfs2,
+    .dno = 1,
+};
+
 static void test_format(void) {
   print_test_result("test_format__format", vfs_format(&_test_vfs_mount) == 0);
+  /* only a mount keeps the disk bound to a volume */
+  print_test_result("test_format__released",
+                    fatfs_disks[fatfs.vol_idx] == NULL);
 }
 
 static void test_mount(void) {
@@ -253,8 +272,404 @@ static void test_fstat(void) {
                     vfs_umount(&_test_vfs_mount, false) == 0);
 }
 
+static int _write_file(const char *path, const char *txt, size_t len) {
+  int fd = vfs_open(path, O_WRONLY | O_CREAT | O_TRUNC, 0);
+  if (fd < 0) {
+    return fd;
+  }
+  ssize_t n = vfs_write(fd, txt, len);
+  vfs_close(fd);
+  return n == (ssize_t)len ? 0 : -EIO;
+}
+
+static bool _file_is(const char *path, const char *txt, size_t len) {
+  char buf[sizeof(test_txt)];
+  int fd = vfs_open(path, O_RDONLY, 0);
+  if (fd < 0) {
+    return false;
+  }
+  ssize_t n = vfs_read(fd, buf, sizeof(buf));
+  vfs_close(fd);
+  return n == (ssize_t)len && memcmp(buf, txt, len) == 0;
+}
+
+static void _frag_fill(uint8_t *buf, uint32_t off, uint8_t salt) {
+  for (uint32_t i = 0; i < FRAG_CHUNK; i++) {
+    buf[i] = (uint8_t)(off + i) ^ salt;
+  }
+}
+
+static bool _frag_check(int fd, uint32_t off, uint8_t salt) {
+  uint8_t buf[FRAG_CHUNK];
+  uint8_t expected[FRAG_CHUNK];
+
+  _frag_fill(expected, off, salt);
+  return vfs_lseek(fd, off, SEEK_SET) == (off_t)off &&
+         vfs_read(fd, buf, FRAG_CHUNK) == FRAG_CHUNK &&
+         memcmp(buf, expected, FRAG_CHUNK) == 0;
+}
+
+/* interleaved writes fragment both chains */
+static bool _frag_write(void) {
+  uint8_t buf[FRAG_CHUNK];
+  bool ok = true;
+
+  int fd1 = vfs_open(FULL_FNAME_FRAG1, O_WRONLY | O_CREAT | O_TRUNC, 0);
+  int fd2 = vfs_open(FULL_FNAME_FRAG2, O_WRONLY | O_CREAT | O_TRUNC, 0);
+  for (uint32_t i = 0; i < FRAG_CHUNKS; i++) {
+    _frag_fill(buf, i * FRAG_CHUNK, 0x00);
+    ok &= vfs_write(fd1, buf, FRAG_CHUNK) == FRAG_CHUNK;
+    _frag_fill(buf, i * FRAG_CHUNK, 0xa5);
+    ok &= vfs_write(fd2, buf, FRAG_CHUNK) == FRAG_CHUNK;
+  }
+  ok &= vfs_close(fd2) == 0;
+  ok &= vfs_close(fd1) == 0;
+  return ok;
+}
+
+/* the cluster link map table must follow the fragments and be rebuilt after
+ * the file grows */
+static void test_fastseek(void) {
+  uint8_t buf[FRAG_CHUNK];
+  bool ok = true;
+
+  print_test_result("test_fastseek__mount", vfs_mount(&_test_vfs_mount) == 0);
+  print_test_result("test_fastseek__write", _frag_write());
+
+  /* backward seeks over the fragments */
+  int fd1 = vfs_open(FULL_FNAME_FRAG1, O_RDONLY | VFS_O_RANDOM, 0);
+  print_test_result("test_fastseek__open_ro", fd1 >= 0);
+  for (uint32_t i = FRAG_CHUNKS; i-- > 0;) {
+    ok &= _frag_check(fd1, i * FRAG_CHUNK, 0x00);
+  }
+  print_test_result("test_fastseek__read_back", ok);
+  print_test_result("test_fastseek__close_ro", vfs_close(fd1) == 0);
+
+  /* append past the chain recorded in the table then seek back into it */
+  int fd2 = vfs_open(FULL_FNAME_FRAG2, O_RDWR | VFS_O_RANDOM, 0);
+  print_test_result("test_fastseek__open_rw", fd2 >= 0);
+  _frag_fill(buf, FRAG_CHUNKS * FRAG_CHUNK, 0xa5);
+  print_test_result(
+      "test_fastseek__append",
+      vfs_lseek(fd2, 0, SEEK_END) == FRAG_CHUNKS * FRAG_CHUNK &&
+          vfs_write(fd2, buf, FRAG_CHUNK) == FRAG_CHUNK);
+  ok = _frag_check(fd2, 0, 0xa5) &&
+       _frag_check(fd2, FRAG_CHUNKS * FRAG_CHUNK, 0xa5) &&
+       _frag_check(fd2, FRAG_CHUNK, 0xa5);
+  print_test_result("test_fastseek__read_appended", ok);
+  print_test_result("test_fastseek__close_rw", vfs_close(fd2) == 0);
+
+  print_test_result("test_fastseek__unlink",
+                    vfs_unlink(FULL_FNAME_FRAG1) == 0 &&
+                        vfs_unlink(FULL_FNAME_FRAG2) == 0);
+  print_test_result("test_fastseek__umount",
+                    vfs_umount(&_test_vfs_mount, false) == 0);
+}
+
+/* run fatfs_defrag() in small steps until a pass completes */
+static bool _defrag_pass(fatfs_defrag_report_t *report) {
+  fatfs_defrag_stats_t stats;
+
+  fatfs_defrag_stats(&_test_vfs_mount, &stats);
+  uint32_t passes = stats.passes;
+  for (unsigned i = 0; i < 256 && stats.passes == passes; i++) {
+    if (fatfs_defrag(&_test_vfs_mount, 1) < 0) {
+      return false;
+    }
+    fatfs_defrag_stats(&_test_vfs_mount, &stats);
+  }
+  *report = stats.last;
+  return stats.passes == passes + 1;
+}
+
+static void test_defrag(void) {
+  fatfs_defrag_report_t report;
+  bool ok = true;
+
+  print_test_result("test_defrag__mount", vfs_mount(&_test_vfs_mount) == 0);
+  print_test_result("test_defrag__write", _frag_write());
+
+  /* the open file stays where it is */
+  int fd2 = vfs_open(FULL_FNAME_FRAG2, O_RDONLY, 0);
+  print_test_result("test_defrag__pass1", _defrag_pass(&report));
+  print_test_result("test_defrag__report1", report.fragmented == 2 &&
+                                                report.moved == 1 &&
+                                                report.skipped == 1);
+  for (uint32_t i = 0; i < FRAG_CHUNKS; i++) {
+    ok &= _frag_check(fd2, i * FRAG_CHUNK, 0xa5);
+  }
+  print_test_result("test_defrag__read_open", ok);
+  print_test_result("test_defrag__close", vfs_close(fd2) == 0);
+
+  print_test_result("test_defrag__pass2", _defrag_pass(&report));
+  print_test_result("test_defrag__report2",
+                    report.fragmented == 1 && report.moved == 1);
+  print_test_result("test_defrag__pass3", _defrag_pass(&report));
+  print_test_result("test_defrag__report3", report.fragmented == 0 &&
+                                                report.max_fragments == 1);
+
+  ok = true;
+  int fd1 = vfs_open(FULL_FNAME_FRAG1, O_RDONLY, 0);
+  fd2 = vfs_open(FULL_FNAME_FRAG2, O_RDONLY, 0);
+  for (uint32_t i = 0; i < FRAG_CHUNKS; i++) {
+    ok &= _frag_check(fd1, i * FRAG_CHUNK, 0x00);
+    ok &= _frag_check(fd2, i * FRAG_CHUNK, 0xa5);
+  }
+  vfs_close(fd2);
+  vfs_close(fd1);
+  print_test_result("test_defrag__read_moved", ok);
+
+  print_test_result("test_defrag__unlink",
+                    vfs_unlink(FULL_FNAME_FRAG1) == 0 &&
+                        vfs_unlink(FULL_FNAME_FRAG2) == 0);
+  print_test_result("test_defrag__umount",
+                    vfs_umount(&_test_vfs_mount, false) == 0);
+}
+
+/* opening the file being copied drops its copy, the pass goes on */
+static void test_defrag_cancel(void) {
+  fatfs_defrag_report_t report;
+  fatfs_defrag_stats_t stats;
+  struct stat st;
+
+  print_test_result("test_defrag_cancel__mount",
+                    vfs_mount(&_test_vfs_mount) == 0);
+  print_test_result("test_defrag_cancel__write", _frag_write());
+
+  /* one file or one sector per call, stop within the first copy */
+  fatfs_defrag_stats(&_test_vfs_mount, &stats);
+  for (unsigned i = 0; i < 16 && stats.cur.fragmented == 0; i++) {
+    fatfs_defrag(&_test_vfs_mount, 0);
+    fatfs_defrag_stats(&_test_vfs_mount, &stats);
+  }
+  fatfs_defrag(&_test_vfs_mount, 0);
+  print_test_result("test_defrag_cancel__copying",
+                    stats.cur.fragmented == 1 &&
+                        vfs_stat(MNT_PATH "/" FATFS_DEFRAG_TMP_NAME, &st) ==
+                            0);
+
+  int fd = vfs_open(FULL_FNAME_FRAG1, O_RDONLY, 0);
+  print_test_result("test_defrag_cancel__open", fd >= 0 && vfs_close(fd) == 0);
+  print_test_result("test_defrag_cancel__pass", _defrag_pass(&report));
+  print_test_result("test_defrag_cancel__report", report.fragmented == 2 &&
+                                                      report.moved == 1 &&
+                                                      report.skipped == 1);
+  print_test_result("test_defrag_cancel__no_tmp",
+                    vfs_stat(MNT_PATH "/" FATFS_DEFRAG_TMP_NAME, &st) < 0);
+
+  print_test_result("test_defrag_cancel__unlink",
+                    vfs_unlink(FULL_FNAME_FRAG1) == 0 &&
+                        vfs_unlink(FULL_FNAME_FRAG2) == 0);
+  print_test_result("test_defrag_cancel__umount",
+                    vfs_umount(&_test_vfs_mount, false) == 0);
+}
+
+/* mount finishes a relocation whose swap stopped after the unlink */
+static void test_defrag_recover(void) {
+  static const char name[] = "/FRAG1.BIN";
+  struct stat st;
+  bool ok = true;
+
+  print_test_result("test_defrag_recover__mount",
+                    vfs_mount(&_test_vfs_mount) == 0);
+  print_test_result("test_defrag_recover__write", _frag_write());
+
+  /* what a failed f_rename() of the copy leaves behind */
+  int fd = vfs_open(MNT_PATH "/" FATFS_DEFRAG_LOG_NAME, O_WRONLY | O_CREAT, 0);
+  print_test_result("test_defrag_recover__log",
+                    fd >= 0 &&
+                        vfs_write(fd, name, strlen(name)) ==
+                            (ssize_t)strlen(name) &&
+                        vfs_close(fd) == 0);
+  print_test_result("test_defrag_recover__unlink",
+                    vfs_rename(FULL_FNAME_FRAG1,
+                               MNT_PATH "/" FATFS_DEFRAG_TMP_NAME) == 0);
+
+  print_test_result("test_defrag_recover__remount",
+                    vfs_umount(&_test_vfs_mount, false) == 0 &&
+                        vfs_mount(&_test_vfs_mount) == 0);
+  fd = vfs_open(FULL_FNAME_FRAG1, O_RDONLY, 0);
+  for (uint32_t i = 0; i < FRAG_CHUNKS; i++) {
+    ok &= _frag_check(fd, i * FRAG_CHUNK, 0x00);
+  }
+  print_test_result("test_defrag_recover__read", fd >= 0 && ok);
+  print_test_result("test_defrag_recover__close", vfs_close(fd) == 0);
+  print_test_result(
+      "test_defrag_recover__cleaned",
+      vfs_stat(MNT_PATH "/" FATFS_DEFRAG_TMP_NAME, &st) < 0 &&
+          vfs_stat(MNT_PATH "/" FATFS_DEFRAG_LOG_NAME, &st) < 0);
+
+  print_test_result("test_defrag_recover__unlink_all",
+                    vfs_unlink(FULL_FNAME_FRAG1) == 0 &&
+                        vfs_unlink(FULL_FNAME_FRAG2) == 0);
+  print_test_result("test_defrag_recover__umount",
+                    vfs_umount(&_test_vfs_mount, false) == 0);
+}
+
+/* freed clusters are trimmed, the ramdisk drops their sectors */
+static void test_trim(void) {
+  ramdisk_t *disk = ramdisk_open(_test_vfs_mount.dno);
+  ramdisk_stats_t written, trimmed;
+
+  print_test_result("test_trim__mount", vfs_mount(&_test_vfs_mount) == 0);
+  print_test_result("test_trim__write", _frag_write());
+  ramdisk_stats(disk, &written, false);
+  print_test_result("test_trim__unlink",
+                    vfs_unlink(FULL_FNAME_FRAG1) == 0 &&
+                        vfs_unlink(FULL_FNAME_FRAG2) == 0);
+  ramdisk_stats(disk, &trimmed, false);
+  print_test_result("test_trim__dropped",
+                    written.sectors_stored - trimmed.sectors_stored >=
+                        2 * FRAG_CHUNKS * FRAG_CHUNK / CONFIG_RAM_SEC_SIZE);
+  print_test_result("test_trim__umount",
+                    vfs_umount(&_test_vfs_mount, false) == 0);
+}
+
+/* every fd gets its own pooled state, closed ones hand it back */
+static void test_fd_table(void) {
+  int fds[VFS_MAX_OPEN_FILES];
+  bool ok = true;
+
+  print_test_result("test_fd_table__mount", vfs_mount(&_test_vfs_mount) == 0);
+  print_test_result("test_fd_table__write",
+                    _write_file(FULL_FNAME1, test_txt, sizeof(test_txt)) == 0);
+
+  for (unsigned i = 0; i < ARRAY_SIZE(fds); i++) {
+    fds[i] = vfs_open(FULL_FNAME1, O_RDONLY, 0);
+    ok &= fds[i] >= 0;
+  }
+  print_test_result("test_fd_table__open_all", ok);
+  print_test_result("test_fd_table__full",
+                    vfs_open(FULL_FNAME1, O_RDONLY, 0) == -ENFILE);
+
+  /* the state of one fd must not leak into the others */
+  char buf[sizeof(test_txt)];
+  ok = vfs_lseek(fds[0], 4, SEEK_SET) == 4;
+  ok &= vfs_read(fds[1], buf, sizeof(buf)) == sizeof(test_txt);
+  ok &= memcmp(buf, test_txt, sizeof(test_txt)) == 0;
+  print_test_result("test_fd_table__independent", ok);
+
+  ok = true;
+  for (unsigned i = 0; i < ARRAY_SIZE(fds); i++) {
+    ok &= vfs_close(fds[i]) == 0;
+  }
+  print_test_result("test_fd_table__close_all", ok);
+  print_test_result("test_fd_table__reuse",
+                    _file_is(FULL_FNAME1, test_txt, sizeof(test_txt)));
+  print_test_result("test_fd_table__umount",
+                    vfs_umount(&_test_vfs_mount, false) == 0);
+}
+
+#define TWO_TASKS_ROUNDS (20u)
+#define TWO_TASKS_STACK_SIZE (0x200)
+
+static OS_TCB _other_tcb;
+static CPU_STK _other_stack[TWO_TASKS_STACK_SIZE];
+static OS_SEM _other_done;
+static volatile bool _other_stop;
+static volatile bool _other_ok;
+static volatile uint32_t _other_rounds;
+
+/* rewrites its own file until told to stop, only runs while the test task
+ * sleeps and is preempted whenever it wakes up */
+static void _other_task(void *p_arg) {
+  OS_ERR err;
+  bool ok = true;
+  (void)p_arg;
+
+  while (!_other_stop && ok) {
+    ok = _write_file(FULL_FNAME2, test_txt2, sizeof(test_txt2)) == 0 &&
+         _file_is(FULL_FNAME2, test_txt2, sizeof(test_txt2));
+    _other_rounds++;
+  }
+  _other_ok = ok;
+  OSSemPost(&_other_done, OS_OPT_POST_1, &err);
+  OSTaskDel(NULL, &err);
+}
+
+/* two tasks open, write and list files of one volume at the same time */
+static void test_two_tasks(void) {
+  vfs_DIR dir;
+  vfs_dirent_t entry;
+  OS_ERR err;
+  bool ok = true;
+
+  print_test_result("test_two_tasks__mount", vfs_mount(&_test_vfs_mount) == 0);
+
+  _other_stop = false;
+  _other_ok = false;
+  _other_rounds = 0;
+  OSSemCreate(&_other_done, "test_fatfs", 0, &err);
+  OSTaskCreate(&_other_tcb, "test_fatfs", _other_task, NULL,
+               OSTCBCurPtr->Prio + 1u, &_other_stack[0],
+               TWO_TASKS_STACK_SIZE / 10u, TWO_TASKS_STACK_SIZE, 0, 0, NULL,
+               OS_OPT_TASK_STK_CHK + OS_OPT_TASK_STK_CLR, &err);
+  print_test_result("test_two_tasks__create", err == OS_ERR_NONE);
+
+  for (unsigned i = 0; i < TWO_TASKS_ROUNDS && ok; i++) {
+    ok = _write_file(FULL_FNAME1, test_txt, sizeof(test_txt)) == 0 &&
+         _file_is(FULL_FNAME1, test_txt, sizeof(test_txt)) &&
+         vfs_opendir(&dir, MNT_PATH) == 0;
+    while (ok && vfs_readdir(&dir, &entry) == 1) {
+      /* the file of the other task may come and go */
+    }
+    ok = ok && vfs_closedir(&dir) == 0;
+    /* the other task runs until this one wakes up again */
+    OSTimeDly(1, OS_OPT_TIME_DLY, &err);
+  }
+  print_test_result("test_two_tasks__this", ok);
+
+  _other_stop = true;
+  OSSemPend(&_other_done, 10 * OS_CFG_TICK_RATE_HZ, OS_OPT_PEND_BLOCKING,
+            NULL, &err);
+  print_test_result("test_two_tasks__other", err == OS_ERR_NONE &&
+                                                 _other_ok &&
+                                                 _other_rounds > 0);
+  OSSemDel(&_other_done, OS_OPT_DEL_ALWAYS, &err);
+
+  print_test_result("test_two_tasks__unlink",
+                    vfs_unlink(FULL_FNAME1) == 0 &&
+                        vfs_unlink(FULL_FNAME2) == 0);
+  print_test_result("test_two_tasks__umount",
+                    vfs_umount(&_test_vfs_mount, false) == 0);
+}
+
+/* same file name on two volumes mounted at the same time */
+static void test_multi_volume(void) {
+  struct stat stat_buf;
+
+  print_test_result("test_multi__format2", vfs_format(&_test_vfs_mount2) == 0);
+  print_test_result("test_multi__mount1", vfs_mount(&_test_vfs_mount) == 0);
+  print_test_result("test_multi__mount2", vfs_mount(&_test_vfs_mount2) == 0);
+  print_test_result("test_multi__vol", fatfs.vol_idx != fatfs2.vol_idx);
+
+  print_test_result("test_multi__write1",
+                    _write_file(FULL_FNAME1, test_txt, sizeof(test_txt)) == 0);
+  print_test_result(
+      "test_multi__write2",
+      _write_file(FULL_FNAME1_VOL2, test_txt2, sizeof(test_txt2)) == 0);
+  print_test_result("test_multi__read1",
+                    _file_is(FULL_FNAME1, test_txt, sizeof(test_txt)));
+  print_test_result("test_multi__read2",
+                    _file_is(FULL_FNAME1_VOL2, test_txt2, sizeof(test_txt2)));
+
+  int fd = vfs_open(FULL_FNAME1_VOL2, O_RDONLY, 0);
+  print_test_result("test_multi__fstat", vfs_fstat(fd, &stat_buf) == 0);
+  print_test_result("test_multi__size", stat_buf.st_size == sizeof(test_txt2));
+  vfs_close(fd);
+
+  print_test_result("test_multi__umount2",
+                    vfs_umount(&_test_vfs_mount2, false) == 0);
+  print_test_result("test_multi__read1_after",
+                    _file_is(FULL_FNAME1, test_txt, sizeof(test_txt)));
+  print_test_result("test_multi__umount1",
+                    vfs_umount(&_test_vfs_mount, false) == 0);
+}
+
 void test_vfs_fatfs(void) {
   print_test_banner("FatFS VFS TESTS");
+  fatfs_vfs_desc_init(&fatfs);
+  fatfs_vfs_desc_init(&fatfs2);
 
   test_format();
   test_mount();
@@ -269,4 +684,13 @@ void test_vfs_fatfs(void) {
   test_unlink();
 
   test_fstat();
+  test_fastseek();
+  test_defrag();
+  test_defrag_cancel();
+  test_defrag_recover();
+  test_trim();
+  test_fd_table();
+
+  test_two_tasks();
+  test_multi_volume();
 }
\ No newline at end of file
@@ -150,6 +150,7 @@ static void test_inter_rw(void) {
 
 void test_vfs_inter() {
   print_test_banner("Inter FS Operation Tests");
+  fatfs_vfs_desc_init(&fatfs_desc);
 
   test_inter_format();
   test_inter_make_content();
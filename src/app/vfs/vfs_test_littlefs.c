@@ -5,6 +5,7 @@
 #include "logging.h"
 
 #include "littlefs/littlefs_vfs.h"
+#include "maint.h"
 #include "vfs.h"
 
 #include "vfs_test.h"
@@ -253,6 +254,141 @@ static void test_fstat(void) {
                     vfs_umount(&_test_vfs_mount, false) == 0);
 }
 
+/* files written with one cache size are readable with another one */
+static void test_cache_size(void) {
+  char buf[sizeof(test_txt)];
+  int fd;
+
+  littlefs.config.cache_size = 96;
+  print_test_result("test_cache_size__mount_bad",
+                    vfs_mount(&_test_vfs_mount) == -EINVAL);
+
+  littlefs.config.cache_size = 256;
+  print_test_result("test_cache_size__mount_256",
+                    vfs_mount(&_test_vfs_mount) == 0);
+  fd = vfs_open(FULL_FNAME1, O_WRONLY | O_CREAT | O_TRUNC, 0);
+  print_test_result("test_cache_size__write",
+                    vfs_write(fd, test_txt, sizeof(test_txt)) ==
+                        sizeof(test_txt));
+  print_test_result("test_cache_size__close", vfs_close(fd) == 0);
+  print_test_result("test_cache_size__umount_256",
+                    vfs_umount(&_test_vfs_mount, false) == 0);
+
+  littlefs.config.cache_size = 0;
+  print_test_result("test_cache_size__mount_default",
+                    vfs_mount(&_test_vfs_mount) == 0);
+  fd = vfs_open(FULL_FNAME1, O_RDONLY, 0);
+  print_test_result("test_cache_size__read",
+                    vfs_read(fd, buf, sizeof(buf)) == sizeof(test_txt) &&
+                        memcmp(buf, test_txt, sizeof(test_txt)) == 0);
+  print_test_result("test_cache_size__close_ro", vfs_close(fd) == 0);
+  print_test_result("test_cache_size__umount_default",
+                    vfs_umount(&_test_vfs_mount, false) == 0);
+}
+
+static void test_geometry(void) {
+  char buf[sizeof(test_txt)];
+  int fd;
+
+  littlefs.config.block_size = 700;
+  littlefs.config.block_count = 0;
+  print_test_result("test_geometry__format_bad",
+                    vfs_format(&_test_vfs_mount) == -EINVAL);
+
+  /* two sector blocks with the metadata logs capped at half a block */
+  littlefs.config.block_size = 2 * CONFIG_RAM_SEC_SIZE;
+  littlefs.config.block_count = 0;
+  littlefs.config.metadata_max = CONFIG_RAM_SEC_SIZE;
+  littlefs.config.inline_max = 0;
+  print_test_result("test_geometry__format", vfs_format(&_test_vfs_mount) == 0);
+  print_test_result("test_geometry__spb", littlefs.sectors_per_block == 2);
+  print_test_result("test_geometry__mount", vfs_mount(&_test_vfs_mount) == 0);
+  fd = vfs_open(FULL_FNAME1, O_RDWR | O_CREAT, 0);
+  print_test_result("test_geometry__write",
+                    vfs_write(fd, test_txt, sizeof(test_txt)) ==
+                        sizeof(test_txt));
+  vfs_lseek(fd, 0, SEEK_SET);
+  print_test_result("test_geometry__read",
+                    vfs_read(fd, buf, sizeof(buf)) == sizeof(test_txt) &&
+                        memcmp(buf, test_txt, sizeof(test_txt)) == 0);
+  print_test_result("test_geometry__close", vfs_close(fd) == 0);
+  print_test_result("test_geometry__umount",
+                    vfs_umount(&_test_vfs_mount, false) == 0);
+
+  littlefs.config.block_size = 0;
+  littlefs.config.block_count = 0;
+  littlefs.config.metadata_max = 0;
+  littlefs.config.inline_max = 0;
+}
+
+/* bit at a time reference for the table driven kernels */
+static uint32_t _crc_ref(uint32_t crc, const uint8_t *data, size_t size) {
+  while (size--) {
+    crc ^= *data++;
+    for (int i = 0; i < 8; i++) {
+      crc = (crc >> 1) ^ ((crc & 1) ? 0xedb88320u : 0);
+    }
+  }
+  return crc;
+}
+
+static void test_crc(void) {
+  static uint8_t buf[160];
+  bool ok = true;
+
+  print_test_result("test_crc__check",
+                    (lfs_crc(0xffffffff, "123456789", 9) ^ 0xffffffff) ==
+                        0xcbf43926);
+
+  for (unsigned i = 0; i < sizeof(buf); i++) {
+    buf[i] = (uint8_t)(i * 131u + 7u);
+  }
+  /* every alignment, the word loops and the 64 byte folding path */
+  for (unsigned off = 0; off < 8 && ok; off++) {
+    for (unsigned len = 0; len + off <= sizeof(buf) && ok; len++) {
+      ok = lfs_crc(0x12345678, buf + off, len) ==
+           _crc_ref(0x12345678, buf + off, len);
+    }
+  }
+  print_test_result("test_crc__unaligned", ok);
+}
+
+/* sleep until the maintenance task passed over the mount n more times */
+static void _maint_wait(const vfs_maint_t *maint, uint32_t n) {
+  uint32_t runs = maint->runs;
+  OS_ERR err;
+
+  for (unsigned i = 0; i < 100 && maint->runs - runs < n; i++) {
+    vfs_maint_kick();
+    OSTimeDly(1, OS_OPT_TIME_DLY, &err);
+  }
+}
+
+static void test_maint(void) {
+  static vfs_maint_t maint = {
+      .mountp = &_test_vfs_mount,
+      .period = 1,
+  };
+
+  print_test_result("test_maint__mount", vfs_mount(&_test_vfs_mount) == 0);
+  print_test_result("test_maint__register", vfs_maint_register(&maint) == 0);
+  _maint_wait(&maint, 2);
+  print_test_result("test_maint__runs", maint.runs >= 2 &&
+                                            maint.busy_runs == maint.runs &&
+                                            maint.errors == 0 &&
+                                            maint.last_err == 0);
+
+  /* still registered, the passes fail until the mount comes back */
+  print_test_result("test_maint__umount",
+                    vfs_umount(&_test_vfs_mount, false) == 0);
+  _maint_wait(&maint, 1);
+  print_test_result("test_maint__not_mounted",
+                    maint.errors > 0 && maint.last_err == -EINVAL);
+  print_test_result("test_maint__unregister",
+                    vfs_maint_unregister(&maint) == 0 &&
+                        vfs_maint_unregister(&maint) == -ENOENT);
+}
+
 void test_vfs_littlefs(void) {
   print_test_banner("LittleFS VFS TESTS");
 
@@ -271,4 +407,8 @@ void test_vfs_littlefs(void) {
   test_unlink();
 
   test_fstat();
+  test_cache_size();
+  test_geometry();
+  test_crc();
+  test_maint();
 }
\ No newline at end of file
@@ -0,0 +1,142 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+
+#include "logging.h"
+
+#include "logfile.h"
+#include "spiffs/spiffs_vfs.h"
+#include "vfs.h"
+
+#include "vfs_test.h"
+#include "vfs_test_logfile.h"
+
+#define MNT_PATH "/logs"
+#define LOG_NAME "LOG.TXT"
+#define FNAME (MNT_PATH "/" LOG_NAME)
+#define FNAME_ROTATED (MNT_PATH "/" LOG_NAME ".1")
+#define RING_SIZE (128)
+
+LOG_MODULE_REGISTER(test_logfile, LOG_LEVEL_DBG);
+
+static spiffs_desc_t spiffs_desc;
+
+static vfs_mount_t _test_vfs_mount = {
+    .mount_point = MNT_PATH,
+    .fs = &spiffs_file_system,
+    .private_data = (void *)&spiffs_desc,
+    .dno = 1,
+};
+
+static uint32_t _ring_buf[RING_SIZE / sizeof(uint32_t)];
+static char _buf[1024];
+
+static void test_ring(void) {
+  log_ring_t ring;
+  char out[RING_SIZE];
+  int n = 0;
+
+  print_test_result("test_ring__init",
+                    log_ring_init(&ring, _ring_buf, sizeof(_ring_buf)) == 0);
+
+  /* 10 bytes plus header round up to 16 */
+  while (log_ring_put(&ring, "0123456789", 10) == 0) {
+    n++;
+  }
+  print_test_result("test_ring__full",
+                    n == RING_SIZE / 16 && ring.dropped == 1);
+  print_test_result("test_ring__get_partial",
+                    log_ring_get(&ring, out, 25) == 20);
+  print_test_result("test_ring__get_rest",
+                    log_ring_get(&ring, out, sizeof(out)) == 10 * (n - 2) &&
+                        log_ring_used(&ring) == 0);
+
+  /* 28 + 8 bytes per round, so records keep landing on the ring end */
+  int ok = 1;
+  for (int i = 0; i < 16; i++) {
+    ok &= log_ring_put(&ring, "abcdefghijklmnopqrstu", 21) == 0;
+    ok &= log_ring_put(&ring, "xyz", 3) == 0;
+    ok &= log_ring_get(&ring, out, sizeof(out)) == 24;
+    ok &= memcmp(out, "abcdefghijklmnopqrstuxyz", 24) == 0;
+  }
+  print_test_result("test_ring__wrap", ok);
+}
+
+static ssize_t _read_log(const char *name) {
+  int fd = vfs_open(name, O_RDONLY, 0);
+  if (fd < 0) {
+    return fd;
+  }
+  ssize_t nr = vfs_read(fd, _buf, sizeof(_buf) - 1);
+  vfs_close(fd);
+  _buf[(nr > 0) ? nr : 0] = '\0';
+  return nr;
+}
+
+static void test_sink(void) {
+  vfs_logfile_stats_t stats;
+
+  print_test_result("test_sink__start", vfs_logfile_start(FNAME, 0) == 0);
+  print_test_result("test_sink__busy", vfs_logfile_start(FNAME, 0) == -EBUSY);
+
+  for (int i = 0; i < 20; i++) {
+    LOG_INF("record %d", i);
+  }
+  /* deferred messages must not depend on the caller's buffer */
+  char name[] = "before";
+  LOG_INF("name %s", name);
+  strcpy(name, "after");
+
+  print_test_result("test_sink__flush", vfs_logfile_flush() == 0);
+  print_test_result("test_sink__read", _read_log(FNAME) > 0);
+  print_test_result("test_sink__first",
+                    strstr(_buf, "<inf test_logfile> record 0\n") != NULL);
+  print_test_result("test_sink__last",
+                    strstr(_buf, "<inf test_logfile> record 19\n") != NULL);
+  print_test_result("test_sink__copied", strstr(_buf, "name before\n") != NULL);
+
+  vfs_logfile_stats(&stats);
+  print_test_result("test_sink__stats", stats.records >= 20 &&
+                                            stats.dropped == 0 &&
+                                            stats.errors == 0);
+  print_test_result("test_sink__stop", vfs_logfile_stop() == 0);
+}
+
+static void test_rotate(void) {
+  vfs_logfile_stats_t before, after;
+  struct stat st;
+
+  vfs_logfile_stats(&before);
+  print_test_result("test_rotate__start", vfs_logfile_start(FNAME, 512) == 0);
+  for (int i = 0; i < 40; i++) {
+    LOG_INF("rotate %d", i);
+  }
+  print_test_result("test_rotate__stop", vfs_logfile_stop() == 0);
+
+  vfs_logfile_stats(&after);
+  print_test_result("test_rotate__rotated",
+                    after.rotations > before.rotations);
+  print_test_result("test_rotate__kept", vfs_stat(FNAME_ROTATED, &st) == 0);
+  print_test_result("test_rotate__size",
+                    vfs_stat(FNAME, &st) == 0 && st.st_size <= 512);
+  print_test_result("test_rotate__last",
+                    _read_log(FNAME) > 0 &&
+                        strstr(_buf, "rotate 39\n") != NULL);
+}
+
+void test_vfs_logfile() {
+  print_test_banner("VFS Log File Tests");
+  spiffs_vfs_desc_init(&spiffs_desc);
+
+  test_ring();
+
+  print_test_result("test_logfile__format",
+                    vfs_format(&_test_vfs_mount) == 0);
+  print_test_result("test_logfile__mount", vfs_mount(&_test_vfs_mount) == 0);
+
+  test_sink();
+  test_rotate();
+
+  print_test_result("test_logfile__umount",
+                    vfs_umount(&_test_vfs_mount, false) == 0);
+}
@@ -0,0 +1,6 @@
+#ifndef UC_VFS_VFS_TEST_LOGFILE_H
+#define UC_VFS_VFS_TEST_LOGFILE_H
+
+void test_vfs_logfile(void);
+
+#endif
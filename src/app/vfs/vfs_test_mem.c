@@ -0,0 +1,131 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "common.h"
+#include "logging.h"
+
+#include "mem.h"
+#include "memops.h"
+
+#include "vfs_test.h"
+#include "vfs_test_mem.h"
+
+#define N_MAX (4)
+#define MAX_CLASS ((size_t)CONFIG_MEM_MIN_CLASS << (CONFIG_MEM_CLASSES - 1))
+
+LOG_MODULE_REGISTER(test_mem, LOG_LEVEL_DBG);
+
+static mem_pool_t _pool;
+
+/* room for every size and misalignment of test_memops() plus guards */
+static uint8_t _src[320];
+static uint8_t _dst[320];
+
+static void test_pool(void) {
+  mem_pool_stats_t st;
+  void *blk[N_MAX];
+
+  print_test_result("test_pool__create",
+                    mem_pool_create(&_pool, "test", 24, 8, 2, N_MAX) == 0);
+
+  int ok = 1;
+  for (int i = 0; i < N_MAX; i++) {
+    blk[i] = mem_pool_alloc(&_pool);
+    ok &= blk[i] != NULL && ((uintptr_t)blk[i] & 7u) == 0;
+  }
+  print_test_result("test_pool__alloc", ok);
+  /* bounded, no more blocks from the heap */
+  print_test_result("test_pool__limit", mem_pool_alloc(&_pool) == NULL);
+
+  mem_pool_stats(&_pool, &st);
+  print_test_result("test_pool__stats_used",
+                    st.total == N_MAX && st.used == N_MAX &&
+                        st.max_used == N_MAX && st.allocs == N_MAX &&
+                        st.fails == 1);
+
+  for (int i = 0; i < N_MAX; i++) {
+    mem_pool_free(&_pool, blk[i]);
+  }
+  mem_pool_stats(&_pool, &st);
+  print_test_result("test_pool__stats_free",
+                    st.used == 0 && st.max_used == N_MAX &&
+                        st.frees == N_MAX);
+
+  /* the last block given back is the first handed out again */
+  void *again = mem_pool_alloc(&_pool);
+  print_test_result("test_pool__lifo", again == blk[N_MAX - 1]);
+  mem_pool_free(&_pool, again);
+}
+
+static void test_classes(void) {
+  static const size_t sizes[] = {
+      1, CONFIG_MEM_MIN_CLASS, CONFIG_MEM_MIN_CLASS + 1, 100, MAX_CLASS};
+  void *blk[ARRAY_SIZE(sizes)];
+
+  int ok = 1;
+  for (unsigned i = 0; i < ARRAY_SIZE(sizes); i++) {
+    blk[i] = mem_alloc(sizes[i]);
+    ok &= blk[i] != NULL && ((uintptr_t)blk[i] % sizeof(void *)) == 0;
+    if (blk[i]) {
+      memset(blk[i], i, sizes[i]);
+    }
+  }
+  print_test_result("test_classes__alloc", ok);
+
+  /* every block still holds its own pattern */
+  for (unsigned i = 0; i < ARRAY_SIZE(sizes); i++) {
+    const uint8_t *p = blk[i];
+    for (size_t j = 0; p && j < sizes[i]; j++) {
+      ok &= p[j] == (uint8_t)i;
+    }
+    mem_free(blk[i]);
+  }
+  print_test_result("test_classes__distinct", ok);
+
+  print_test_result("test_classes__too_big",
+                    mem_alloc(MAX_CLASS + 1) == NULL);
+
+  mem_free(NULL);
+}
+
+/* all small sizes and the burst sizes around them, at every alignment */
+static void test_memops(void) {
+  static const size_t sizes[] = {0, 1, 3, 4, 15, 16, 17, 31, 32, 33, 63, 64,
+                                 65, 100, 255, 256, 257, 300};
+  int cpy_ok = 1;
+  int set_ok = 1;
+
+  for (size_t i = 0; i < sizeof(_src); i++) {
+    _src[i] = (uint8_t)(i * 7u + 1u);
+  }
+  for (unsigned k = 0; k < ARRAY_SIZE(sizes); k++) {
+    size_t n = sizes[k];
+    for (unsigned d = 0; d < 4; d++) {
+      for (unsigned s = 0; s < 4; s++) {
+        memset(_dst, 0xEE, sizeof(_dst));
+        cpy_ok &= vfs_memcpy(&_dst[4 + d], &_src[s], n) == &_dst[4 + d];
+        cpy_ok &= memcmp(&_dst[4 + d], &_src[s], n) == 0;
+        /* nothing written around the block */
+        cpy_ok &= _dst[3 + d] == 0xEE && _dst[4 + d + n] == 0xEE;
+      }
+      memset(_dst, 0xEE, sizeof(_dst));
+      vfs_memset(&_dst[4 + d], 0x5A, n);
+      for (size_t j = 0; j < n; j++) {
+        set_ok &= _dst[4 + d + j] == 0x5A;
+      }
+      set_ok &= _dst[3 + d] == 0xEE && _dst[4 + d + n] == 0xEE;
+    }
+  }
+  print_test_result("test_memops__memcpy", cpy_ok);
+  print_test_result("test_memops__memset", set_ok);
+}
+
+void test_vfs_mem(void) {
+  print_test_banner("VFS Allocator Tests");
+
+  test_pool();
+  test_classes();
+  test_memops();
+
+  mem_stats_print();
+}
@@ -0,0 +1,6 @@
+#ifndef UC_VFS_VFS_TEST_MEM_H
+#define UC_VFS_VFS_TEST_MEM_H
+
+void test_vfs_mem(void);
+
+#endif
@@ -0,0 +1,96 @@
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "logging.h"
+
+#include "ramdisk.h"
+
+#include "vfs_test.h"
+#include "vfs_test_ramdisk.h"
+
+#define SEC CONFIG_RAM_SEC_SIZE
+#define DISK_SIZE (SEC * CONFIG_RAM_N_SECS)
+/* straddles three sectors */
+#define ADDR (4 * SEC + SEC / 2)
+#define LEN (2 * SEC)
+
+LOG_MODULE_REGISTER(test_ramdisk, LOG_LEVEL_DBG);
+
+static uint8_t _buf[LEN];
+static uint8_t _out[LEN];
+
+static bool _reads(ramdisk_t *disk, size_t addr, const uint8_t *data,
+                   size_t len) {
+  return ramdisk_read_addr(disk, _out, addr, len) == (int)len &&
+         memcmp(_out, data, len) == 0;
+}
+
+static bool _reads_fill(ramdisk_t *disk, size_t addr, size_t len,
+                        uint8_t fill) {
+  if (ramdisk_read_addr(disk, _out, addr, len) != (int)len) {
+    return false;
+  }
+  for (size_t i = 0; i < len; i++) {
+    if (_out[i] != fill) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* disk 1 reads as 0xFF where nothing was written, erase drops sectors */
+static void test_snapshot(void) {
+  ramdisk_t *disk = ramdisk_open(1);
+  static uint8_t orig[LEN];
+  ramdisk_stats_t st;
+
+  print_test_result("test_snapshot__none", ramdisk_restore(disk) == -EINVAL);
+
+  for (size_t i = 0; i < LEN; i++) {
+    orig[i] = (uint8_t)(i * 3u + 1u);
+    _buf[i] = (uint8_t)~orig[i];
+  }
+  ramdisk_write_addr(disk, orig, ADDR, LEN);
+  print_test_result("test_snapshot__take", ramdisk_snapshot(disk) == 0);
+
+  /* overwrite, grow into a fresh sector, erase and trim */
+  bool ok = ramdisk_write_addr(disk, _buf, ADDR + SEC, LEN) == LEN;
+  ok &= ramdisk_erase_addr(disk, ADDR, SEC) == SEC;
+  ok &= ramdisk_trim(disk, 4 * SEC, SEC) == 0;
+  print_test_result("test_snapshot__change", ok);
+  ramdisk_stats(disk, &st, false);
+  /* sector 4 to 7, every one copied once */
+  print_test_result("test_snapshot__dirty", st.sectors_dirty == 4);
+
+  print_test_result("test_snapshot__restore", ramdisk_restore(disk) == 0);
+  print_test_result("test_snapshot__content",
+                    _reads(disk, ADDR, orig, LEN) &&
+                        _reads_fill(disk, ADDR + LEN, SEC / 2, 0xFF));
+  ramdisk_stats(disk, &st, false);
+  print_test_result("test_snapshot__clean", st.sectors_dirty == 0);
+
+  /* the snapshot stays for the next run */
+  ramdisk_write_addr(disk, _buf, ADDR, LEN);
+  print_test_result("test_snapshot__again",
+                    ramdisk_restore(disk) == 0 &&
+                        _reads(disk, ADDR, orig, LEN));
+
+  /* dropping keeps what is on the disk */
+  ramdisk_write_addr(disk, _buf, ADDR, LEN);
+  ramdisk_snapshot_drop(disk);
+  print_test_result("test_snapshot__drop",
+                    ramdisk_restore(disk) == -EINVAL &&
+                        _reads(disk, ADDR, _buf, LEN));
+
+  ramdisk_trim(disk, 0, DISK_SIZE);
+  ramdisk_stats(disk, &st, false);
+  print_test_result("test_snapshot__trim",
+                    st.sectors_stored == 0 && st.sectors_dirty == 0);
+}
+
+void test_vfs_ramdisk(void) {
+  print_test_banner("Ramdisk Tests");
+
+  test_snapshot();
+}
@@ -0,0 +1,6 @@
+#ifndef UC_VFS_VFS_TEST_RAMDISK_H
+#define UC_VFS_VFS_TEST_RAMDISK_H
+
+void test_vfs_ramdisk(void);
+
+#endif
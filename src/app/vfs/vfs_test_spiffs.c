@@ -4,7 +4,9 @@
 
 #include "logging.h"
 
+#include "maint.h"
 #include "spiffs/spiffs_vfs.h"
+#include "spiffs/spiffs_nucleus.h"
 #include "vfs.h"
 
 #include "vfs_test.h"
@@ -243,6 +245,310 @@ static void test_fstat(void) {
                     vfs_umount(&_test_vfs_mount, false) == 0);
 }
 
+static void test_gc(void) {
+  vfs_gc_t gc = {.threshold = 8192, .budget = 4096};
+  int fd;
+
+  print_test_result("test_gc__mount", vfs_mount(&_test_vfs_mount) == 0);
+
+  fd = vfs_open(FULL_FNAME2, O_WRONLY | O_CREAT | O_TRUNC, 0);
+  print_test_result("test_gc__open", fd >= 0);
+  print_test_result("test_gc__write",
+                    vfs_write(fd, test_txt, sizeof(test_txt)) ==
+                        sizeof(test_txt));
+  print_test_result("test_gc__close", vfs_close(fd) == 0);
+  print_test_result("test_gc__unlink", vfs_unlink(FULL_FNAME2) == 0);
+
+  print_test_result("test_gc__gc", vfs_gc(&_test_vfs_mount, &gc) >= 0);
+
+  print_test_result("test_gc__umount",
+                    vfs_umount(&_test_vfs_mount, false) == 0);
+  print_test_result("test_gc__not_mounted",
+                    vfs_gc(&_test_vfs_mount, &gc) == -EINVAL);
+}
+
+static void test_random(void) {
+  char buf[5];
+  int fd;
+
+  print_test_result("test_random__mount", vfs_mount(&_test_vfs_mount) == 0);
+  fd = vfs_open(FULL_FNAME2, O_WRONLY | O_CREAT | O_TRUNC, 0);
+  print_test_result("test_random__write",
+                    fd >= 0 && vfs_write(fd, test_txt3, sizeof(test_txt3)) ==
+                                   sizeof(test_txt3));
+  print_test_result("test_random__close", vfs_close(fd) == 0);
+
+  fd = vfs_open(FULL_FNAME2, O_RDONLY | VFS_O_RANDOM, 0);
+  print_test_result("test_random__open", fd >= 0);
+  print_test_result("test_random__lseek", vfs_lseek(fd, 6, SEEK_SET) == 6);
+  print_test_result("test_random__read",
+                    vfs_read(fd, buf, sizeof(buf)) == sizeof(buf) &&
+                        memcmp(buf, "world", sizeof(buf)) == 0);
+  print_test_result("test_random__lseek_back",
+                    vfs_lseek(fd, 0, SEEK_SET) == 0);
+  print_test_result("test_random__read_back",
+                    vfs_read(fd, buf, sizeof(buf)) == sizeof(buf) &&
+                        memcmp(buf, "hello", sizeof(buf)) == 0);
+  print_test_result("test_random__close2", vfs_close(fd) == 0);
+
+  print_test_result("test_random__unlink", vfs_unlink(FULL_FNAME2) == 0);
+  print_test_result("test_random__umount",
+                    vfs_umount(&_test_vfs_mount, false) == 0);
+}
+
+static void test_subdir(void) {
+  vfs_DIR dir;
+  vfs_dirent_t entry;
+  struct stat st;
+  int fd;
+
+  print_test_result("test_subdir__mount", vfs_mount(&_test_vfs_mount) == 0);
+
+  /* created out of order, listed in name order */
+  fd = vfs_open(MNT_PATH "/" DIR_NAME "/B.TXT", O_CREAT | O_WRONLY, 0);
+  print_test_result("test_subdir__create_b", fd >= 0 && vfs_close(fd) == 0);
+  fd = vfs_open(MNT_PATH "/" DIR_NAME "/A.TXT", O_CREAT | O_WRONLY, 0);
+  print_test_result("test_subdir__create_a", fd >= 0 && vfs_close(fd) == 0);
+
+  print_test_result("test_subdir__opendir",
+                    vfs_opendir(&dir, MNT_PATH "/" DIR_NAME) == 0);
+#if CONFIG_SPIFFS_VFS_INDEX_SIZE
+  print_test_result("test_subdir__readdir1",
+                    vfs_readdir(&dir, &entry) == 1 &&
+                        strcmp(entry.d_name, "A.TXT") == 0);
+  print_test_result("test_subdir__readdir2",
+                    vfs_readdir(&dir, &entry) == 1 &&
+                        strcmp(entry.d_name, "B.TXT") == 0);
+#else
+  /* without the index the scan lists in page order */
+  print_test_result("test_subdir__readdir1", vfs_readdir(&dir, &entry) == 1);
+  print_test_result("test_subdir__readdir2", vfs_readdir(&dir, &entry) == 1);
+#endif
+  print_test_result("test_subdir__readdir3", vfs_readdir(&dir, &entry) == 0);
+  print_test_result("test_subdir__closedir", vfs_closedir(&dir) == 0);
+
+  print_test_result("test_subdir__rename",
+                    vfs_rename(MNT_PATH "/" DIR_NAME "/A.TXT",
+                               MNT_PATH "/" DIR_NAME "/C.TXT") == 0);
+  print_test_result("test_subdir__stat_old",
+                    vfs_stat(MNT_PATH "/" DIR_NAME "/A.TXT", &st) == -ENOENT);
+  print_test_result("test_subdir__stat_new",
+                    vfs_stat(MNT_PATH "/" DIR_NAME "/C.TXT", &st) == 0);
+
+  print_test_result("test_subdir__unlink_b",
+                    vfs_unlink(MNT_PATH "/" DIR_NAME "/B.TXT") == 0);
+  print_test_result("test_subdir__unlink_c",
+                    vfs_unlink(MNT_PATH "/" DIR_NAME "/C.TXT") == 0);
+  print_test_result("test_subdir__open_gone",
+                    vfs_open(MNT_PATH "/" DIR_NAME "/B.TXT", O_RDONLY, 0) ==
+                        -ENOENT);
+
+  print_test_result("test_subdir__opendir2",
+                    vfs_opendir(&dir, MNT_PATH "/" DIR_NAME) == 0);
+  print_test_result("test_subdir__empty", vfs_readdir(&dir, &entry) == 0);
+  print_test_result("test_subdir__closedir2", vfs_closedir(&dir) == 0);
+
+  print_test_result("test_subdir__umount",
+                    vfs_umount(&_test_vfs_mount, false) == 0);
+}
+
+#if CONFIG_SPIFFS_VFS_SNAPSHOT
+static void _snapshot_counters(u32_t counters[4]) {
+  counters[0] = spiffs_desc.fs.free_blocks;
+  counters[1] = spiffs_desc.fs.stats_p_allocated;
+  counters[2] = spiffs_desc.fs.stats_p_deleted;
+  counters[3] = spiffs_desc.fs.max_erase_count;
+}
+
+static void test_snapshot(void) {
+  static uint8_t old[256];
+  u32_t from_snapshot[4], from_scan[4];
+  char buf[sizeof(test_txt3)];
+  int fd;
+
+  print_test_result("test_snapshot__mount", vfs_mount(&_test_vfs_mount) == 0);
+  fd = vfs_open(FULL_FNAME2, O_WRONLY | O_CREAT | O_TRUNC, 0);
+  print_test_result("test_snapshot__open", fd >= 0);
+  print_test_result("test_snapshot__write",
+                    vfs_write(fd, test_txt3, sizeof(test_txt3)) ==
+                        sizeof(test_txt3));
+  print_test_result("test_snapshot__close", vfs_close(fd) == 0);
+  print_test_result("test_snapshot__umount",
+                    vfs_umount(&_test_vfs_mount, false) == 0);
+
+  /* mount from the summary written by the umount above */
+  print_test_result("test_snapshot__mount2", vfs_mount(&_test_vfs_mount) == 0);
+  _snapshot_counters(from_snapshot);
+  fd = vfs_open(FULL_FNAME2, O_RDONLY, 0);
+  print_test_result("test_snapshot__open2", fd >= 0);
+  print_test_result("test_snapshot__read",
+                    vfs_read(fd, buf, sizeof(buf)) == sizeof(test_txt3));
+  print_test_result("test_snapshot__content",
+                    memcmp(buf, test_txt3, sizeof(test_txt3)) == 0);
+  print_test_result("test_snapshot__close2", vfs_close(fd) == 0);
+  print_test_result("test_snapshot__umount2",
+                    vfs_umount(&_test_vfs_mount, false) == 0);
+
+  /* drop the summary, the next mount has to scan and must agree */
+  ramdisk_erase_addr(spiffs_desc.disk,
+                     spiffs_desc.config.phys_addr +
+                         spiffs_desc.config.phys_size,
+                     spiffs_desc.config.phys_erase_block);
+  print_test_result("test_snapshot__mount3", vfs_mount(&_test_vfs_mount) == 0);
+  _snapshot_counters(from_scan);
+  print_test_result("test_snapshot__counters",
+                    memcmp(from_snapshot, from_scan, sizeof(from_scan)) == 0);
+  print_test_result("test_snapshot__umount3",
+                    vfs_umount(&_test_vfs_mount, false) == 0);
+
+  /* keep the summary of umount3 around, it still lists FNAME2 */
+  size_t addr = spiffs_desc.config.phys_addr + spiffs_desc.config.phys_size;
+  ramdisk_read_addr(spiffs_desc.disk, old, addr, sizeof(old));
+
+  print_test_result("test_snapshot__mount4", vfs_mount(&_test_vfs_mount) == 0);
+  print_test_result("test_snapshot__unlink", vfs_unlink(FULL_FNAME2) == 0);
+  print_test_result("test_snapshot__umount4",
+                    vfs_umount(&_test_vfs_mount, false) == 0);
+  print_test_result("test_snapshot__mount5", vfs_mount(&_test_vfs_mount) == 0);
+  _snapshot_counters(from_snapshot);
+  print_test_result("test_snapshot__umount5",
+                    vfs_umount(&_test_vfs_mount, false) == 0);
+
+  /* put the old summary back behind the back of the file system, its
+   * generation gives it away */
+  ramdisk_erase_addr(spiffs_desc.disk, addr,
+                     spiffs_desc.config.phys_erase_block);
+  ramdisk_write_addr(spiffs_desc.disk, old, addr, sizeof(old));
+  print_test_result("test_snapshot__mount6", vfs_mount(&_test_vfs_mount) == 0);
+  _snapshot_counters(from_scan);
+  print_test_result("test_snapshot__stale",
+                    memcmp(from_snapshot, from_scan, sizeof(from_scan)) == 0);
+  print_test_result("test_snapshot__umount6",
+                    vfs_umount(&_test_vfs_mount, false) == 0);
+}
+#endif
+
+#if SPIFFS_CHECK_INCREMENTAL
+static int _check_run(unsigned max_blocks, bool busy) {
+  int steps = 0;
+  int res;
+
+  while ((res = spiffs_vfs_check(&_test_vfs_mount, max_blocks)) == 1) {
+    /* the file system stays usable between two steps */
+    if (busy && ++steps % 4 == 0) {
+      int fd = vfs_open(FULL_FNAME1, O_WRONLY | O_APPEND, 0);
+      vfs_write(fd, test_txt2, sizeof(test_txt2));
+      vfs_close(fd);
+    }
+  }
+  return res;
+}
+
+static void test_check(void) {
+  spiffs_vfs_check_status_t status;
+  spiffs_stat st;
+  spiffs_page_header ph;
+  int fd;
+
+  print_test_result("test_check__mount", vfs_mount(&_test_vfs_mount) == 0);
+  fd = vfs_open(FULL_FNAME1, O_WRONLY | O_CREAT | O_TRUNC, 0);
+  vfs_write(fd, test_txt, sizeof(test_txt));
+  vfs_close(fd);
+  fd = vfs_open(FULL_FNAME2, O_WRONLY | O_CREAT | O_TRUNC, 0);
+  print_test_result("test_check__write",
+                    vfs_write(fd, test_txt3, sizeof(test_txt3)) ==
+                        sizeof(test_txt3));
+  vfs_close(fd);
+
+  /* consistent file system, written to between the steps */
+  print_test_result("test_check__start",
+                    spiffs_vfs_check_start(&_test_vfs_mount) == 0);
+  print_test_result("test_check__run", _check_run(2, true) == 0);
+  spiffs_vfs_check_status(&_test_vfs_mount, &status);
+  print_test_result("test_check__status",
+                    !status.running && status.steps > 1 &&
+                        status.progress == 256 && !status.repaired &&
+                        status.err == 0);
+  print_test_result("test_check__idle",
+                    spiffs_vfs_check(&_test_vfs_mount, 2) == 0);
+
+  /* mark the object index header of FNAME2 deleted behind the back of the
+   * file system, its data pages become orphans. Unmounted, so that no cached
+   * copy of the page survives. */
+  print_test_result("test_check__stat",
+                    SPIFFS_stat(&spiffs_desc.fs, "/" FNAME2, &st) == SPIFFS_OK);
+  print_test_result("test_check__umount",
+                    vfs_umount(&_test_vfs_mount, false) == 0);
+  size_t addr = spiffs_desc.config.phys_addr +
+                st.pix * spiffs_desc.config.log_page_size;
+  ramdisk_read_addr(spiffs_desc.disk, &ph, addr, sizeof(ph));
+  ph.flags &= ~SPIFFS_PH_FLAG_DELET;
+  ramdisk_write_addr(spiffs_desc.disk, &ph, addr, sizeof(ph));
+#if CONFIG_SPIFFS_VFS_SNAPSHOT
+  /* the clean umount left a snapshot, the mount has to scan the pages */
+  ramdisk_erase_addr(spiffs_desc.disk,
+                     spiffs_desc.config.phys_addr +
+                         spiffs_desc.config.phys_size,
+                     spiffs_desc.config.phys_erase_block);
+#endif
+  print_test_result("test_check__mount2", vfs_mount(&_test_vfs_mount) == 0);
+
+  print_test_result("test_check__start2",
+                    spiffs_vfs_check_start(&_test_vfs_mount) == 0);
+  print_test_result("test_check__run2", _check_run(4, false) == 0);
+  spiffs_vfs_check_status(&_test_vfs_mount, &status);
+  print_test_result("test_check__repaired", status.repaired);
+  print_test_result("test_check__removed",
+                    vfs_open(FULL_FNAME2, O_RDONLY, 0) == -ENOENT);
+  fd = vfs_open(FULL_FNAME1, O_RDONLY, 0);
+  print_test_result("test_check__intact", fd >= 0);
+  vfs_close(fd);
+
+  print_test_result("test_check__unlink", vfs_unlink(FULL_FNAME1) == 0);
+  print_test_result("test_check__umount2",
+                    vfs_umount(&_test_vfs_mount, false) == 0);
+}
+#endif
+
+#if SPIFFS_CHECK_INCREMENTAL && CONFIG_SPIFFS_VFS_CHECK_GC_BLOCKS
+/* the maintenance task steps a check through vfs_gc() while this task sleeps */
+static void test_maint(void) {
+  static vfs_maint_t maint = {
+      .mountp = &_test_vfs_mount,
+      .gc = {.threshold = 8192, .budget = 4096},
+      .period = 1,
+  };
+  spiffs_vfs_check_status_t status;
+  OS_ERR err;
+
+  print_test_result("test_maint__mount", vfs_mount(&_test_vfs_mount) == 0);
+  print_test_result("test_maint__start",
+                    spiffs_vfs_check_start(&_test_vfs_mount) == 0);
+  print_test_result("test_maint__register", vfs_maint_register(&maint) == 0);
+  print_test_result("test_maint__register_twice",
+                    vfs_maint_register(&maint) == -EEXIST);
+
+  spiffs_vfs_check_status(&_test_vfs_mount, &status);
+  for (unsigned i = 0; i < 100 && status.running; i++) {
+    vfs_maint_kick();
+    OSTimeDly(1, OS_OPT_TIME_DLY, &err);
+    spiffs_vfs_check_status(&_test_vfs_mount, &status);
+  }
+  print_test_result("test_maint__checked", !status.running &&
+                                               status.progress == 256 &&
+                                               status.err == 0);
+
+  print_test_result("test_maint__unregister",
+                    vfs_maint_unregister(&maint) == 0);
+  print_test_result("test_maint__stats", maint.runs > 1 &&
+                                             maint.busy_runs > 0 &&
+                                             maint.errors == 0 &&
+                                             maint.last_err == 0);
+  print_test_result("test_maint__umount",
+                    vfs_umount(&_test_vfs_mount, false) == 0);
+}
+#endif
+
 void test_vfs_spiffs() {
   print_test_banner("SPIFFS VFS Tests");
   spiffs_vfs_desc_init(&spiffs_desc);
@@ -260,4 +566,17 @@ void test_vfs_spiffs() {
   test_unlink();
 
   test_fstat();
+
+  test_gc();
+  test_subdir();
+  test_random();
+#if CONFIG_SPIFFS_VFS_SNAPSHOT
+  test_snapshot();
+#endif
+#if SPIFFS_CHECK_INCREMENTAL
+  test_check();
+#endif
+#if SPIFFS_CHECK_INCREMENTAL && CONFIG_SPIFFS_VFS_CHECK_GC_BLOCKS
+  test_maint();
+#endif
 }
\ No newline at end of file
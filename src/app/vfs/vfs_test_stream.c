@@ -0,0 +1,158 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+
+#include "logging.h"
+
+#include "printf.h"
+#include "spiffs/spiffs_vfs.h"
+#include "stream.h"
+#include "vfs.h"
+
+#include "vfs_test.h"
+#include "vfs_test_stream.h"
+
+#define MNT_PATH "/stream"
+#define FNAME (MNT_PATH "/STREAM.TXT")
+#define N_LINES (100)
+
+LOG_MODULE_REGISTER(test_stream, LOG_LEVEL_DBG);
+
+static spiffs_desc_t spiffs_desc;
+
+static vfs_mount_t _test_vfs_mount = {
+    .mount_point = MNT_PATH,
+    .fs = &spiffs_file_system,
+    .private_data = (void *)&spiffs_desc,
+    .dno = 1,
+};
+
+static char _buf[N_LINES * 16];
+
+/* size the driver has seen so far, buffered bytes are not included */
+static off_t _size(vfs_stream_t *s) {
+  struct stat st;
+
+  if (vfs_fstat(vfs_fileno(s), &st) < 0) {
+    return -1;
+  }
+  return st.st_size;
+}
+
+static int _expected(char *buf) {
+  int len = 0;
+
+  for (int i = 0; i < N_LINES; i++) {
+    len += snprintf_(&buf[len], 16, "line %d\n", i);
+  }
+  return len;
+}
+
+static void test_printf(void) {
+  static char expected[sizeof(_buf)];
+  int len = _expected(expected);
+
+  vfs_stream_t *s = vfs_fopen(FNAME, "w");
+  print_test_result("test_printf__fopen", s != NULL);
+
+  int ok = 1;
+  for (int i = 0; i < N_LINES; i++) {
+    ok &= vfs_fprintf(s, "line %d\n", i) > 0;
+  }
+  print_test_result("test_printf__fprintf", ok);
+  /* only whole buffers went to the driver */
+  print_test_result("test_printf__buffered",
+                    _size(s) == len - len % CONFIG_VFS_STREAM_BUF_SIZE);
+  print_test_result("test_printf__fflush", vfs_fflush(s) == 0);
+  print_test_result("test_printf__size", _size(s) == len);
+  print_test_result("test_printf__fclose", vfs_fclose(s) == 0);
+
+  int fd = vfs_open(FNAME, O_RDONLY, 0);
+  ssize_t nr = vfs_read(fd, _buf, sizeof(_buf));
+  print_test_result("test_printf__read",
+                    nr == len && memcmp(_buf, expected, len) == 0);
+  vfs_close(fd);
+}
+
+static void test_modes(void) {
+  vfs_stream_t *s = vfs_fopen(FNAME, "w");
+  print_test_result("test_modes__fopen", s != NULL);
+
+  print_test_result("test_modes__setvbuf_lbf",
+                    vfs_setvbuf(s, NULL, VFS_IOLBF, 0) == 0);
+  vfs_fputs(s, "no newline");
+  print_test_result("test_modes__lbf_held", _size(s) == 0);
+  vfs_fprintf(s, " %s\n", "then one");
+  print_test_result("test_modes__lbf_flushed", _size(s) == 20);
+
+  vfs_fputc(s, 'x');
+  print_test_result("test_modes__setvbuf_busy",
+                    vfs_setvbuf(s, NULL, VFS_IONBF, 0) == -EBUSY);
+  /* fsync on the fd pushes out the stream first */
+  print_test_result("test_modes__fsync",
+                    vfs_fsync(vfs_fileno(s)) == 0 && _size(s) == 21);
+
+  print_test_result("test_modes__setvbuf_nbf",
+                    vfs_setvbuf(s, NULL, VFS_IONBF, 0) == 0);
+  vfs_fputc(s, 'y');
+  print_test_result("test_modes__nbf", _size(s) == 22);
+
+  /* a plain close of the fd flushes and leaves the stream to be freed */
+  print_test_result("test_modes__setvbuf_fbf",
+                    vfs_setvbuf(s, NULL, VFS_IOFBF, 0) == 0);
+  vfs_fputc(s, 'z');
+  print_test_result("test_modes__close_fd", vfs_close(vfs_fileno(s)) == 0);
+  print_test_result("test_modes__closed", vfs_fputc(s, 'z') == -EBADF);
+  print_test_result("test_modes__fclose", vfs_fclose(s) == 0);
+
+  struct stat st;
+  print_test_result("test_modes__stat",
+                    vfs_stat(FNAME, &st) == 0 && st.st_size == 23);
+}
+
+static void test_rw(void) {
+  vfs_stream_t *s = vfs_fopen(FNAME, "r+");
+  print_test_result("test_rw__fopen", s != NULL);
+
+  memset(_buf, 0, sizeof(_buf));
+  print_test_result("test_rw__fread",
+                    vfs_fread(s, _buf, 3) == 3 && memcmp(_buf, "no ", 3) == 0);
+  /* the write lands behind what was read, not behind the read-ahead */
+  print_test_result("test_rw__fputs", vfs_fputs(s, "NEW") == 0);
+  print_test_result("test_rw__fclose", vfs_fclose(s) == 0);
+
+  s = vfs_fopen(FNAME, "r");
+  ssize_t nr = vfs_fread(s, _buf, sizeof(_buf));
+  print_test_result("test_rw__read_back",
+                    nr == 23 && memcmp(_buf, "no NEWline", 10) == 0);
+  print_test_result("test_rw__write_ro", vfs_fputc(s, 'x') == -EBADF);
+  vfs_fclose(s);
+}
+
+static void test_fdopen(void) {
+  /* the stream gets the access of the mode, not the one of the fd */
+  int fd = vfs_open(FNAME, O_RDWR, 0);
+  vfs_stream_t *s = vfs_fdopen(fd, "r");
+  print_test_result("test_fdopen__fdopen", s != NULL);
+  print_test_result("test_fdopen__write_ro", vfs_fputc(s, 'x') == -EBADF);
+  print_test_result("test_fdopen__fread",
+                    vfs_fread(s, _buf, 3) == 3 && memcmp(_buf, "no ", 3) == 0);
+  print_test_result("test_fdopen__fclose", vfs_fclose(s) == 0);
+}
+
+void test_vfs_stream() {
+  print_test_banner("VFS Stream Tests");
+  spiffs_vfs_desc_init(&spiffs_desc);
+
+  print_test_result("test_stream__format", vfs_format(&_test_vfs_mount) == 0);
+  print_test_result("test_stream__mount", vfs_mount(&_test_vfs_mount) == 0);
+
+  test_printf();
+  test_modes();
+  test_rw();
+  test_fdopen();
+
+  vfs_unlink(FNAME);
+  print_test_result("test_stream__umount",
+                    vfs_umount(&_test_vfs_mount, false) == 0);
+}
@@ -0,0 +1,6 @@
+#ifndef UC_VFS_VFS_TEST_STREAM_H
+#define UC_VFS_VFS_TEST_STREAM_H
+
+void test_vfs_stream(void);
+
+#endif
@@ -0,0 +1,293 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "logging.h"
+
+#include "fatfs/fatfs_vfs.h"
+#include "littlefs/littlefs_vfs.h"
+#include "ramdisk.h"
+#include "spiffs/spiffs_vfs.h"
+#include "vfs.h"
+
+#include "vfs_bench.h"
+#include "vfs_tune.h"
+
+#define MNT_PATH "/tune"
+#define BUF_SIZE (2048u)
+
+LOG_MODULE_REGISTER(tune, LOG_LEVEL_INF);
+
+static const vfs_tune_op_t _synthetic_ops[] = {
+    {VFS_TUNE_APPEND, 0, 32},  {VFS_TUNE_APPEND, 0, 32},
+    {VFS_TUNE_APPEND, 1, 64},  {VFS_TUNE_WRITE, 2, 200},
+    {VFS_TUNE_READ, 2, 200},   {VFS_TUNE_APPEND, 0, 32},
+    {VFS_TUNE_WRITE, 3, 2048}, {VFS_TUNE_READ, 3, 2048},
+    {VFS_TUNE_READ, 0, 512},   {VFS_TUNE_UNLINK, 3, 0},
+};
+
+const vfs_tune_profile_t vfs_tune_synthetic = {
+    .name = "synthetic",
+    .ops = _synthetic_ops,
+    .n_ops = ARRAY_SIZE(_synthetic_ops),
+    .repeat = 32,
+};
+
+static fatfs_desc_t _fatfs;
+static spiffs_desc_t _spiffs;
+static littlefs2_desc_t _littlefs;
+
+static vfs_mount_t _fatfs_mount = {
+    .mount_point = MNT_PATH,
+    .fs = &fatfs_file_system,
+    .private_data = (void *)&_fatfs,
+    .dno = 0,
+};
+
+static vfs_mount_t _spiffs_mount = {
+    .mount_point = MNT_PATH,
+    .fs = &spiffs_file_system,
+    .private_data = (void *)&_spiffs,
+    .dno = 1,
+};
+
+static vfs_mount_t _littlefs_mount = {
+    .mount_point = MNT_PATH,
+    .fs = &littlefs2_file_system,
+    .private_data = (void *)&_littlefs,
+    .dno = 1,
+};
+
+/* p[] is the geometry, its meaning depends on the backend, see _apply() */
+typedef struct {
+  const char *name;
+  vfs_mount_t *mountp;
+  uint32_t p[3];
+} _candidate_t;
+
+/* candidates of one backend are next to each other, the Pareto front is
+ * computed per backend */
+static const _candidate_t _candidates[] = {
+    /* cluster size */
+    {"fatfs__au_512", &_fatfs_mount, {512}},
+    {"fatfs__au_1k", &_fatfs_mount, {1024}},
+    {"fatfs__au_2k", &_fatfs_mount, {2048}},
+    {"fatfs__au_4k", &_fatfs_mount, {4096}},
+    /* erase block, logical block, logical page */
+    {"spiffs__4k_4k_128", &_spiffs_mount, {4096, 4096, 128}},
+    {"spiffs__4k_4k_256", &_spiffs_mount, {4096, 4096, 256}},
+    {"spiffs__4k_8k_256", &_spiffs_mount, {4096, 8192, 256}},
+    {"spiffs__8k_8k_256", &_spiffs_mount, {8192, 8192, 256}},
+    /* block, cache, lookahead */
+    {"littlefs__512_64_16", &_littlefs_mount, {512, 64, 16}},
+    {"littlefs__2k_64_16", &_littlefs_mount, {2048, 64, 16}},
+    {"littlefs__2k_256_64", &_littlefs_mount, {2048, 256, 64}},
+    {"littlefs__4k_256_64", &_littlefs_mount, {4096, 256, 64}},
+    {"littlefs__4k_512_64", &_littlefs_mount, {4096, 512, 64}},
+};
+
+typedef struct {
+  uint32_t kib_s;   /**< payload throughput */
+  uint32_t p99_ms;  /**< tail latency of a single operation */
+  uint32_t max_ms;
+  uint32_t ram;     /**< descriptor, one open file and pooled caches */
+  uint32_t wa_x100; /**< device bytes written per 100 payload bytes */
+  bool ok;
+} _result_t;
+
+static _result_t _results[ARRAY_SIZE(_candidates)];
+static OS_TICK _lat[CONFIG_VFS_TUNE_MAX_OPS];
+static uint8_t _buf[BUF_SIZE];
+
+static uint32_t _ms(OS_TICK ticks) {
+  return ticks * 1000u / OS_CFG_TICK_RATE_HZ;
+}
+
+/* sets the geometry up for the next format, returns the RAM it costs. The
+ * FAT window and the SPIFFS work, fd and cache buffers are arrays of the
+ * descriptors, sized at compile time whatever the geometry. */
+static uint32_t _apply(const _candidate_t *c) {
+  const vfs_file_system_t *fs = c->mountp->fs;
+
+  if (fs == &fatfs_file_system) {
+    _fatfs.au_size = c->p[0];
+    return sizeof(_fatfs) + fs->file_size;
+  }
+  if (fs == &spiffs_file_system) {
+    memset(&_spiffs.config, 0, sizeof(_spiffs.config));
+    _spiffs.config.phys_erase_block = c->p[0];
+    _spiffs.config.log_block_size = c->p[1];
+    _spiffs.config.log_page_size = c->p[2];
+    return sizeof(_spiffs) + fs->file_size;
+  }
+  memset(&_littlefs.config, 0, sizeof(_littlefs.config));
+  _littlefs.config.block_size = c->p[0];
+  _littlefs.config.cache_size = c->p[1];
+  _littlefs.config.lookahead_size = c->p[2];
+  /* a file cache, plus pooled read and prog caches when the static buffers
+   * are too small */
+  uint32_t ram = sizeof(_littlefs) + fs->file_size + c->p[1];
+  if (c->p[1] > CONFIG_LITTLEFS2_READ_BUFFER_SIZE) {
+    ram += c->p[1];
+  }
+  if (c->p[1] > CONFIG_LITTLEFS2_PROG_BUFFER_SIZE) {
+    ram += c->p[1];
+  }
+  return ram;
+}
+
+/* bytes moved, or a negative errno */
+static int _run_op(const vfs_tune_op_t *op) {
+  char name[sizeof(MNT_PATH) + 8];
+  size_t size = MIN(op->size, sizeof(_buf));
+  int flags = O_RDONLY;
+  int ret;
+
+  snprintf(name, sizeof(name), "%s/T%u", MNT_PATH, (unsigned)op->file);
+  switch (op->kind) {
+  case VFS_TUNE_UNLINK:
+    ret = vfs_unlink(name);
+    return ret == -ENOENT ? 0 : ret;
+  case VFS_TUNE_WRITE:
+    flags = O_WRONLY | O_CREAT | O_TRUNC;
+    break;
+  case VFS_TUNE_APPEND:
+    flags = O_WRONLY | O_CREAT | O_APPEND;
+    break;
+  case VFS_TUNE_READ:
+    break;
+  default:
+    return -EINVAL;
+  }
+
+  int fd = vfs_open(name, flags, 0);
+  if (fd < 0) {
+    return fd;
+  }
+  if (op->kind == VFS_TUNE_READ) {
+    ret = vfs_read(fd, _buf, size);
+  } else {
+    memset(_buf, op->file, size);
+    ret = vfs_write(fd, _buf, size);
+  }
+  int close_ret = vfs_close(fd);
+  return ret < 0 ? ret : (close_ret < 0 ? close_ret : ret);
+}
+
+static int _cmp_ticks(const void *a, const void *b) {
+  OS_TICK x = *(const OS_TICK *)a;
+  OS_TICK y = *(const OS_TICK *)b;
+  return (x > y) - (x < y);
+}
+
+static void _run(const vfs_tune_profile_t *profile, const _candidate_t *c,
+                 _result_t *r) {
+  vfs_mount_t *mountp = c->mountp;
+  ramdisk_t *disk = ramdisk_open(mountp->dno);
+  ramdisk_stats_t stats;
+  uint32_t payload = 0;
+  uint32_t written = 0;
+  unsigned n = 0;
+  int ret;
+
+  memset(r, 0, sizeof(*r));
+  r->ram = _apply(c);
+  if ((ret = vfs_format(mountp)) || (ret = vfs_mount(mountp))) {
+    LOG_INF("%s: setup=%d", c->name, ret);
+    return;
+  }
+
+  ramdisk_stats(disk, &stats, true);
+  OS_TICK start = bench_ticks();
+  for (unsigned rep = 0; rep < profile->repeat; rep++) {
+    for (size_t i = 0; i < profile->n_ops; i++) {
+      const vfs_tune_op_t *op = &profile->ops[i];
+      OS_TICK t0 = bench_ticks();
+      if ((ret = _run_op(op)) < 0) {
+        LOG_INF("%s: op %u=%d", c->name, (unsigned)i, ret);
+        vfs_umount(mountp, true);
+        return;
+      }
+      if (n < ARRAY_SIZE(_lat)) {
+        _lat[n++] = bench_ticks() - t0;
+      }
+      payload += ret;
+      if (op->kind != VFS_TUNE_READ) {
+        written += ret;
+      }
+    }
+  }
+  /* what umount flushes belongs to the workload as well */
+  vfs_umount(mountp, false);
+  OS_TICK total = bench_ticks() - start;
+  ramdisk_stats(disk, &stats, false);
+
+  qsort(_lat, n, sizeof(_lat[0]), _cmp_ticks);
+  r->kib_s = payload / 1024u * 1000u / MAX(_ms(total), 1u);
+  r->p99_ms = n ? _ms(_lat[MIN(n * 99u / 100u, n - 1)]) : 0;
+  r->max_ms = n ? _ms(_lat[n - 1]) : 0;
+  r->wa_x100 = written ? (uint32_t)((uint64_t)stats.bytes_written * 100u /
+                                    written)
+                       : 0;
+  r->ok = true;
+}
+
+/* only the littlefs caches follow the geometry, see _apply() */
+static bool _ram_varies(const vfs_mount_t *mountp) {
+  return mountp->fs == &littlefs2_file_system;
+}
+
+/* b is at least as good as a everywhere and better somewhere, RAM only
+ * counts when ram is set */
+static bool _dominates(const _result_t *b, const _result_t *a, bool ram) {
+  if (b->kib_s < a->kib_s || b->p99_ms > a->p99_ms ||
+      (ram && b->ram > a->ram) || b->wa_x100 > a->wa_x100) {
+    return false;
+  }
+  return b->kib_s > a->kib_s || b->p99_ms < a->p99_ms ||
+         (ram && b->ram < a->ram) || b->wa_x100 < a->wa_x100;
+}
+
+static bool _on_front(size_t i) {
+  bool ram = _ram_varies(_candidates[i].mountp);
+
+  for (size_t j = 0; j < ARRAY_SIZE(_candidates); j++) {
+    if (j != i && _results[j].ok &&
+        _candidates[j].mountp == _candidates[i].mountp &&
+        _dominates(&_results[j], &_results[i], ram)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void vfs_tune(const vfs_tune_profile_t *profile) {
+  LOG_INF("tune: profile %s, %u ops", profile->name,
+          (unsigned)(profile->n_ops * profile->repeat));
+
+  for (size_t i = 0; i < ARRAY_SIZE(_candidates); i++) {
+    _run(profile, &_candidates[i], &_results[i]);
+  }
+  for (size_t i = 0; i < ARRAY_SIZE(_candidates); i++) {
+    const _result_t *r = &_results[i];
+    if (!r->ok) {
+      continue;
+    }
+    LOG_INF("%s: %u KiB/s, p99 %u ms, max %u ms, %u B RAM, WA %u.%02u%s",
+            _candidates[i].name, (unsigned)r->kib_s, (unsigned)r->p99_ms,
+            (unsigned)r->max_ms, (unsigned)r->ram,
+            (unsigned)(r->wa_x100 / 100u), (unsigned)(r->wa_x100 % 100u),
+            _on_front(i) ? " [pareto]" : "");
+  }
+}
+
+void tune_vfs(void) {
+  print_bench_banner("VFS Geometry Tuner");
+  fatfs_vfs_desc_init(&_fatfs);
+  spiffs_vfs_desc_init(&_spiffs);
+  littlefs_vfs_desc_init(&_littlefs);
+
+  vfs_tune(&vfs_tune_synthetic);
+}
@@ -0,0 +1,46 @@
+#ifndef UC_VFS_VFS_TUNE_H
+#define UC_VFS_VFS_TUNE_H
+
+#include <stddef.h>
+
+#include "inttypes.h"
+
+#ifndef CONFIG_VFS_TUNE
+/** Run the geometry sweep from app_task, it reformats both ramdisks */
+#define CONFIG_VFS_TUNE (0)
+#endif
+
+#ifndef CONFIG_VFS_TUNE_MAX_OPS
+/** Operations of a replay whose latency is kept for the percentiles */
+#define CONFIG_VFS_TUNE_MAX_OPS (512)
+#endif
+
+typedef enum {
+  VFS_TUNE_WRITE,  /**< create or truncate, then write size bytes */
+  VFS_TUNE_APPEND, /**< append size bytes */
+  VFS_TUNE_READ,   /**< read up to size bytes from the start */
+  VFS_TUNE_UNLINK, /**< remove the file, a missing file is not an error */
+} vfs_tune_op_kind_t;
+
+/** one step of a workload, e.g. taken from an application trace */
+typedef struct {
+  uint8_t kind;  /**< vfs_tune_op_kind_t */
+  uint8_t file;  /**< file number, every backend maps it to a name */
+  uint16_t size; /**< bytes, clamped to the replay buffer */
+} vfs_tune_op_t;
+
+typedef struct {
+  const char *name;
+  const vfs_tune_op_t *ops;
+  size_t n_ops;
+  uint16_t repeat; /**< number of times the ops are replayed */
+} vfs_tune_profile_t;
+
+/** log appends, a small rewritten config file and a short-lived blob */
+extern const vfs_tune_profile_t vfs_tune_synthetic;
+
+void vfs_tune(const vfs_tune_profile_t *profile);
+
+void tune_vfs(void);
+
+#endif
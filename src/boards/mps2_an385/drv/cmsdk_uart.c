@@ -8,8 +8,26 @@
 
 #include <CMSDK_CM3.h>
 
+#include <os.h>
+
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+
 #define UART_BAUDRATE 115200u
 
+/* Kernel aware, must not be above CPU_CFG_KA_IPL_BOUNDARY */
+#define UART_ISR_PRIORITY 5u
+
+/* Ring sizes, powers of two */
+#ifndef CONFIG_CMSDK_UART_TX_BUF_SIZE
+#define CONFIG_CMSDK_UART_TX_BUF_SIZE 256u
+#endif
+
+#ifndef CONFIG_CMSDK_UART_RX_BUF_SIZE
+#define CONFIG_CMSDK_UART_RX_BUF_SIZE 64u
+#endif
+
 /*
  * MPS2 UART Driver - cmsdk_apb_uart :
  *
@@ -24,20 +42,147 @@
 struct cmsdk_uart_serial_config
 {
 	CMSDK_UART_TypeDef *const uart;
+	IRQn_Type rx_irq_n;
+	IRQn_Type tx_irq_n;
+};
+
+/*
+ * Async mode state. Each ring has a single task side, serialized by its
+ * mutex, and the interrupt on the other side. Indexes run freely and are
+ * only written by their owner: tx_head and rx_tail by the task, tx_tail and
+ * rx_head by the interrupt.
+ */
+struct cmsdk_uart_data
+{
+	uint8_t tx_buf[CONFIG_CMSDK_UART_TX_BUF_SIZE];
+	uint8_t rx_buf[CONFIG_CMSDK_UART_RX_BUF_SIZE];
+	volatile uint32_t tx_head;
+	volatile uint32_t tx_tail;
+	volatile uint32_t rx_head;
+	volatile uint32_t rx_tail;
+
+	/* a byte is in the transmitter, the TX interrupt sends the next one */
+	volatile bool tx_busy;
+	/* a task pends on the semaphore, the interrupt posts once */
+	volatile bool tx_waiting;
+	volatile bool rx_waiting;
+
+	bool async;
+	OS_MUTEX tx_lock;
+	OS_MUTEX rx_lock;
+	OS_SEM tx_sem;
+	OS_SEM rx_sem;
+
+	serial_callback_t callback;
+	void *user_data;
+	uint32_t rx_overruns;
 };
 
 #define CMSDK_UART_REGS_GET(_dev) \
 	DEVICE_CONFIG_GET(_dev, struct cmsdk_uart_serial_config)->uart
 
-#define CMSDK_UART_DEFINE(_name, _uart) \
+#define CMSDK_UART_DATA_GET(_dev) \
+	DEVICE_DATA_GET(_dev, struct cmsdk_uart_data)
+
+static inline void isr_enter(void)
+{
+	CPU_SR_ALLOC();
+
+	CPU_CRITICAL_ENTER();
+	OSIntEnter();
+	CPU_CRITICAL_EXIT();
+}
+
+static inline void notify(const struct device *serial,
+			  struct cmsdk_uart_data *data,
+			  enum serial_event event)
+{
+	if (data->callback != NULL) {
+		data->callback(serial, event, data->user_data);
+	}
+}
+
+static void tx_handler(const struct device *serial)
+{
+	CMSDK_UART_TypeDef *const uart = CMSDK_UART_REGS_GET(serial);
+	struct cmsdk_uart_data *const data = CMSDK_UART_DATA_GET(serial);
+	OS_ERR err;
+
+	uart->INTCLEAR = CMSDK_UART_CTRL_TXIRQ_Msk;
+
+	if (uart->STATE & CMSDK_UART_STATE_TXBF_Msk) {
+		/* raised by an earlier byte, the one in the transmitter
+		 * raises its own once sent */
+		return;
+	}
+
+	if (data->tx_tail != data->tx_head) {
+		uart->DATA = data->tx_buf[data->tx_tail++ &
+					  (CONFIG_CMSDK_UART_TX_BUF_SIZE - 1u)];
+	} else if (data->tx_busy) {
+		/* not for a byte sent by poll_out() */
+		data->tx_busy = false;
+		notify(serial, data, SERIAL_EVT_TX_DONE);
+	}
+
+	/* wake the writer once half the ring is free, not for every byte */
+	if (data->tx_waiting && ((data->tx_head - data->tx_tail) <=
+				 CONFIG_CMSDK_UART_TX_BUF_SIZE / 2u)) {
+		data->tx_waiting = false;
+		OSSemPost(&data->tx_sem, OS_OPT_POST_1, &err);
+	}
+}
+
+static void rx_handler(const struct device *serial)
+{
+	CMSDK_UART_TypeDef *const uart = CMSDK_UART_REGS_GET(serial);
+	struct cmsdk_uart_data *const data = CMSDK_UART_DATA_GET(serial);
+	bool overrun = false;
+	OS_ERR err;
+
+	uart->INTCLEAR = CMSDK_UART_CTRL_RXIRQ_Msk;
+
+	while (uart->STATE & CMSDK_UART_STATE_RXBF_Msk) {
+		uint8_t c = uart->DATA;
+
+		if (data->rx_head - data->rx_tail <
+		    CONFIG_CMSDK_UART_RX_BUF_SIZE) {
+			data->rx_buf[data->rx_head++ &
+				     (CONFIG_CMSDK_UART_RX_BUF_SIZE - 1u)] = c;
+		} else {
+			data->rx_overruns++;
+			overrun = true;
+		}
+	}
+
+	notify(serial, data, overrun ? SERIAL_EVT_RX_OVERRUN :
+				       SERIAL_EVT_RX_READY);
+
+	if (data->rx_waiting) {
+		data->rx_waiting = false;
+		OSSemPost(&data->rx_sem, OS_OPT_POST_1, &err);
+	}
+}
+
+#define CMSDK_UART_ISR_DEFINE(_device_ptr, _rx_isr, _tx_isr) \
+void _rx_isr(void) { isr_enter(); rx_handler(_device_ptr); OSIntExit(); } \
+void _tx_isr(void) { isr_enter(); tx_handler(_device_ptr); OSIntExit(); }
+
+#define CMSDK_UART_DEFINE(_name, _uart, _rx_irq_n, _tx_irq_n, \
+			  _rx_isr, _tx_isr) \
 	const struct device _name = { \
 		.api = &api, \
-		.data = NULL, \
+		.data = &(struct cmsdk_uart_data) { \
+			.async = false \
+		}, \
 		.config =  \
 		&(struct cmsdk_uart_serial_config) { \
-			.uart = _uart \
+			.uart = _uart, \
+			.rx_irq_n = _rx_irq_n, \
+			.tx_irq_n = _tx_irq_n \
 		} \
-	}
+	}; \
+	CMSDK_UART_ISR_DEFINE(&_name, _rx_isr, _tx_isr)
 
 static int init(const struct device *serial)
 {
@@ -78,14 +223,223 @@ static int poll_in(const struct device *serial, unsigned char *c)
 	return 0u;
 }
 
+static int async_enable(const struct device *serial)
+{
+	CMSDK_UART_TypeDef *const uart = CMSDK_UART_REGS_GET(serial);
+	struct cmsdk_uart_data *const data = CMSDK_UART_DATA_GET(serial);
+	const struct cmsdk_uart_serial_config *const config =
+		DEVICE_CONFIG_GET(serial, struct cmsdk_uart_serial_config);
+	OS_ERR err;
+
+	if (data->async) {
+		return 0;
+	}
+
+	OSMutexCreate(&data->tx_lock, "uart_tx", &err);
+	if (err == OS_ERR_NONE) {
+		OSMutexCreate(&data->rx_lock, "uart_rx", &err);
+	}
+	if (err == OS_ERR_NONE) {
+		OSSemCreate(&data->tx_sem, "uart_tx", 0, &err);
+	}
+	if (err == OS_ERR_NONE) {
+		OSSemCreate(&data->rx_sem, "uart_rx", 0, &err);
+	}
+	if (err != OS_ERR_NONE) {
+		return -ENOMEM;
+	}
+
+	data->tx_head = data->tx_tail = 0;
+	data->rx_head = data->rx_tail = 0;
+	data->tx_busy = false;
+	data->tx_waiting = false;
+	data->rx_waiting = false;
+	data->rx_overruns = 0;
+
+	uart->INTCLEAR = CMSDK_UART_CTRL_TXIRQ_Msk | CMSDK_UART_CTRL_RXIRQ_Msk;
+
+	__NVIC_ClearPendingIRQ(config->rx_irq_n);
+	__NVIC_ClearPendingIRQ(config->tx_irq_n);
+	__NVIC_SetPriority(config->rx_irq_n, UART_ISR_PRIORITY);
+	__NVIC_SetPriority(config->tx_irq_n, UART_ISR_PRIORITY);
+	__NVIC_EnableIRQ(config->rx_irq_n);
+	__NVIC_EnableIRQ(config->tx_irq_n);
+
+	data->async = true;
+	uart->CTRL |= CMSDK_UART_CTRL_TXIRQEN_Msk | CMSDK_UART_CTRL_RXIRQEN_Msk;
+
+	return 0;
+}
+
+/* SERIAL_FOREVER maps to the uC/OS "wait forever" timeout of 0 */
+static inline OS_TICK os_timeout(uint32_t timeout)
+{
+	return (timeout == SERIAL_FOREVER) ? 0u : (OS_TICK)timeout;
+}
+
+static int async_write(const struct device *serial, const void *buf,
+		       size_t len, uint32_t timeout)
+{
+	CMSDK_UART_TypeDef *const uart = CMSDK_UART_REGS_GET(serial);
+	struct cmsdk_uart_data *const data = CMSDK_UART_DATA_GET(serial);
+	const uint8_t *src = buf;
+	size_t done = 0;
+	OS_ERR err;
+	CPU_SR_ALLOC();
+
+	if (!data->async) {
+		return -ENOTSUP;
+	}
+	if (OSIntNestingCtr > 0u) {
+		/* cannot wait for the transmitter in an interrupt */
+		return -EWOULDBLOCK;
+	}
+
+	OSMutexPend(&data->tx_lock, 0, OS_OPT_PEND_BLOCKING, NULL, &err);
+	if (err == OS_ERR_MUTEX_OWNER) {
+		/* re-entered by the owner, e.g. from a callback, the pend only
+		 * counted the nesting */
+		OSMutexPost(&data->tx_lock, OS_OPT_POST_NONE, &err);
+		return -EWOULDBLOCK;
+	}
+	if (err != OS_ERR_NONE) {
+		/* the caller falls back to polling */
+		return -EWOULDBLOCK;
+	}
+
+	while (done < len) {
+		uint32_t head = data->tx_head;
+		uint32_t room = CONFIG_CMSDK_UART_TX_BUF_SIZE -
+				(head - data->tx_tail);
+		size_t n = MIN(room, len - done);
+
+		/* the interrupt never reads past tx_head, copy without lock */
+		for (size_t i = 0; i < n; i++) {
+			data->tx_buf[(head + i) &
+				     (CONFIG_CMSDK_UART_TX_BUF_SIZE - 1u)] =
+				src[done + i];
+		}
+		done += n;
+
+		CPU_CRITICAL_ENTER();
+		data->tx_head = head + n;
+		if (!data->tx_busy && (data->tx_tail != data->tx_head)) {
+			/* the TX interrupt takes over from the first byte. A
+			 * byte from poll_out() may still be in the transmitter,
+			 * the interrupt it raises starts on the ring instead */
+			data->tx_busy = true;
+			if (!(uart->STATE & CMSDK_UART_STATE_TXBF_Msk)) {
+				uart->DATA = data->tx_buf[data->tx_tail++ &
+					(CONFIG_CMSDK_UART_TX_BUF_SIZE - 1u)];
+			}
+		}
+		data->tx_waiting = (done < len) && (timeout != SERIAL_NO_WAIT);
+		CPU_CRITICAL_EXIT();
+
+		if (!data->tx_waiting) {
+			break;
+		}
+		OSSemPend(&data->tx_sem, os_timeout(timeout),
+			  OS_OPT_PEND_BLOCKING, NULL, &err);
+		if (err != OS_ERR_NONE) {
+			data->tx_waiting = false;
+			break;
+		}
+	}
+
+	OSMutexPost(&data->tx_lock, OS_OPT_POST_NONE, &err);
+
+	return done;
+}
+
+static int async_read(const struct device *serial, void *buf, size_t len,
+		      uint32_t timeout)
+{
+	struct cmsdk_uart_data *const data = CMSDK_UART_DATA_GET(serial);
+	uint8_t *dst = buf;
+	uint32_t avail;
+	OS_ERR err;
+	CPU_SR_ALLOC();
+
+	if (!data->async) {
+		return -ENOTSUP;
+	}
+	if ((OSIntNestingCtr > 0u) && (timeout != SERIAL_NO_WAIT)) {
+		return -EWOULDBLOCK;
+	}
+
+	OSMutexPend(&data->rx_lock, 0, OS_OPT_PEND_BLOCKING, NULL, &err);
+	if (err == OS_ERR_MUTEX_OWNER) {
+		OSMutexPost(&data->rx_lock, OS_OPT_POST_NONE, &err);
+		return -EWOULDBLOCK;
+	}
+	if (err != OS_ERR_NONE) {
+		return -EWOULDBLOCK;
+	}
+
+	for (;;) {
+		CPU_CRITICAL_ENTER();
+		avail = data->rx_head - data->rx_tail;
+		data->rx_waiting = (avail == 0) && (timeout != SERIAL_NO_WAIT);
+		CPU_CRITICAL_EXIT();
+
+		if (!data->rx_waiting) {
+			break;
+		}
+		/* posted by the RX interrupt, no polling */
+		OSSemPend(&data->rx_sem, os_timeout(timeout),
+			  OS_OPT_PEND_BLOCKING, NULL, &err);
+		if (err != OS_ERR_NONE) {
+			data->rx_waiting = false;
+			avail = data->rx_head - data->rx_tail;
+			break;
+		}
+	}
+
+	size_t n = MIN(avail, len);
+	for (size_t i = 0; i < n; i++) {
+		dst[i] = data->rx_buf[(data->rx_tail + i) &
+				      (CONFIG_CMSDK_UART_RX_BUF_SIZE - 1u)];
+	}
+	data->rx_tail += n;
+
+	OSMutexPost(&data->rx_lock, OS_OPT_POST_NONE, &err);
+
+	return n ? (int)n : -EAGAIN;
+}
+
+static int set_callback(const struct device *serial,
+			serial_callback_t callback,
+			void *user_data)
+{
+	struct cmsdk_uart_data *const data = CMSDK_UART_DATA_GET(serial);
+	CPU_SR_ALLOC();
+
+	CPU_CRITICAL_ENTER();
+	data->callback = callback;
+	data->user_data = user_data;
+	CPU_CRITICAL_EXIT();
+
+	return 0;
+}
+
 static const struct serial_api api = {
 	.init = init,
 	.poll_out = poll_out,
-	.poll_in = poll_in
+	.poll_in = poll_in,
+	.async_enable = async_enable,
+	.async_write = async_write,
+	.async_read = async_read,
+	.set_callback = set_callback,
 };
 
-CMSDK_UART_DEFINE(cmsdk_uart0, CMSDK_UART0);
-CMSDK_UART_DEFINE(cmsdk_uart1, CMSDK_UART1);
-CMSDK_UART_DEFINE(cmsdk_uart2, CMSDK_UART2);
-CMSDK_UART_DEFINE(cmsdk_uart3, CMSDK_UART3);
-CMSDK_UART_DEFINE(cmsdk_uart4, CMSDK_UART4);
\ No newline at end of file
+CMSDK_UART_DEFINE(cmsdk_uart0, CMSDK_UART0, UARTRX0_IRQn, UARTTX0_IRQn,
+		  UARTRX0_Handler, UARTTX0_Handler);
+CMSDK_UART_DEFINE(cmsdk_uart1, CMSDK_UART1, UARTRX1_IRQn, UARTTX1_IRQn,
+		  UARTRX1_Handler, UARTTX1_Handler);
+CMSDK_UART_DEFINE(cmsdk_uart2, CMSDK_UART2, UARTRX2_IRQn, UARTTX2_IRQn,
+		  UARTRX2_Handler, UARTTX2_Handler);
+CMSDK_UART_DEFINE(cmsdk_uart3, CMSDK_UART3, UARTRX3_IRQn, UARTTX3_IRQn,
+		  UARTRX3_Handler, UARTTX3_Handler);
+CMSDK_UART_DEFINE(cmsdk_uart4, CMSDK_UART4, UARTRX4_IRQn, UARTTX4_IRQn,
+		  UARTRX4_Handler, UARTTX4_Handler);
\ No newline at end of file
@@ -4,6 +4,8 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <errno.h>
+
 #include <device.h>
 
 int serial_init(const struct device *serial)
@@ -21,6 +23,43 @@ int serial_poll_in(const struct device *serial, unsigned char *c)
 	return SERIAL_API_GET(serial)->poll_in(serial, c);
 }
 
+int serial_async_enable(const struct device *serial)
+{
+	if (SERIAL_API_GET(serial)->async_enable == NULL) {
+		return -ENOTSUP;
+	}
+	return SERIAL_API_GET(serial)->async_enable(serial);
+}
+
+int serial_async_write(const struct device *serial, const void *buf,
+		       size_t len, uint32_t timeout)
+{
+	if (SERIAL_API_GET(serial)->async_write == NULL) {
+		return -ENOTSUP;
+	}
+	return SERIAL_API_GET(serial)->async_write(serial, buf, len, timeout);
+}
+
+int serial_async_read(const struct device *serial, void *buf, size_t len,
+		      uint32_t timeout)
+{
+	if (SERIAL_API_GET(serial)->async_read == NULL) {
+		return -ENOTSUP;
+	}
+	return SERIAL_API_GET(serial)->async_read(serial, buf, len, timeout);
+}
+
+int serial_set_callback(const struct device *serial,
+			serial_callback_t callback,
+			void *user_data)
+{
+	if (SERIAL_API_GET(serial)->set_callback == NULL) {
+		return -ENOTSUP;
+	}
+	return SERIAL_API_GET(serial)->set_callback(serial, callback,
+						    user_data);
+}
+
 int timer_set_callback(const struct device *timer,
 		       timer_callback_t callback,
 		       void *user_data)
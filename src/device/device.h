@@ -9,6 +9,7 @@
 
 #include <stdio.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #include <common.h>
 
@@ -29,11 +30,35 @@ struct device
 	((const _type *) (_device)->api)
 	
 
+/* timeouts of serial_async_write() and serial_async_read(), in OS ticks
+ * otherwise */
+#define SERIAL_NO_WAIT 0u
+#define SERIAL_FOREVER UINT32_MAX
+
+enum serial_event {
+	SERIAL_EVT_TX_DONE,	/* the TX ring is empty */
+	SERIAL_EVT_RX_READY,	/* bytes were added to the RX ring */
+	SERIAL_EVT_RX_OVERRUN,	/* the RX ring was full, bytes were lost */
+};
+
+/* called from the UART interrupt */
+typedef void (*serial_callback_t)(const struct device *serial,
+				  enum serial_event event,
+				  void *user_data);
+
 struct serial_api
 {
 	int (*init)(const struct device *serial);
 	void (*poll_out)(const struct device *serial, unsigned char c);
 	int (*poll_in)(const struct device *serial, unsigned char *c);
+	int (*async_enable)(const struct device *serial);
+	int (*async_write)(const struct device *serial, const void *buf,
+			   size_t len, uint32_t timeout);
+	int (*async_read)(const struct device *serial, void *buf, size_t len,
+			  uint32_t timeout);
+	int (*set_callback)(const struct device *serial,
+			    serial_callback_t callback,
+			    void *user_data);
 };
 
 #define SERIAL_API_GET(_device) \
@@ -45,6 +70,24 @@ void serial_poll_out(const struct device *serial, unsigned char c);
 
 int serial_poll_in(const struct device *serial, unsigned char *c);
 
+/* switches the device to interrupt driven TX and RX, poll_out still works
+ * but bypasses the TX ring */
+int serial_async_enable(const struct device *serial);
+
+/* queues up to len bytes, waiting at most timeout for room in the TX ring,
+ * returns the number of bytes queued */
+int serial_async_write(const struct device *serial, const void *buf,
+		       size_t len, uint32_t timeout);
+
+/* returns between 1 and len received bytes, waiting at most timeout for the
+ * first one, -EAGAIN if none arrived */
+int serial_async_read(const struct device *serial, void *buf, size_t len,
+		      uint32_t timeout);
+
+int serial_set_callback(const struct device *serial,
+			serial_callback_t callback,
+			void *user_data);
+
 typedef void (*timer_callback_t)(const struct device *timer,
 				       void *user_data);
 
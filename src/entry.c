@@ -17,6 +17,7 @@
 #include <board.h>
 
 #include <app.h>
+#include <os_app_hooks.h>
 
 #define OS_TICKS_PER_SEC OS_CFG_TICK_RATE_HZ
 
@@ -49,6 +50,8 @@ int main(void) {
 
   OSInit(&uce);
 
+  App_OS_SetAllHooks();
+
   OSTaskCreate(&sys_main_thread, "sys_main", sys_task, (void *)0,
                SYS_MAIN_TASK_PRIORITY, &sys_main_stack[0], 10,
                sizeof(sys_main_stack) / 4u, 5, 10, (void *)0,
@@ -27,6 +27,7 @@
 #define   MICRIUM_SOURCE
 #include  <os.h>
 #include  "os_app_hooks.h"
+#include  "maint.h"
 
 
 /*
@@ -125,7 +126,7 @@ void  App_OS_ClrAllHooks (void)
 
 void  App_OS_IdleTaskHook (void)
 {
-
+    vfs_maint_idle_hook();                                      /* Wake up file system maintenance if it is due.        */
 }
 
 /*
@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2022 Lucas Dietrich <ld.adecy@gmail.com>
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <log_ring.h>
+
+#define REC_COMMIT (1u << 31)
+#define REC_PAD (1u << 30)
+#define REC_LEN(h) ((h) & 0xffffu)
+#define REC_HDR (sizeof(uint32_t))
+
+static inline uint32_t rec_size(size_t len)
+{
+	return (REC_HDR + len + REC_HDR - 1u) & ~(REC_HDR - 1u);
+}
+
+int log_ring_init(log_ring_t *r, uint32_t *buf, uint32_t size)
+{
+	if ((r == NULL) || (buf == NULL)) {
+		return -EINVAL;
+	}
+	if ((size < 2 * REC_HDR) || (size > 0x10000u) || (size & (size - 1))) {
+		return -EINVAL;
+	}
+
+	/* free space must read as uncommitted headers */
+	memset(buf, 0, size);
+	r->buf = buf;
+	r->size = size;
+	r->head = 0;
+	r->tail = 0;
+	r->records = 0;
+	r->dropped = 0;
+
+	return 0;
+}
+
+int log_ring_put(log_ring_t *r, const void *data, size_t len)
+{
+	uint32_t need = rec_size(len);
+	uint32_t head, off, pad;
+
+	if ((len == 0) || (need > r->size)) {
+		return -EINVAL;
+	}
+
+	do {
+		head = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+		/* pairs with the release in the consumer, the space behind
+		 * tail has been zeroed */
+		uint32_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+		off = head & (r->size - 1);
+		/* records never wrap, the end of the ring is skipped with a
+		 * pad */
+		pad = (off + need > r->size) ? r->size - off : 0;
+		if (head + pad + need - tail > r->size) {
+			__atomic_fetch_add(&r->dropped, 1, __ATOMIC_RELAXED);
+			return -ENOSPC;
+		}
+	} while (!__atomic_compare_exchange_n(&r->head, &head,
+					      head + pad + need, true,
+					      __ATOMIC_ACQ_REL,
+					      __ATOMIC_RELAXED));
+
+	uint8_t *base = (uint8_t *)r->buf;
+	if (pad) {
+		__atomic_store_n((uint32_t *)&base[off],
+				 REC_COMMIT | REC_PAD | (pad - REC_HDR),
+				 __ATOMIC_RELEASE);
+		off = 0;
+	}
+	memcpy(&base[off + REC_HDR], data, len);
+	__atomic_store_n((uint32_t *)&base[off], REC_COMMIT | len,
+			 __ATOMIC_RELEASE);
+	__atomic_fetch_add(&r->records, 1, __ATOMIC_RELAXED);
+
+	return 0;
+}
+
+/* copies records until one does not fit or @once is set */
+static size_t consume(log_ring_t *r, uint8_t *dst, size_t max, bool once)
+{
+	uint8_t *base = (uint8_t *)r->buf;
+	uint32_t tail = r->tail;
+	size_t n = 0;
+
+	for (;;) {
+		uint32_t *hdr = (uint32_t *)&base[tail & (r->size - 1)];
+		uint32_t h = __atomic_load_n(hdr, __ATOMIC_ACQUIRE);
+		if (!(h & REC_COMMIT)) {
+			/* empty, or the producer is still copying */
+			break;
+		}
+
+		uint32_t len = REC_LEN(h);
+		bool pad = (h & REC_PAD) != 0;
+		if (!pad) {
+			if (n + len > max) {
+				break;
+			}
+			memcpy(&dst[n], &hdr[1], len);
+			n += len;
+		}
+		memset(hdr, 0, rec_size(len));
+		tail += rec_size(len);
+		__atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+
+		if (once && !pad) {
+			break;
+		}
+	}
+
+	return n;
+}
+
+size_t log_ring_get(log_ring_t *r, void *dest, size_t max)
+{
+	return consume(r, dest, max, false);
+}
+
+size_t log_ring_pop(log_ring_t *r, void *dest, size_t max)
+{
+	return consume(r, dest, max, true);
+}
+
+uint32_t log_ring_used(const log_ring_t *r)
+{
+	return __atomic_load_n(&r->head, __ATOMIC_RELAXED) -
+	       __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+}
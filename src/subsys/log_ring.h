@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2022 Lucas Dietrich <ld.adecy@gmail.com>
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _APP_LOG_RING_H
+#define _APP_LOG_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Multi-producer, single-consumer ring of variable sized records.
+ *
+ * Producers reserve space with a compare-and-swap on head, copy their record
+ * and publish it by setting the commit bit in its header, so they never
+ * block and may run in interrupts. The consumer stops at the first record
+ * that is not committed yet and zeroes what it consumed before handing the
+ * space back through tail.
+ */
+typedef struct {
+	uint32_t *buf;
+	uint32_t size;		/* bytes, power of two, at most 64 KiB */
+	uint32_t head;		/* reserved by producers */
+	uint32_t tail;		/* released by the consumer */
+	uint32_t records;	/* records accepted */
+	uint32_t dropped;	/* records rejected because the ring was full */
+} log_ring_t;
+
+int log_ring_init(log_ring_t *r, uint32_t *buf, uint32_t size);
+
+int log_ring_put(log_ring_t *r, const void *data, size_t len);
+
+/* copies as many whole records as fit, back to back */
+size_t log_ring_get(log_ring_t *r, void *dest, size_t max);
+
+/* copies the oldest record, returns its length or 0 if there is none */
+size_t log_ring_pop(log_ring_t *r, void *dest, size_t max);
+
+uint32_t log_ring_used(const log_ring_t *r);
+
+#endif /* _APP_LOG_RING_H */
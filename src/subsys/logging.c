@@ -7,71 +7,567 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 
 #include <logging.h>
 
+#if CONFIG_LOG_DEFERRED
+#include <os.h>
+
+#include <log_ring.h>
+#endif
+
 /* https://github.com/lucasdietrich/LoRaMac-node/blob/lucas/playground/src/apps/playground/periodic-uplink-lpp/B-L072Z-LRWAN1-playground/logging.h */
 
-int _log_print(const struct log_line *log,
-	       const char *__restrict__ fmt,
-	       ...)
+static volatile log_backend_t _backend;
+
+void log_backend_set(log_backend_t backend)
 {
-	va_list args;
-	va_start(args, fmt);
+	_backend = backend;
+}
 
-	if (log->level > log->module->level) {
-		return -1;
+/* snprintf returns what it would have written, keep len inside the line */
+static size_t _clamp(size_t len, int res, size_t max)
+{
+	if (res > 0) {
+		len += res;
+	}
+	return (len < max) ? len : max;
+}
+
+static const char *_color_prefix(const struct log_module *module, int level)
+{
+	if (!module->color) {
+		return "";
+	}
+
+	switch (level) {
+	case LOG_LEVEL_ERR:
+		return LOG_COLOR_ERR;
+	case LOG_LEVEL_WRN:
+		return LOG_COLOR_WRN;
+	default:
+		return "";
+	}
+}
+
+static const char *_level_prefix(const struct log_module *module, int level)
+{
+	if (!module->color) {
+		return "";
+	}
+
+	switch (level) {
+	case LOG_LEVEL_ERR:
+		return "err";
+	case LOG_LEVEL_WRN:
+		return "wrn";
+	case LOG_LEVEL_INF:
+		return "inf";
+	case LOG_LEVEL_DBG:
+		return "dbg";
+	case LOG_LEVEL_VERBOSE:
+		return "vrb";
+	default:
+		return "";
+	}
+}
+
+/* Line buffer, leaves room for the '\n' and the terminating '\0' */
+#define LOG_LINE_LEN (CONFIG_LOG_LINE_MAX - 2u)
+
+/* Write prefix */
+static size_t _prefix(char *line, const struct log_module *module, int level,
+		      const char *func)
+{
+	size_t len = 0;
+
+	len = _clamp(len, snprintf(line, LOG_LINE_LEN + 1u, "<%s %s",
+				   _level_prefix(module, level), module->name),
+		     LOG_LINE_LEN);
+
+	if (level == LOG_LEVEL_DBG) {
+		len = _clamp(len, snprintf(&line[len], LOG_LINE_LEN + 1u - len,
+					   ".%s", func), LOG_LINE_LEN);
+	}
+
+	return _clamp(len, snprintf(&line[len], LOG_LINE_LEN + 1u - len, "> "),
+		      LOG_LINE_LEN);
+}
+
+/* Write suffix, then the line reaches the console in one printf and the
+ * backend as one record */
+static void _output(const struct log_module *module, int level, char *line,
+		    size_t len)
+{
+	line[len++] = '\n';
+	line[len] = '\0';
+
+	if (module->color) {
+		printf("%s%.*s" LOG_COLOR_RESET "\n",
+		       _color_prefix(module, level), (int)len - 1, line);
+	} else {
+		printf("%s", line);
+	}
+
+	log_backend_t backend = _backend;
+	if (backend != NULL) {
+		backend(line, len);
+	}
+}
+
+static void _log_vprint(const struct log_module *module, int level,
+			const char *func, const char *fmt, va_list args)
+{
+	char line[CONFIG_LOG_LINE_MAX];
+	size_t len = _prefix(line, module, level, func);
+
+	/* Write log message */
+	len = _clamp(len, vsnprintf(&line[len], LOG_LINE_LEN + 1u - len, fmt,
+				    args), LOG_LINE_LEN);
+
+	_output(module, level, line, len);
+}
+
+#if CONFIG_LOG_DEFERRED
+
+/*
+ * Deferred messages keep the format string pointer and the raw arguments.
+ * Both sides walk the format string with _conversion() to know the type of
+ * each argument, the producer to copy it out of the va_list, the log task to
+ * hand it back to snprintf one conversion at a time.
+ */
+
+enum {
+	ARG_NONE,
+	ARG_INT,
+	ARG_LONG,
+	ARG_LLONG,
+	ARG_SIZE,
+	ARG_PTR,
+	ARG_DOUBLE,
+	ARG_STR,
+	/* long double and anything else that can't be packed */
+	ARG_OTHER,
+};
+
+/* longest conversion _unpack() hands back to snprintf */
+#define SPEC_MAX 16
+
+struct log_msg {
+	const struct log_module *module;
+	const char *func;
+	const char *fmt;
+	uint8_t level;
+	/* arguments follow, packed back to back */
+	uint8_t args[];
+};
+
+#define MSG_ARGS_MAX \
+	(CONFIG_LOG_DEFERRED_MSG_MAX - offsetof(struct log_msg, args))
+
+#define LOG_PERIOD_TICKS \
+	((OS_TICK)(CONFIG_LOG_DEFERRED_PERIOD_MS * OS_CFG_TICK_RATE_HZ / 1000u))
+
+static uint32_t _ring_buf[CONFIG_LOG_DEFERRED_RING_SIZE / sizeof(uint32_t)];
+static log_ring_t _ring;
+
+static OS_MUTEX _log_mutex;
+static OS_TCB _log_tcb;
+static CPU_STK _log_stack[CONFIG_LOG_DEFERRED_TASK_STACK_SIZE];
+
+/* producers format synchronously until the log task runs */
+static volatile bool _running;
+
+/* messages an interrupt could neither queue nor print in order */
+static uint32_t _dropped;
+
+/* parses the conversion at fmt[0] == '%', returns its argument type and
+ * length, a '*' width or precision takes an extra int before it */
+static int _conversion(const char *fmt, size_t *len, int *stars)
+{
+	const char *p = fmt + 1;
+	int longs = 0;
+	bool size = false;
+	bool ldouble = false;
+
+	*stars = 0;
+	while (*p && strchr("-+ #0", *p)) {
+		p++;
+	}
+	for (; (*p == '*') || (*p == '.') || ((*p >= '0') && (*p <= '9'));
+	     p++) {
+		if (*p == '*') {
+			(*stars)++;
+		}
+	}
+	for (; *p && strchr("hlzjtL", *p); p++) {
+		if (*p == 'L') {
+			ldouble = true;
+		} else if (*p == 'l') {
+			longs++;
+		} else if (*p == 'j') {
+			longs = 2;
+		} else if ((*p == 'z') || (*p == 't')) {
+			size = true;
+		}
+	}
+
+	char conv = *p;
+	*len = (p - fmt) + (conv ? 1 : 0);
+
+	switch (conv) {
+	case 'd':
+	case 'i':
+	case 'u':
+	case 'x':
+	case 'X':
+	case 'o':
+		if (size) {
+			return ARG_SIZE;
+		}
+		return (longs >= 2) ? ARG_LLONG :
+		       (longs == 1) ? ARG_LONG : ARG_INT;
+	case 'c':
+		return ARG_INT;
+	case 'p':
+		return ARG_PTR;
+	case 's':
+		return ARG_STR;
+	case 'f':
+	case 'F':
+	case 'e':
+	case 'E':
+	case 'g':
+	case 'G':
+		return ldouble ? ARG_OTHER : ARG_DOUBLE;
+	case '%':
+		return ARG_NONE;
+	default:
+		return ARG_OTHER;
+	}
+}
+
+#define PACK(_type, _val)						\
+	do {								\
+		_type _v = (_val);					\
+		if (off + sizeof(_v) > max) {				\
+			return -1;					\
+		}							\
+		memcpy(&args[off], &_v, sizeof(_v));			\
+		off += sizeof(_v);					\
+	} while (0)
+
+/* copies the arguments, strings by value since they may not outlive the
+ * call. Returns -1 if they do not fit, a string is longer than
+ * CONFIG_LOG_DEFERRED_STR_MAX or a conversion can't be replayed, the caller
+ * then formats right away. */
+static int _pack(uint8_t *args, size_t max, const char *fmt, va_list ap)
+{
+	size_t off = 0;
+	size_t len;
+	int stars;
+
+	for (const char *p = fmt; (p = strchr(p, '%')) != NULL; p += len) {
+		int type = _conversion(p, &len, &stars);
+		if ((type == ARG_OTHER) || (len >= SPEC_MAX) || (stars > 2)) {
+			return -1;
+		}
+
+		while (stars--) {
+			PACK(int, va_arg(ap, int));
+		}
+
+		switch (type) {
+		case ARG_INT:
+			PACK(int, va_arg(ap, int));
+			break;
+		case ARG_LONG:
+			PACK(long, va_arg(ap, long));
+			break;
+		case ARG_LLONG:
+			PACK(long long, va_arg(ap, long long));
+			break;
+		case ARG_SIZE:
+			PACK(size_t, va_arg(ap, size_t));
+			break;
+		case ARG_PTR:
+			PACK(void *, va_arg(ap, void *));
+			break;
+		case ARG_DOUBLE:
+			PACK(double, va_arg(ap, double));
+			break;
+		case ARG_STR: {
+			const char *s = va_arg(ap, const char *);
+			if (s == NULL) {
+				s = "(null)";
+			}
+			size_t n = strnlen(s, CONFIG_LOG_DEFERRED_STR_MAX + 1u);
+			if ((n > CONFIG_LOG_DEFERRED_STR_MAX) ||
+			    (off + n + 1u > max)) {
+				return -1;
+			}
+			memcpy(&args[off], s, n);
+			args[off + n] = '\0';
+			off += n + 1u;
+			break;
+		}
+		default:
+			break;
+		}
 	}
 
-	const char *color_prefix = "";
-	const char *level_prefix = "";
-	if (log->module->color) {
+	return off;
+}
+
+#define UNPACK(_type)							\
+	({								\
+		_type _v;						\
+		memcpy(&_v, &args[off], sizeof(_v));			\
+		off += sizeof(_v);					\
+		_v;							\
+	})
+
+/* snprintf() for a single conversion with up to two '*' arguments */
+#define FORMAT_ONE(_val)						\
+	((stars == 2) ? snprintf(dst, room, spec, star[0], star[1], _val) : \
+	 (stars == 1) ? snprintf(dst, room, spec, star[0], _val) :	\
+			snprintf(dst, room, spec, _val))
+
+static size_t _unpack(char *line, size_t len, const char *fmt,
+		      const uint8_t *args)
+{
+	char spec[SPEC_MAX];
+	size_t off = 0;
+	size_t n;
+	int stars;
+	int star[2] = {0, 0};
+
+	for (const char *p = fmt; *p && (len < LOG_LINE_LEN); p += n) {
+		const char *pct = strchr(p, '%');
+		if (pct != p) {
+			/* literal text up to the next conversion */
+			n = (pct != NULL) ? (size_t)(pct - p) : strlen(p);
+			size_t room = LOG_LINE_LEN - len;
+			memcpy(&line[len], p, (n < room) ? n : room);
+			len += (n < room) ? n : room;
+			continue;
+		}
+
+		int type = _conversion(p, &n, &stars);
+		for (int i = 0; i < stars; i++) {
+			star[i & 1] = UNPACK(int);
+		}
+		if ((n >= sizeof(spec)) || (stars > 2)) {
+			/* not worth supporting, the arguments are out of
+			 * sync from here on */
+			break;
+		}
+		memcpy(spec, p, n);
+		spec[n] = '\0';
 
-		switch (log->level) {
-		case LOG_LEVEL_ERR:
-			color_prefix = LOG_COLOR_ERR;
-			level_prefix = "err";
+		char *dst = &line[len];
+		size_t room = LOG_LINE_LEN + 1u - len;
+		int res;
+		switch (type) {
+		case ARG_INT:
+			res = FORMAT_ONE(UNPACK(int));
+			break;
+		case ARG_LONG:
+			res = FORMAT_ONE(UNPACK(long));
 			break;
-		case LOG_LEVEL_WRN:
-			level_prefix = "wrn";
-			color_prefix = LOG_COLOR_WRN;
+		case ARG_LLONG:
+			res = FORMAT_ONE(UNPACK(long long));
 			break;
-		case LOG_LEVEL_INF:
-			level_prefix = "inf";
+		case ARG_SIZE:
+			res = FORMAT_ONE(UNPACK(size_t));
 			break;
-		case LOG_LEVEL_DBG:
-			level_prefix = "dbg";
+		case ARG_PTR:
+			res = FORMAT_ONE(UNPACK(void *));
 			break;
-		case LOG_LEVEL_VERBOSE:
-			level_prefix = "vrb";
+		case ARG_DOUBLE:
+			res = FORMAT_ONE(UNPACK(double));
 			break;
+		case ARG_STR: {
+			const char *s = (const char *)&args[off];
+			off += strlen(s) + 1u;
+			res = FORMAT_ONE(s);
+			break;
+		}
 		default:
+			res = snprintf(dst, room, spec);
 			break;
 		}
+		len = _clamp(len, res, LOG_LINE_LEN);
+	}
+
+	return len;
+}
+
+static void _process(void);
+
+static bool _log_defer(const struct log_line *log, const char *fmt,
+		       va_list args)
+{
+	uint32_t buf[CONFIG_LOG_DEFERRED_MSG_MAX / sizeof(uint32_t)];
+	struct log_msg *msg = (struct log_msg *)buf;
 
-		printf(color_prefix);
+	int len = _pack(msg->args, MSG_ARGS_MAX, fmt, args);
+	if (len < 0) {
+		/* too many or too long arguments, format right away */
+		return false;
 	}
 
-	/* Write prefix */
-	printf("%s<%s %s", color_prefix, level_prefix,  log->module->name);
+	msg->module = log->module;
+	msg->func = log->func;
+	msg->fmt = fmt;
+	msg->level = log->level;
 
-	if (log->level == LOG_LEVEL_DBG) {
-		printf(".%s", log->func);
+	len += offsetof(struct log_msg, args);
+
+	/* a task that outruns the log task formats the backlog itself, which
+	 * keeps the order, interrupts cannot wait and drop the message */
+	if ((OSIntNestingCtr == 0u) &&
+	    (sizeof(_ring_buf) - log_ring_used(&_ring) < len + 8u)) {
+		_process();
 	}
+	log_ring_put(&_ring, msg, len);
 
-	printf("> ");
+	return true;
+}
 
-	/* Write log message */
-	vprintf(fmt, args);
+/* formats everything queued so far, one consumer at a time */
+static void _process(void)
+{
+	OS_ERR err;
+	uint32_t buf[CONFIG_LOG_DEFERRED_MSG_MAX / sizeof(uint32_t)];
+	const struct log_msg *msg = (const struct log_msg *)buf;
+	char line[CONFIG_LOG_LINE_MAX];
 
-	/* Write suffix */
-	if (log->module->color) {
-		printf(LOG_COLOR_RESET "\n");
-	} else {
-		printf("\n");
+	OSMutexPend(&_log_mutex, 0, OS_OPT_PEND_BLOCKING, NULL, &err);
+	if (err != OS_ERR_NONE) {
+		/* e.g. the scheduler is locked, the log task may be halfway
+		 * through a pop and the ring has a single consumer */
+		return;
+	}
+	while (log_ring_pop(&_ring, buf, sizeof(buf)) != 0) {
+		size_t len = _prefix(line, msg->module, msg->level, msg->func);
+		len = _unpack(line, len, msg->fmt, msg->args);
+		_output(msg->module, msg->level, line, len);
+	}
+	OSMutexPost(&_log_mutex, OS_OPT_POST_NONE, &err);
+}
+
+static void _log_task(void *p_arg)
+{
+	OS_ERR err;
+	(void)p_arg;
+
+	for (;;) {
+		/* there is no wakeup per message, the period bounds the
+		 * latency */
+		OSTimeDly(LOG_PERIOD_TICKS, OS_OPT_TIME_DLY, &err);
+		_process();
+	}
+}
+
+void log_flush(void)
+{
+	if (_running) {
+		_process();
+	}
+}
+
+unsigned int log_dropped(void)
+{
+	return _ring.dropped + _dropped;
+}
+
+int log_init(void)
+{
+	OS_ERR err;
+	int ret;
+
+	if ((ret = log_ring_init(&_ring, _ring_buf, sizeof(_ring_buf)))) {
+		return ret;
+	}
+
+	OSMutexCreate(&_log_mutex, "log", &err);
+	if (err != OS_ERR_NONE) {
+		return -1;
+	}
+
+	OSTaskCreate(&_log_tcb, "log", _log_task, NULL,
+		     CONFIG_LOG_DEFERRED_TASK_PRIO, &_log_stack[0],
+		     CONFIG_LOG_DEFERRED_TASK_STACK_SIZE / 10u,
+		     CONFIG_LOG_DEFERRED_TASK_STACK_SIZE, 0, 0, NULL,
+		     OS_OPT_TASK_STK_CHK + OS_OPT_TASK_STK_CLR, &err);
+	if (err != OS_ERR_NONE) {
+		return -1;
 	}
 
+	_running = true;
+	return 0;
+}
+
+#else
+
+void log_flush(void)
+{
+}
+
+unsigned int log_dropped(void)
+{
+	return 0;
+}
+
+int log_init(void)
+{
+	return 0;
+}
+
+#endif /* CONFIG_LOG_DEFERRED */
+
+int _log_print(const struct log_line *log,
+	       const char *__restrict__ fmt,
+	       ...)
+{
+	if (log->level > log->module->level) {
+		return -1;
+	}
+
+	va_list args;
+	va_start(args, fmt);
+
+#if CONFIG_LOG_DEFERRED
+	if (_running && log->module->deferred) {
+		/* the copy keeps args intact for the fallback below */
+		va_list copy;
+		va_copy(copy, args);
+		bool deferred = _log_defer(log, fmt, copy);
+		va_end(copy);
+		if (deferred) {
+			va_end(args);
+			return 0;
+		}
+		if (OSIntNestingCtr > 0u) {
+			/* printing here would overtake the queued messages */
+			__atomic_fetch_add(&_dropped, 1, __ATOMIC_RELAXED);
+			va_end(args);
+			return -1;
+		}
+	}
+	if (_running && (OSIntNestingCtr == 0u)) {
+		/* the queued messages go out first, which keeps the order */
+		_process();
+	}
+#endif
+
+	_log_vprint(log->module, log->level, log->func, fmt, args);
+
 	va_end(args);
 
 	return 0;
-}
\ No newline at end of file
+}
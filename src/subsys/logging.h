@@ -69,10 +69,37 @@
 #define LOG_LEVEL_VERBOSE 5
 #define LOG_LEVEL_ALL LOG_LEVEL_VERBOSE
 
+/* longest line handed to the backend, longer messages are cut */
+#define CONFIG_LOG_LINE_MAX 128
+
+/* Deferred mode: LOG() only copies the format string pointer and the
+ * arguments into a ring, a low priority task formats them later */
+#ifndef CONFIG_LOG_DEFERRED
+#define CONFIG_LOG_DEFERRED 1
+#endif
+
+/* bytes of queued messages, a power of two */
+#define CONFIG_LOG_DEFERRED_RING_SIZE 2048
+
+/* largest queued message, bigger ones are formatted right away */
+#define CONFIG_LOG_DEFERRED_MSG_MAX 64
+
+/* %s arguments are copied, messages with a longer one, a long double or
+ * another conversion that can't be copied are formatted right away after
+ * the queued ones, or dropped in an interrupt */
+#define CONFIG_LOG_DEFERRED_STR_MAX 24
+
+/* delay between two passes of the log task */
+#define CONFIG_LOG_DEFERRED_PERIOD_MS 20
+
+#define CONFIG_LOG_DEFERRED_TASK_PRIO ((OS_PRIO)(OS_CFG_PRIO_MAX - 6u))
+#define CONFIG_LOG_DEFERRED_TASK_STACK_SIZE 0x200
+
 struct log_module {
 	const char *name;
 	int level;
 	bool color;
+	bool deferred;
 };
 
 struct log_line
@@ -85,12 +112,29 @@ struct log_line
 
 #define LOG_MODULE_REGISTER(_name, _level) \
 	static const struct log_module _log_module = \
-		{ .name = #_name, .level = _level, .color = CONFIG_LOG_COLOR_ENABLED } \
+		{ .name = #_name, .level = _level, .color = CONFIG_LOG_COLOR_ENABLED, \
+		  .deferred = CONFIG_LOG_DEFERRED } \
 
 int _log_print(const struct log_line *log,
 	       const char *__restrict__ fmt,
 	       ...);
 
+/* receives every printed line without colors, terminated by '\n'
+ * must not block, it is called from the task that logs */
+typedef void (*log_backend_t)(const char *line, size_t len);
+
+void log_backend_set(log_backend_t backend);
+
+/* starts the deferred log task, messages are formatted in place until then */
+int log_init(void);
+
+/* formats every queued message before returning */
+void log_flush(void);
+
+/* messages lost because the deferred ring was full, or because an interrupt
+ * logged one that can't be deferred */
+unsigned int log_dropped(void);
+
 #define LOG(_level, _fmt, ...) \
 	if ((_level) <= (_log_module.level)) { \
 		_log_print(&((const struct log_line) { \
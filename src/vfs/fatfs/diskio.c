@@ -13,7 +13,11 @@
 
 #include "diskio.h" /* Declarations of disk functions */
 
-extern ramdisk_t *fat_disk;
+extern ramdisk_t *fatfs_disks[FF_VOLUMES];
+
+static ramdisk_t *_disk(BYTE pdrv) {
+  return pdrv < FF_VOLUMES ? fatfs_disks[pdrv] : NULL;
+}
 
 /*-----------------------------------------------------------------------*/
 /* Get Drive Status                                                      */
@@ -22,7 +26,7 @@ extern ramdisk_t *fat_disk;
 DSTATUS
 disk_status(BYTE pdrv /* Physical drive nmuber to identify the drive */
 ) {
-  return 0;
+  return _disk(pdrv) ? 0 : STA_NOINIT;
 }
 
 /*-----------------------------------------------------------------------*/
@@ -32,7 +36,7 @@ disk_status(BYTE pdrv /* Physical drive nmuber to identify the drive */
 DSTATUS
 disk_initialize(BYTE pdrv /* Physical drive nmuber to identify the drive */
 ) {
-  return 0;
+  return _disk(pdrv) ? 0 : STA_NOINIT;
 }
 
 /*-----------------------------------------------------------------------*/
@@ -44,8 +48,12 @@ DRESULT disk_read(BYTE pdrv,  /* Physical drive nmuber to identify the drive */
                   LBA_t sector, /* Start sector in LBA */
                   UINT count    /* Number of sectors to read */
 ) {
-  int res =
-      ramdisk_read(fat_disk, buff, sector, 0, count * CONFIG_RAM_SEC_SIZE);
+  ramdisk_t *disk = _disk(pdrv);
+  if (disk == NULL) {
+    return RES_NOTRDY;
+  }
+
+  int res = ramdisk_read(disk, buff, sector, 0, count * CONFIG_RAM_SEC_SIZE);
   if (res < 0) {
     return RES_ERROR;
   }
@@ -63,8 +71,12 @@ DRESULT disk_write(BYTE pdrv, /* Physical drive nmuber to identify the drive */
                    LBA_t sector,     /* Start sector in LBA */
                    UINT count        /* Number of sectors to write */
 ) {
-  int res =
-      ramdisk_write(fat_disk, buff, sector, 0, count * CONFIG_RAM_SEC_SIZE);
+  ramdisk_t *disk = _disk(pdrv);
+  if (disk == NULL) {
+    return RES_NOTRDY;
+  }
+
+  int res = ramdisk_write(disk, buff, sector, 0, count * CONFIG_RAM_SEC_SIZE);
   if (res < 0) {
     return RES_ERROR;
   }
@@ -97,6 +109,20 @@ DRESULT disk_ioctl(BYTE pdrv, /* Physical drive nmuber (0..) */
     *((DWORD *)buff) = 1;
     return RES_OK;
 
+  case CTRL_TRIM: {
+    /* inclusive sector range, a sparse disk frees the storage */
+    const LBA_t *lba = buff;
+    ramdisk_t *disk = _disk(pdrv);
+    if (disk == NULL || lba[1] < lba[0]) {
+      return RES_PARERR;
+    }
+    size_t sz = (size_t)(lba[1] - lba[0] + 1) * CONFIG_RAM_SEC_SIZE;
+    if (ramdisk_trim(disk, (size_t)lba[0] * CONFIG_RAM_SEC_SIZE, sz) < 0) {
+      return RES_ERROR;
+    }
+    return RES_OK;
+  }
+
   default:
     return RES_PARERR;
   }
@@ -1,9 +1,12 @@
+#include <ctype.h>
 #include <errno.h>
+#include <stdbool.h>
 #include <string.h>
 #include <fcntl.h>
 
 #include "inttypes.h"
 #include "logging.h"
+#include "mem.h"
 #include "mutex.h"
 #include "printf.h"
 #include "ramdisk.h"
@@ -14,25 +17,87 @@
 LOG_MODULE_REGISTER(fatfs, LOG_LEVEL_INF);
 
 static mutex_t work_mtx;
+/* sector sized work area of f_mkfs and of the defragmenter, see work_mtx */
+static BYTE work[FF_MAX_SS];
 
 #define TEST_FATFS_MAX_VOL_STR_LEN 14 /* "-2147483648:/\0" */
 
 static int fatfs_err_to_errno(int32_t err);
 static void _fatfs_time_to_timespec(WORD fdate, WORD ftime, time_t *time);
+#if CONFIG_FATFS_VFS_DEFRAG
+static int _defrag_recover(fatfs_desc_t *fs_desc);
+static void _defrag_cancel(fatfs_desc_t *fs_desc, const char *path);
+static void _relocate_abort(fatfs_desc_t *fs_desc);
+#endif
+
+/* block device of each FatFs volume, indexed by pdrv */
+ramdisk_t *fatfs_disks[FF_VOLUMES];
 
-ramdisk_t *fat_disk;
+static mutex_t _vol_mtx;
 
-static void _build_abs_path(fatfs_desc_t *fs_desc, const char *name) {
-  snprintf(fs_desc->abs_path_str_buff, FATFS_MAX_ABS_PATH_SIZE, "/%s", name);
+static inline void _open_lock(fatfs_desc_t *fs_desc) {
+#if CONFIG_FATFS_VFS_DEFRAG
+  mutex_lock(&fs_desc->open_lock);
+#else
+  (void)fs_desc;
+#endif
 }
 
+static inline void _open_unlock(fatfs_desc_t *fs_desc) {
+#if CONFIG_FATFS_VFS_DEFRAG
+  mutex_unlock(&fs_desc->open_lock);
+#else
+  (void)fs_desc;
+#endif
+}
+
+/* FatFs paths carry the volume, e.g. "1:/dir/file", the caller provides the
+ * buffer so that no two calls share it */
+static int _build_abs_path(const fatfs_desc_t *fs_desc, const char *name,
+                           char buf[FATFS_MAX_ABS_PATH_SIZE]) {
+  int len =
+      snprintf(buf, FATFS_MAX_ABS_PATH_SIZE, "%u:%s", fs_desc->vol_idx, name);
+  if (len < 0 || len >= FATFS_MAX_ABS_PATH_SIZE) {
+    return -ENAMETOOLONG;
+  }
+  return 0;
+}
+
+/* bind the disk of the mount to a FatFs volume, returns 1 if it took a free
+ * slot, 0 if the disk was bound already */
 static int _init(vfs_mount_t *mountp) {
-  fat_disk = ramdisk_open(mountp->dno);
-  if (fat_disk) {
-    return 0;
+  fatfs_desc_t *fs_desc = mountp->private_data;
+  ramdisk_t *disk = ramdisk_open(mountp->dno);
+  int ret = -ENOMEM;
+
+  if (disk == NULL) {
+    return -EINVAL;
+  }
+
+  mutex_lock(&_vol_mtx);
+  for (unsigned i = 0; i < FF_VOLUMES; i++) {
+    if (fatfs_disks[i] == disk) {
+      fs_desc->vol_idx = i;
+      ret = 0;
+      break;
+    }
   }
+  for (unsigned i = 0; ret < 0 && i < FF_VOLUMES; i++) {
+    if (fatfs_disks[i] == NULL) {
+      fatfs_disks[i] = disk;
+      fs_desc->vol_idx = i;
+      ret = 1;
+    }
+  }
+  mutex_unlock(&_vol_mtx);
 
-  return -EINVAL;
+  return ret;
+}
+
+static void _deinit(fatfs_desc_t *fs_desc) {
+  mutex_lock(&_vol_mtx);
+  fatfs_disks[fs_desc->vol_idx] = NULL;
+  mutex_unlock(&_vol_mtx);
 }
 
 #ifdef MODULE_FATFS_VFS_FORMAT
@@ -40,24 +105,29 @@ static int _format(vfs_mount_t *mountp) {
   fatfs_desc_t *fs_desc = mountp->private_data;
   char volume_str[TEST_FATFS_MAX_VOL_STR_LEN];
 
-  static BYTE work[FF_MAX_SS];
-  mutex_lock(&work_mtx);
-
   /* make sure the volume has been initialized */
-  if (_init(mountp)) {
+  int bound = _init(mountp);
+  if (bound < 0) {
     return -EINVAL;
   }
 
   const MKFS_PARM param = {
       .fmt = CONFIG_FATFS_FORMAT_TYPE,
+      .au_size = fs_desc->au_size,
   };
 
   snprintf(volume_str, sizeof(volume_str), "%u:/", fs_desc->vol_idx);
 
+  /* f_mkfs is not reentrant and the work area is shared */
+  mutex_lock(&work_mtx);
   FRESULT res = f_mkfs(volume_str, &param, work, FF_MAX_SS);
-
   mutex_unlock(&work_mtx);
 
+  /* only a mounted volume keeps its slot */
+  if (bound) {
+    _deinit(fs_desc);
+  }
+
   return fatfs_err_to_errno(res);
 }
 #endif
@@ -65,30 +135,58 @@ static int _format(vfs_mount_t *mountp) {
 static int _mount(vfs_mount_t *mountp) {
 
   fatfs_desc_t *fs_desc = (fatfs_desc_t *)mountp->private_data;
+  char path[FATFS_MAX_ABS_PATH_SIZE];
 
-  if (_init(mountp)) {
-    LOG_DBG("can't find free slot in fatfs_mtd_devs\n");
+  if (_init(mountp) < 0) {
+    LOG_DBG("can't find free slot in fatfs_disks\n");
     return -ENOMEM;
   }
 
-  _build_abs_path(fs_desc, "");
+  _build_abs_path(fs_desc, "", path);
 
   memset(&fs_desc->fat_fs, 0, sizeof(fs_desc->fat_fs));
 
-  FRESULT res = f_mount(&fs_desc->fat_fs, fs_desc->abs_path_str_buff, 1);
+  FRESULT res = f_mount(&fs_desc->fat_fs, path, 1);
+  if (res != FR_OK) {
+    /* f_mount registers the volume even if it fails to mount it */
+    f_unmount(path);
+    _deinit(fs_desc);
+  }
+#if CONFIG_FATFS_VFS_DEFRAG
+  /* the volume is usable anyway, the next pass tries again */
+  if (res == FR_OK && _defrag_recover(fs_desc) < 0) {
+    LOG_DBG("fatfs_vfs.c: defrag recovery failed\n");
+  }
+#endif
 
   return fatfs_err_to_errno(res);
 }
 
 static int _umount(vfs_mount_t *mountp) {
   fatfs_desc_t *fs_desc = mountp->private_data;
+  char path[FATFS_MAX_ABS_PATH_SIZE];
 
-  _build_abs_path(fs_desc, "");
+  _build_abs_path(fs_desc, "", path);
 
-  FRESULT res = f_unmount(fs_desc->abs_path_str_buff);
+#if CONFIG_FATFS_VFS_DEFRAG
+  /* the copy is dropped, the next pass starts over */
+  mutex_lock(&work_mtx);
+  _relocate_abort(fs_desc);
+  mutex_unlock(&work_mtx);
+#endif
+
+  FRESULT res = f_unmount(path);
 
   if (res == FR_OK) {
     memset(&fs_desc->fat_fs, 0, sizeof(fs_desc->fat_fs));
+    _deinit(fs_desc);
+#if CONFIG_FATFS_VFS_DEFRAG
+    /* the directories of an unfinished pass are gone with the volume */
+    memset(&fs_desc->defrag, 0, sizeof(fs_desc->defrag));
+    _open_lock(fs_desc);
+    fs_desc->open_files = NULL;
+    _open_unlock(fs_desc);
+#endif
   }
 
   return fatfs_err_to_errno(res);
@@ -96,43 +194,575 @@ static int _umount(vfs_mount_t *mountp) {
 
 static int _unlink(vfs_mount_t *mountp, const char *name) {
   fatfs_desc_t *fs_desc = (fatfs_desc_t *)mountp->private_data;
+  char path[FATFS_MAX_ABS_PATH_SIZE];
 
-  _build_abs_path(fs_desc, name);
+  int ret = _build_abs_path(fs_desc, name, path);
+  if (ret) {
+    return ret;
+  }
+
+  _open_lock(fs_desc);
+  FRESULT res = f_unlink(path);
+#if CONFIG_FATFS_VFS_DEFRAG
+  _defrag_cancel(fs_desc, path);
+#endif
+  _open_unlock(fs_desc);
 
-  return fatfs_err_to_errno(f_unlink(fs_desc->abs_path_str_buff));
+  return fatfs_err_to_errno(res);
 }
 
 static int _rename(vfs_mount_t *mountp, const char *from_path,
                    const char *to_path) {
+  char fatfs_abs_path_from[FATFS_MAX_ABS_PATH_SIZE];
   char fatfs_abs_path_to[FATFS_MAX_ABS_PATH_SIZE];
   fatfs_desc_t *fs_desc = (fatfs_desc_t *)mountp->private_data;
 
-  _build_abs_path(fs_desc, from_path);
+  int ret = _build_abs_path(fs_desc, from_path, fatfs_abs_path_from);
+  if (ret) {
+    return ret;
+  }
+  /* f_rename takes the volume from the first path only */
+  if (strlen(to_path) >= sizeof(fatfs_abs_path_to)) {
+    return -ENAMETOOLONG;
+  }
+  strcpy(fatfs_abs_path_to, to_path);
 
-  snprintf(fatfs_abs_path_to, sizeof(fatfs_abs_path_to), "%u:/%s",
-           fs_desc->vol_idx, to_path);
+  _open_lock(fs_desc);
+  FRESULT res = f_rename(fatfs_abs_path_from, fatfs_abs_path_to);
+#if CONFIG_FATFS_VFS_DEFRAG
+  /* renaming a directory moves the file being copied as well */
+  _defrag_cancel(fs_desc, NULL);
+#endif
+  _open_unlock(fs_desc);
 
-  return fatfs_err_to_errno(
-      f_rename(fs_desc->abs_path_str_buff, fatfs_abs_path_to));
+  return fatfs_err_to_errno(res);
+}
+
+static int _gc(vfs_mount_t *mountp, const vfs_gc_t *gc) {
+  fatfs_desc_t *fs_desc = (fatfs_desc_t *)mountp->private_data;
+  FATFS *fs = &fs_desc->fat_fs;
+  (void)gc;
+
+  if (fs->free_clst <= fs->n_fatent - 2) {
+    /* free cluster count is known, nothing to recount */
+#if CONFIG_FATFS_VFS_DEFRAG && CONFIG_FATFS_VFS_DEFRAG_GC_TICKS
+    return fatfs_defrag(mountp, CONFIG_FATFS_VFS_DEFRAG_GC_TICKS);
+#else
+    return 0;
+#endif
+  }
+
+  /* count the free clusters now rather than in the first foreground
+   * f_getfree() call after mount */
+  char path[FATFS_MAX_ABS_PATH_SIZE];
+  DWORD nclst;
+  FATFS *fsp;
+  _build_abs_path(fs_desc, "", path);
+  FRESULT res = f_getfree(path, &nclst, &fsp);
+
+  return res == FR_OK ? 1 : fatfs_err_to_errno(res);
 }
 
 static fatfs_file_desc_t *_get_fatfs_file_desc(vfs_file_t *f) {
-  /* the private buffer is part of a union that also contains a
-   * void pointer, hence, it is naturally aligned */
-  return (fatfs_file_desc_t *)(uintptr_t)f->private_data.buffer;
+  return f->private_data.ptr;
+}
+
+#if CONFIG_FATFS_VFS_DEFRAG
+/* 8.3 names are case insensitive */
+static bool _same_path(const char *a, const char *b) {
+  for (; *a && *b; a++, b++) {
+    if (toupper((unsigned char)*a) != toupper((unsigned char)*b)) {
+      return false;
+    }
+  }
+  return *a == *b;
 }
 
+/* with open_lock held, close takes the file off the list before the VFS
+ * frees it */
+static bool _is_open(const fatfs_desc_t *fs_desc, const char *path) {
+  for (const fatfs_file_desc_t *fd = fs_desc->open_files; fd; fd = fd->next) {
+    if (_same_path(fd->fname, path)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/* "n:/dir/name" to "n:/dir/other" */
+static int _sibling(char *buf, size_t size, const char *path,
+                    const char *other) {
+  const char *sep = strrchr(path, '/');
+  int len = sep ? (int)(sep - path) : 0;
+
+  if (snprintf(buf, size, "%.*s/%s", len, path, other) >= (int)size) {
+    return -ENAMETOOLONG;
+  }
+  return 0;
+}
+
+/* record the path of the file the copy replaces, without the volume which
+ * may differ at the next mount */
+static FRESULT _log_write(const char *log, const char *path) {
+  const char *name = strchr(path, ':') + 1;
+  UINT len = strlen(name);
+  FIL fp;
+  UINT bw;
+
+  FRESULT res = f_open(&fp, log, FA_WRITE | FA_CREATE_ALWAYS);
+  if (res != FR_OK) {
+    return res;
+  }
+  res = f_write(&fp, name, len, &bw);
+  FRESULT close_res = f_close(&fp);
+  if (res == FR_OK && bw != len) {
+    res = FR_DENIED;
+  }
+  return res == FR_OK ? close_res : res;
+}
+
+/* finish or undo the swap the log records, the copy is complete once the log
+ * exists */
+static int _defrag_recover(fatfs_desc_t *fs_desc) {
+  char log[FATFS_MAX_ABS_PATH_SIZE];
+  char name[FATFS_MAX_ABS_PATH_SIZE];
+  char path[FATFS_MAX_ABS_PATH_SIZE];
+  char tmp[FATFS_MAX_ABS_PATH_SIZE];
+  FILINFO fi;
+  FIL fp;
+  UINT br = 0;
+
+  _build_abs_path(fs_desc, "/" FATFS_DEFRAG_LOG_NAME, log);
+  FRESULT res = f_open(&fp, log, FA_READ);
+  if (res == FR_NO_FILE) {
+    return 0;
+  }
+  if (res != FR_OK) {
+    return fatfs_err_to_errno(res);
+  }
+  res = f_read(&fp, name, sizeof(name) - 1, &br);
+  f_close(&fp);
+  if (res != FR_OK) {
+    return fatfs_err_to_errno(res);
+  }
+  name[br] = '\0';
+
+  _open_lock(fs_desc);
+  if (name[0] == '/' && _build_abs_path(fs_desc, name, path) == 0 &&
+      _sibling(tmp, sizeof(tmp), path, FATFS_DEFRAG_TMP_NAME) == 0) {
+    res = f_stat(path, &fi);
+    if (res == FR_NO_FILE) {
+      /* unlinked, the copy takes its name */
+      LOG_DBG("fatfs_vfs.c: defrag recovers %s\n", path);
+      res = f_rename(tmp, path);
+    } else if (res == FR_OK) {
+      /* not unlinked yet or already replaced */
+      res = f_unlink(tmp);
+      res = res == FR_NO_FILE ? FR_OK : res;
+    }
+  }
+  if (res == FR_OK) {
+    res = f_unlink(log);
+  }
+  _open_unlock(fs_desc);
+
+  return fatfs_err_to_errno(res);
+}
+
+/* number of fragments of the chain of an open file */
+static int _fragments(FIL *fp) {
+  /* too small on purpose, FatFs still reports the size it needs */
+  DWORD tbl[4] = {ARRAY_SIZE(tbl)};
+
+  fp->cltbl = tbl;
+  FRESULT res = f_lseek(fp, CREATE_LINKMAP);
+  fp->cltbl = NULL;
+  if (res != FR_OK && res != FR_NOT_ENOUGH_CORE) {
+    return fatfs_err_to_errno(res);
+  }
+  return (int)(tbl[0] - 2) / 2;
+}
+
+/* with open_lock held, drop the copy of path, of any file if path is NULL */
+static void _defrag_cancel(fatfs_desc_t *fs_desc, const char *path) {
+  fatfs_defrag_t *d = &fs_desc->defrag;
+
+  if (d->copying && (path == NULL || _same_path(d->file, path))) {
+    d->cancel = 1;
+  }
+}
+
+/* check the file and start copying it into a contiguous run, the copy goes
+ * on sector by sector in _relocate_step() */
+static int _relocate_begin(fatfs_desc_t *fs_desc, const char *path,
+                           const FILINFO *fi) {
+  fatfs_defrag_t *d = &fs_desc->defrag;
+  fatfs_defrag_report_t *report = &d->stats.cur;
+  char tmp[FATFS_MAX_ABS_PATH_SIZE];
+  FRESULT res;
+
+  int ret = _sibling(tmp, sizeof(tmp), path, FATFS_DEFRAG_TMP_NAME);
+  if (ret) {
+    return ret;
+  }
+
+  if ((res = f_open(&d->src, path, FA_READ)) != FR_OK) {
+    return fatfs_err_to_errno(res);
+  }
+  int frags = _fragments(&d->src);
+  if (frags < 0) {
+    f_close(&d->src);
+    return frags;
+  }
+  report->files++;
+  report->fragments += frags;
+  if ((uint32_t)frags > report->max_fragments) {
+    report->max_fragments = frags;
+  }
+  if (frags <= 1) {
+    f_close(&d->src);
+    return 0;
+  }
+  report->fragmented++;
+
+  /* the copy would lose the attributes, the open file would keep using the
+   * freed chain. An existing copy may be all that is left of an interrupted
+   * relocation */
+  _open_lock(fs_desc);
+  if ((fi->fattrib & (AM_RDO | AM_HID | AM_SYS)) || _is_open(fs_desc, path)) {
+    res = FR_DENIED;
+  } else if ((res = f_open(&d->dst, tmp, FA_WRITE | FA_CREATE_NEW)) ==
+                 FR_OK &&
+             (res = f_expand(&d->dst, f_size(&d->src), 1)) != FR_OK) {
+    f_close(&d->dst);
+    f_unlink(tmp);
+  }
+  if (res == FR_OK) {
+    strcpy(d->file, path);
+    d->fi = *fi;
+    d->copying = 1;
+    d->cancel = 0;
+  }
+  _open_unlock(fs_desc);
+
+  if (res == FR_OK) {
+    return 0;
+  }
+  f_close(&d->src);
+  if (res == FR_DENIED || res == FR_EXIST) {
+    /* no contiguous run large enough or a leftover copy */
+    LOG_DBG("fatfs_vfs.c: defrag %s: %d\n", path, res);
+    report->skipped++;
+    return 0;
+  }
+  return fatfs_err_to_errno(res);
+}
+
+/* close the copy and replace the file with it if the copy is complete,
+ * returns 1 if the file was relocated, 0 if it was left in place */
+static int _relocate_end(fatfs_desc_t *fs_desc, FRESULT res) {
+  fatfs_defrag_t *d = &fs_desc->defrag;
+  char tmp[FATFS_MAX_ABS_PATH_SIZE];
+  char log[FATFS_MAX_ABS_PATH_SIZE];
+  FILINFO now;
+
+  FRESULT close_res = f_close(&d->dst);
+  if (res == FR_OK) {
+    res = close_res;
+  }
+  f_close(&d->src);
+  _sibling(tmp, sizeof(tmp), d->file, FATFS_DEFRAG_TMP_NAME);
+  _build_abs_path(fs_desc, "/" FATFS_DEFRAG_LOG_NAME, log);
+
+  /* held until the copy replaced the file, nothing opens, renames or unlinks
+   * it meanwhile. The entry must still be the one that was copied */
+  _open_lock(fs_desc);
+  if (res == FR_OK && (d->cancel || _is_open(fs_desc, d->file))) {
+    res = FR_DENIED;
+  }
+  if (res == FR_OK && ((res = f_stat(d->file, &now)) != FR_OK ||
+                       now.fsize != d->fi.fsize || now.fdate != d->fi.fdate ||
+                       now.ftime != d->fi.ftime)) {
+    res = res == FR_OK ? FR_DENIED : res;
+  }
+  if (res != FR_OK) {
+    f_unlink(tmp);
+  }
+
+  /* from here on the log lets mount finish an interrupted swap */
+  if (res == FR_OK && (res = _log_write(log, d->file)) != FR_OK) {
+    f_unlink(tmp);
+    f_unlink(log);
+  }
+  if (res == FR_OK && (res = f_unlink(d->file)) == FR_OK &&
+      (res = f_rename(tmp, d->file)) == FR_OK) {
+    res = f_unlink(log);
+  }
+  if (res == FR_OK) {
+    strcpy(d->moved, d->file);
+  }
+  d->copying = 0;
+  d->cancel = 0;
+  _open_unlock(fs_desc);
+
+  if (res == FR_DENIED) {
+    /* a changed file */
+    LOG_DBG("fatfs_vfs.c: defrag %s: %d\n", d->file, res);
+    d->stats.cur.skipped++;
+    return 0;
+  }
+  if (res != FR_OK) {
+    return fatfs_err_to_errno(res);
+  }
+  d->stats.cur.moved++;
+  return 1;
+}
+
+/* copy one more sector, same return as _relocate_end() */
+static int _relocate_step(fatfs_desc_t *fs_desc) {
+  fatfs_defrag_t *d = &fs_desc->defrag;
+  UINT br = 0;
+  UINT bw;
+
+  _open_lock(fs_desc);
+  FRESULT res = d->cancel ? FR_DENIED : FR_OK;
+  _open_unlock(fs_desc);
+
+  if (res == FR_OK) {
+    res = f_read(&d->src, work, sizeof(work), &br);
+  }
+  if (res == FR_OK && br > 0) {
+    res = f_write(&d->dst, work, br, &bw);
+    if (res == FR_OK && bw == br) {
+      return 0;
+    }
+    res = res == FR_OK ? FR_DENIED : res;
+  }
+  return _relocate_end(fs_desc, res);
+}
+
+/* with work_mtx held, drop an unfinished copy */
+static void _relocate_abort(fatfs_desc_t *fs_desc) {
+  fatfs_defrag_t *d = &fs_desc->defrag;
+
+  if (d->copying) {
+    _open_lock(fs_desc);
+    d->cancel = 1;
+    _open_unlock(fs_desc);
+    _relocate_end(fs_desc, FR_DENIED);
+  }
+}
+
+/* end of the directory on top of the stack */
+static void _defrag_pop(fatfs_defrag_t *d) {
+  f_closedir(&d->dirs[--d->depth]);
+  char *sep = strrchr(d->path, '/');
+  if (sep) {
+    *sep = '\0';
+  }
+}
+
+static void _defrag_reset(fatfs_defrag_t *d) {
+  while (d->depth) {
+    _defrag_pop(d);
+  }
+}
+
+int fatfs_defrag(vfs_mount_t *mountp, OS_TICK budget) {
+  fatfs_desc_t *fs_desc = mountp->private_data;
+  fatfs_defrag_t *d = &fs_desc->defrag;
+  char path[FATFS_MAX_ABS_PATH_SIZE];
+  OS_ERR err;
+  FILINFO fi;
+  FRESULT res;
+  int moved = 0;
+  int ret = 0;
+
+  mutex_lock(&work_mtx);
+
+  if (d->depth == 0) {
+    /* new pass from the root directory, d->path holds "n:" then "n:/DIR" */
+    char root[FATFS_MAX_VOL_STR_LEN];
+    snprintf(d->path, sizeof(d->path), "%u:", fs_desc->vol_idx);
+    snprintf(root, sizeof(root), "%u:/", fs_desc->vol_idx);
+    /* a swap of the previous pass may have failed half way */
+    if ((ret = _defrag_recover(fs_desc)) < 0) {
+      mutex_unlock(&work_mtx);
+      return ret;
+    }
+    if ((res = f_opendir(&d->dirs[0], root)) != FR_OK) {
+      mutex_unlock(&work_mtx);
+      return fatfs_err_to_errno(res);
+    }
+    d->depth = 1;
+    d->moved[0] = '\0';
+    memset(&d->stats.cur, 0, sizeof(d->stats.cur));
+  }
+
+  OS_TICK start = OSTimeGet(&err);
+  bool visited = false;
+  while (d->depth) {
+    if (visited && OSTimeGet(&err) - start >= budget) {
+      break;
+    }
+    if (d->copying) {
+      visited = true;
+      if ((ret = _relocate_step(fs_desc)) < 0) {
+        LOG_DBG("fatfs_vfs.c: defrag %s: %d\n", d->file, ret);
+        _defrag_reset(d);
+        break;
+      }
+      moved += ret;
+      continue;
+    }
+    if ((res = f_readdir(&d->dirs[d->depth - 1], &fi)) != FR_OK) {
+      ret = fatfs_err_to_errno(res);
+      _defrag_reset(d);
+      break;
+    }
+    if (fi.fname[0] == '\0') {
+      _defrag_pop(d);
+      if (d->depth == 0) {
+        d->stats.last = d->stats.cur;
+        d->stats.passes++;
+      }
+      continue;
+    }
+    if (fi.fattrib & AM_DIR) {
+      size_t len = strlen(d->path);
+      if (fi.fname[0] == '.' || d->depth == CONFIG_FATFS_VFS_DEFRAG_DEPTH ||
+          snprintf(d->path + len, sizeof(d->path) - len, "/%s", fi.fname) >=
+              (int)(sizeof(d->path) - len)) {
+        d->path[len] = '\0';
+        continue;
+      }
+      if ((res = f_opendir(&d->dirs[d->depth], d->path)) != FR_OK) {
+        d->path[len] = '\0';
+        continue;
+      }
+      d->depth++;
+      continue;
+    }
+    if (snprintf(path, sizeof(path), "%s/%s", d->path, fi.fname) >=
+        (int)sizeof(path)) {
+      ret = -ENAMETOOLONG;
+      LOG_DBG("fatfs_vfs.c: defrag %s/%s: %d\n", d->path, fi.fname, ret);
+      _defrag_reset(d);
+      break;
+    }
+    if (strcmp(fi.fname, FATFS_DEFRAG_TMP_NAME) == 0) {
+      /* with no log left by _defrag_recover() it is a partial copy */
+      f_unlink(path);
+      continue;
+    }
+    if (strcmp(fi.fname, FATFS_DEFRAG_LOG_NAME) == 0) {
+      continue;
+    }
+    if (_same_path(path, d->moved)) {
+      /* the entry of the file just relocated, listed a second time */
+      continue;
+    }
+    visited = true;
+    if ((ret = _relocate_begin(fs_desc, path, &fi)) < 0) {
+      LOG_DBG("fatfs_vfs.c: defrag %s: %d\n", path, ret);
+      _defrag_reset(d);
+      break;
+    }
+  }
+
+  mutex_unlock(&work_mtx);
+
+  return ret < 0 ? ret : moved;
+}
+
+int fatfs_defrag_stats(vfs_mount_t *mountp, fatfs_defrag_stats_t *stats) {
+  fatfs_desc_t *fs_desc = mountp->private_data;
+
+  mutex_lock(&work_mtx);
+  *stats = fs_desc->defrag.stats;
+  mutex_unlock(&work_mtx);
+
+  return 0;
+}
+#endif /* CONFIG_FATFS_VFS_DEFRAG */
+
+#if FF_USE_FASTSEEK
+static mem_pool_t _clmt_pool;
+
+static FSIZE_t _cluster_size(const FIL *fp) {
+  return (FSIZE_t)fp->obj.fs->csize * FF_MAX_SS;
+}
+
+/* bytes covered by the chain recorded in the table */
+static FSIZE_t _clmt_span(const fatfs_file_desc_t *fd) {
+  FSIZE_t clusters = 0;
+
+  for (const DWORD *tbl = fd->clmt + 1; *tbl; tbl += 2) {
+    clusters += *tbl;
+  }
+  return clusters * _cluster_size(&fd->file);
+}
+
+static void _clmt_free(fatfs_file_desc_t *fd) {
+  fd->file.cltbl = NULL;
+  if (fd->clmt) {
+    mem_pool_free(&_clmt_pool, fd->clmt);
+    fd->clmt = NULL;
+  }
+}
+
+/* failing to build the table only costs speed, the file stays usable */
+static void _clmt_build(fatfs_file_desc_t *fd) {
+  FIL *fp = &fd->file;
+
+  if (fd->clmt_failed || f_size(fp) <= _cluster_size(fp)) {
+    return;
+  }
+  if (fd->clmt == NULL && (fd->clmt = mem_pool_alloc(&_clmt_pool)) == NULL) {
+    return;
+  }
+
+  fd->clmt[0] = CONFIG_FATFS_VFS_CLMT_SIZE;
+  fp->cltbl = fd->clmt;
+  FRESULT res = f_lseek(fp, CREATE_LINKMAP);
+  if (res != FR_OK) {
+    LOG_DBG("fatfs_vfs.c: clmt %s: %d\n", fd->fname, res);
+    _clmt_free(fd);
+    fd->clmt_failed = 1;
+  }
+}
+
+/* FatFs can't extend a chain through the table, it is dropped before the
+ * chain grows past it and rebuilt by the next long seek */
+static void _clmt_detach(fatfs_file_desc_t *fd, FSIZE_t end) {
+  if (fd->file.cltbl && end > _clmt_span(fd)) {
+    fd->file.cltbl = NULL;
+  }
+}
+
+/* seeks that make FatFs follow the FAT over several clusters */
+static bool _is_long_seek(const FIL *fp, FSIZE_t pos) {
+  FSIZE_t cur = f_tell(fp) / _cluster_size(fp);
+  FSIZE_t dst = pos / _cluster_size(fp);
+
+  return dst < cur || dst - cur >= CONFIG_FATFS_VFS_CLMT_SEEK_CLUSTERS;
+}
+#endif /* FF_USE_FASTSEEK */
+
 static int _open(vfs_file_t *filp, const char *name, int flags, mode_t mode) {
   fatfs_file_desc_t *fd = _get_fatfs_file_desc(filp);
   fatfs_desc_t *fs_desc = (fatfs_desc_t *)filp->mp->private_data;
-  _build_abs_path(fs_desc, name);
+
+  /* kept for fstat */
+  int ret = _build_abs_path(fs_desc, name, fd->fname);
+  if (ret) {
+    return ret;
+  }
 
   (void)mode; /* fatfs can't use mode param with f_open*/
   LOG_DBG("fatfs_vfs.c: _open: private_data = %p, name = %s; flags = 0x%x\n",
           filp->mp->private_data, name, flags);
 
-  strncpy(fd->fname, fs_desc->abs_path_str_buff, VFS_NAME_MAX);
-
   uint8_t fatfs_flags = 0;
 
   if ((flags & O_ACCMODE) == O_RDONLY) {
@@ -160,16 +790,46 @@ static int _open(vfs_file_t *filp, const char *name, int flags, mode_t mode) {
     fatfs_flags |= FA_OPEN_EXISTING;
   }
 
-  FRESULT open_resu =
-      f_open(&fd->file, fs_desc->abs_path_str_buff, fatfs_flags);
+  _open_lock(fs_desc);
+  FRESULT open_resu = f_open(&fd->file, fd->fname, fatfs_flags);
+#if CONFIG_FATFS_VFS_DEFRAG
+  if (open_resu == FR_OK) {
+    fd->next = fs_desc->open_files;
+    fs_desc->open_files = fd;
+    _defrag_cancel(fs_desc, fd->fname);
+  }
+#endif
+  _open_unlock(fs_desc);
+
+#if FF_USE_FASTSEEK
+  fd->clmt = NULL;
+  fd->clmt_failed = 0;
+  if (open_resu == FR_OK && (flags & VFS_O_RANDOM)) {
+    _clmt_build(fd);
+  }
+#endif
 
   return fatfs_err_to_errno(open_resu);
 }
 
 static int _close(vfs_file_t *filp) {
   fatfs_file_desc_t *fd = _get_fatfs_file_desc(filp);
-
+  fatfs_desc_t *fs_desc = filp->mp->private_data;
+
+  _open_lock(fs_desc);
+#if CONFIG_FATFS_VFS_DEFRAG
+  for (fatfs_file_desc_t **p = &fs_desc->open_files; *p; p = &(*p)->next) {
+    if (*p == fd) {
+      *p = fd->next;
+      break;
+    }
+  }
+#endif
   FRESULT res = f_close(&fd->file);
+  _open_unlock(fs_desc);
+#if FF_USE_FASTSEEK
+  _clmt_free(fd);
+#endif
 
   return fatfs_err_to_errno(res);
 }
@@ -179,6 +839,10 @@ static ssize_t _write(vfs_file_t *filp, const void *src, size_t nbytes) {
 
   UINT bw;
 
+#if FF_USE_FASTSEEK
+  _clmt_detach(fd, f_tell(&fd->file) + nbytes);
+#endif
+
   FRESULT res = f_write(&fd->file, src, nbytes, &bw);
 
   if (res != FR_OK) {
@@ -229,6 +893,15 @@ static off_t _lseek(vfs_file_t *filp, off_t off, int whence) {
     return fatfs_err_to_errno(FR_INVALID_PARAMETER);
   }
 
+#if FF_USE_FASTSEEK
+  if ((FSIZE_t)new_pos > f_size(&fd->file)) {
+    /* fast seek clips at the file size, a normal one extends the file */
+    fd->file.cltbl = NULL;
+  } else if (fd->file.cltbl == NULL && _is_long_seek(&fd->file, new_pos)) {
+    _clmt_build(fd);
+  }
+#endif
+
   res = f_lseek(&fd->file, new_pos);
 
   if (res == FR_OK) {
@@ -239,11 +912,11 @@ static off_t _lseek(vfs_file_t *filp, off_t off, int whence) {
 }
 
 static int _fstat(vfs_file_t *filp, struct stat *buf) {
-  fatfs_desc_t *fs_desc = (fatfs_desc_t *)filp->mp->private_data;
+  fatfs_file_desc_t *fd = _get_fatfs_file_desc(filp);
   FILINFO fi;
   FRESULT res;
 
-  res = f_stat(fs_desc->abs_path_str_buff, &fi);
+  res = f_stat(fd->fname, &fi);
 
   if (res != FR_OK) {
     return fatfs_err_to_errno(res);
@@ -284,10 +957,14 @@ static inline DIR *_get_DIR(vfs_DIR *d) {
 static int _opendir(vfs_DIR *dirp, const char *dirname) {
   DIR *dir = _get_DIR(dirp);
   fatfs_desc_t *fs_desc = (fatfs_desc_t *)dirp->mp->private_data;
+  char path[FATFS_MAX_ABS_PATH_SIZE];
 
-  _build_abs_path(fs_desc, dirname);
+  int ret = _build_abs_path(fs_desc, dirname, path);
+  if (ret) {
+    return ret;
+  }
 
-  return fatfs_err_to_errno(f_opendir(dir, fs_desc->abs_path_str_buff));
+  return fatfs_err_to_errno(f_opendir(dir, path));
 }
 
 static int _readdir(vfs_DIR *dirp, vfs_dirent_t *entry) {
@@ -317,19 +994,27 @@ static int _closedir(vfs_DIR *dirp) {
 
 static int _mkdir(vfs_mount_t *mountp, const char *name, mode_t mode) {
   fatfs_desc_t *fs_desc = (fatfs_desc_t *)mountp->private_data;
+  char path[FATFS_MAX_ABS_PATH_SIZE];
   (void)mode;
 
-  _build_abs_path(fs_desc, name);
+  int ret = _build_abs_path(fs_desc, name, path);
+  if (ret) {
+    return ret;
+  }
 
-  return fatfs_err_to_errno(f_mkdir(fs_desc->abs_path_str_buff));
+  return fatfs_err_to_errno(f_mkdir(path));
 }
 
 static int _rmdir(vfs_mount_t *mountp, const char *name) {
   fatfs_desc_t *fs_desc = (fatfs_desc_t *)mountp->private_data;
+  char path[FATFS_MAX_ABS_PATH_SIZE];
 
-  _build_abs_path(fs_desc, name);
+  int ret = _build_abs_path(fs_desc, name, path);
+  if (ret) {
+    return ret;
+  }
 
-  return fatfs_err_to_errno(f_unlink(fs_desc->abs_path_str_buff));
+  return fatfs_err_to_errno(f_unlink(path));
 }
 
 static void _fatfs_time_to_timespec(WORD fdate, WORD ftime, time_t *time) {
@@ -416,9 +1101,28 @@ int fatfs_vfs_init() {
   if ((ret = mutex_init(&work_mtx))) {
     return ret;
   }
+  if ((ret = mutex_init(&_vol_mtx))) {
+    return ret;
+  }
+#if FF_USE_FASTSEEK
+  if ((ret = mem_pool_create(&_clmt_pool, "fatfs_clmt",
+                             CONFIG_FATFS_VFS_CLMT_SIZE * sizeof(DWORD),
+                             sizeof(DWORD), 0, 0))) {
+    return ret;
+  }
+#endif
   return ret;
 }
 
+int fatfs_vfs_desc_init(fatfs_desc_t *desc) {
+#if CONFIG_FATFS_VFS_DEFRAG
+  return mutex_init(&desc->open_lock);
+#else
+  (void)desc;
+  return 0;
+#endif
+}
+
 static const vfs_file_system_ops_t fatfs_fs_ops = {
 #ifdef MODULE_FATFS_VFS_FORMAT
     .format = _format,
@@ -430,6 +1134,7 @@ static const vfs_file_system_ops_t fatfs_fs_ops = {
     .mkdir = _mkdir,
     .rmdir = _rmdir,
     .stat = vfs_sysop_stat_from_fstat,
+    .gc = _gc,
 };
 
 static const vfs_file_ops_t fatfs_file_ops = {
@@ -452,4 +1157,5 @@ const vfs_file_system_t fatfs_file_system = {
     .fs_op = &fatfs_fs_ops,
     .f_op = &fatfs_file_ops,
     .d_op = &fatfs_dir_ops,
+    .file_size = sizeof(fatfs_file_desc_t),
 };
\ No newline at end of file
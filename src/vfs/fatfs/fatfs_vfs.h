@@ -2,6 +2,7 @@
 #define UC_VFS_FATFS_VFS_H
 
 #include "inttypes.h"
+#include "mutex.h"
 #include "ramdisk.h"
 #include "vfs.h"
 
@@ -35,20 +36,139 @@
 
 #define FATFS_MAX_ABS_PATH_SIZE (FATFS_MAX_VOL_STR_LEN + VFS_NAME_MAX + 1)
 
+#if FF_USE_FASTSEEK
+#ifndef CONFIG_FATFS_VFS_CLMT_SIZE
+/**
+ * Number of DWORD items of the cluster link map table of a file, a chain of
+ * n fragments needs 2 * n + 2 items
+ */
+#define CONFIG_FATFS_VFS_CLMT_SIZE (64)
+#endif
+
+#ifndef CONFIG_FATFS_VFS_CLMT_SEEK_CLUSTERS
+/** Forward seeks over at least this many clusters build the table */
+#define CONFIG_FATFS_VFS_CLMT_SEEK_CLUSTERS (4)
+#endif
+#endif /* FF_USE_FASTSEEK */
+
+#ifndef CONFIG_FATFS_VFS_DEFRAG
+#define CONFIG_FATFS_VFS_DEFRAG (FF_USE_EXPAND && FF_USE_FASTSEEK)
+#endif
+
+#if CONFIG_FATFS_VFS_DEFRAG
+#ifndef CONFIG_FATFS_VFS_DEFRAG_DEPTH
+/** Directories nested deeper than this are not defragmented */
+#define CONFIG_FATFS_VFS_DEFRAG_DEPTH (4)
+#endif
+
+#ifndef CONFIG_FATFS_VFS_DEFRAG_GC_TICKS
+/** Ticks of defragmentation per vfs_gc() pass, 0 leaves it to the
+ * application */
+#define CONFIG_FATFS_VFS_DEFRAG_GC_TICKS (0)
+#endif
+
+/** Name of the copy a file is relocated into, in the directory of the file */
+#define FATFS_DEFRAG_TMP_NAME "~DEFRAG.TMP"
+
+/**
+ * Name of the file in the root directory that holds the path of the file a
+ * complete copy is about to replace, mount puts back what an interrupted swap
+ * left behind
+ */
+#define FATFS_DEFRAG_LOG_NAME "~DEFRAG.LOG"
+
+/** Fragmentation of the files visited by a defragmentation pass */
+typedef struct {
+  uint32_t files;         /**< regular files visited */
+  uint32_t fragmented;    /**< files found in more than one fragment */
+  uint32_t fragments;     /**< fragments of all the visited files */
+  uint32_t max_fragments; /**< fragments of the most fragmented file */
+  uint32_t moved;         /**< files relocated into a contiguous run */
+  /** fragmented files left in place: open, attributes or no contiguous run */
+  uint32_t skipped;
+} fatfs_defrag_report_t;
+
+typedef struct {
+  fatfs_defrag_report_t last; /**< last complete pass */
+  fatfs_defrag_report_t cur;  /**< pass in progress */
+  uint32_t passes;            /**< complete passes since mount */
+} fatfs_defrag_stats_t;
+
+/** where an incremental pass resumes */
+typedef struct {
+  DIR dirs[CONFIG_FATFS_VFS_DEFRAG_DEPTH];
+  char path[FATFS_MAX_ABS_PATH_SIZE];
+  uint8_t depth; /**< open directories, 0 when no pass is in progress */
+  char file[FATFS_MAX_ABS_PATH_SIZE]; /**< file being copied */
+  /** last file relocated, the swap may have moved its entry further on in
+   * the directory being read */
+  char moved[FATFS_MAX_ABS_PATH_SIZE];
+  FILINFO fi;      /**< entry of the file being copied */
+  FIL src;         /**< the file being copied, open while copying is set */
+  FIL dst;         /**< its copy, open while copying is set */
+  uint8_t copying; /**< a copy is in progress, the next call resumes it */
+  /** the file was opened, renamed or unlinked meanwhile, the copy is
+   * dropped */
+  uint8_t cancel;
+  fatfs_defrag_stats_t stats;
+} fatfs_defrag_t;
+#endif /* CONFIG_FATFS_VFS_DEFRAG */
+
 typedef struct fatfs_desc {
   FATFS fat_fs;
   ramdisk_no dno;
+  /** FatFs volume and physical drive the mount is bound to */
   uint8_t vol_idx;
-  char abs_path_str_buff[FATFS_MAX_ABS_PATH_SIZE];
+  /** cluster size in bytes used by format, 0 lets f_mkfs pick one */
+  DWORD au_size;
+#if CONFIG_FATFS_VFS_DEFRAG
+  fatfs_defrag_t defrag;
+  /** files open on the volume, the defragmenter leaves them in place */
+  struct fatfs_file_desc *open_files;
+  /** guards open_files and fatfs_defrag_t::cancel, held by the defragmenter
+   * while it checks a file and while it swaps it with its copy */
+  mutex_t open_lock;
+#endif
 } fatfs_desc_t;
 
 typedef struct fatfs_file_desc {
   FIL file;
-  char fname[VFS_NAME_MAX + 1];
+  char fname[FATFS_MAX_ABS_PATH_SIZE];
+#if FF_USE_FASTSEEK
+  /** table owned by the file, file.cltbl only points to it while valid */
+  DWORD *clmt;
+  /** set once the table could not be built, e.g. chain too fragmented */
+  uint8_t clmt_failed;
+#endif
+#if CONFIG_FATFS_VFS_DEFRAG
+  struct fatfs_file_desc *next; /**< in fatfs_desc_t::open_files */
+#endif
 } fatfs_file_desc_t;
 
+/** block device of each FatFs volume, used by diskio */
+extern ramdisk_t *fatfs_disks[FF_VOLUMES];
+
 extern const vfs_file_system_t fatfs_file_system;
 
 int fatfs_vfs_init(void);
 
+int fatfs_vfs_desc_init(fatfs_desc_t *desc);
+
+#if CONFIG_FATFS_VFS_DEFRAG
+/**
+ * @brief   Relocate fragmented files of a mounted volume into contiguous runs
+ *
+ * Runs until the pass over the volume completes or @p budget ticks elapsed,
+ * the next call resumes where this one stopped, within the copy of a file if
+ * need be. At least one file or one sector of a copy is handled per call.
+ * Files open through the VFS are left in place, opening or unlinking the file
+ * being copied or renaming anything on the volume drops its copy.
+ *
+ * @return  number of files relocated, negative errno on failure
+ */
+int fatfs_defrag(vfs_mount_t *mountp, OS_TICK budget);
+
+int fatfs_defrag_stats(vfs_mount_t *mountp, fatfs_defrag_stats_t *stats);
+#endif
+
 #endif /* UC_VFS_FATFS_VFS_H */
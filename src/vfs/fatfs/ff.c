@@ -267,6 +267,15 @@
 #endif
 
 
+/* FAT accelerators */
+#if FF_FS_EXFAT && (FF_FAT_BITMAP || FF_FAT_CACHE)
+#error FF_FAT_BITMAP and FF_FAT_CACHE must be 0 when exFAT is enabled
+#endif
+#if FF_DIR_CACHE && (FF_USE_LFN || FF_FS_EXFAT)
+#error FF_DIR_CACHE must be 0 when LFN or exFAT is enabled
+#endif
+
+
 /* Timestamp */
 #if FF_FS_NORTC == 1
 #if FF_NORTC_YEAR < 1980 || FF_NORTC_YEAR > 2107 || FF_NORTC_MON < 1 || FF_NORTC_MON > 12 || FF_NORTC_MDAY < 1 || FF_NORTC_MDAY > 31
@@ -1103,6 +1112,104 @@ static FRESULT move_window (	/* Returns FR_OK or FR_DISK_ERR */
 
 
 
+#if FF_FAT_CACHE
+/*-----------------------------------------------------------------------*/
+/* FAT sector cache                                                      */
+/*-----------------------------------------------------------------------*/
+
+static void fat_cache_inval (
+	FATFS* fs		/* Filesystem object */
+)
+{
+	UINT i;
+
+
+	for (i = 0; i < FF_FAT_CACHE; i++) {
+		fs->fcsect[i] = (LBA_t)0 - 1;
+		fs->fcflag[i] = 0;
+		fs->fcstamp[i] = 0;
+	}
+	fs->fcclock = 0;
+}
+
+
+#if !FF_FS_READONLY
+static FRESULT fat_cache_flush (	/* Returns FR_OK or FR_DISK_ERR */
+	FATFS* fs,		/* Filesystem object */
+	UINT i			/* Cache line to write back */
+)
+{
+	if (fs->fcflag[i]) {	/* Is the line dirty? */
+		if (disk_write(fs->pdrv, fs->fcbuf[i], fs->fcsect[i], 1) != RES_OK) return FR_DISK_ERR;
+		if (fs->n_fats == 2) disk_write(fs->pdrv, fs->fcbuf[i], fs->fcsect[i] + fs->fsize, 1);	/* Reflect it to 2nd FAT if needed */
+		fs->fcflag[i] = 0;
+	}
+	return FR_OK;
+}
+
+
+static FRESULT sync_fat (	/* Returns FR_OK or FR_DISK_ERR */
+	FATFS* fs		/* Filesystem object */
+)
+{
+	UINT i;
+
+
+	for (i = 0; i < FF_FAT_CACHE; i++) {
+		if (fat_cache_flush(fs, i) != FR_OK) return FR_DISK_ERR;
+	}
+	return FR_OK;
+}
+#endif
+
+
+static BYTE* fat_sector (	/* Pointer to the cached FAT sector, 0:Disk error */
+	FATFS* fs,		/* Filesystem object */
+	LBA_t sect		/* FAT sector to get */
+)
+{
+	UINT i, lru = 0;
+
+
+	for (i = 0; i < FF_FAT_CACHE && fs->fcsect[i] != sect; i++) {	/* Find the sector in the cache */
+		if (fs->fcstamp[i] < fs->fcstamp[lru]) lru = i;
+	}
+	if (i == FF_FAT_CACHE) {	/* Not cached, replace the least recently used line */
+		i = lru;
+#if !FF_FS_READONLY
+		if (fat_cache_flush(fs, i) != FR_OK) return 0;
+#endif
+		if (disk_read(fs->pdrv, fs->fcbuf[i], sect, 1) != RES_OK) {
+			fs->fcsect[i] = (LBA_t)0 - 1;
+			fs->fcstamp[i] = 0;
+			return 0;
+		}
+		fs->fcsect[i] = sect;
+	}
+	fs->fcstamp[i] = ++fs->fcclock;
+	fs->fcline = (BYTE)i;
+	return fs->fcbuf[i];
+}
+
+#define fat_dirty(fs)	((fs)->fcflag[(fs)->fcline] = 1)	/* Mark the sector of the last fat_sector() dirty */
+
+#else
+
+static BYTE* fat_sector (	/* Pointer to the FAT sector in the window, 0:Disk error */
+	FATFS* fs,		/* Filesystem object */
+	LBA_t sect		/* FAT sector to get */
+)
+{
+	return (move_window(fs, sect) == FR_OK) ? fs->win : 0;
+}
+
+#define fat_dirty(fs)	((fs)->wflag = 1)
+
+#endif	/* FF_FAT_CACHE */
+
+
+
+
 #if !FF_FS_READONLY
 /*-----------------------------------------------------------------------*/
 /* Synchronize filesystem and data on the storage                        */
@@ -1116,6 +1223,9 @@ static FRESULT sync_fs (	/* Returns FR_OK or FR_DISK_ERR */
 
 
 	res = sync_window(fs);
+#if FF_FAT_CACHE
+	if (res == FR_OK) res = sync_fat(fs);
+#endif
 	if (res == FR_OK) {
 		if (fs->fsi_flag == 1) {	/* Allocation changed? */
 			fs->fsi_flag = 0;
@@ -1181,6 +1291,7 @@ static DWORD get_fat (		/* 0xFFFFFFFF:Disk error, 1:Internal error, 2..0x7FFFFFF
 {
 	UINT wc, bc;
 	DWORD val;
+	BYTE *fat;
 	FATFS *fs = obj->fs;
 
 
@@ -1193,21 +1304,21 @@ static DWORD get_fat (		/* 0xFFFFFFFF:Disk error, 1:Internal error, 2..0x7FFFFFF
 		switch (fs->fs_type) {
 		case FS_FAT12 :
 			bc = (UINT)clst; bc += bc / 2;
-			if (move_window(fs, fs->fatbase + (bc / SS(fs))) != FR_OK) break;
-			wc = fs->win[bc++ % SS(fs)];		/* Get 1st byte of the entry */
-			if (move_window(fs, fs->fatbase + (bc / SS(fs))) != FR_OK) break;
-			wc |= fs->win[bc % SS(fs)] << 8;	/* Merge 2nd byte of the entry */
+			if ((fat = fat_sector(fs, fs->fatbase + (bc / SS(fs)))) == 0) break;
+			wc = fat[bc++ % SS(fs)];			/* Get 1st byte of the entry */
+			if ((fat = fat_sector(fs, fs->fatbase + (bc / SS(fs)))) == 0) break;
+			wc |= fat[bc % SS(fs)] << 8;		/* Merge 2nd byte of the entry */
 			val = (clst & 1) ? (wc >> 4) : (wc & 0xFFF);	/* Adjust bit position */
 			break;
 
 		case FS_FAT16 :
-			if (move_window(fs, fs->fatbase + (clst / (SS(fs) / 2))) != FR_OK) break;
-			val = ld_word(fs->win + clst * 2 % SS(fs));		/* Simple WORD array */
+			if ((fat = fat_sector(fs, fs->fatbase + (clst / (SS(fs) / 2)))) == 0) break;
+			val = ld_word(fat + clst * 2 % SS(fs));		/* Simple WORD array */
 			break;
 
 		case FS_FAT32 :
-			if (move_window(fs, fs->fatbase + (clst / (SS(fs) / 4))) != FR_OK) break;
-			val = ld_dword(fs->win + clst * 4 % SS(fs)) & 0x0FFFFFFF;	/* Simple DWORD array but mask out upper 4 bits */
+			if ((fat = fat_sector(fs, fs->fatbase + (clst / (SS(fs) / 4)))) == 0) break;
+			val = ld_dword(fat + clst * 4 % SS(fs)) & 0x0FFFFFFF;	/* Simple DWORD array but mask out upper 4 bits */
 			break;
 #if FF_FS_EXFAT
 		case FS_EXFAT :
@@ -1259,50 +1370,136 @@ static FRESULT put_fat (	/* FR_OK(0):succeeded, !=0:error */
 )
 {
 	UINT bc;
-	BYTE *p;
+	BYTE *p, *fat;
 	FRESULT res = FR_INT_ERR;
+#if FF_FAT_BITMAP
+	DWORD bit = clst - 2;		/* Bit of the cluster in the free cluster bitmap */
+	int freed = (val == 0);		/* Is the cluster to be marked free? */
+#endif
 
 
 	if (clst >= 2 && clst < fs->n_fatent) {	/* Check if in valid range */
 		switch (fs->fs_type) {
 		case FS_FAT12:
+			res = FR_DISK_ERR;
 			bc = (UINT)clst; bc += bc / 2;	/* bc: byte offset of the entry */
-			res = move_window(fs, fs->fatbase + (bc / SS(fs)));
-			if (res != FR_OK) break;
-			p = fs->win + bc++ % SS(fs);
+			if ((fat = fat_sector(fs, fs->fatbase + (bc / SS(fs)))) == 0) break;
+			p = fat + bc++ % SS(fs);
 			*p = (clst & 1) ? ((*p & 0x0F) | ((BYTE)val << 4)) : (BYTE)val;	/* Update 1st byte */
-			fs->wflag = 1;
-			res = move_window(fs, fs->fatbase + (bc / SS(fs)));
-			if (res != FR_OK) break;
-			p = fs->win + bc % SS(fs);
+			fat_dirty(fs);
+			if ((fat = fat_sector(fs, fs->fatbase + (bc / SS(fs)))) == 0) break;
+			p = fat + bc % SS(fs);
 			*p = (clst & 1) ? (BYTE)(val >> 4) : ((*p & 0xF0) | ((BYTE)(val >> 8) & 0x0F));	/* Update 2nd byte */
-			fs->wflag = 1;
+			fat_dirty(fs);
+			res = FR_OK;
 			break;
 
 		case FS_FAT16:
-			res = move_window(fs, fs->fatbase + (clst / (SS(fs) / 2)));
-			if (res != FR_OK) break;
-			st_word(fs->win + clst * 2 % SS(fs), (WORD)val);	/* Simple WORD array */
-			fs->wflag = 1;
+			res = FR_DISK_ERR;
+			if ((fat = fat_sector(fs, fs->fatbase + (clst / (SS(fs) / 2)))) == 0) break;
+			st_word(fat + clst * 2 % SS(fs), (WORD)val);	/* Simple WORD array */
+			fat_dirty(fs);
+			res = FR_OK;
 			break;
 
 		case FS_FAT32:
 #if FF_FS_EXFAT
 		case FS_EXFAT:
 #endif
-			res = move_window(fs, fs->fatbase + (clst / (SS(fs) / 4)));
-			if (res != FR_OK) break;
+			res = FR_DISK_ERR;
+			if ((fat = fat_sector(fs, fs->fatbase + (clst / (SS(fs) / 4)))) == 0) break;
 			if (!FF_FS_EXFAT || fs->fs_type != FS_EXFAT) {
-				val = (val & 0x0FFFFFFF) | (ld_dword(fs->win + clst * 4 % SS(fs)) & 0xF0000000);
+				val = (val & 0x0FFFFFFF) | (ld_dword(fat + clst * 4 % SS(fs)) & 0xF0000000);
 			}
-			st_dword(fs->win + clst * 4 % SS(fs), val);
-			fs->wflag = 1;
+			st_dword(fat + clst * 4 % SS(fs), val);
+			fat_dirty(fs);
+			res = FR_OK;
 			break;
 		}
+#if FF_FAT_BITMAP
+		if (res == FR_OK && fs->fbmp_valid) {	/* Keep the free cluster bitmap in sync */
+			if (freed) {
+				fs->fbmp[bit / 32] |= (DWORD)1 << (bit % 32);
+			} else {
+				fs->fbmp[bit / 32] &= ~((DWORD)1 << (bit % 32));
+			}
+		}
+#endif
 	}
 	return res;
 }
 
+
+
+
+#if FF_FAT_BITMAP
+/*-----------------------------------------------------------------------*/
+/* FAT: Free cluster bitmap                                              */
+/*-----------------------------------------------------------------------*/
+
+static FRESULT fbmp_build (	/* FR_OK(0):succeeded or the volume is too large, !=0:error */
+	FATFS* fs		/* Filesystem object */
+)
+{
+	FFOBJID obj;
+	DWORD clst, stat, nfree = 0;
+
+
+	if (fs->n_fatent - 2 > FF_FAT_BITMAP) return FR_OK;	/* Does not fit, keep scanning the FAT */
+	memset(fs->fbmp, 0, sizeof fs->fbmp);
+	obj.fs = fs;
+	for (clst = 2; clst < fs->n_fatent; clst++) {	/* Scan the FAT once */
+		stat = get_fat(&obj, clst);
+		if (stat == 0xFFFFFFFF) return FR_DISK_ERR;
+		if (stat == 1) return FR_INT_ERR;
+		if (stat == 0) {
+			fs->fbmp[(clst - 2) / 32] |= (DWORD)1 << ((clst - 2) % 32);
+			nfree++;
+		}
+	}
+	fs->fbmp_valid = 1;
+	fs->free_clst = nfree;	/* Free cluster count is valid as well */
+	fs->fsi_flag |= 1;
+	return FR_OK;
+}
+
+
+static int fbmp_is_free (	/* 1:Free, 0:In use */
+	FATFS* fs,		/* Filesystem object */
+	DWORD clst		/* Cluster# to test */
+)
+{
+	clst -= 2;
+	return (fs->fbmp[clst / 32] >> (clst % 32)) & 1;
+}
+
+
+static DWORD fbmp_find (	/* 0:No free cluster, >=2:Free cluster# */
+	FATFS* fs,		/* Filesystem object */
+	DWORD scl		/* Cluster# to start to find after (wraps around) */
+)
+{
+	DWORD n = fs->n_fatent - 2;	/* Number of clusters */
+	DWORD i = scl - 1;			/* Bit of the cluster next to scl */
+	DWORD left;
+
+
+	if (scl < 2 || i >= n) i = 0;
+	for (left = n; left; ) {
+		if (i % 32 == 0 && n - i >= 32 && fs->fbmp[i / 32] == 0) {	/* Skip a word without free cluster */
+			i += 32;
+			left = (left > 32) ? left - 32 : 0;
+		} else {
+			if ((fs->fbmp[i / 32] >> (i % 32)) & 1) return i + 2;
+			i++; left--;
+		}
+		if (i >= n) i = 0;	/* Wrap-around */
+	}
+	return 0;
+}
+
+#endif	/* FF_FAT_BITMAP */
+
 #endif /* !FF_FS_READONLY */
 
 
@@ -1591,6 +1788,11 @@ static DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:D
 		if (scl == clst) {						/* Stretching an existing chain? */
 			ncl = scl + 1;						/* Test if next cluster is free */
 			if (ncl >= fs->n_fatent) ncl = 2;
+#if FF_FAT_BITMAP
+			if (fs->fbmp_valid) {
+				cs = fbmp_is_free(fs, ncl) ? 0 : 2;	/* Get next cluster status from the bitmap */
+			} else
+#endif
 			cs = get_fat(obj, ncl);				/* Get next cluster status */
 			if (cs == 1 || cs == 0xFFFFFFFF) return cs;	/* Test for error */
 			if (cs != 0) {						/* Not free? */
@@ -1599,6 +1801,16 @@ static DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:D
 				ncl = 0;
 			}
 		}
+#if FF_FAT_BITMAP
+		if (ncl == 0 && !fs->fbmp_valid) {	/* Build the bitmap at the first search after mount */
+			res = fbmp_build(fs);
+			if (res != FR_OK) return (res == FR_DISK_ERR) ? 0xFFFFFFFF : 1;
+		}
+		if (ncl == 0 && fs->fbmp_valid) {	/* Find another fragment in the bitmap */
+			ncl = fbmp_find(fs, scl);
+			if (ncl == 0) return 0;			/* No free cluster found? */
+		}
+#endif
 		if (ncl == 0) {	/* The new cluster cannot be contiguous and find another fragment */
 			ncl = scl;	/* Start cluster */
 			for (;;) {
@@ -2402,6 +2614,91 @@ static FRESULT dir_read (
 /* Directory handling - Find an object in the directory                  */
 /*-----------------------------------------------------------------------*/
 
+#if FF_DIR_CACHE
+/*-----------------------------------------------------------------------*/
+/* Directory lookup cache                                                */
+/*-----------------------------------------------------------------------*/
+
+static UINT dcache_slot (	/* Cache entry of the name in the directory */
+	DIR* dp					/* Directory object with the SFN */
+)
+{
+	DWORD hash = 2166136261UL;	/* FNV-1a of the start cluster and the SFN */
+	DWORD clst = dp->obj.sclust;
+	UINT i;
+
+
+	for (i = 0; i < 4; i++, clst >>= 8) hash = (hash ^ (BYTE)clst) * 16777619UL;
+	for (i = 0; i < 11; i++) hash = (hash ^ dp->fn[i]) * 16777619UL;
+	return (UINT)(hash % FF_DIR_CACHE);
+}
+
+
+static int dcache_match (	/* 1:The entry holds the name in the directory */
+	DIR* dp,				/* Directory object with the SFN */
+	UINT i					/* Cache entry */
+)
+{
+	FATFS *fs = dp->obj.fs;
+
+
+	return fs->dcname[i][0] && fs->dcclst[i] == dp->obj.sclust && !memcmp(fs->dcname[i], dp->fn, 11);
+}
+
+
+static FRESULT dcache_find (	/* FR_OK:Found and dp points the entry, FR_NO_FILE:Not cached, !=FR_OK:Error */
+	DIR* dp					/* Directory object with the SFN */
+)
+{
+	FRESULT res;
+	FATFS *fs = dp->obj.fs;
+	UINT i = dcache_slot(dp);
+
+
+	if (!dcache_match(dp, i)) return FR_NO_FILE;
+	res = dir_sdi(dp, fs->dcofs[i]);	/* Go to the cached entry (fails if the directory is not as long) */
+	if (res == FR_OK) res = move_window(fs, dp->sect);
+	if (res == FR_DISK_ERR) return res;
+	if (res == FR_OK && !(dp->dir[DIR_Attr] & AM_VOL) && !memcmp(dp->dir, dp->fn, 11)) {	/* Does it still hold the name? */
+		dp->obj.attr = dp->dir[DIR_Attr] & AM_MASK;
+		return FR_OK;
+	}
+	fs->dcname[i][0] = 0;	/* Stale entry */
+	return FR_NO_FILE;
+}
+
+
+static void dcache_put (
+	DIR* dp					/* Directory object pointing the entry with the SFN */
+)
+{
+	FATFS *fs = dp->obj.fs;
+	UINT i = dcache_slot(dp);
+
+
+	fs->dcclst[i] = dp->obj.sclust;
+	fs->dcofs[i] = dp->dptr;
+	memcpy(fs->dcname[i], dp->fn, 11);
+}
+
+
+#if !FF_FS_READONLY
+static void dcache_drop (
+	DIR* dp					/* Directory object with the SFN */
+)
+{
+	UINT i = dcache_slot(dp);
+
+
+	if (dcache_match(dp, i)) dp->obj.fs->dcname[i][0] = 0;
+}
+#endif
+
+#endif	/* FF_DIR_CACHE */
+
+
+
+
 static FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
 	DIR* dp					/* Pointer to the directory object with the file name */
 )
@@ -2413,6 +2710,10 @@ static FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
 	BYTE a, ord, sum;
 #endif
 
+#if FF_DIR_CACHE
+	res = dcache_find(dp);			/* Try the entry found last time */
+	if (res != FR_NO_FILE) return res;
+#endif
 	res = dir_sdi(dp, 0);			/* Rewind directory object */
 	if (res != FR_OK) return res;
 #if FF_FS_EXFAT
@@ -2473,6 +2774,9 @@ static FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
 		res = dir_next(dp, 0);	/* Next entry */
 	} while (res == FR_OK);
 
+#if FF_DIR_CACHE
+	if (res == FR_OK) dcache_put(dp);	/* Remember where the name is */
+#endif
 	return res;
 }
 
@@ -2575,6 +2879,9 @@ static FRESULT dir_register (	/* FR_OK:succeeded, FR_DENIED:no free entry or too
 			dp->dir[DIR_NTres] = dp->fn[NSFLAG] & (NS_BODY | NS_EXT);	/* Put NT flag */
 #endif
 			fs->wflag = 1;
+#if FF_DIR_CACHE
+			dcache_drop(dp);
+#endif
 		}
 	}
 
@@ -2621,6 +2928,9 @@ static FRESULT dir_remove (	/* FR_OK:Succeeded, FR_DISK_ERR:A disk error */
 	if (res == FR_OK) {
 		dp->dir[DIR_Name] = DDEM;	/* Mark the entry 'deleted'.*/
 		fs->wflag = 1;
+#if FF_DIR_CACHE
+		dcache_drop(dp);
+#endif
 	}
 #endif
 
@@ -3441,6 +3751,15 @@ static FRESULT mount_volume (	/* FR_OK(0): successful, !=0: an error occurred */
 	/* Following code attempts to mount the volume. (find an FAT volume, analyze the BPB and initialize the filesystem object) */
 
 	fs->fs_type = 0;					/* Invalidate the filesystem object */
+#if FF_FAT_BITMAP && !FF_FS_READONLY
+	fs->fbmp_valid = 0;					/* Invalidate the free cluster bitmap */
+#endif
+#if FF_FAT_CACHE
+	fat_cache_inval(fs);				/* Discard the cached FAT sectors */
+#endif
+#if FF_DIR_CACHE
+	memset(fs->dcname, 0, sizeof fs->dcname);	/* Discard the directory lookup cache */
+#endif
 	stat = disk_initialize(fs->pdrv);	/* Initialize the volume hosting physical drive */
 	if (stat & STA_NOINIT) { 			/* Check if the initialization succeeded */
 		return FR_NOT_READY;			/* Failed to initialize due to no medium or hard error */
@@ -4839,6 +5158,7 @@ FRESULT f_getfree (
 	DWORD nfree, clst, stat;
 	LBA_t sect;
 	UINT i;
+	BYTE *fat = 0;
 	FFOBJID obj;
 
 
@@ -4850,6 +5170,13 @@ FRESULT f_getfree (
 		if (fs->free_clst <= fs->n_fatent - 2) {
 			*nclst = fs->free_clst;
 		} else {
+#if FF_FAT_BITMAP
+			if (!fs->fbmp_valid) {	/* The bitmap build counts the free clusters */
+				res = fbmp_build(fs);
+				if (res == FR_OK && fs->fbmp_valid) *nclst = fs->free_clst;
+			}
+			if (res != FR_OK || fs->fbmp_valid) LEAVE_FF(fs, res);
+#endif
 			/* Scan FAT to obtain the correct free cluster count */
 			nfree = 0;
 			if (fs->fs_type == FS_FAT12) {	/* FAT12: Scan bit field FAT entries */
@@ -4892,14 +5219,15 @@ FRESULT f_getfree (
 					i = 0;					/* Offset in the sector */
 					do {	/* Counts numbuer of entries with zero in the FAT */
 						if (i == 0) {	/* New sector? */
-							res = move_window(fs, sect++);
-							if (res != FR_OK) break;
+							if ((fat = fat_sector(fs, sect++)) == 0) {
+								res = FR_DISK_ERR; break;
+							}
 						}
 						if (fs->fs_type == FS_FAT16) {
-							if (ld_word(fs->win + i) == 0) nfree++;	/* FAT16: Is this cluster free? */
+							if (ld_word(fat + i) == 0) nfree++;	/* FAT16: Is this cluster free? */
 							i += 2;	/* Next entry */
 						} else {
-							if ((ld_dword(fs->win + i) & 0x0FFFFFFF) == 0) nfree++;	/* FAT32: Is this cluster free? */
+							if ((ld_dword(fat + i) & 0x0FFFFFFF) == 0) nfree++;	/* FAT32: Is this cluster free? */
 							i += 4;	/* Next entry */
 						}
 						i %= SS(fs);
@@ -172,6 +172,23 @@ typedef struct {
 #endif
 	LBA_t	winsect;		/* Current sector appearing in the win[] */
 	BYTE	win[FF_MAX_SS];	/* Disk access window for Directory, FAT (and file data at tiny cfg) */
+#if FF_FAT_BITMAP && !FF_FS_READONLY
+	BYTE	fbmp_valid;		/* fbmp[] status (1:valid) */
+	DWORD	fbmp[(FF_FAT_BITMAP + 31) / 32];	/* Free cluster bitmap (bit n set: cluster n + 2 is free) */
+#endif
+#if FF_FAT_CACHE
+	BYTE	fcline;			/* Cache line of the last FAT access */
+	BYTE	fcflag[FF_FAT_CACHE];	/* FAT cache line status (1:dirty) */
+	DWORD	fcclock;		/* FAT cache access counter */
+	DWORD	fcstamp[FF_FAT_CACHE];	/* Access counter at the last access of each line (0:empty) */
+	LBA_t	fcsect[FF_FAT_CACHE];	/* FAT sector held in each line */
+	BYTE	fcbuf[FF_FAT_CACHE][FF_MAX_SS];	/* FAT cache lines */
+#endif
+#if FF_DIR_CACHE
+	DWORD	dcclst[FF_DIR_CACHE];	/* Directory lookup cache: start cluster of the directory */
+	DWORD	dcofs[FF_DIR_CACHE];	/* Directory lookup cache: offset of the entry in the directory */
+	BYTE	dcname[FF_DIR_CACHE][12];	/* Directory lookup cache: SFN of the entry (empty:unused) */
+#endif
 } FATFS;
 
 
@@ -34,11 +34,11 @@
 /* This option switches f_mkfs(). (0:Disable or 1:Enable) */
 
 
-#define FF_USE_FASTSEEK	0
+#define FF_USE_FASTSEEK	1
 /* This option switches fast seek feature. (0:Disable or 1:Enable) */
 
 
-#define FF_USE_EXPAND	0
+#define FF_USE_EXPAND	1
 /* This option switches f_expand(). (0:Disable or 1:Enable) */
 
 
@@ -166,7 +166,7 @@
 / Drive/Volume Configurations
 /---------------------------------------------------------------------------*/
 
-#define FF_VOLUMES		1
+#define FF_VOLUMES		2
 /* Number of volumes (logical drives) to be used. (1-10) */
 
 
@@ -213,7 +213,7 @@
 /  f_fdisk(). 2^32 sectors maximum. This option has no effect when FF_LBA64 == 0. */
 
 
-#define FF_USE_TRIM		0
+#define FF_USE_TRIM		1
 /* This option switches support for ATA-TRIM. (0:Disable or 1:Enable)
 /  To enable this feature, also CTRL_TRIM command should be implemented to
 /  the disk_ioctl(). */
@@ -263,6 +263,34 @@
 */
 
 
+#define FF_FAT_BITMAP	1024
+/* This option defines the size of the in-memory free cluster bitmap in clusters.
+/  (0:Disable or >0:Enable) The bitmap is built by a single FAT scan at the first
+/  cluster allocation or f_getfree() after the volume is mounted. Then allocation and
+/  free space queries no longer scan the FAT. Volumes with more clusters than the
+/  bitmap can hold fall back to the FAT scan. The bitmap takes FF_FAT_BITMAP / 8
+/  bytes in the filesystem object. */
+
+
+#define FF_FAT_CACHE	4
+/* This option defines the number of FAT sectors cached per volume. (0:Disable)
+/  FAT accesses go through an LRU write-back cache instead of the sector window
+/  shared with the directory accesses, dirty sectors are written back when the
+/  filesystem is synchronized. The cache takes FF_FAT_CACHE * FF_MAX_SS bytes in the
+/  filesystem object. Both options are available on FAT12/16/32 volumes only, they
+/  must be 0 when FF_FS_EXFAT is 1. */
+
+
+#define FF_DIR_CACHE	128
+/* This option defines the number of entries of the per-volume directory lookup
+/  cache. (0:Disable) Each entry maps a hash of the directory start cluster and the
+/  SFN to the offset of the entry in the directory, so dir_find() of a name found
+/  before reads a single directory sector instead of scanning the directory. Hits
+/  are checked against the directory entry, entries are dropped when an object is
+/  created, renamed or removed. An entry takes 20 bytes in the filesystem object.
+/  This option is available only when FF_USE_LFN == 0 and FF_FS_EXFAT == 0. */
+
+
 #define FF_FS_LOCK		0
 /* The option FF_FS_LOCK switches file lock function to control duplicated file open
 /  and illegal operation to open objects. This option must be 0 when FF_FS_READONLY
@@ -275,7 +303,7 @@
 /      lock control is independent of re-entrancy. */
 
 
-#define FF_FS_REENTRANT	0
+#define FF_FS_REENTRANT	1
 #define FF_FS_TIMEOUT	1000
 /* The option FF_FS_REENTRANT switches the re-entrancy (thread safe) of the FatFs
 /  module itself. Note that regardless of this option, file access to different
@@ -0,0 +1,92 @@
+/*------------------------------------------------------------------------*/
+/* OS Dependent Functions for FatFs                                       */
+/*------------------------------------------------------------------------*/
+/* Synchronization objects of the volumes on top of uC/OS-III mutexes.    */
+/*------------------------------------------------------------------------*/
+
+#include <os.h>
+
+#include "ff.h"
+#include "logging.h"
+#include "mutex.h"
+
+LOG_MODULE_REGISTER(ffsystem, LOG_LEVEL_INF);
+
+#if FF_FS_REENTRANT	/* Mutal exclusion */
+
+/* One mutex per volume plus the system mutex used with FF_FS_LOCK */
+static mutex_t Mutex[FF_VOLUMES + 1];
+
+
+/*------------------------------------------------------------------------*/
+/* Create a Mutex                                                         */
+/*------------------------------------------------------------------------*/
+/* This function is called in f_mount function to create a new mutex
+/  or semaphore for the volume. When a 0 is returned, the f_mount function
+/  fails with FR_INT_ERR.
+*/
+
+int ff_mutex_create (	/* Returns 1:Function succeeded or 0:Could not create the mutex */
+	int vol				/* Mutex ID: Volume mutex (0 to FF_VOLUMES - 1) or system mutex (FF_VOLUMES) */
+)
+{
+	return mutex_init(&Mutex[vol]) == 0;
+}
+
+
+/*------------------------------------------------------------------------*/
+/* Delete a Mutex                                                         */
+/*------------------------------------------------------------------------*/
+/* This function is called in f_mount function to delete a mutex or
+/  semaphore of the volume created with ff_mutex_create function.
+*/
+
+void ff_mutex_delete (	/* Returns 1:Function succeeded or 0:Could not delete due to an error */
+	int vol				/* Mutex ID: Volume mutex (0 to FF_VOLUMES - 1) or system mutex (FF_VOLUMES) */
+)
+{
+	OS_ERR err;
+
+	OSMutexDel(&Mutex[vol], OS_OPT_DEL_ALWAYS, &err);
+	if (err != OS_ERR_NONE) {
+		LOG_DBG("MutexDel=%d", err);
+	}
+}
+
+
+/*------------------------------------------------------------------------*/
+/* Request a Grant to Access the Volume                                   */
+/*------------------------------------------------------------------------*/
+/* This function is called on enter file functions to lock the volume.
+/  When a 0 is returned, the file function fails with FR_TIMEOUT.
+*/
+
+int ff_mutex_take (	/* Returns 1:Succeeded or 0:Timeout */
+	int vol			/* Mutex ID: Volume mutex (0 to FF_VOLUMES - 1) or system mutex (FF_VOLUMES) */
+)
+{
+	OS_ERR err;
+
+	OSMutexPend(&Mutex[vol], FF_FS_TIMEOUT, OS_OPT_PEND_BLOCKING, NULL, &err);
+	if (err != OS_ERR_NONE) {
+		LOG_DBG("MutexPend=%d", err);
+		return 0;
+	}
+	return 1;
+}
+
+
+/*------------------------------------------------------------------------*/
+/* Release a Grant to Access the Volume                                   */
+/*------------------------------------------------------------------------*/
+/* This function is called on leave file functions to unlock the volume.
+*/
+
+void ff_mutex_give (
+	int vol			/* Mutex ID: Volume mutex (0 to FF_VOLUMES - 1) or system mutex (FF_VOLUMES) */
+)
+{
+	mutex_unlock(&Mutex[vol]);
+}
+
+#endif	/* FF_FS_REENTRANT */
@@ -0,0 +1,12 @@
+#ifndef UC_VFS_LFS_DEFINES_H
+#define UC_VFS_LFS_DEFINES_H
+
+/* included by lfs_util.h through LFS_DEFINES */
+
+#include "mem.h"
+
+/* buffers the mount does not provide come from the VFS size classes */
+#define LFS_MALLOC(sz) mem_alloc(sz)
+#define LFS_FREE(p) mem_free(p)
+
+#endif
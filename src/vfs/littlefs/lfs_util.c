@@ -13,6 +13,7 @@
 
 // If user provides their own CRC impl we don't need this
 #ifndef LFS_CRC
+#if LFS_CRC_IMPL == LFS_CRC_NIBBLE
 // Software CRC implementation with small lookup table
 uint32_t lfs_crc(uint32_t crc, const void *buffer, size_t size) {
     static const uint32_t rtable[16] = {
@@ -31,6 +32,181 @@ uint32_t lfs_crc(uint32_t crc, const void *buffer, size_t size) {
 
     return crc;
 }
+
+#else
+#if LFS_CRC_IMPL == LFS_CRC_WORD
+#define LFS_CRC_TAB_N 4
+#else
+#define LFS_CRC_TAB_N 8
+#endif
+#include "lfs_crc_tab.h"
+
+#if LFS_CRC_IMPL == LFS_CRC_PCLMUL
+#include <immintrin.h>
+#endif
+
+#if (defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && \
+        __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define LFS_CRC_BYTES_ONLY
+#endif
+
+static inline uint32_t lfs_crc_byte(uint32_t crc, uint8_t data) {
+    return (crc >> 8) ^ lfs_crc_tab[0][(crc ^ data) & 0xff];
+}
+
+// One little-endian word folded into the crc, the words have to be aligned
+static inline uint32_t lfs_crc_word(uint32_t crc, const uint8_t *data) {
+    crc ^= *(const uint32_t*)(const void*)data;
+    return lfs_crc_tab[3][(crc >>  0) & 0xff] ^
+           lfs_crc_tab[2][(crc >>  8) & 0xff] ^
+           lfs_crc_tab[1][(crc >> 16) & 0xff] ^
+           lfs_crc_tab[0][(crc >> 24) & 0xff];
+}
+
+#if LFS_CRC_IMPL != LFS_CRC_WORD
+// Eight bytes per step, the second word does not depend on the crc so both
+// lookups chains can overlap
+static inline uint32_t lfs_crc_dword(uint32_t crc, const uint8_t *data) {
+    uint32_t lo = crc ^ *(const uint32_t*)(const void*)data;
+    uint32_t hi = *(const uint32_t*)(const void*)(data + 4);
+    return lfs_crc_tab[7][(lo >>  0) & 0xff] ^
+           lfs_crc_tab[6][(lo >>  8) & 0xff] ^
+           lfs_crc_tab[5][(lo >> 16) & 0xff] ^
+           lfs_crc_tab[4][(lo >> 24) & 0xff] ^
+           lfs_crc_tab[3][(hi >>  0) & 0xff] ^
+           lfs_crc_tab[2][(hi >>  8) & 0xff] ^
+           lfs_crc_tab[1][(hi >> 16) & 0xff] ^
+           lfs_crc_tab[0][(hi >> 24) & 0xff];
+}
+#endif
+
+static uint32_t lfs_crc_sliced(uint32_t crc, const uint8_t *data,
+        size_t size) {
+#ifndef LFS_CRC_BYTES_ONLY
+    // byte steps up to the first aligned word
+    while (size && ((uintptr_t)data & 3)) {
+        crc = lfs_crc_byte(crc, *data++);
+        size--;
+    }
+#if LFS_CRC_IMPL != LFS_CRC_WORD
+    while (size >= 8) {
+        crc = lfs_crc_dword(crc, data);
+        data += 8;
+        size -= 8;
+    }
+#endif
+    while (size >= 4) {
+        crc = lfs_crc_word(crc, data);
+        data += 4;
+        size -= 4;
+    }
+#endif
+    while (size--) {
+        crc = lfs_crc_byte(crc, *data++);
+    }
+    return crc;
+}
+
+#if LFS_CRC_IMPL == LFS_CRC_PCLMUL
+// Folds 64 bytes at a time with carry-less multiplies, then reduces to 32
+// bits with Barrett reduction, see Gopal et al., "Fast CRC Computation for
+// Generic Polynomials Using PCLMULQDQ Instruction". size must be at least 64
+// and a multiple of 16.
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t lfs_crc_fold(uint32_t crc, const uint8_t *data,
+        size_t size) {
+    // bit-reflected constants for the CRC-32 polynomial
+    const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+    const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+    const __m128i k5k0 = _mm_set_epi64x(0x0000000000, 0x0163cd6124);
+    const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+    const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+    x1 = _mm_loadu_si128((const __m128i*)(data + 0x00));
+    x2 = _mm_loadu_si128((const __m128i*)(data + 0x10));
+    x3 = _mm_loadu_si128((const __m128i*)(data + 0x20));
+    x4 = _mm_loadu_si128((const __m128i*)(data + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+    data += 64;
+    size -= 64;
+
+    // four parallel folds of 64 bytes
+    while (size >= 64) {
+        x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+                _mm_loadu_si128((const __m128i*)(data + 0x00)));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6),
+                _mm_loadu_si128((const __m128i*)(data + 0x10)));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7),
+                _mm_loadu_si128((const __m128i*)(data + 0x20)));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8),
+                _mm_loadu_si128((const __m128i*)(data + 0x30)));
+        data += 64;
+        size -= 64;
+    }
+
+    // fold the four lanes into one
+    x0 = k3k4;
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    // remaining blocks of 16
+    while (size >= 16) {
+        x2 = _mm_loadu_si128((const __m128i*)data);
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+        data += 16;
+        size -= 16;
+    }
+
+    // 128 to 64 bits
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, mask);
+    x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett reduction to 32 bits
+    x2 = _mm_and_si128(x1, mask);
+    x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+    x2 = _mm_and_si128(x2, mask);
+    x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    return (uint32_t)_mm_extract_epi32(x1, 1);
+}
+#endif
+
+uint32_t lfs_crc(uint32_t crc, const void *buffer, size_t size) {
+    const uint8_t *data = buffer;
+
+#if LFS_CRC_IMPL == LFS_CRC_PCLMUL
+    if (size >= 64) {
+        size_t n = size & ~(size_t)15;
+        crc = lfs_crc_fold(crc, data, n);
+        data += n;
+        size -= n;
+    }
+#endif
+    return lfs_crc_sliced(crc, data, size);
+}
+#endif
 #endif
 
 
@@ -238,6 +238,29 @@ static inline uint32_t lfs_tobe32(uint32_t a) {
 }
 
 // Calculate CRC-32 with polynomial = 0x04c11db7
+//
+// The software implementation is picked at compile time with LFS_CRC_IMPL:
+// - LFS_CRC_NIBBLE: 64 byte table, two lookups per byte
+// - LFS_CRC_SLICE8: 8 KiB of tables, eight bytes per step
+// - LFS_CRC_WORD: 4 KiB of tables, one aligned 32-bit load per step, for
+//   cores without a data cache such as the Cortex-M3
+// - LFS_CRC_PCLMUL: x86 carry-less multiply folding for host builds, the
+//   SSE4.2 crc32 instruction uses another polynomial
+#define LFS_CRC_NIBBLE 0
+#define LFS_CRC_SLICE8 1
+#define LFS_CRC_WORD   2
+#define LFS_CRC_PCLMUL 3
+
+#ifndef LFS_CRC_IMPL
+#if defined(__PCLMUL__) && defined(__SSE4_1__)
+#define LFS_CRC_IMPL LFS_CRC_PCLMUL
+#elif defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_6M__)
+#define LFS_CRC_IMPL LFS_CRC_WORD
+#else
+#define LFS_CRC_IMPL LFS_CRC_SLICE8
+#endif
+#endif
+
 #ifdef LFS_CRC
 uint32_t lfs_crc(uint32_t crc, const void *buffer, size_t size) {
     return LFS_CRC(crc, buffer, size)
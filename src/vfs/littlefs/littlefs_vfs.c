@@ -9,8 +9,6 @@
 
 #include "littlefs_vfs.h"
 
-mem_pool_t cache_pool;
-
 static int littlefs_err_to_errno(ssize_t err) {
   switch (err) {
   case LFS_ERR_OK:
@@ -42,18 +40,40 @@ static int littlefs_err_to_errno(ssize_t err) {
   }
 }
 
-void *_cache_alloc() { return mem_pool_alloc(&cache_pool); }
+#if (CONFIG_PAGE_SIZE << (CONFIG_LITTLEFS2_CACHE_CLASSES - 1)) >               \
+    (CONFIG_MEM_MIN_CLASS << (CONFIG_MEM_CLASSES - 1))
+#error "the largest littlefs cache does not fit the mem_alloc() classes"
+#endif
+
+/* -1 unless size is CONFIG_PAGE_SIZE << n for n below
+ * CONFIG_LITTLEFS2_CACHE_CLASSES, the #if above makes sure that such a size
+ * has a mem_alloc() class */
+static int _cache_class(lfs_size_t size) {
+  for (int i = 0; i < CONFIG_LITTLEFS2_CACHE_CLASSES; i++) {
+    if (size == ((lfs_size_t)CONFIG_PAGE_SIZE << i)) {
+      return i;
+    }
+  }
+  return -1;
+}
 
-void _cache_free(void *blk) { mem_pool_free(&cache_pool, blk); }
+/* caches come from the mem_alloc() size classes, which fit them exactly */
+static void *_cache_alloc(lfs_size_t size) {
+  return _cache_class(size) < 0 ? NULL : mem_alloc(size);
+}
+
+static void _cache_free(lfs_size_t size, void *buf) {
+  (void)size;
+  mem_free(buf);
+}
 
 static int _dev_read(const struct lfs_config *c, lfs_block_t block,
                      lfs_off_t off, void *buffer, lfs_size_t size) {
   littlefs2_desc_t *fs = c->context;
   ramdisk_t *disk = fs->disk;
 
-  uint32_t start_sec = block * fs->sectors_per_block;
-  ramdisk_read(disk, buffer, start_sec, off, size);
-  return 0;
+  uint32_t start_sec = (fs->base_addr + block) * fs->sectors_per_block;
+  return ramdisk_read(disk, buffer, start_sec, off, size) < 0 ? LFS_ERR_IO : 0;
 }
 
 static int _dev_write(const struct lfs_config *c, lfs_block_t block,
@@ -61,13 +81,20 @@ static int _dev_write(const struct lfs_config *c, lfs_block_t block,
   littlefs2_desc_t *fs = c->context;
   ramdisk_t *disk = fs->disk;
 
-  uint32_t start_sec = block * fs->sectors_per_block;
-  ramdisk_write(disk, buffer, start_sec, off, size);
-  return 0;
+  uint32_t start_sec = (fs->base_addr + block) * fs->sectors_per_block;
+  return ramdisk_write(disk, buffer, start_sec, off, size) < 0 ? LFS_ERR_IO
+                                                                : 0;
 }
 
+/* littlefs makes no assumption about erased content, the block is trimmed */
 static int _dev_erase(const struct lfs_config *c, lfs_block_t block) {
-  return 0;
+  littlefs2_desc_t *fs = c->context;
+
+  uint32_t start_sec = (fs->base_addr + block) * fs->sectors_per_block;
+  return ramdisk_trim(fs->disk, start_sec * CONFIG_RAM_SEC_SIZE,
+                      c->block_size) < 0
+             ? LFS_ERR_IO
+             : 0;
 }
 
 static int _dev_sync(const struct lfs_config *c) {
@@ -76,28 +103,70 @@ static int _dev_sync(const struct lfs_config *c) {
   return 0;
 }
 
+/* give back the pooled read and prog buffers of prepare() */
+static void _release(littlefs2_desc_t *fs) {
+  void *read_buf = (void *)fs->config.read_buffer;
+  void *prog_buf = (void *)fs->config.prog_buffer;
+
+#if CONFIG_LITTLEFS2_READ_BUFFER_SIZE
+  if (read_buf == fs->read_buf) {
+    read_buf = NULL;
+  }
+#endif
+#if CONFIG_LITTLEFS2_PROG_BUFFER_SIZE
+  if (prog_buf == fs->prog_buf) {
+    prog_buf = NULL;
+  }
+#endif
+  _cache_free(fs->config.cache_size, read_buf);
+  _cache_free(fs->config.cache_size, prog_buf);
+  fs->config.read_buffer = NULL;
+  fs->config.prog_buffer = NULL;
+}
+
+/* littlefs only asserts these, and asserts are compiled out */
+static int _check_geometry(const littlefs2_desc_t *fs) {
+  const struct lfs_config *c = &fs->config;
+  lfs_size_t mdir = c->metadata_max ? c->metadata_max : c->block_size;
+
+  if (c->lookahead_size > sizeof(fs->lookahead_buf) ||
+      c->lookahead_size % 8) {
+    return -EINVAL;
+  }
+  if (c->block_size % CONFIG_RAM_SEC_SIZE || c->block_count < 2 ||
+      (fs->base_addr + c->block_count) * fs->sectors_per_block >
+          CONFIG_RAM_N_SECS) {
+    return -EINVAL;
+  }
+  /* (lfs_size_t)-1 disables compaction in lfs_fs_gc() and inline files */
+  if (mdir > c->block_size || mdir % c->prog_size ||
+      (c->compact_thresh > c->block_size &&
+       c->compact_thresh != (lfs_size_t)-1) ||
+      (c->inline_max > mdir / 8 && c->inline_max != (lfs_size_t)-1)) {
+    return -EINVAL;
+  }
+  return 0;
+}
+
 static int prepare(littlefs2_desc_t *fs, ramdisk_no dno) {
   mutex_lock(&fs->lock);
 
   ramdisk_t *disk = ramdisk_open(dno);
   if (!disk) {
     mutex_unlock(&fs->lock);
-    return -EINVAL;
+    return -ENODEV;
   }
 
   memset(&fs->fs, 0, sizeof(fs->fs));
   fs->disk = disk;
 
-  size_t block_size = CONFIG_PAGES_PER_SEC * CONFIG_PAGE_SIZE;
-
-  fs->sectors_per_block =
-      block_size / (CONFIG_PAGES_PER_SEC * CONFIG_PAGE_SIZE);
-  size_t block_count = CONFIG_RAM_N_SECS / fs->sectors_per_block;
-
   if (!fs->config.block_size) {
-    fs->config.block_size = block_size;
+    fs->config.block_size = CONFIG_SECTORS_PER_BLOCK * CONFIG_RAM_SEC_SIZE;
   }
-  if (!fs->config.block_count) {
+  fs->sectors_per_block = fs->config.block_size / CONFIG_RAM_SEC_SIZE;
+  size_t block_count = CONFIG_RAM_N_SECS / MAX(fs->sectors_per_block, 1);
+
+  if (!fs->config.block_count && block_count > fs->base_addr) {
     fs->config.block_count = block_count - fs->base_addr;
   }
   if (!fs->config.prog_size) {
@@ -109,10 +178,25 @@ static int prepare(littlefs2_desc_t *fs, ramdisk_no dno) {
   if (!fs->config.cache_size) {
     fs->config.cache_size = CONFIG_PAGE_SIZE * CONFIG_LITTLEFS2_CACHE_PAGES;
   }
+  if (!fs->config.metadata_max) {
+    fs->config.metadata_max = CONFIG_LITTLEFS2_METADATA_MAX;
+  }
+  if (!fs->config.compact_thresh) {
+    fs->config.compact_thresh = CONFIG_LITTLEFS2_COMPACT_THRESH;
+  }
+  if (!fs->config.inline_max) {
+    /* inline files are read back into a single cache, keep them readable
+     * from mounts using the smallest cache size */
+    lfs_size_t mdir = fs->config.metadata_max ? fs->config.metadata_max
+                                              : fs->config.block_size;
+    fs->config.inline_max = MIN(CONFIG_PAGE_SIZE, mdir / 8);
+  }
   if (!fs->config.block_cycles) {
     fs->config.block_cycles = CONFIG_LITTLEFS2_BLOCK_CYCLES;
   }
-  fs->config.lookahead_size = CONFIG_LITTLEFS2_LOOKAHEAD_SIZE;
+  if (!fs->config.lookahead_size) {
+    fs->config.lookahead_size = CONFIG_LITTLEFS2_LOOKAHEAD_SIZE;
+  }
   fs->config.lookahead_buffer = fs->lookahead_buf;
   fs->config.context = fs;
 
@@ -120,12 +204,38 @@ static int prepare(littlefs2_desc_t *fs, ramdisk_no dno) {
   fs->config.prog = _dev_write;
   fs->config.erase = _dev_erase;
   fs->config.sync = _dev_sync;
+
+  lfs_size_t cache_size = fs->config.cache_size;
+  if (_check_geometry(fs) || _cache_class(cache_size) < 0 ||
+      fs->config.block_size % cache_size) {
+    mutex_unlock(&fs->lock);
+    return -EINVAL;
+  }
+  /* the static buffers serve the default cache size, larger ones come from
+   * mem_alloc() until _release() */
+  fs->config.read_buffer = NULL;
+  fs->config.prog_buffer = NULL;
 #if CONFIG_LITTLEFS2_READ_BUFFER_SIZE
-  fs->config.read_buffer = fs->read_buf;
+  if (cache_size <= sizeof(fs->read_buf)) {
+    fs->config.read_buffer = fs->read_buf;
+  }
 #endif
 #if CONFIG_LITTLEFS2_PROG_BUFFER_SIZE
-  fs->config.prog_buffer = fs->prog_buf;
+  if (cache_size <= sizeof(fs->prog_buf)) {
+    fs->config.prog_buffer = fs->prog_buf;
+  }
 #endif
+  if (!fs->config.read_buffer) {
+    fs->config.read_buffer = _cache_alloc(cache_size);
+  }
+  if (!fs->config.prog_buffer) {
+    fs->config.prog_buffer = _cache_alloc(cache_size);
+  }
+  if (!fs->config.read_buffer || !fs->config.prog_buffer) {
+    _release(fs);
+    mutex_unlock(&fs->lock);
+    return -ENOMEM;
+  }
 
   return 0;
 }
@@ -135,10 +245,11 @@ static int _format(vfs_mount_t *mountp) {
 
   int ret = prepare(fs, mountp->dno);
   if (ret) {
-    return -ENODEV;
+    return ret;
   }
 
   ret = lfs_format(&fs->fs, &fs->config);
+  _release(fs);
   mutex_unlock(&fs->lock);
 
   return littlefs_err_to_errno(ret);
@@ -151,10 +262,13 @@ static int _mount(vfs_mount_t *mountp) {
 
   int ret = prepare(fs, mountp->dno);
   if (ret) {
-    return -ENODEV;
+    return ret;
   }
 
   ret = lfs_mount(&fs->fs, &fs->config);
+  if (ret < 0) {
+    _release(fs);
+  }
   mutex_unlock(&fs->lock);
 
   return littlefs_err_to_errno(ret);
@@ -166,6 +280,7 @@ static int _umount(vfs_mount_t *mountp) {
   mutex_lock(&fs->lock);
 
   int ret = lfs_unmount(&fs->fs);
+  _release(fs);
   mutex_unlock(&fs->lock);
 
   return littlefs_err_to_errno(ret);
@@ -217,17 +332,31 @@ static int _rmdir(vfs_mount_t *mountp, const char *name) {
   return littlefs_err_to_errno(ret);
 }
 
+static int _gc(vfs_mount_t *mountp, const vfs_gc_t *gc) {
+  littlefs2_desc_t *fs = mountp->private_data;
+  (void)gc; /* lfs_fs_gc can't be bounded, compact_thresh does it */
+
+  mutex_lock(&fs->lock);
+
+  /* fills the lookahead buffer and compacts metadata pairs above
+   * compact_thresh so that foreground commits don't have to */
+  int ret = lfs_fs_gc(&fs->fs);
+  mutex_unlock(&fs->lock);
+
+  return ret < 0 ? littlefs_err_to_errno(ret) : 1;
+}
+
+static inline littlefs2_file_desc_t *_get_file_desc(vfs_file_t *f) {
+  return f->private_data.ptr;
+}
+
 static inline lfs_file_t *_get_lfs_file(vfs_file_t *f) {
-  /* The buffer in `private_data` is part of a union that also contains a
-   * pointer, so the alignment is fine. Adding an intermediate cast to
-   * uintptr_t to silence -Wcast-align
-   */
-  return (lfs_file_t *)(uintptr_t)f->private_data.buffer;
+  return &_get_file_desc(f)->file;
 }
 
 static int _open(vfs_file_t *filp, const char *name, int flags, mode_t mode) {
   littlefs2_desc_t *fs = filp->mp->private_data;
-  lfs_file_t *fp = _get_lfs_file(filp);
+  littlefs2_file_desc_t *desc = _get_file_desc(filp);
   (void)mode;
 
   mutex_lock(&fs->lock);
@@ -255,14 +384,16 @@ static int _open(vfs_file_t *filp, const char *name, int flags, mode_t mode) {
     l_flags |= LFS_O_EXCL;
   }
 
-  void *buffer = _cache_alloc();
-  if (!buffer) {
+  desc->cfg = (struct lfs_file_config){
+      .buffer = _cache_alloc(fs->config.cache_size)};
+  if (!desc->cfg.buffer) {
     mutex_unlock(&fs->lock);
     return -ENOMEM;
   }
-
-  struct lfs_file_config cfg = {.buffer = buffer};
-  int ret = lfs_file_opencfg(&fs->fs, fp, name, l_flags, &cfg);
+  int ret = lfs_file_opencfg(&fs->fs, &desc->file, name, l_flags, &desc->cfg);
+  if (ret < 0) {
+    _cache_free(fs->config.cache_size, desc->cfg.buffer);
+  }
   mutex_unlock(&fs->lock);
 
   return littlefs_err_to_errno(ret);
@@ -270,12 +401,12 @@ static int _open(vfs_file_t *filp, const char *name, int flags, mode_t mode) {
 
 static int _close(vfs_file_t *filp) {
   littlefs2_desc_t *fs = filp->mp->private_data;
-  lfs_file_t *fp = _get_lfs_file(filp);
+  littlefs2_file_desc_t *desc = _get_file_desc(filp);
 
   mutex_lock(&fs->lock);
 
-  int ret = lfs_file_close(&fs->fs, fp);
-  _cache_free(fp->cfg->buffer);
+  int ret = lfs_file_close(&fs->fs, &desc->file);
+  _cache_free(fs->config.cache_size, desc->cfg.buffer);
   mutex_unlock(&fs->lock);
 
   return littlefs_err_to_errno(ret);
@@ -402,17 +533,6 @@ static int _closedir(vfs_DIR *dirp) {
   return littlefs_err_to_errno(ret);
 }
 
-int littlefs_vfs_init(void) {
-  int ret = 0;
-
-  if ((ret = mem_pool_create(&cache_pool,
-                             CONFIG_PAGE_SIZE * CONFIG_LITTLEFS2_CACHE_PAGES,
-                             sizeof(void *), 2))) {
-    return ret;
-  }
-  return ret;
-}
-
 int littlefs_vfs_desc_init(littlefs2_desc_t *desc) {
   int ret = 0;
 
@@ -431,6 +551,7 @@ static const vfs_file_system_ops_t littlefs_fs_ops = {
     .rmdir = _rmdir,
     .rename = _rename,
     .stat = _stat,
+    .gc = _gc,
 };
 
 static const vfs_file_ops_t littlefs_file_ops = {
@@ -452,4 +573,5 @@ const vfs_file_system_t littlefs2_file_system = {
     .fs_op = &littlefs_fs_ops,
     .f_op = &littlefs_file_ops,
     .d_op = &littlefs_dir_ops,
+    .file_size = sizeof(littlefs2_file_desc_t),
 };
\ No newline at end of file
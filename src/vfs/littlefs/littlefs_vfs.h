@@ -7,60 +7,34 @@
 
 #include "lfs.h"
 
-#ifndef CONFIG_SECTORS_PER_BLOCK
-#define CONFIG_SECTORS_PER_BLOCK (4)
-#endif
-
-#define CONFIG_PAGE_SIZE (64)
-#define CONFIG_PAGES_PER_SEC (CONFIG_RAM_SEC_SIZE / CONFIG_PAGE_SIZE)
-
-#ifndef CONFIG_LITTLEFS2_LOOKAHEAD_SIZE
-/** Default lookahead size */
-#define CONFIG_LITTLEFS2_LOOKAHEAD_SIZE (64)
-#endif
-
-#ifndef CONFIG_LITTLEFS2_FILE_BUFFER_SIZE
-/** File buffer size, if 0, dynamic allocation is used.
- * If set, only one file can be used at a time, must be program size (mtd page
- * size is used internally as program size) */
-#define CONFIG_LITTLEFS2_FILE_BUFFER_SIZE (0)
-#endif
-
-#ifndef CONFIG_LITTLEFS2_READ_BUFFER_SIZE
-/** Read buffer size, if 0, dynamic allocation is used.
- * If set, it must be read size (mtd page size is used internally as read
- * size) */
-#define CONFIG_LITTLEFS2_READ_BUFFER_SIZE (CONFIG_PAGE_SIZE * CONFIG_LITTLEFS2_CACHE_PAGES)
-#endif
-
-#ifndef CONFIG_LITTLEFS2_PROG_BUFFER_SIZE
-/** Prog buffer size, if 0, dynamic allocation is used.
- * If set, it must be program size */
-#define CONFIG_LITTLEFS2_PROG_BUFFER_SIZE (CONFIG_PAGE_SIZE * CONFIG_LITTLEFS2_CACHE_PAGES)
-#endif
+#include "littlefs_vfs_config.h"
 
-#ifndef CONFIG_LITTLEFS2_CACHE_PAGES
-/** Sets the number of pages used as cache. Has to be at least 1.
- */
-#define CONFIG_LITTLEFS2_CACHE_PAGES (1)
-#endif
-
-#ifndef CONFIG_LITTLEFS2_BLOCK_CYCLES
-/** Sets the maximum number of erase cycles before blocks are evicted as a part
- * of wear leveling. -1 disables wear-leveling. */
-#define CONFIG_LITTLEFS2_BLOCK_CYCLES (512)
-#endif
-
-#ifndef CONFIG_LITTLEFS2_MIN_BLOCK_SIZE_EXP
 /**
- * The exponent of the minimum acceptable block size in bytes (2^n).
- * The desired block size is not guaranteed to be applicable but will be
- * respected. */
-#define CONFIG_LITTLEFS2_MIN_BLOCK_SIZE_EXP (-1)
-#endif
+ * @brief   per-file state, the VFS allocates it on open
+ */
+typedef struct {
+  lfs_file_t file;
+  /** littlefs keeps a pointer to it, the buffer comes from mem_alloc() with
+   * the cache size of the mount */
+  struct lfs_file_config cfg;
+} littlefs2_file_desc_t;
 
 /**
  * @brief   littlefs descriptor for vfs integration
+ *
+ * The geometry is set per mount through @p config before format: a
+ * @p config.block_size that is a multiple of CONFIG_RAM_SEC_SIZE,
+ * @p config.metadata_max, @p config.compact_thresh and @p config.inline_max,
+ * plus a @p config.lookahead_size up to CONFIG_LITTLEFS2_LOOKAHEAD_SIZE.
+ * Fields left at 0 get the CONFIG_ defaults, @p config.block_count is derived
+ * from the disk size when it is 0. Geometries littlefs would reject are
+ * refused with -EINVAL.
+ *
+ * @p config.cache_size may be set before format or mount to pick the cache
+ * size of the mount, it must be CONFIG_PAGE_SIZE << n with
+ * n < CONFIG_LITTLEFS2_CACHE_CLASSES. Every open file gets a cache of that
+ * size, larger ones turn sequential I/O into fewer, longer device accesses.
+ * 0 selects CONFIG_PAGE_SIZE * CONFIG_LITTLEFS2_CACHE_PAGES.
  */
 typedef struct {
   lfs_t fs;                 /**< littlefs descriptor */
@@ -99,8 +73,6 @@ typedef struct {
 /** The littlefs vfs driver */
 extern const vfs_file_system_t littlefs2_file_system;
 
-int littlefs_vfs_init(void);
-
 int littlefs_vfs_desc_init(littlefs2_desc_t *desc);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,85 @@
+#ifndef UC_VFS_LITTLEFS_VFS_CONFIG_H
+#define UC_VFS_LITTLEFS_VFS_CONFIG_H
+
+/*
+ * Defaults of the littlefs glue. Kept apart from littlefs_vfs.h, the host
+ * image builder in tools/mkimage formats with them as well.
+ */
+
+#include "ramdisk.h"
+
+#ifndef CONFIG_SECTORS_PER_BLOCK
+/** Default number of ramdisk sectors in a littlefs block */
+#define CONFIG_SECTORS_PER_BLOCK (4)
+#endif
+
+#define CONFIG_PAGE_SIZE (64)
+#define CONFIG_PAGES_PER_SEC (CONFIG_RAM_SEC_SIZE / CONFIG_PAGE_SIZE)
+
+#ifndef CONFIG_LITTLEFS2_LOOKAHEAD_SIZE
+/** Default lookahead size */
+#define CONFIG_LITTLEFS2_LOOKAHEAD_SIZE (64)
+#endif
+
+#ifndef CONFIG_LITTLEFS2_FILE_BUFFER_SIZE
+/** File buffer size, if 0, dynamic allocation is used.
+ * If set, only one file can be used at a time, must be program size (mtd page
+ * size is used internally as program size) */
+#define CONFIG_LITTLEFS2_FILE_BUFFER_SIZE (0)
+#endif
+
+#ifndef CONFIG_LITTLEFS2_READ_BUFFER_SIZE
+/** Read buffer size, if 0, dynamic allocation is used.
+ * If set, it must be read size (mtd page size is used internally as read
+ * size) */
+#define CONFIG_LITTLEFS2_READ_BUFFER_SIZE (CONFIG_PAGE_SIZE * CONFIG_LITTLEFS2_CACHE_PAGES)
+#endif
+
+#ifndef CONFIG_LITTLEFS2_PROG_BUFFER_SIZE
+/** Prog buffer size, if 0, dynamic allocation is used.
+ * If set, it must be program size */
+#define CONFIG_LITTLEFS2_PROG_BUFFER_SIZE (CONFIG_PAGE_SIZE * CONFIG_LITTLEFS2_CACHE_PAGES)
+#endif
+
+#ifndef CONFIG_LITTLEFS2_CACHE_PAGES
+/** Sets the number of pages used as cache. Has to be at least 1.
+ */
+#define CONFIG_LITTLEFS2_CACHE_PAGES (1)
+#endif
+
+#ifndef CONFIG_LITTLEFS2_METADATA_MAX
+/** Default upper bound of a metadata log in bytes, 0 uses the whole block.
+ * Smaller logs compact faster but more often. */
+#define CONFIG_LITTLEFS2_METADATA_MAX (0)
+#endif
+
+#ifndef CONFIG_LITTLEFS2_COMPACT_THRESH
+/** Default size above which lfs_fs_gc() compacts a metadata log, 0 lets
+ * littlefs pick ~88% of the block size */
+#define CONFIG_LITTLEFS2_COMPACT_THRESH (0)
+#endif
+
+#ifndef CONFIG_LITTLEFS2_CACHE_CLASSES
+/**
+ * Number of cache sizes, class n holds caches of CONFIG_PAGE_SIZE << n bytes.
+ * A mount may use any of these sizes that divides the block size, they are
+ * taken from the mem_alloc() size classes.
+ */
+#define CONFIG_LITTLEFS2_CACHE_CLASSES (4)
+#endif
+
+#ifndef CONFIG_LITTLEFS2_BLOCK_CYCLES
+/** Sets the maximum number of erase cycles before blocks are evicted as a part
+ * of wear leveling. -1 disables wear-leveling. */
+#define CONFIG_LITTLEFS2_BLOCK_CYCLES (512)
+#endif
+
+#ifndef CONFIG_LITTLEFS2_MIN_BLOCK_SIZE_EXP
+/**
+ * The exponent of the minimum acceptable block size in bytes (2^n).
+ * The desired block size is not guaranteed to be applicable but will be
+ * respected. */
+#define CONFIG_LITTLEFS2_MIN_BLOCK_SIZE_EXP (-1)
+#endif
+
+#endif /* UC_VFS_LITTLEFS_VFS_CONFIG_H */
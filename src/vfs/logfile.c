@@ -0,0 +1,262 @@
+#include <fcntl.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "common.h"
+#include "errno.h"
+#include "logfile.h"
+#include "logging.h"
+#include "mutex.h"
+#include "printf.h"
+#include "vfs.h"
+
+LOG_MODULE_REGISTER(logfile, LOG_LEVEL_INF);
+
+#define LOGFILE_PERIOD_TICKS                                                   \
+  ((OS_TICK)(CONFIG_VFS_LOGFILE_PERIOD_MS * OS_CFG_TICK_RATE_HZ / 1000u))
+
+static uint32_t _ring_buf[CONFIG_VFS_LOGFILE_RING_SIZE / sizeof(uint32_t)];
+static log_ring_t _ring;
+
+/* a batch always has room for one more record behind a partial page */
+static uint8_t _batch[CONFIG_VFS_LOGFILE_BATCH_SIZE + CONFIG_LOG_LINE_MAX];
+static size_t _batch_len;
+
+static mutex_t _logfile_mutex;
+static char _path[CONFIG_VFS_LOGFILE_PATH_MAX];
+static bool _started;
+/* -1 while started if <path> could not be reopened, the next drain retries */
+static int _fd = -1;
+static size_t _size;
+static size_t _max_size;
+static bool _dirty;
+static vfs_logfile_stats_t _stats;
+
+static OS_TCB _logfile_tcb;
+static CPU_STK _logfile_stack[CONFIG_VFS_LOGFILE_TASK_STACK_SIZE];
+
+/* set by producers once a batch is waiting, cleared by the task */
+static volatile bool _kicked;
+
+static void _put(const char *line, size_t len) {
+  OS_ERR err;
+
+  if (len > CONFIG_LOG_LINE_MAX) {
+    len = CONFIG_LOG_LINE_MAX;
+  }
+  if (log_ring_put(&_ring, line, len) < 0) {
+    return;
+  }
+  if (!_kicked && log_ring_used(&_ring) >= CONFIG_VFS_LOGFILE_BATCH_SIZE) {
+    _kicked = true;
+    OSTaskSemPost(&_logfile_tcb, OS_OPT_POST_NONE, &err);
+  }
+}
+
+/* append to <path>, created if need be */
+static int _open(void) {
+  struct stat st;
+
+  int fd = vfs_open(_path, O_WRONLY | O_CREAT | O_APPEND, 0);
+  if (fd < 0) {
+    LOG_DBG("open %s: %d", _path, fd);
+    return fd;
+  }
+  int res = vfs_fstat(fd, &st);
+  if (res < 0) {
+    vfs_close(fd);
+    return res;
+  }
+  _fd = fd;
+  _size = st.st_size;
+  return 0;
+}
+
+static int _rotate(void) {
+  char from[CONFIG_VFS_LOGFILE_PATH_MAX + 4];
+  char to[CONFIG_VFS_LOGFILE_PATH_MAX + 4];
+
+  vfs_close(_fd);
+  _fd = -1;
+  /* <path>.N-1 -> <path>.N ... <path> -> <path>.1, the oldest is dropped */
+  for (int i = CONFIG_VFS_LOGFILE_FILES; i > 0; i--) {
+    snprintf_(to, sizeof(to), "%s.%d", _path, i);
+    if (i == CONFIG_VFS_LOGFILE_FILES) {
+      vfs_unlink(to);
+    }
+    if (i > 1) {
+      snprintf_(from, sizeof(from), "%s.%d", _path, i - 1);
+    } else {
+      strcpy(from, _path);
+    }
+    vfs_rename(from, to);
+  }
+  _stats.rotations++;
+
+  return _open();
+}
+
+static int _write_out(size_t len) {
+  if (_size && (_size + len > _max_size)) {
+    int res = _rotate();
+    if (res < 0) {
+      /* the batch waits for the file to be reopened */
+      _stats.errors++;
+      _stats.last_err = res;
+      return res;
+    }
+  }
+
+  ssize_t nw = vfs_write(_fd, _batch, len);
+  int res = (nw == (ssize_t)len) ? 0 : ((nw < 0) ? (int)nw : -ENOSPC);
+  _stats.batches++;
+  if (res < 0) {
+    /* the batch is lost, keeping it would stall the ring */
+    _stats.errors++;
+    _stats.last_err = res;
+  } else {
+    _stats.bytes += len;
+    _size += len;
+    _dirty = true;
+  }
+  _batch_len -= len;
+  memmove(_batch, &_batch[len], _batch_len);
+  return res;
+}
+
+/* called with _logfile_mutex held */
+static int _drain(bool force) {
+  int res = 0;
+
+  if (_started && (_fd < 0) && ((res = _open()) < 0)) {
+    /* records pile up in the ring until the file is back */
+    _stats.errors++;
+    _stats.last_err = res;
+    return res;
+  }
+  while (_fd >= 0) {
+    size_t n = log_ring_get(&_ring, &_batch[_batch_len],
+                            sizeof(_batch) - _batch_len);
+    _batch_len += n;
+    if (_batch_len >= CONFIG_VFS_LOGFILE_BATCH_SIZE) {
+      /* whole pages only, the rest waits for the next records */
+      res = _write_out(CONFIG_VFS_LOGFILE_BATCH_SIZE);
+    } else if (n == 0) {
+      break;
+    }
+  }
+  if (force && (_fd >= 0)) {
+    if (_batch_len) {
+      res = _write_out(_batch_len);
+    }
+    if (_dirty && (_fd >= 0)) {
+      _dirty = false;
+      int err = vfs_fsync(_fd);
+      res = (res < 0) ? res : err;
+    }
+  }
+  return res;
+}
+
+static void _logfile_task(void *p_arg) {
+  OS_ERR err;
+  (void)p_arg;
+
+  for (;;) {
+    /* posted by _put() once a batch is waiting */
+    OSTaskSemPend(LOGFILE_PERIOD_TICKS, OS_OPT_PEND_BLOCKING, NULL, &err);
+    _kicked = false;
+
+    mutex_lock(&_logfile_mutex);
+    /* a quiet period also pushes out the partial batch */
+    _drain(err == OS_ERR_TIMEOUT);
+    mutex_unlock(&_logfile_mutex);
+  }
+}
+
+int vfs_logfile_start(const char *path, size_t max_size) {
+  int res = 0;
+
+  if ((path == NULL) || (strlen(path) >= sizeof(_path))) {
+    return -EINVAL;
+  }
+
+  mutex_lock(&_logfile_mutex);
+  if (_started) {
+    mutex_unlock(&_logfile_mutex);
+    return -EBUSY;
+  }
+  strcpy(_path, path);
+  if ((res = _open()) < 0) {
+    mutex_unlock(&_logfile_mutex);
+    return res;
+  }
+  _started = true;
+  _max_size = max_size ? max_size : CONFIG_VFS_LOGFILE_MAX_SIZE;
+  _dirty = false;
+  log_backend_set(_put);
+  mutex_unlock(&_logfile_mutex);
+
+  return 0;
+}
+
+int vfs_logfile_stop(void) {
+  log_flush();
+
+  mutex_lock(&_logfile_mutex);
+  log_backend_set(NULL);
+  if (!_started) {
+    mutex_unlock(&_logfile_mutex);
+    return -EBADF;
+  }
+  /* a last try to reopen the file if a rotation lost it */
+  int res = _drain(true);
+  int err = (_fd >= 0) ? vfs_close(_fd) : 0;
+  _fd = -1;
+  _started = false;
+  mutex_unlock(&_logfile_mutex);
+
+  return (res < 0) ? res : err;
+}
+
+int vfs_logfile_flush(void) {
+  /* deferred messages reach _put() only once they are formatted */
+  log_flush();
+
+  mutex_lock(&_logfile_mutex);
+  int res = _started ? _drain(true) : -EBADF;
+  mutex_unlock(&_logfile_mutex);
+
+  return res;
+}
+
+void vfs_logfile_stats(vfs_logfile_stats_t *stats) {
+  mutex_lock(&_logfile_mutex);
+  *stats = _stats;
+  stats->records = _ring.records;
+  stats->dropped = _ring.dropped;
+  mutex_unlock(&_logfile_mutex);
+}
+
+int vfs_logfile_init(void) {
+  OS_ERR err;
+  int ret = 0;
+
+  if ((ret = mutex_init(&_logfile_mutex))) {
+    return ret;
+  }
+  if ((ret = log_ring_init(&_ring, _ring_buf, sizeof(_ring_buf)))) {
+    return ret;
+  }
+
+  OSTaskCreate(&_logfile_tcb, "vfs_logfile", _logfile_task, NULL,
+               CONFIG_VFS_LOGFILE_TASK_PRIO, &_logfile_stack[0],
+               CONFIG_VFS_LOGFILE_TASK_STACK_SIZE / 10u,
+               CONFIG_VFS_LOGFILE_TASK_STACK_SIZE, 0, 0, NULL,
+               OS_OPT_TASK_STK_CHK + OS_OPT_TASK_STK_CLR, &err);
+  if (err != OS_ERR_NONE) {
+    LOG_DBG("TaskCreate=%d", err);
+    return -EAGAIN;
+  }
+  return 0;
+}
@@ -0,0 +1,78 @@
+#ifndef UC_VFS_LOGFILE_H
+#define UC_VFS_LOGFILE_H
+
+#include <os.h>
+
+#include "inttypes.h"
+#include "log_ring.h"
+#include "logging.h"
+
+#ifndef CONFIG_VFS_LOGFILE_RING_SIZE
+/** Bytes of formatted records waiting for the file, a power of two */
+#define CONFIG_VFS_LOGFILE_RING_SIZE (4096)
+#endif
+
+#ifndef CONFIG_VFS_LOGFILE_BATCH_SIZE
+/** Bytes handed to vfs_write() at once, best set to the flash page size */
+#define CONFIG_VFS_LOGFILE_BATCH_SIZE (256)
+#endif
+
+#ifndef CONFIG_VFS_LOGFILE_MAX_SIZE
+/** Default size at which the log file is rotated */
+#define CONFIG_VFS_LOGFILE_MAX_SIZE (16u * 1024u)
+#endif
+
+#ifndef CONFIG_VFS_LOGFILE_FILES
+/** Rotated files kept next to the log file, as <path>.1 to <path>.N */
+#define CONFIG_VFS_LOGFILE_FILES (2)
+#endif
+
+#ifndef CONFIG_VFS_LOGFILE_PATH_MAX
+#define CONFIG_VFS_LOGFILE_PATH_MAX (48)
+#endif
+
+#ifndef CONFIG_VFS_LOGFILE_PERIOD_MS
+/** A partial batch is written out after the ring stayed idle this long */
+#define CONFIG_VFS_LOGFILE_PERIOD_MS (1000)
+#endif
+
+#ifndef CONFIG_VFS_LOGFILE_TASK_PRIO
+/** Just above the maintenance task, so long gc passes do not hold logs */
+#define CONFIG_VFS_LOGFILE_TASK_PRIO ((OS_PRIO)(OS_CFG_PRIO_MAX - 5u))
+#endif
+
+#ifndef CONFIG_VFS_LOGFILE_TASK_STACK_SIZE
+#define CONFIG_VFS_LOGFILE_TASK_STACK_SIZE (0x200)
+#endif
+
+typedef struct {
+  uint32_t records;   /**< records accepted into the ring */
+  uint32_t dropped;   /**< records lost because the ring was full */
+  uint32_t batches;   /**< vfs_write() calls */
+  uint32_t bytes;     /**< bytes written to the file */
+  uint32_t rotations; /**< files rotated */
+  /** failed writes, their batch is lost, and failed reopens of the file
+   * after a rotation, retried by the next drain */
+  uint32_t errors;
+  int last_err;       /**< last error returned by the VFS */
+} vfs_logfile_stats_t;
+
+int vfs_logfile_init(void);
+
+/**
+ * @brief   start appending log records to @p path
+ *
+ * @p max_size is the size at which the file is rotated, 0 selects
+ * CONFIG_VFS_LOGFILE_MAX_SIZE. The mount must stay mounted until
+ * vfs_logfile_stop() returns.
+ */
+int vfs_logfile_start(const char *path, size_t max_size);
+
+int vfs_logfile_stop(void);
+
+/** write out everything logged so far and sync the file */
+int vfs_logfile_flush(void);
+
+void vfs_logfile_stats(vfs_logfile_stats_t *stats);
+
+#endif /* UC_VFS_LOGFILE_H */
@@ -0,0 +1,183 @@
+#include <stdbool.h>
+
+#include "common.h"
+#include "errno.h"
+#include "logging.h"
+#include "maint.h"
+#include "mutex.h"
+
+LOG_MODULE_REGISTER(maint, LOG_LEVEL_INF);
+
+#define MAINT_PERIOD_TICKS                                                     \
+  ((OS_TICK)(CONFIG_VFS_MAINT_PERIOD_MS * OS_CFG_TICK_RATE_HZ / 1000u))
+
+static clist_node_t _maint_list;
+static mutex_t _maint_mutex;
+
+static OS_TCB _maint_tcb;
+static CPU_STK _maint_stack[CONFIG_VFS_MAINT_TASK_STACK_SIZE];
+
+/* read by the idle hook without holding _maint_mutex */
+static volatile OS_TICK _next_due;
+static volatile bool _has_entries;
+static volatile bool _kicked;
+
+static inline OS_TICK _period(const vfs_maint_t *entry) {
+  return entry->period ? entry->period : MAINT_PERIOD_TICKS;
+}
+
+static inline bool _is_due(OS_TICK now, OS_TICK due) {
+  /* wrap-around safe comparison */
+  return (int32_t)(now - due) >= 0;
+}
+
+static void _run_one(vfs_maint_t *entry, OS_TICK now) {
+  OS_ERR err;
+
+  int res = vfs_gc(entry->mountp, &entry->gc);
+  OS_TICK end = OSTimeGet(&err);
+
+  entry->last_run = end;
+  entry->runs++;
+  if (res < 0) {
+    entry->errors++;
+    entry->last_err = res;
+    LOG_DBG("gc %s: %d", entry->mountp->mount_point, res);
+  } else if (res > 0) {
+    entry->busy_runs++;
+  }
+  if (end - now > entry->max_ticks) {
+    entry->max_ticks = end - now;
+  }
+}
+
+int vfs_maint_run(void) {
+  OS_ERR err;
+  int ran = 0;
+
+  mutex_lock(&_maint_mutex);
+
+  OS_TICK next_due = OSTimeGet(&err) + MAINT_PERIOD_TICKS;
+  clist_node_t *node = _maint_list.next;
+  if (node) {
+    do {
+      node = node->next;
+      vfs_maint_t *entry = CONTAINER_OF(node, vfs_maint_t, list_entry);
+      OS_TICK now = OSTimeGet(&err);
+
+      if (_is_due(now, entry->last_run + _period(entry))) {
+        _run_one(entry, now);
+        ran++;
+      }
+      OS_TICK due = entry->last_run + _period(entry);
+      if ((int32_t)(due - next_due) < 0) {
+        next_due = due;
+      }
+    } while (node != _maint_list.next);
+  }
+  _next_due = next_due;
+  _kicked = false;
+
+  mutex_unlock(&_maint_mutex);
+
+  return ran;
+}
+
+static void _maint_task(void *p_arg) {
+  OS_ERR err;
+  (void)p_arg;
+
+  for (;;) {
+    /* posted by the idle hook once a mount is due, or by vfs_maint_kick() */
+    OSTaskSemPend(0, OS_OPT_PEND_BLOCKING, NULL, &err);
+    if (err != OS_ERR_NONE) {
+      LOG_DBG("TaskSemPend=%d", err);
+      continue;
+    }
+    vfs_maint_run();
+  }
+}
+
+void vfs_maint_kick(void) {
+  OS_ERR err;
+
+  _kicked = true;
+  OSTaskSemPost(&_maint_tcb, OS_OPT_POST_NONE, &err);
+}
+
+void vfs_maint_idle_hook(void) {
+  OS_ERR err;
+
+  /* The idle task must never pend, so it only wakes the maintenance task up.
+   * That task runs just above idle and therefore only gets the CPU when
+   * nothing else is ready. */
+  if (!_has_entries || _kicked) {
+    return;
+  }
+  if (_is_due(OSTimeGet(&err), _next_due)) {
+    vfs_maint_kick();
+  }
+}
+
+int vfs_maint_register(vfs_maint_t *entry) {
+  OS_ERR err;
+
+  if ((entry == NULL) || (entry->mountp == NULL)) {
+    return -EINVAL;
+  }
+
+  mutex_lock(&_maint_mutex);
+  if (clist_find(&_maint_list, &entry->list_entry)) {
+    mutex_unlock(&_maint_mutex);
+    return -EEXIST;
+  }
+  entry->last_run = OSTimeGet(&err);
+  entry->runs = 0;
+  entry->busy_runs = 0;
+  entry->errors = 0;
+  entry->last_err = 0;
+  entry->max_ticks = 0;
+  clist_rpush(&_maint_list, &entry->list_entry);
+
+  OS_TICK due = entry->last_run + _period(entry);
+  if (!_has_entries || (int32_t)(due - _next_due) < 0) {
+    _next_due = due;
+  }
+  _has_entries = true;
+  mutex_unlock(&_maint_mutex);
+
+  return 0;
+}
+
+int vfs_maint_unregister(vfs_maint_t *entry) {
+  if (entry == NULL) {
+    return -EINVAL;
+  }
+
+  mutex_lock(&_maint_mutex);
+  clist_node_t *node = clist_remove(&_maint_list, &entry->list_entry);
+  _has_entries = !clist_is_empty(&_maint_list);
+  mutex_unlock(&_maint_mutex);
+
+  return node ? 0 : -ENOENT;
+}
+
+int vfs_maint_init(void) {
+  OS_ERR err;
+  int ret = 0;
+
+  if ((ret = mutex_init(&_maint_mutex))) {
+    return ret;
+  }
+
+  OSTaskCreate(&_maint_tcb, "vfs_maint", _maint_task, NULL,
+               CONFIG_VFS_MAINT_TASK_PRIO, &_maint_stack[0],
+               CONFIG_VFS_MAINT_TASK_STACK_SIZE / 10u,
+               CONFIG_VFS_MAINT_TASK_STACK_SIZE, 0, 0, NULL,
+               OS_OPT_TASK_STK_CHK + OS_OPT_TASK_STK_CLR, &err);
+  if (err != OS_ERR_NONE) {
+    LOG_DBG("TaskCreate=%d", err);
+    return -EAGAIN;
+  }
+  return 0;
+}
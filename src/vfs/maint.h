@@ -0,0 +1,56 @@
+#ifndef UC_VFS_MAINT_H
+#define UC_VFS_MAINT_H
+
+#include <os.h>
+
+#include "clist.h"
+#include "inttypes.h"
+#include "vfs.h"
+
+#ifndef CONFIG_VFS_MAINT_TASK_PRIO
+/** Just above the statistics, timer and idle tasks */
+#define CONFIG_VFS_MAINT_TASK_PRIO ((OS_PRIO)(OS_CFG_PRIO_MAX - 4u))
+#endif
+
+#ifndef CONFIG_VFS_MAINT_TASK_STACK_SIZE
+#define CONFIG_VFS_MAINT_TASK_STACK_SIZE (0x200)
+#endif
+
+#ifndef CONFIG_VFS_MAINT_PERIOD_MS
+/** Default delay between two passes over the same mount */
+#define CONFIG_VFS_MAINT_PERIOD_MS (500)
+#endif
+
+/**
+ * @brief   per-mount maintenance registration
+ *
+ * The entry is owned by the caller and must stay valid until
+ * vfs_maint_unregister() returns.
+ */
+typedef struct {
+  clist_node_t list_entry;
+  vfs_mount_t *mountp; /**< mount to maintain */
+  vfs_gc_t gc;         /**< threshold and budget handed to the driver */
+  /** minimum ticks between two passes, 0 selects the default period */
+  OS_TICK period;
+  OS_TICK last_run;    /**< tick of the last pass */
+  uint32_t runs;       /**< number of passes */
+  uint32_t busy_runs;  /**< passes in which the driver did some work */
+  uint32_t errors;     /**< passes that failed */
+  int last_err;        /**< last error returned by the driver */
+  OS_TICK max_ticks;   /**< longest pass */
+} vfs_maint_t;
+
+int vfs_maint_init(void);
+
+int vfs_maint_register(vfs_maint_t *entry);
+
+int vfs_maint_unregister(vfs_maint_t *entry);
+
+int vfs_maint_run(void);
+
+void vfs_maint_kick(void);
+
+void vfs_maint_idle_hook(void);
+
+#endif /* UC_VFS_MAINT_H */
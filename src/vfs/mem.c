@@ -1,43 +1,257 @@
+#include <os.h>
+
 #include <lib_def.h>
 #include <lib_mem.h>
 
+#include "common.h"
 #include "errno.h"
 #include "inttypes.h"
 #include "logging.h"
 #include "mem.h"
+#include "printf.h"
 
 LOG_MODULE_REGISTER(mem, LOG_LEVEL_DBG);
 
-int mem_pool_create(mem_pool_t *pool, size_t blk_size, size_t align,
-                    size_t n_init) {
+/* mem_alloc() blocks start with their pool */
+#define MEM_HDR_SIZE sizeof(mem_pool_t *)
+
+static mem_pool_t *volatile _pools;
+
+static mem_pool_t _classes[CONFIG_MEM_CLASSES];
+static char _class_names[CONFIG_MEM_CLASSES][8];
+
+#if CONFIG_MEM_LOCKFREE
+/*
+ * Exception entry and return clear the exclusive monitor, so a store of
+ * another task or interrupt between _ldrex() and _strex() makes the latter
+ * fail. Popping is therefore safe from ABA without a tag.
+ */
+static inline void *_ldrex(void *volatile *addr) {
+  void *val;
+  __asm__ volatile("ldrex %0, [%1]" : "=r"(val) : "r"(addr) : "memory");
+  return val;
+}
+
+static inline int _strex(void *volatile *addr, void *val) {
+  int res;
+  __asm__ volatile("strex %0, %2, [%1]"
+                   : "=&r"(res)
+                   : "r"(addr), "r"(val)
+                   : "memory");
+  return res;
+}
+
+static inline void _clrex(void) { __asm__ volatile("clrex" ::: "memory"); }
+
+static void *_pop(mem_pool_t *pool) {
+  void *blk;
+
+  do {
+    if ((blk = _ldrex(&pool->free)) == NULL) {
+      _clrex();
+      return NULL;
+    }
+  } while (_strex(&pool->free, *(void **)blk));
+  return blk;
+}
+
+static void _push(mem_pool_t *pool, void *blk) {
+  do {
+    *(void **)blk = _ldrex(&pool->free);
+  } while (_strex(&pool->free, blk));
+}
+#else
+static void *_pop(mem_pool_t *pool) {
+  CPU_SR_ALLOC();
+
+  CPU_CRITICAL_ENTER();
+  void *blk = pool->free;
+  if (blk) {
+    pool->free = *(void **)blk;
+  }
+  CPU_CRITICAL_EXIT();
+  return blk;
+}
+
+static void _push(mem_pool_t *pool, void *blk) {
+  CPU_SR_ALLOC();
+
+  CPU_CRITICAL_ENTER();
+  *(void **)blk = pool->free;
+  pool->free = blk;
+  CPU_CRITICAL_EXIT();
+}
+#endif
+
+static inline void _count(volatile uint32_t *ctr) {
+  __atomic_fetch_add(ctr, 1u, __ATOMIC_RELAXED);
+}
+
+/* takes up to n_grow blocks from the heap and puts them on the free list */
+static int _grow(mem_pool_t *pool) {
+  uint32_t total = pool->total;
+  uint32_t n;
   LIB_ERR err = LIB_MEM_ERR_NONE;
 
-  Mem_DynPoolCreate(NULL, pool, NULL, blk_size, align, n_init,
-                    LIB_MEM_BLK_QTY_UNLIMITED, &err);
+  /* reserve first, pools grown by two tasks at once stay below n_max */
+  do {
+    n = pool->n_grow;
+    if (pool->n_max) {
+      if (total >= pool->n_max) {
+        return -ENOMEM;
+      }
+      n = MIN(n, pool->n_max - total);
+    }
+  } while (!__atomic_compare_exchange_n(&pool->total, &total, total + n, false,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+  uint8_t *chunk = Mem_SegAllocExt(pool->name, NULL, n * pool->blk_size,
+                                   pool->align, NULL, &err);
   if (err != LIB_MEM_ERR_NONE) {
-    LOG_DBG("DynPoolCreate=%d", err);
+    __atomic_fetch_sub(&pool->total, n, __ATOMIC_RELAXED);
+    LOG_DBG("%s: SegAlloc(%u)=%d", pool->name,
+            (unsigned)(n * pool->blk_size), err);
+    return -ENOMEM;
+  }
+  for (uint32_t i = 0; i < n; i++) {
+    _push(pool, &chunk[i * pool->blk_size]);
+  }
+  return 0;
+}
+
+int mem_pool_create(mem_pool_t *pool, const char *name, size_t blk_size,
+                    size_t align, size_t n_init, size_t n_max) {
+  CPU_SR_ALLOC();
+
+  if (pool == NULL || blk_size == 0 || (align & (align - 1))) {
     return -EINVAL;
   }
+  if (n_max && n_init > n_max) {
+    return -EINVAL;
+  }
+
+  /* free blocks hold the list link */
+  align = MAX(align, sizeof(void *));
+  pool->free = NULL;
+  pool->name = name ? name : "pool";
+  pool->blk_size = ROUND_UP(MAX(blk_size, sizeof(void *)), align);
+  pool->align = align;
+  pool->n_grow = MAX(1u, CONFIG_MEM_CHUNK_SIZE / pool->blk_size);
+  pool->n_max = n_max;
+  pool->total = 0;
+  pool->used = 0;
+  pool->max_used = 0;
+  pool->allocs = 0;
+  pool->frees = 0;
+  pool->fails = 0;
+
+  while (pool->total < n_init) {
+    int ret = _grow(pool);
+    if (ret) {
+      return ret;
+    }
+  }
+
+  CPU_CRITICAL_ENTER();
+  pool->next = _pools;
+  _pools = pool;
+  CPU_CRITICAL_EXIT();
+
   return 0;
 }
 
 void *mem_pool_alloc(mem_pool_t *pool) {
-  LIB_ERR err = LIB_MEM_ERR_NONE;
+  void *blk;
 
-  void *blk = Mem_DynPoolBlkGet(pool, &err);
-  if (err != LIB_MEM_ERR_NONE) {
-    LOG_DBG("DynPoolGet=%d", err);
-    return NULL;
+  while ((blk = _pop(pool)) == NULL) {
+    /* the heap is not for interrupts */
+    if (OSIntNestingCtr > 0u || _grow(pool) < 0) {
+      _count(&pool->fails);
+      return NULL;
+    }
+  }
+
+  _count(&pool->allocs);
+  uint32_t used = __atomic_add_fetch(&pool->used, 1u, __ATOMIC_RELAXED);
+  uint32_t max = pool->max_used;
+  while (used > max &&
+         !__atomic_compare_exchange_n(&pool->max_used, &max, used, false,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
   }
   return blk;
 }
 
 void mem_pool_free(mem_pool_t *pool, void *blk) {
-  LIB_ERR err = LIB_MEM_ERR_NONE;
+  if (blk == NULL) {
+    return;
+  }
+  _count(&pool->frees);
+  __atomic_fetch_sub(&pool->used, 1u, __ATOMIC_RELAXED);
+  _push(pool, blk);
+}
 
-  Mem_DynPoolBlkFree(pool, blk, &err);
-  if (err != LIB_MEM_ERR_NONE) {
-    LOG_DBG("DynPoolFree=%d", err);
+void mem_pool_stats(const mem_pool_t *pool, mem_pool_stats_t *stats) {
+  stats->name = pool->name;
+  stats->blk_size = pool->blk_size;
+  stats->total = pool->total;
+  stats->used = pool->used;
+  stats->max_used = pool->max_used;
+  stats->allocs = pool->allocs;
+  stats->frees = pool->frees;
+  stats->fails = pool->fails;
+}
+
+mem_pool_t *mem_pool_next(const mem_pool_t *pool) {
+  return pool ? pool->next : _pools;
+}
+
+void *mem_alloc(size_t size) {
+  for (int i = 0; i < CONFIG_MEM_CLASSES; i++) {
+    if (size <= ((size_t)CONFIG_MEM_MIN_CLASS << i)) {
+      mem_pool_t **blk = mem_pool_alloc(&_classes[i]);
+      if (blk == NULL) {
+        return NULL;
+      }
+      *blk = &_classes[i];
+      return (uint8_t *)blk + MEM_HDR_SIZE;
+    }
+  }
+  LOG_DBG("no class for %u bytes", (unsigned)size);
+  return NULL;
+}
+
+void mem_free(void *ptr) {
+  if (ptr == NULL) {
     return;
   }
+  mem_pool_t **blk = (mem_pool_t **)((uint8_t *)ptr - MEM_HDR_SIZE);
+  mem_pool_free(*blk, blk);
+}
+
+void mem_stats_print(void) {
+  mem_pool_stats_t st;
+
+  for (mem_pool_t *p = mem_pool_next(NULL); p; p = mem_pool_next(p)) {
+    mem_pool_stats(p, &st);
+    LOG_INF("%-14s %5u B: %4u used, %4u max, %4u total, %u/%u alloc/free, "
+            "%u failed",
+            st.name, (unsigned)st.blk_size, st.used, st.max_used, st.total,
+            st.allocs, st.frees, st.fails);
+  }
+}
+
+int mem_init(void) {
+  int ret = 0;
+
+  for (int i = 0; i < CONFIG_MEM_CLASSES; i++) {
+    size_t size = (size_t)CONFIG_MEM_MIN_CLASS << i;
+    snprintf_(_class_names[i], sizeof(_class_names[i]), "mem%u",
+              (unsigned)size);
+    if ((ret = mem_pool_create(&_classes[i], _class_names[i],
+                               size + MEM_HDR_SIZE, sizeof(void *), 0,
+                               CONFIG_MEM_CLASS_MAX_BLOCKS))) {
+      return ret;
+    }
+  }
+  return 0;
 }
@@ -1,17 +1,108 @@
 #ifndef UC_VFS_SLAB_H
 #define UC_VFS_SLAB_H
 
-#include <lib_mem.h>
+#include <stdbool.h>
 
 #include "inttypes.h"
 
-typedef MEM_DYN_POOL mem_pool_t;
+#ifndef CONFIG_MEM_LOCKFREE
+/** Take and give back blocks with LDREX/STREX instead of masking interrupts */
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+#define CONFIG_MEM_LOCKFREE (1)
+#else
+#define CONFIG_MEM_LOCKFREE (0)
+#endif
+#endif
 
-int mem_pool_create(mem_pool_t *pool, size_t blk_size, size_t align,
-                    size_t n_init);
+#ifndef CONFIG_MEM_CHUNK_SIZE
+/** A pool takes at least this many bytes of blocks from the heap at once */
+#define CONFIG_MEM_CHUNK_SIZE (512)
+#endif
+
+#ifndef CONFIG_MEM_CLASSES
+/** Size classes of mem_alloc(), CONFIG_MEM_MIN_CLASS << n bytes */
+#define CONFIG_MEM_CLASSES (8)
+#endif
+
+#ifndef CONFIG_MEM_MIN_CLASS
+#define CONFIG_MEM_MIN_CLASS (16)
+#endif
+
+#ifndef CONFIG_MEM_CLASS_MAX_BLOCKS
+/** Upper bound of blocks in every size class, 0 for no bound but the heap */
+#define CONFIG_MEM_CLASS_MAX_BLOCKS (0)
+#endif
+
+/**
+ * @brief   pool of fixed size blocks
+ *
+ * Blocks are carved from the uC-LIB heap in chunks and never go back to it,
+ * freed blocks are kept on a LIFO free list for the next allocation. The
+ * pool can be bounded to n_max blocks, allocations fail once they are all
+ * in use.
+ *
+ * Allocating and freeing only touch the free list head and the counters, both
+ * are safe from any task and from interrupts. Growing the pool takes from the
+ * heap and must not happen in an interrupt, an empty pool returns NULL there.
+ */
+typedef struct mem_pool {
+  void *volatile free; /**< free list, linked through the first word */
+  const char *name;
+  size_t blk_size; /**< block stride, rounded up to the alignment */
+  size_t align;
+  uint32_t n_grow; /**< blocks taken from the heap at once */
+  uint32_t n_max;  /**< 0 for unbounded */
+  volatile uint32_t total;
+  volatile uint32_t used;
+  volatile uint32_t max_used;
+  volatile uint32_t allocs;
+  volatile uint32_t frees;
+  volatile uint32_t fails;
+  struct mem_pool *next; /**< all pools, for mem_pool_next() */
+} mem_pool_t;
+
+typedef struct {
+  const char *name;
+  size_t blk_size;
+  uint32_t total;    /**< blocks taken from the heap */
+  uint32_t used;     /**< blocks currently allocated */
+  uint32_t max_used; /**< high-water mark of used */
+  uint32_t allocs;   /**< successful allocations */
+  uint32_t frees;
+  uint32_t fails; /**< allocations that returned NULL */
+} mem_pool_stats_t;
+
+/**
+ * @brief   set up @p pool and take @p n_init blocks from the heap
+ *
+ * @p n_max bounds the pool, 0 lets it grow until the heap is exhausted.
+ */
+int mem_pool_create(mem_pool_t *pool, const char *name, size_t blk_size,
+                    size_t align, size_t n_init, size_t n_max);
 
 void *mem_pool_alloc(mem_pool_t *pool);
 
 void mem_pool_free(mem_pool_t *pool, void *blk);
 
-#endif
\ No newline at end of file
+void mem_pool_stats(const mem_pool_t *pool, mem_pool_stats_t *stats);
+
+/** iterate over all pools, starting with NULL, in creation order reversed */
+mem_pool_t *mem_pool_next(const mem_pool_t *pool);
+
+/**
+ * @brief   allocate @p size bytes from the smallest fitting size class
+ *
+ * The block is aligned to sizeof(void *). Sizes above the largest class
+ * fail with NULL.
+ */
+void *mem_alloc(size_t size);
+
+/** give back a block of mem_alloc(), NULL is ignored */
+void mem_free(void *ptr);
+
+/** log the statistics of every pool */
+void mem_stats_print(void);
+
+int mem_init(void);
+
+#endif
@@ -0,0 +1,122 @@
+#include <string.h>
+
+#include "memops.h"
+
+#if CONFIG_VFS_MEMOPS_ASM &&                                                   \
+    (defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__))
+
+/* r7 is left alone, it is the Thumb frame pointer */
+#define BURST_REGS "{r3-r6, r8-r10, r12}"
+#define BURST_CLOBBERS "r3", "r4", "r5", "r6", "r8", "r9", "r10", "r12"
+#define BURST_SIZE (32u)
+
+/* keep GCC from turning the byte loops back into memcpy()/memset() calls */
+#define NO_LIBCALLS                                                            \
+  __attribute__((optimize("no-tree-loop-distribute-patterns")))
+
+/* LDR and STR take unaligned addresses on ARMv7-M, LDM and STM do not */
+typedef struct __attribute__((packed)) {
+  uint32_t v;
+} _unaligned_u32_t;
+
+NO_LIBCALLS void *vfs_memcpy(void *dst, const void *src, size_t n) {
+  uint8_t *d = dst;
+  const uint8_t *s = src;
+
+  if (n >= CONFIG_VFS_MEMOPS_SMALL) {
+    /* stores must not straddle words, the source may */
+    while ((uintptr_t)d & 3u) {
+      *d++ = *s++;
+      n--;
+    }
+    size_t bursts = n / BURST_SIZE;
+    if (bursts && ((uintptr_t)s & 3u) == 0) {
+      __asm__ volatile("1:\n\t"
+                       "ldmia %1!, " BURST_REGS "\n\t"
+                       "stmia %0!, " BURST_REGS "\n\t"
+                       "subs %2, %2, #1\n\t"
+                       "bne 1b"
+                       : "+r"(d), "+r"(s), "+r"(bursts)
+                       :
+                       : BURST_CLOBBERS, "cc", "memory");
+      n %= BURST_SIZE;
+    }
+    for (; n >= 4u; n -= 4u, d += 4, s += 4) {
+      *(uint32_t *)d = ((const _unaligned_u32_t *)s)->v;
+    }
+  }
+  while (n--) {
+    *d++ = *s++;
+  }
+  return dst;
+}
+
+NO_LIBCALLS void *vfs_memset(void *dst, int c, size_t n) {
+  uint8_t *d = dst;
+
+  if (n >= CONFIG_VFS_MEMOPS_SMALL) {
+    uint32_t w = (uint8_t)c * 0x01010101u;
+
+    while ((uintptr_t)d & 3u) {
+      *d++ = (uint8_t)c;
+      n--;
+    }
+    size_t bursts = n / BURST_SIZE;
+    if (bursts) {
+      __asm__ volatile("mov r3, %2\n\t"
+                       "mov r4, %2\n\t"
+                       "mov r5, %2\n\t"
+                       "mov r6, %2\n\t"
+                       "mov r8, %2\n\t"
+                       "mov r9, %2\n\t"
+                       "mov r10, %2\n\t"
+                       "mov r12, %2\n"
+                       "1:\n\t"
+                       "stmia %0!, " BURST_REGS "\n\t"
+                       "subs %1, %1, #1\n\t"
+                       "bne 1b"
+                       : "+r"(d), "+r"(bursts)
+                       : "r"(w)
+                       : BURST_CLOBBERS, "cc", "memory");
+      n %= BURST_SIZE;
+    }
+    for (; n >= 4u; n -= 4u, d += 4) {
+      *(uint32_t *)d = w;
+    }
+  }
+  while (n--) {
+    *d++ = (uint8_t)c;
+  }
+  return dst;
+}
+
+#elif CONFIG_VFS_MEMOPS_ASM && defined(__x86_64__)
+
+/* glibc picks SIMD loops by CPU, only large blocks are worth "rep movsb" */
+void *vfs_memcpy(void *dst, const void *src, size_t n) {
+  if (n < CONFIG_VFS_MEMOPS_REP_MIN) {
+    return memcpy(dst, src, n);
+  }
+  void *d = dst;
+  __asm__ volatile("rep movsb" : "+D"(d), "+S"(src), "+c"(n) : : "memory");
+  return dst;
+}
+
+void *vfs_memset(void *dst, int c, size_t n) {
+  if (n < CONFIG_VFS_MEMOPS_REP_MIN) {
+    return memset(dst, c, n);
+  }
+  void *d = dst;
+  __asm__ volatile("rep stosb" : "+D"(d), "+c"(n) : "a"(c) : "memory");
+  return dst;
+}
+
+#else
+
+void *vfs_memcpy(void *dst, const void *src, size_t n) {
+  return memcpy(dst, src, n);
+}
+
+void *vfs_memset(void *dst, int c, size_t n) { return memset(dst, c, n); }
+
+#endif
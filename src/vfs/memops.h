@@ -0,0 +1,34 @@
+#ifndef UC_VFS_MEMOPS_H
+#define UC_VFS_MEMOPS_H
+
+#include "inttypes.h"
+
+#ifndef CONFIG_VFS_MEMOPS_ASM
+/** Use the assembly kernels where the architecture has them */
+#define CONFIG_VFS_MEMOPS_ASM (1)
+#endif
+
+#ifndef CONFIG_VFS_MEMOPS_SMALL
+/** Below this many bytes the alignment fix-ups cost more than they save */
+#define CONFIG_VFS_MEMOPS_SMALL (16)
+#endif
+
+#ifndef CONFIG_VFS_MEMOPS_REP_MIN
+/** x86-64: from this size on "rep movsb/stosb" beats the libc SIMD loops */
+#define CONFIG_VFS_MEMOPS_REP_MIN (2048)
+#endif
+
+/**
+ * @brief   memcpy() for the ramdisk and the cache layers
+ *
+ * On ARMv7-M the destination is aligned first, then moved in 32 byte
+ * LDM/STM bursts when the source is aligned too, in unaligned word loads
+ * otherwise. Other targets use the C library, large blocks on x86-64 go
+ * through "rep movsb". The areas must not overlap.
+ */
+void *vfs_memcpy(void *dst, const void *src, size_t n);
+
+/** memset() counterpart of vfs_memcpy() */
+void *vfs_memset(void *dst, int c, size_t n);
+
+#endif
@@ -951,4 +951,11 @@ int fctprintf(void (*out)(char character, void *arg), void *arg,
                              (size_t)-1, format, va);
   va_end(va);
   return ret;
+}
+
+int vfctprintf(void (*out)(char character, void *arg), void *arg,
+               const char *format, va_list va) {
+  const out_fct_wrap_type out_fct_wrap = {out, arg};
+  return _vsnprintf(_out_fct, (char *)(uintptr_t)&out_fct_wrap, (size_t)-1,
+                    format, va);
 }
\ No newline at end of file
@@ -4,27 +4,403 @@
 #include "errno.h"
 #include "inttypes.h"
 #include "logging.h"
+#include "mem.h"
+#include "memops.h"
 #include "ramdisk.h"
 #include "string.h"
 
 LOG_MODULE_REGISTER(diskio, LOG_LEVEL_DBG);
 
 #define RAMDISK_MAX_SIZE (CONFIG_RAM_SEC_SIZE * CONFIG_RAM_N_SECS)
+#define RAMDISK_N_DISKS (2)
+#define RAMDISK_MAP_WORDS ((CONFIG_RAM_N_SECS + 31) / 32)
+
+#if CONFIG_RAM_SPARSE
+#define RAMDISK_N_LEAVES                                                       \
+  ((CONFIG_RAM_N_SECS + CONFIG_RAM_LEAF_SECS - 1) / CONFIG_RAM_LEAF_SECS)
+
+/* second level of the sector table */
+typedef struct {
+  uint32_t used; /**< sectors with storage, the leaf goes at 0 */
+  uint8_t *secs[CONFIG_RAM_LEAF_SECS];
+} _leaf_t;
+#endif
+
+/* a sector as it was when the snapshot was taken */
+typedef struct _undo {
+  struct _undo *next;
+  uint32_t sec;
+  uint8_t *old; /**< copy from the sector pool, NULL if it read as fill */
+} _undo_t;
 
 struct ramdisk_struct {
-  char mem[CONFIG_RAM_SEC_SIZE * CONFIG_RAM_N_SECS];
+#if CONFIG_RAM_SPARSE
+  _leaf_t *leaves[RAMDISK_N_LEAVES];
+#else
+  uint8_t *mem;
+  /** sectors that hold real data in mem, the others only exist as fill */
+  uint32_t written[RAMDISK_MAP_WORDS];
+#endif
+  uint8_t fill;    /**< content of sectors that were never written */
+  uint32_t stored; /**< sectors holding data */
+  bool snap;       /**< changes are recorded for ramdisk_restore() */
+  _undo_t *undo;   /**< sectors changed since the snapshot */
+  uint32_t n_undo;
+  uint32_t dirty[RAMDISK_MAP_WORDS]; /**< sectors on the undo list */
+  ramdisk_stats_t stats;
 };
 
-ramdisk_t disks[2] = {};
+/* sparse storage and snapshot copies */
+static mem_pool_t _sec_pool;
+static mem_pool_t _undo_pool;
+#if CONFIG_RAM_SPARSE
+static mem_pool_t _leaf_pool;
+#else
+/* skipped by the startup code, sectors are only touched once written */
+static uint8_t _mem[RAMDISK_N_DISKS][RAMDISK_MAX_SIZE]
+    __attribute__((section(".uninitialized"), aligned(4)));
+#endif
+
+ramdisk_t disks[RAMDISK_N_DISKS] = {};
+
+static inline bool _bit_test(const uint32_t *map, uint32_t n) {
+  return map[n / 32] & (1u << (n % 32));
+}
+
+static inline void _bit_set(uint32_t *map, uint32_t n) {
+  map[n / 32] |= 1u << (n % 32);
+}
+
+static inline void _bit_clear(uint32_t *map, uint32_t n) {
+  map[n / 32] &= ~(1u << (n % 32));
+}
+
+#if CONFIG_RAM_SPARSE
+/* storage of sec, NULL while it reads as fill */
+static inline uint8_t *_sec_get(const ramdisk_t *disk, uint32_t sec) {
+  const _leaf_t *leaf = disk->leaves[sec / CONFIG_RAM_LEAF_SECS];
+  return leaf ? leaf->secs[sec % CONFIG_RAM_LEAF_SECS] : NULL;
+}
+
+/* p becomes the storage of sec, which has none */
+static int _sec_set(ramdisk_t *disk, uint32_t sec, uint8_t *p) {
+  _leaf_t **leafp = &disk->leaves[sec / CONFIG_RAM_LEAF_SECS];
+
+  if (*leafp == NULL) {
+    if ((*leafp = mem_pool_alloc(&_leaf_pool)) == NULL) {
+      return -ENOSPC;
+    }
+    memset(*leafp, 0, sizeof(_leaf_t));
+  }
+  (*leafp)->secs[sec % CONFIG_RAM_LEAF_SECS] = p;
+  (*leafp)->used++;
+  disk->stored++;
+  return 0;
+}
+
+/* storage for the first write to sec, its content is undefined */
+static uint8_t *_sec_alloc(ramdisk_t *disk, uint32_t sec) {
+  uint8_t *p = mem_pool_alloc(&_sec_pool);
+
+  if (p && _sec_set(disk, sec, p)) {
+    mem_pool_free(&_sec_pool, p);
+    return NULL;
+  }
+  return p;
+}
+
+/* sec reads as fill again, its storage goes back to the pool */
+static void _sec_discard(ramdisk_t *disk, uint32_t sec) {
+  _leaf_t **leafp = &disk->leaves[sec / CONFIG_RAM_LEAF_SECS];
+  uint8_t **secp = *leafp ? &(*leafp)->secs[sec % CONFIG_RAM_LEAF_SECS] : NULL;
+
+  if (secp == NULL || *secp == NULL) {
+    return;
+  }
+  mem_pool_free(&_sec_pool, *secp);
+  *secp = NULL;
+  disk->stored--;
+  if (--(*leafp)->used == 0) {
+    mem_pool_free(&_leaf_pool, *leafp);
+    *leafp = NULL;
+  }
+}
+
+/* sec gets its snapshot copy back, no data is moved */
+static int _sec_restore(ramdisk_t *disk, uint32_t sec, uint8_t *old) {
+  uint8_t *cur = _sec_get(disk, sec);
+
+  if (old == NULL) {
+    _sec_discard(disk, sec);
+    return 0;
+  }
+  if (cur == NULL) {
+    return _sec_set(disk, sec, old);
+  }
+  disk->leaves[sec / CONFIG_RAM_LEAF_SECS]->secs[sec % CONFIG_RAM_LEAF_SECS] =
+      old;
+  mem_pool_free(&_sec_pool, cur);
+  return 0;
+}
+#else
+static inline uint8_t *_sec_get(const ramdisk_t *disk, uint32_t sec) {
+  if (_bit_test(disk->written, sec)) {
+    return disk->mem + sec * CONFIG_RAM_SEC_SIZE;
+  }
+  return NULL;
+}
+
+static uint8_t *_sec_alloc(ramdisk_t *disk, uint32_t sec) {
+  _bit_set(disk->written, sec);
+  disk->stored++;
+  return disk->mem + sec * CONFIG_RAM_SEC_SIZE;
+}
+
+static void _sec_discard(ramdisk_t *disk, uint32_t sec) {
+  if (_sec_get(disk, sec)) {
+    _bit_clear(disk->written, sec);
+    disk->stored--;
+  }
+}
+
+/* sec gets its snapshot copy back, which goes to the pool */
+static int _sec_restore(ramdisk_t *disk, uint32_t sec, uint8_t *old) {
+  if (old == NULL) {
+    _sec_discard(disk, sec);
+    return 0;
+  }
+  uint8_t *p = _sec_get(disk, sec);
+  vfs_memcpy(p ? p : _sec_alloc(disk, sec), old, CONFIG_RAM_SEC_SIZE);
+  mem_pool_free(&_sec_pool, old);
+  return 0;
+}
+#endif
+
+/*
+ * keeps what sec holds at its first change after the snapshot, later changes
+ * need nothing. Fails once the pools are exhausted, sec must stay unchanged.
+ */
+static int _cow(ramdisk_t *disk, uint32_t sec) {
+  if (!disk->snap || _bit_test(disk->dirty, sec)) {
+    return 0;
+  }
+  _undo_t *u = mem_pool_alloc(&_undo_pool);
+  if (u == NULL) {
+    return -ENOSPC;
+  }
+  const uint8_t *p = _sec_get(disk, sec);
+  u->old = NULL;
+  if (p) {
+    if ((u->old = mem_pool_alloc(&_sec_pool)) == NULL) {
+      mem_pool_free(&_undo_pool, u);
+      return -ENOSPC;
+    }
+    vfs_memcpy(u->old, p, CONFIG_RAM_SEC_SIZE);
+  }
+  u->sec = sec;
+  u->next = disk->undo;
+  disk->undo = u;
+  disk->n_undo++;
+  _bit_set(disk->dirty, sec);
+  return 0;
+}
+
+/* the current content becomes the snapshot, the copies are freed */
+static void _forget(ramdisk_t *disk) {
+  _undo_t *u;
+
+  while ((u = disk->undo) != NULL) {
+    disk->undo = u->next;
+    _bit_clear(disk->dirty, u->sec);
+    mem_pool_free(&_sec_pool, u->old);
+    mem_pool_free(&_undo_pool, u);
+  }
+  disk->n_undo = 0;
+}
+
+/*
+ * length of the run at addr that is contiguous in memory, at most left bytes,
+ * *p is NULL for a run of sectors that read as fill
+ */
+static size_t _run(const ramdisk_t *disk, size_t addr, size_t left,
+                   uint8_t **p) {
+  uint32_t sec = addr / CONFIG_RAM_SEC_SIZE;
+  uint8_t *base = _sec_get(disk, sec);
+  size_t n = MIN(left, CONFIG_RAM_SEC_SIZE - addr % CONFIG_RAM_SEC_SIZE);
+
+  *p = base ? base + addr % CONFIG_RAM_SEC_SIZE : NULL;
+  while (n < left) {
+    uint8_t *next = _sec_get(disk, ++sec);
+    if (base ? next != base + CONFIG_RAM_SEC_SIZE : next != NULL) {
+      break;
+    }
+    base = next;
+    n += MIN(left - n, CONFIG_RAM_SEC_SIZE);
+  }
+  return n;
+}
+
+static void _read(ramdisk_t *disk, uint8_t *buf, size_t addr, size_t sz) {
+  uint8_t *p;
+
+  /* one copy for neighbours that follow each other in memory */
+  for (size_t n; sz; addr += n, buf += n, sz -= n) {
+    n = _run(disk, addr, sz, &p);
+    if (p) {
+      vfs_memcpy(buf, p, n);
+    } else {
+      vfs_memset(buf, disk->fill, n);
+    }
+  }
+}
+
+/*
+ * gives the sectors of [addr, addr + sz) storage on first write, holding the
+ * fill value where the write does not cover them. Returns how much of the
+ * range has storage, less than sz once the pool is exhausted.
+ */
+static size_t _materialize(ramdisk_t *disk, size_t addr, size_t sz) {
+  uint32_t first = addr / CONFIG_RAM_SEC_SIZE;
+  uint32_t last = (addr + sz - 1) / CONFIG_RAM_SEC_SIZE;
+
+  for (uint32_t sec = first; sec <= last; sec++) {
+    size_t start = sec * CONFIG_RAM_SEC_SIZE;
+    size_t end = start + CONFIG_RAM_SEC_SIZE;
+    uint8_t *p = NULL;
+    if (_cow(disk, sec) == 0) {
+      if (_sec_get(disk, sec)) {
+        continue;
+      }
+      p = _sec_alloc(disk, sec);
+    }
+    if (p == NULL) {
+      LOG_DBG("no storage for sector %u", (unsigned)sec);
+      return (sec == first) ? 0 : start - addr;
+    }
+    if (addr > start) {
+      vfs_memset(p, disk->fill, addr - start);
+    }
+    if (addr + sz < end) {
+      vfs_memset(p + (addr + sz - start), disk->fill, end - (addr + sz));
+    }
+  }
+  return sz;
+}
+
+/* the sectors fully inside [addr, addr + sz) read as fill again */
+static int _discard(ramdisk_t *disk, size_t addr, size_t sz) {
+  uint32_t first = ROUND_UP(addr, CONFIG_RAM_SEC_SIZE) / CONFIG_RAM_SEC_SIZE;
+  uint32_t end = (addr + sz) / CONFIG_RAM_SEC_SIZE;
+
+  for (uint32_t sec = first; sec < end; sec++) {
+    if (_sec_get(disk, sec) == NULL) {
+      continue;
+    }
+    int ret = _cow(disk, sec);
+    if (ret) {
+      LOG_DBG("no snapshot copy of sector %u", (unsigned)sec);
+      return ret;
+    }
+    _sec_discard(disk, sec);
+  }
+  return 0;
+}
+
+/* out of storage the write is torn at a sector boundary, like on a device */
+static int _write(ramdisk_t *disk, const uint8_t *buf, size_t addr,
+                  size_t sz) {
+  size_t avail = _materialize(disk, addr, sz);
+  uint8_t *p;
+
+  for (size_t n, left = avail; left; addr += n, buf += n, left -= n) {
+    n = _run(disk, addr, left, &p);
+    vfs_memcpy(p, buf, n);
+  }
+  return (avail < sz) ? -ENOSPC : 0;
+}
+
+/* [addr, addr + sz) reads as c afterwards */
+static int _set(ramdisk_t *disk, size_t addr, size_t sz, uint8_t c) {
+  if (c == disk->fill) {
+    /* whole sectors go back to fill, only the partial ones are touched */
+    size_t start = ROUND_UP(addr, CONFIG_RAM_SEC_SIZE);
+    size_t end = (addr + sz) / CONFIG_RAM_SEC_SIZE * CONFIG_RAM_SEC_SIZE;
+    if (start < end) {
+      /* in address order, a failure tears the erase like a write */
+      int ret = 0;
+      if (addr < start) {
+        ret = _set(disk, addr, start - addr, c);
+      }
+      if (ret == 0) {
+        ret = _discard(disk, start, end - start);
+      }
+      if (ret == 0 && end < addr + sz) {
+        ret = _set(disk, end, addr + sz - end, c);
+      }
+      return ret;
+    }
+  }
+  size_t avail = _materialize(disk, addr, sz);
+  uint8_t *p;
+
+  for (size_t n, left = avail; left; addr += n, left -= n) {
+    n = _run(disk, addr, left, &p);
+    vfs_memset(p, c, n);
+  }
+  return (avail < sz) ? -ENOSPC : 0;
+}
+
+static int _erase(ramdisk_t *disk, size_t addr, size_t sz) {
+  return _set(disk, addr, sz, 0xFF);
+}
 
+/* a sector of an image that holds nothing but the fill value */
+static bool _is_fill(const ramdisk_t *disk, const uint8_t *p, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    if (p[i] != disk->fill) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* O(1) in the disk size, no sector is touched before its first write */
 int ramdisk_init() {
-  memset(disks[0].mem, 0, RAMDISK_MAX_SIZE);
-  memset(disks[1].mem, 0xFF, RAMDISK_MAX_SIZE);
+  int ret = mem_pool_create(&_sec_pool, "ramdisk_sec", CONFIG_RAM_SEC_SIZE,
+                            sizeof(uint32_t), 0, CONFIG_RAM_SPARSE_MAX_SECS);
+  if (ret == 0) {
+    ret = mem_pool_create(&_undo_pool, "ramdisk_undo", sizeof(_undo_t),
+                          sizeof(void *), 0, 0);
+  }
+#if CONFIG_RAM_SPARSE
+  if (ret == 0) {
+    ret = mem_pool_create(&_leaf_pool, "ramdisk_leaf", sizeof(_leaf_t),
+                          sizeof(void *), 0, 0);
+  }
+#endif
+  if (ret) {
+    return ret;
+  }
+  for (int i = 0; i < RAMDISK_N_DISKS; i++) {
+#if CONFIG_RAM_SPARSE
+    memset(disks[i].leaves, 0, sizeof(disks[i].leaves));
+#else
+    disks[i].mem = _mem[i];
+    memset(disks[i].written, 0, sizeof(disks[i].written));
+#endif
+    disks[i].stored = 0;
+    disks[i].snap = false;
+    disks[i].undo = NULL;
+    disks[i].n_undo = 0;
+    memset(disks[i].dirty, 0, sizeof(disks[i].dirty));
+  }
+  disks[0].fill = 0x00;
+  disks[1].fill = 0xFF;
   return 0;
 }
 
 ramdisk_t *ramdisk_open(ramdisk_no no) {
-  if (no > 1) {
+  if (no >= RAMDISK_N_DISKS) {
     LOG_DBG("disk_no=%d", no);
     return NULL;
   }
@@ -56,7 +432,8 @@ int ramdisk_read(ramdisk_t *disk, void *buf, uint32_t start_sec, off_t off,
     return -EOVERFLOW;
   }
 
-  memcpy(buf, disk->mem + start_addr, sz);
+  _read(disk, buf, start_addr, sz);
+  disk->stats.bytes_read += sz;
   return sz;
 }
 
@@ -79,7 +456,8 @@ int ramdisk_read_addr(ramdisk_t *disk, void *buf, size_t addr, size_t sz) {
     LOG_ERR("addr overflow");
     return -EOVERFLOW;
   }
-  memcpy(buf, disk->mem + addr, sz);
+  _read(disk, buf, addr, sz);
+  disk->stats.bytes_read += sz;
   return sz;
 }
 
@@ -105,7 +483,11 @@ int ramdisk_write(ramdisk_t *disk, const void *buf, uint32_t start_sec,
     return -EOVERFLOW;
   }
 
-  memcpy(disk->mem + start_addr, buf, sz);
+  int ret = _write(disk, buf, start_addr, sz);
+  if (ret < 0) {
+    return ret;
+  }
+  disk->stats.bytes_written += sz;
   return sz;
 }
 
@@ -128,7 +510,11 @@ int ramdisk_write_addr(ramdisk_t *disk, const void *buf, size_t addr,
   if (end_addr > RAMDISK_MAX_SIZE || end_addr < addr) {
     return -EOVERFLOW;
   }
-  memcpy(disk->mem + addr, buf, sz);
+  int ret = _write(disk, buf, addr, sz);
+  if (ret < 0) {
+    return ret;
+  }
+  disk->stats.bytes_written += sz;
   return sz;
 }
 
@@ -151,6 +537,96 @@ int ramdisk_erase_addr(ramdisk_t *disk, size_t addr, size_t sz) {
     LOG_ERR("addr overflow");
     return -EOVERFLOW;
   }
-  memset(disk->mem + addr, 0xFF, sz);
+  int ret = _erase(disk, addr, sz);
+  if (ret < 0) {
+    return ret;
+  }
+  disk->stats.bytes_erased += sz;
   return sz;
+}
+
+int ramdisk_trim(ramdisk_t *disk, size_t addr, size_t sz) {
+  if (!disk) {
+    LOG_ERR("invalid disk");
+    return -EINVAL;
+  }
+  size_t end_addr = addr + sz;
+  if (end_addr > RAMDISK_MAX_SIZE || end_addr < addr) {
+    LOG_ERR("addr overflow");
+    return -EOVERFLOW;
+  }
+  return _discard(disk, addr, sz);
+}
+
+int ramdisk_load(ramdisk_t *disk, const void *img, size_t sz, uint8_t pad) {
+  const uint8_t *src = img;
+  int ret = 0;
+
+  if (!disk || (!img && sz)) {
+    LOG_ERR("invalid disk or img");
+    return -EINVAL;
+  }
+  if (sz > RAMDISK_MAX_SIZE) {
+    LOG_ERR("image too large");
+    return -EOVERFLOW;
+  }
+
+  for (size_t addr = 0; ret == 0 && addr < sz; addr += CONFIG_RAM_SEC_SIZE) {
+    size_t n = MIN(CONFIG_RAM_SEC_SIZE, sz - addr);
+    if (n == CONFIG_RAM_SEC_SIZE && _is_fill(disk, src + addr, n)) {
+      ret = _discard(disk, addr, n);
+    } else {
+      ret = _write(disk, src + addr, addr, n);
+    }
+  }
+  if (ret == 0 && sz < RAMDISK_MAX_SIZE) {
+    ret = _set(disk, sz, RAMDISK_MAX_SIZE - sz, pad);
+  }
+  return ret;
+}
+
+int ramdisk_snapshot(ramdisk_t *disk) {
+  if (!disk) {
+    LOG_ERR("invalid disk");
+    return -EINVAL;
+  }
+  _forget(disk);
+  disk->snap = true;
+  return 0;
+}
+
+int ramdisk_restore(ramdisk_t *disk) {
+  if (!disk || !disk->snap) {
+    LOG_ERR("no snapshot");
+    return -EINVAL;
+  }
+  while (disk->undo) {
+    _undo_t *u = disk->undo;
+    int ret = _sec_restore(disk, u->sec, u->old);
+    if (ret) {
+      LOG_ERR("restore of sector %u=%d", (unsigned)u->sec, ret);
+      return ret;
+    }
+    disk->undo = u->next;
+    disk->n_undo--;
+    _bit_clear(disk->dirty, u->sec);
+    mem_pool_free(&_undo_pool, u);
+  }
+  return 0;
+}
+
+void ramdisk_snapshot_drop(ramdisk_t *disk) {
+  if (disk) {
+    _forget(disk);
+    disk->snap = false;
+  }
+}
+
+void ramdisk_stats(ramdisk_t *disk, ramdisk_stats_t *stats, bool reset) {
+  *stats = disk->stats;
+  stats->sectors_stored = disk->stored;
+  stats->sectors_dirty = disk->n_undo;
+  if (reset) {
+    memset(&disk->stats, 0, sizeof(disk->stats));
+  }
 }
\ No newline at end of file
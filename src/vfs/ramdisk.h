@@ -1,17 +1,53 @@
 #ifndef UC_VFS_DISKIO_H
 #define UC_VFS_DISKIO_H
 
+#include <stdbool.h>
 #include <unistd.h>
 
 #include "inttypes.h"
 
 #define CONFIG_RAM_SEC_SIZE 512
+
+#ifndef CONFIG_RAM_N_SECS
+/** Sectors of every disk, initialization does not depend on it */
 #define CONFIG_RAM_N_SECS 1024
+#endif
+
+#ifndef CONFIG_RAM_SPARSE
+/**
+ * Give sectors storage from a pool on first write instead of reserving the
+ * whole disk, the pools grow from the uC-LIB heap. CONFIG_RAM_N_SECS then
+ * only sizes the sector table.
+ */
+#define CONFIG_RAM_SPARSE 0
+#endif
+
+#ifndef CONFIG_RAM_LEAF_SECS
+/** Sectors per second level table of a sparse disk */
+#define CONFIG_RAM_LEAF_SECS 64
+#endif
+
+#ifndef CONFIG_RAM_SPARSE_MAX_SECS
+/**
+ * Sectors stored by all sparse disks together, snapshot copies included, 0
+ * for no bound but the heap
+ */
+#define CONFIG_RAM_SPARSE_MAX_SECS 0
+#endif
 
 typedef uint8_t ramdisk_no;
 
 typedef struct ramdisk_struct ramdisk_t;
 
+/** bytes moved by the driver since the last reset, for write amplification */
+typedef struct {
+  uint32_t bytes_read;
+  uint32_t bytes_written;
+  uint32_t bytes_erased;
+  uint32_t sectors_stored; /**< sectors holding data, not reset */
+  uint32_t sectors_dirty;  /**< sectors changed since the snapshot */
+} ramdisk_stats_t;
+
 int ramdisk_init(void);
 
 ramdisk_t *ramdisk_open(ramdisk_no no);
@@ -29,4 +65,45 @@ int ramdisk_write_addr(ramdisk_t *disk, const void *buf, size_t addr,
 
 int ramdisk_erase_addr(ramdisk_t *disk, size_t addr, size_t sz);
 
+/**
+ * @brief   drop the content of the sectors fully inside [addr, addr + sz)
+ *
+ * They read as the fill value of the disk afterwards, a sparse disk gives
+ * their storage back.
+ */
+int ramdisk_trim(ramdisk_t *disk, size_t addr, size_t sz);
+
+/**
+ * @brief   make @p disk read as the image @p img, then @p pad up to its end
+ *
+ * For images of tools/mkimage, which are linked into the firmware or loaded
+ * by the debugger. Sectors that only hold the fill value of the disk take
+ * no storage. Nothing may have the disk mounted.
+ */
+int ramdisk_load(ramdisk_t *disk, const void *img, size_t sz, uint8_t pad);
+
+/**
+ * @brief   capture the current content of @p disk for ramdisk_restore()
+ *
+ * Sectors are copied on their first change after the snapshot, taking one
+ * sector from the pool each. Writes that find the pool exhausted fail with
+ * -ENOSPC like a full sparse disk. A previous snapshot of the disk is
+ * dropped, a disk has at most one.
+ */
+int ramdisk_snapshot(ramdisk_t *disk);
+
+/**
+ * @brief   put the content of the snapshot back
+ *
+ * Takes time in the sectors changed since the snapshot or the last restore,
+ * not in the disk size. The snapshot stays for the next restore. Nothing may
+ * have the disk mounted.
+ */
+int ramdisk_restore(ramdisk_t *disk);
+
+/** keep the current content and free the copies of the snapshot */
+void ramdisk_snapshot_drop(ramdisk_t *disk);
+
+void ramdisk_stats(ramdisk_t *disk, ramdisk_stats_t *stats, bool reset);
+
 #endif
\ No newline at end of file
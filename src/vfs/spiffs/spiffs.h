@@ -125,6 +125,28 @@ typedef void (*spiffs_check_callback)(spiffs_check_type type, spiffs_check_repor
     u32_t arg1, u32_t arg2);
 #endif // SPIFFS_HAL_CALLBACK_EXTRA
 
+#if SPIFFS_CHECK_INCREMENTAL
+/* state of an incremental consistency check */
+typedef struct {
+  // pass being run, past SPIFFS_CHECK_PAGE once the check is complete
+  u8_t pass;
+  // set once a step repaired something
+  u8_t repaired;
+  // next block of the pass
+  spiffs_block_ix block;
+  // first page of the range the page pass builds its bitmap for
+  spiffs_page_ix pix_offset;
+  // number of page range restarts of the page pass
+  u32_t restarts;
+  // restarts of the current page range caused by writes between two steps
+  u8_t range_restarts;
+  // modification count of the file system at the end of the last step
+  u32_t mod_count;
+  // page pass bitmap, one logical page owned by the caller
+  u8_t *map;
+} spiffs_check_state;
+#endif
+
 /* file system listener callback operation */
 typedef enum {
   /* the file has been created */
@@ -197,6 +219,30 @@ typedef void (*spiffs_file_callback)(struct spiffs_t *fs, spiffs_fileop_type op,
 // phys structs
 
 // spiffs spi configuration struct
+#if SPIFFS_MOUNT_SNAPSHOT
+/* summary of the object lookup scan, kept across a clean unmount */
+typedef struct {
+  // number of free blocks
+  u32_t free_blocks;
+  // number of busy pages
+  u32_t stats_p_allocated;
+  // number of deleted pages
+  u32_t stats_p_deleted;
+  // max erase count amongst all blocks
+  spiffs_obj_id max_erase_count;
+} spiffs_snapshot;
+
+/* snapshot load function type, must return SPIFFS_OK only for a valid summary */
+typedef s32_t (*spiffs_snapshot_load)(struct spiffs_t *fs, spiffs_snapshot *snap);
+/* snapshot store function type */
+typedef s32_t (*spiffs_snapshot_store)(struct spiffs_t *fs, const spiffs_snapshot *snap);
+#endif
+
+#if SPIFFS_NAME_LOOKUP
+/* object index header lookup by name function type */
+typedef s32_t (*spiffs_name_lookup)(struct spiffs_t *fs, const u8_t *name, spiffs_page_ix *pix);
+#endif
+
 typedef struct {
   // physical read function
   spiffs_read hal_read_f;
@@ -226,6 +272,16 @@ typedef struct {
   // an integer offset added to each file handle
   u16_t fh_ix_offset;
 #endif
+#if SPIFFS_MOUNT_SNAPSHOT
+  // loads the lookup scan summary on mount, may be null
+  spiffs_snapshot_load snapshot_load_f;
+  // stores the lookup scan summary on unmount, may be null
+  spiffs_snapshot_store snapshot_store_f;
+#endif
+#if SPIFFS_NAME_LOOKUP
+  // looks up object index headers by name, may be null
+  spiffs_name_lookup name_lookup_f;
+#endif
 } spiffs_config;
 
 typedef struct spiffs_t {
@@ -263,6 +319,10 @@ typedef struct spiffs_t {
   u32_t stats_p_deleted;
   // flag indicating that garbage collector is cleaning
   u8_t cleaning;
+#if SPIFFS_CHECK_INCREMENTAL
+  // bumped by every write and erase
+  u32_t mod_count;
+#endif
   // max erase count amongst all blocks
   spiffs_obj_id max_erase_count;
 
@@ -595,6 +655,34 @@ struct spiffs_dirent *SPIFFS_readdir(spiffs_DIR *d, struct spiffs_dirent *e);
  */
 s32_t SPIFFS_check(spiffs *fs);
 
+#if SPIFFS_CHECK_INCREMENTAL
+/**
+ * Prepares an incremental consistency check, see SPIFFS_check_step.
+ * @param fs            the file system struct
+ * @param st            the check state
+ * @param map           page pass bitmap of SPIFFS_CFG_LOG_PAGE_SZ(fs) bytes,
+ *                      must stay valid until the check is complete
+ */
+s32_t SPIFFS_check_start(spiffs *fs, spiffs_check_state *st, u8_t *map);
+
+/**
+ * Runs the consistency check started with SPIFFS_check_start over at most
+ * max_blocks blocks. The file system may be used between two steps.
+ * @param fs            the file system struct
+ * @param st            the check state
+ * @param max_blocks    number of blocks to visit
+ * @returns 1 while there is work left, 0 once the check is complete, or error
+ */
+s32_t SPIFFS_check_step(spiffs *fs, spiffs_check_state *st, u32_t max_blocks);
+
+/**
+ * Returns the progress of an incremental consistency check, 0 to 256.
+ * @param fs            the file system struct
+ * @param st            the check state
+ */
+u32_t SPIFFS_check_progress(spiffs *fs, const spiffs_check_state *st);
+#endif
+
 /**
  * Returns number of total bytes available and number of used bytes.
  * This is an estimation, and depends on if there a many files with little
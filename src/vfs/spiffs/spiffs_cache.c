@@ -191,6 +191,9 @@ s32_t spiffs_phys_wr(
   spiffs_cache *cache = spiffs_get_cache(fs);
   spiffs_cache_page *cp =  spiffs_cache_page_get(fs, pix);
 
+#if SPIFFS_CHECK_INCREMENTAL
+  fs->mod_count++;
+#endif
   if (cp && (op & SPIFFS_OP_COM_MASK) != SPIFFS_OP_C_WRTHRU) {
     // have a cache page
     // copy in data to cache page
@@ -47,6 +47,10 @@ extern "C" {
 
 // ----------- >8 ------------
 
+// Cache page and object buffer copies use the tuned VFS kernels
+#include "memops.h"
+#define _SPIFFS_MEMCPY(__d, __s, __l) do{vfs_memcpy((__d),(__s),(__l));}while(0)
+
 // compile time switches
 
 // Set generic spiffs debug output call.
@@ -276,6 +280,48 @@ void spiffs_unlock(struct spiffs_t *fs);
 #define SPIFFS_FILEHDL_OFFSET                 0
 #endif
 
+// Enable this to let the HAL keep a summary of the object lookup scan across
+// a clean unmount. SPIFFS_unmount hands the summary to snapshot_store_f and
+// SPIFFS_mount skips the scan of all lookup pages when snapshot_load_f
+// returns SPIFFS_OK. The HAL is responsible for storing the summary outside
+// of the file system and for refusing it once it may be stale, i.e. after it
+// has been loaded once or after a format.
+// NB: This adds config fields snapshot_load_f and snapshot_store_f in the
+// configuration struct when mounting, both may be null.
+#ifndef SPIFFS_MOUNT_SNAPSHOT
+#define SPIFFS_MOUNT_SNAPSHOT                 1
+#endif
+
+// Enable this to let the HAL answer lookups of object index headers by name
+// from an index of its own instead of visiting the object lookup pages.
+// name_lookup_f returns SPIFFS_OK with the header page or SPIFFS_ERR_NOT_FOUND
+// when it knows the answer, any other result falls back to the scan.
+// NB: This adds config field name_lookup_f in the configuration struct when
+// mounting, which may be null.
+#ifndef SPIFFS_NAME_LOOKUP
+#define SPIFFS_NAME_LOOKUP                    1
+#endif
+
+// Enable this to get SPIFFS_check_start and SPIFFS_check_step, which run the
+// same passes as SPIFFS_check a bounded number of blocks at a time. The page
+// consistency pass needs a bitmap of one logical page that the caller owns
+// for the whole check, and restarts its current page range whenever the file
+// system was written to between two steps. After SPIFFS_CHECK_MAX_RESTARTS
+// such restarts in a row, the range is finished within a single step so the
+// check cannot be starved by a busy file system.
+#ifndef SPIFFS_CHECK_INCREMENTAL
+#define SPIFFS_CHECK_INCREMENTAL              1
+#endif
+#ifndef SPIFFS_CHECK_MAX_RESTARTS
+#define SPIFFS_CHECK_MAX_RESTARTS             2
+#endif
+
+// Enable this to get the SPIFFS_ix_map family of functions, which let an
+// open file keep the data page indices of a range of its content in RAM.
+#ifndef SPIFFS_IX_MAP
+#define SPIFFS_IX_MAP                         1
+#endif
+
 // Enable this to compile a read only version of spiffs.
 // This will reduce binary size of spiffs. All code comprising modification
 // of the file system will not be compiled. Some config will be ignored.
@@ -129,8 +129,20 @@ s32_t SPIFFS_mount(spiffs *fs, spiffs_config *config, u8_t *work,
 
   fs->config_magic = SPIFFS_CONFIG_MAGIC;
 
-  res = spiffs_obj_lu_scan(fs);
-  SPIFFS_API_CHECK_RES_UNLOCK(fs, res);
+#if SPIFFS_MOUNT_SNAPSHOT
+  spiffs_snapshot snap;
+  if (fs->cfg.snapshot_load_f && fs->cfg.snapshot_load_f(fs, &snap) == SPIFFS_OK) {
+    fs->free_blocks = snap.free_blocks;
+    fs->stats_p_allocated = snap.stats_p_allocated;
+    fs->stats_p_deleted = snap.stats_p_deleted;
+    fs->max_erase_count = snap.max_erase_count;
+    SPIFFS_DBG("mount: lookup scan skipped, using snapshot\n");
+  } else
+#endif
+  {
+    res = spiffs_obj_lu_scan(fs);
+    SPIFFS_API_CHECK_RES_UNLOCK(fs, res);
+  }
 
   SPIFFS_DBG("page index byte len:         "_SPIPRIi"\n", (u32_t)SPIFFS_CFG_LOG_PAGE_SZ(fs));
   SPIFFS_DBG("object lookup pages:         "_SPIPRIi"\n", (u32_t)SPIFFS_OBJ_LOOKUP_PAGES(fs));
@@ -165,6 +177,16 @@ void SPIFFS_unmount(spiffs *fs) {
       spiffs_fd_return(fs, cur_fd->file_nbr);
     }
   }
+#if SPIFFS_MOUNT_SNAPSHOT && !SPIFFS_READ_ONLY
+  if (fs->cfg.snapshot_store_f && !fs->cleaning) {
+    spiffs_snapshot snap;
+    snap.free_blocks = fs->free_blocks;
+    snap.stats_p_allocated = fs->stats_p_allocated;
+    snap.stats_p_deleted = fs->stats_p_deleted;
+    snap.max_erase_count = fs->max_erase_count;
+    (void)fs->cfg.snapshot_store_f(fs, &snap);
+  }
+#endif
   fs->mounted = 0;
 
   SPIFFS_UNLOCK(fs);
@@ -1119,6 +1141,55 @@ s32_t SPIFFS_check(spiffs *fs) {
 #endif // SPIFFS_READ_ONLY
 }
 
+#if SPIFFS_CHECK_INCREMENTAL
+s32_t SPIFFS_check_start(spiffs *fs, spiffs_check_state *st, u8_t *map) {
+  SPIFFS_API_DBG("%s\n", __func__);
+#if SPIFFS_READ_ONLY
+  (void)fs; (void)st; (void)map;
+  return SPIFFS_ERR_RO_NOT_IMPL;
+#else
+  SPIFFS_API_CHECK_CFG(fs);
+  SPIFFS_API_CHECK_MOUNT(fs);
+  SPIFFS_LOCK(fs);
+
+  memset(st, 0, sizeof(spiffs_check_state));
+  st->pass = SPIFFS_CHECK_LOOKUP;
+  st->mod_count = fs->mod_count;
+  st->map = map;
+
+  SPIFFS_UNLOCK(fs);
+  return SPIFFS_OK;
+#endif // SPIFFS_READ_ONLY
+}
+
+s32_t SPIFFS_check_step(spiffs *fs, spiffs_check_state *st, u32_t max_blocks) {
+  SPIFFS_API_DBG("%s "_SPIPRIi"\n", __func__, max_blocks);
+#if SPIFFS_READ_ONLY
+  (void)fs; (void)st; (void)max_blocks;
+  return SPIFFS_ERR_RO_NOT_IMPL;
+#else
+  s32_t res;
+  SPIFFS_API_CHECK_CFG(fs);
+  SPIFFS_API_CHECK_MOUNT(fs);
+  SPIFFS_LOCK(fs);
+
+  res = spiffs_check_step(fs, st, max_blocks);
+
+  SPIFFS_UNLOCK(fs);
+  return res;
+#endif // SPIFFS_READ_ONLY
+}
+
+u32_t SPIFFS_check_progress(spiffs *fs, const spiffs_check_state *st) {
+#if SPIFFS_READ_ONLY
+  (void)fs; (void)st;
+  return 0;
+#else
+  return spiffs_check_progress(fs, st);
+#endif // SPIFFS_READ_ONLY
+}
+#endif // SPIFFS_CHECK_INCREMENTAL
+
 s32_t SPIFFS_info(spiffs *fs, u32_t *total, u32_t *used) {
   SPIFFS_API_DBG("%s\n", __func__);
   s32_t res = SPIFFS_OK;
@@ -1327,9 +1398,9 @@ s32_t SPIFFS_ix_remap(spiffs *fs, spiffs_file fh, u32_t offset) {
     const s32_t vec_len = map->end_spix - map->start_spix + 1; // spix range includes last
     map->start_spix += spix_diff;
     map->end_spix += spix_diff;
-    if (spix_diff >= vec_len) {
+    if (spix_diff >= vec_len || -spix_diff >= vec_len) {
       // moving beyond range
-      memset(&map->map_buf, 0, vec_len * sizeof(spiffs_page_ix));
+      memset(&map->map_buf[0], 0, vec_len * sizeof(spiffs_page_ix));
       // populate_ix_map is inclusive
       res = spiffs_populate_ix_map(fs, fd, 0, vec_len-1);
       SPIFFS_API_CHECK_RES_UNLOCK(fs, res);
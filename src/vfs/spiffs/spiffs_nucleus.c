@@ -74,6 +74,9 @@ s32_t spiffs_phys_wr(
     u32_t addr,
     u32_t len,
     u8_t *src) {
+#if SPIFFS_CHECK_INCREMENTAL
+  fs->mod_count++;
+#endif
   return SPIFFS_HAL_WRITE(fs, addr, len, src);
 }
 
@@ -230,6 +233,9 @@ s32_t spiffs_erase_block(
   u32_t addr = SPIFFS_BLOCK_TO_PADDR(fs, bix);
   s32_t size = SPIFFS_CFG_LOG_BLOCK_SZ(fs);
 
+#if SPIFFS_CHECK_INCREMENTAL
+  fs->mod_count++;
+#endif
   // here we ignore res, just try erasing the block
   while (size > 0) {
     SPIFFS_DBG("erase "_SPIPRIad":"_SPIPRIi"\n", addr,  SPIFFS_CFG_PHYS_ERASE_SZ(fs));
@@ -1682,6 +1688,19 @@ s32_t spiffs_object_find_object_index_header_by_name(
   spiffs_block_ix bix;
   int entry;
 
+#if SPIFFS_NAME_LOOKUP
+  if (fs->cfg.name_lookup_f) {
+    spiffs_page_ix found_pix;
+    res = fs->cfg.name_lookup_f(fs, name, &found_pix);
+    if (res == SPIFFS_OK && pix) {
+      *pix = found_pix;
+    }
+    if (res == SPIFFS_OK || res == SPIFFS_ERR_NOT_FOUND) {
+      return res;
+    }
+  }
+#endif
+
   res = spiffs_obj_lu_find_entry_visitor(fs,
       fs->cursor_block_ix,
       fs->cursor_obj_lu_entry,
@@ -803,6 +803,17 @@ s32_t spiffs_page_consistency_check(
 s32_t spiffs_object_index_consistency_check(
     spiffs *fs);
 
+#if SPIFFS_CHECK_INCREMENTAL
+s32_t spiffs_check_step(
+    spiffs *fs,
+    spiffs_check_state *st,
+    u32_t max_blocks);
+
+u32_t spiffs_check_progress(
+    spiffs *fs,
+    const spiffs_check_state *st);
+#endif
+
 // memcpy macro,
 // checked in test builds, otherwise plain memcpy (unless already defined)
 #ifdef _SPIFFS_TEST
@@ -1,39 +1,48 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <stddef.h>
+#include <string.h>
 
 #include "common.h"
 #include "logging.h"
+#include "mem.h"
 #include "mutex.h"
 #include "ramdisk.h"
 
 #include "spiffs_vfs.h"
+#include "spiffs_nucleus.h"
+
+#if CONFIG_SPIFFS_VFS_SNAPSHOT
+#include "lfs_util.h"
+#endif
 
 LOG_MODULE_REGISTER(spiffs, LOG_LEVEL_INF);
 
 static int spiffs_err_to_errno(s32_t err);
 
+/* negative errno values of the ramdisk pass through SPIFFS unchanged */
 static int32_t _dev_read(struct spiffs_t *fs, u32_t addr, u32_t size,
                          u8_t *dst) {
   ramdisk_t *disk = (ramdisk_t *)fs->user_data;
 
-  ramdisk_read_addr(disk, dst, addr, size);
-  return 0;
+  int ret = ramdisk_read_addr(disk, dst, addr, size);
+  return ret < 0 ? ret : SPIFFS_OK;
 }
 
 static int32_t _dev_write(struct spiffs_t *fs, u32_t addr, u32_t size,
                           u8_t *src) {
   ramdisk_t *disk = (ramdisk_t *)fs->user_data;
 
-  ramdisk_write_addr(disk, src, addr, size);
-  return 0;
+  int ret = ramdisk_write_addr(disk, src, addr, size);
+  return ret < 0 ? ret : SPIFFS_OK;
 }
 
 static int32_t _dev_erase(struct spiffs_t *fs, u32_t addr, u32_t size) {
   ramdisk_t *disk = (ramdisk_t *)fs->user_data;
 
-  ramdisk_erase_addr(disk, addr, size);
-  return 0;
+  int ret = ramdisk_erase_addr(disk, addr, size);
+  return ret < 0 ? ret : SPIFFS_OK;
 }
 
 void spiffs_lock(struct spiffs_t *fs) {
@@ -48,6 +57,372 @@ void spiffs_unlock(struct spiffs_t *fs) {
   mutex_unlock(&fs_desc->lock);
 }
 
+#if CONFIG_SPIFFS_VFS_SNAPSHOT
+#define SNAPSHOT_MAGIC (0x53504e53) /* "SNPS" */
+
+typedef struct {
+  uint32_t magic;
+  /* geometry the summary was taken with */
+  uint32_t phys_size;
+  uint32_t log_block_size;
+  uint32_t log_page_size;
+  spiffs_snapshot snap;
+  /* counts the umounts that wrote a summary */
+  uint32_t gen;
+  uint32_t crc;
+} _snapshot_rec_t;
+
+/* the snapshot lives in the erase block right behind the file system */
+static inline u32_t _snapshot_addr(struct spiffs_t *fs) {
+  return fs->cfg.phys_addr + fs->cfg.phys_size;
+}
+
+static void _snapshot_fill(struct spiffs_t *fs, _snapshot_rec_t *rec) {
+  rec->magic = SNAPSHOT_MAGIC;
+  rec->phys_size = fs->cfg.phys_size;
+  rec->log_block_size = fs->cfg.log_block_size;
+  rec->log_page_size = fs->cfg.log_page_size;
+}
+
+static s32_t _snapshot_invalidate(struct spiffs_t *fs) {
+  return _dev_erase(fs, _snapshot_addr(fs), fs->cfg.phys_erase_block);
+}
+
+static s32_t _snapshot_load(struct spiffs_t *fs, spiffs_snapshot *snap) {
+  spiffs_desc_t *fs_desc = CONTAINER_OF(fs, spiffs_desc_t, fs);
+  _snapshot_rec_t rec, expect;
+
+  s32_t res = _dev_read(fs, _snapshot_addr(fs), sizeof(rec), (u8_t *)&rec);
+  if (res != SPIFFS_OK) {
+    return res;
+  }
+  if (rec.magic != SNAPSHOT_MAGIC) {
+    return SPIFFS_ERR_NOT_FOUND;
+  }
+
+  /* a summary is only good for the mount right after the umount that wrote
+   * it, anything written from now on makes it stale */
+  if ((res = _snapshot_invalidate(fs)) != SPIFFS_OK) {
+    return res;
+  }
+
+  memset(&expect, 0, sizeof(expect));
+  _snapshot_fill(fs, &expect);
+  if (rec.phys_size != expect.phys_size ||
+      rec.log_block_size != expect.log_block_size ||
+      rec.log_page_size != expect.log_page_size ||
+      rec.crc != lfs_crc(0xffffffff, &rec, offsetof(_snapshot_rec_t, crc)) ||
+      rec.snap.free_blocks > fs->block_count) {
+    LOG_DBG("spiffs: snapshot: rejected\n");
+    return SPIFFS_ERR_NOT_A_FS;
+  }
+  /* only the first mount after boot has to trust the generation it finds,
+   * later ones know which one their last umount wrote */
+  uint32_t gen = fs_desc->snapshot_gen;
+  fs_desc->snapshot_gen = MAX(gen, rec.gen);
+  if (gen && rec.gen != gen) {
+    LOG_DBG("spiffs: snapshot: stale\n");
+    return SPIFFS_ERR_NOT_A_FS;
+  }
+
+  *snap = rec.snap;
+#if SPIFFS_CHECK_INCREMENTAL
+  /* the previous umount was clean, no need to check on mount */
+  fs_desc->check_pending = false;
+#endif
+  return SPIFFS_OK;
+}
+
+static s32_t _snapshot_store(struct spiffs_t *fs, const spiffs_snapshot *snap) {
+  spiffs_desc_t *fs_desc = CONTAINER_OF(fs, spiffs_desc_t, fs);
+  _snapshot_rec_t rec;
+
+  /* zero the padding, it is covered by the crc */
+  memset(&rec, 0, sizeof(rec));
+  _snapshot_fill(fs, &rec);
+  rec.snap = *snap;
+  if (++fs_desc->snapshot_gen == 0) {
+    fs_desc->snapshot_gen = 1;
+  }
+  rec.gen = fs_desc->snapshot_gen;
+  rec.crc = lfs_crc(0xffffffff, &rec, offsetof(_snapshot_rec_t, crc));
+
+  s32_t res = _snapshot_invalidate(fs);
+  if (res != SPIFFS_OK) {
+    return res;
+  }
+  return _dev_write(fs, _snapshot_addr(fs), sizeof(rec), (u8_t *)&rec);
+}
+#endif /* CONFIG_SPIFFS_VFS_SNAPSHOT */
+
+#if CONFIG_SPIFFS_VFS_INDEX_SIZE
+static mem_pool_t _index_pool;
+
+/* first entry whose name is not less than the first n characters of name */
+static unsigned _index_name_pos(const spiffs_vfs_index_t *index,
+                                const char *name, size_t n) {
+  unsigned lo = 0, hi = index->count;
+
+  while (lo < hi) {
+    unsigned mid = lo + (hi - lo) / 2;
+    if (strncmp(index->by_name[mid]->name, name, n) < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+static unsigned _index_id_pos(const spiffs_vfs_index_t *index,
+                              spiffs_obj_id obj_id) {
+  unsigned lo = 0, hi = index->count;
+
+  while (lo < hi) {
+    unsigned mid = lo + (hi - lo) / 2;
+    if (index->by_id[mid]->obj_id < obj_id) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+static void _index_insert(spiffs_vfs_index_entry_t **arr, unsigned count,
+                          unsigned pos, spiffs_vfs_index_entry_t *entry) {
+  memmove(&arr[pos + 1], &arr[pos], (count - pos) * sizeof(*arr));
+  arr[pos] = entry;
+}
+
+static void _index_remove(spiffs_vfs_index_entry_t **arr, unsigned count,
+                          unsigned pos) {
+  memmove(&arr[pos], &arr[pos + 1], (count - pos - 1) * sizeof(*arr));
+}
+
+static int _index_add(spiffs_vfs_index_t *index, spiffs_obj_id obj_id,
+                      spiffs_page_ix pix, const u8_t *name) {
+  if (index->count == CONFIG_SPIFFS_VFS_INDEX_SIZE) {
+    return -ENOSPC;
+  }
+  spiffs_vfs_index_entry_t *entry = mem_pool_alloc(&_index_pool);
+  if (entry == NULL) {
+    return -ENOMEM;
+  }
+  entry->obj_id = obj_id;
+  entry->pix = pix;
+  strncpy(entry->name, (const char *)name, SPIFFS_OBJ_NAME_LEN);
+
+  _index_insert(index->by_name, index->count,
+                _index_name_pos(index, entry->name, SPIFFS_OBJ_NAME_LEN),
+                entry);
+  _index_insert(index->by_id, index->count, _index_id_pos(index, obj_id),
+                entry);
+  index->count++;
+  return 0;
+}
+
+/* pos is the position of the entry in by_id */
+static void _index_del(spiffs_vfs_index_t *index, unsigned pos) {
+  spiffs_vfs_index_entry_t *entry = index->by_id[pos];
+  unsigned name_pos = _index_name_pos(index, entry->name, SPIFFS_OBJ_NAME_LEN);
+
+  /* names are unique, but stay on the safe side */
+  while (index->by_name[name_pos] != entry) {
+    name_pos++;
+  }
+  _index_remove(index->by_name, index->count, name_pos);
+  _index_remove(index->by_id, index->count, pos);
+  index->count--;
+  mem_pool_free(&_index_pool, entry);
+}
+
+static void _index_clear(spiffs_vfs_index_t *index) {
+  index->valid = false;
+  for (unsigned i = 0; i < index->count; i++) {
+    mem_pool_free(&_index_pool, index->by_id[i]);
+  }
+  index->count = 0;
+}
+
+/* called by spiffs with the file system locked */
+static void _index_file_cb(struct spiffs_t *fs, spiffs_fileop_type op,
+                           spiffs_obj_id obj_id, spiffs_page_ix pix) {
+  spiffs_desc_t *fs_desc = CONTAINER_OF(fs, spiffs_desc_t, fs);
+  spiffs_vfs_index_t *index = &fs_desc->index;
+  u8_t name[SPIFFS_OBJ_NAME_LEN];
+
+  if (!index->valid) {
+    return;
+  }
+
+  unsigned pos = _index_id_pos(index, obj_id);
+  bool found = pos < index->count && index->by_id[pos]->obj_id == obj_id;
+
+  if (op == SPIFFS_CB_DELETED) {
+    if (found) {
+      _index_del(index, pos);
+    }
+    return;
+  }
+
+  /* a rename only shows up as an update of the header page, so compare the
+   * name that has just been written */
+  s32_t res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_IX | SPIFFS_OP_C_READ, 0,
+                         SPIFFS_PAGE_TO_PADDR(fs, pix) +
+                             offsetof(spiffs_page_object_ix_header, name),
+                         SPIFFS_OBJ_NAME_LEN, name);
+  if (res == SPIFFS_OK && found &&
+      strncmp(index->by_id[pos]->name, (char *)name, SPIFFS_OBJ_NAME_LEN) ==
+          0) {
+    index->by_id[pos]->pix = pix;
+    return;
+  }
+  if (res == SPIFFS_OK) {
+    if (found) {
+      _index_del(index, pos);
+    }
+    if (_index_add(index, obj_id, pix, name) == 0) {
+      return;
+    }
+  }
+  LOG_DBG("spiffs: index: dropped, falling back to scans\n");
+  _index_clear(index);
+}
+
+static s32_t _index_lookup(struct spiffs_t *fs, const u8_t *name,
+                           spiffs_page_ix *pix) {
+  spiffs_desc_t *fs_desc = CONTAINER_OF(fs, spiffs_desc_t, fs);
+  spiffs_vfs_index_t *index = &fs_desc->index;
+
+  if (!index->valid) {
+    return SPIFFS_ERR_NOT_CONFIGURED;
+  }
+
+  unsigned pos = _index_name_pos(index, (const char *)name,
+                                 SPIFFS_OBJ_NAME_LEN);
+  if (pos < index->count && strncmp(index->by_name[pos]->name,
+                                    (const char *)name,
+                                    SPIFFS_OBJ_NAME_LEN) == 0) {
+    *pix = index->by_name[pos]->pix;
+    return SPIFFS_OK;
+  }
+  return SPIFFS_ERR_NOT_FOUND;
+}
+
+static void _index_build(spiffs_desc_t *fs_desc) {
+  spiffs_vfs_index_t *index = &fs_desc->index;
+  spiffs *fs = &fs_desc->fs;
+  spiffs_DIR d;
+  struct spiffs_dirent e;
+  int res = 0;
+
+  _index_clear(index);
+  if (SPIFFS_opendir(fs, "/", &d) == NULL) {
+    return;
+  }
+  while (res == 0 && SPIFFS_readdir(&d, &e)) {
+    res = _index_add(index, e.obj_id, e.pix, e.name);
+  }
+  SPIFFS_closedir(&d);
+
+  if (res < 0) {
+    LOG_DBG("spiffs: index: %d, falling back to scans\n", res);
+    _index_clear(index);
+    return;
+  }
+
+  /* not SPIFFS_set_file_callback_func(), it takes the lock itself */
+  spiffs_lock(fs);
+  fs->file_cb_f = _index_file_cb;
+  index->valid = true;
+  spiffs_unlock(fs);
+}
+#endif /* CONFIG_SPIFFS_VFS_INDEX_SIZE */
+
+#if SPIFFS_CHECK_INCREMENTAL
+/* the SPIFFS_check_*() calls take the file system lock themselves, only the
+ * status is updated under it here */
+static int _check_start(spiffs_desc_t *fs_desc) {
+  spiffs_vfs_check_status_t *status = &fs_desc->check_status;
+
+  s32_t ret = SPIFFS_check_start(&fs_desc->fs, &fs_desc->check,
+                                 fs_desc->check_map);
+  if (ret < 0) {
+    return spiffs_err_to_errno(ret);
+  }
+  spiffs_lock(&fs_desc->fs);
+  memset(status, 0, sizeof(*status));
+  status->running = true;
+  spiffs_unlock(&fs_desc->fs);
+  return 0;
+}
+
+int spiffs_vfs_check_start(vfs_mount_t *mountp) {
+  return _check_start(mountp->private_data);
+}
+
+int spiffs_vfs_check(vfs_mount_t *mountp, unsigned max_blocks) {
+  spiffs_desc_t *fs_desc = mountp->private_data;
+  spiffs_vfs_check_status_t *status = &fs_desc->check_status;
+  spiffs_check_state *st = &fs_desc->check;
+  spiffs *fs = &fs_desc->fs;
+  int ret = 1;
+
+  spiffs_lock(fs);
+  bool running = status->running;
+  bool repaired = st->repaired;
+  spiffs_unlock(fs);
+  if (!running) {
+    return 0;
+  }
+
+  s32_t res = SPIFFS_check_step(fs, st, max_blocks);
+
+  spiffs_lock(fs);
+#if CONFIG_SPIFFS_VFS_INDEX_SIZE
+  if (st->repaired && !repaired) {
+    /* repairs do not go through the file callbacks, lookups fall back to
+     * scans until the check is done */
+    _index_clear(&fs_desc->index);
+  }
+#endif
+  if (res <= 0) {
+    ret = spiffs_err_to_errno(res);
+    status->err = ret;
+    status->running = false;
+  }
+  status->steps++;
+  status->pass = st->pass;
+  status->progress = SPIFFS_check_progress(fs, st);
+  status->restarts = st->restarts;
+  status->repaired = st->repaired;
+  spiffs_unlock(fs);
+
+  if (ret <= 0) {
+    LOG_DBG("spiffs: check: %d after %u steps, repaired %d\n", ret,
+            (unsigned)status->steps, st->repaired);
+#if CONFIG_SPIFFS_VFS_INDEX_SIZE
+    if (st->repaired) {
+      _index_build(fs_desc);
+    }
+#endif
+  }
+  return ret;
+}
+
+int spiffs_vfs_check_status(vfs_mount_t *mountp,
+                            spiffs_vfs_check_status_t *status) {
+  spiffs_desc_t *fs_desc = mountp->private_data;
+
+  spiffs_lock(&fs_desc->fs);
+  *status = fs_desc->check_status;
+  spiffs_unlock(&fs_desc->fs);
+
+  return 0;
+}
+#endif /* SPIFFS_CHECK_INCREMENTAL */
+
 static int prepare(spiffs_desc_t *fs_desc) {
   ramdisk_t *dev = fs_desc->disk;
   fs_desc->fs.user_data = dev;
@@ -56,17 +431,39 @@ static int prepare(spiffs_desc_t *fs_desc) {
   fs_desc->config.hal_write_f = _dev_write;
   fs_desc->config.hal_erase_f = _dev_erase;
 
-  // fs_desc->config.phys_size = CONFIG_RAM_SEC_SIZE * CONFIG_RAM_N_SECS;
-  // fs_desc->config.phys_addr = 0;
-  // fs_desc->config.phys_erase_block = CONFIG_PAGE_SIZE * CONFIG_PAGES_PER_SEC;
-  // fs_desc->config.log_block_size = CONFIG_PAGE_SIZE * CONFIG_PAGES_PER_SEC;
-  // fs_desc->config.log_page_size = CONFIG_PAGE_SIZE;
+  /* the geometry may be preset per mount, it has to match the one the disk
+   * was formatted with */
+  spiffs_config *cfg = &fs_desc->config;
+  cfg->phys_size = CONFIG_RAM_SEC_SIZE * CONFIG_RAM_N_SECS;
+  cfg->phys_addr = 0;
+  if (!cfg->phys_erase_block) {
+    cfg->phys_erase_block = CONFIG_SPIFFS_VFS_ERASE_BLOCK_SIZE;
+  }
+  if (!cfg->log_block_size) {
+    cfg->log_block_size = cfg->phys_erase_block;
+  }
+  if (!cfg->log_page_size) {
+    cfg->log_page_size = CONFIG_SPIFFS_VFS_PAGE_SIZE;
+  }
+  /* the work buffer holds two pages, a block has to hold the object lookup
+   * page plus at least one data page */
+  if (cfg->log_page_size * 2 > SPIFFS_FS_WORK_SIZE ||
+      cfg->log_page_size <= SPIFFS_OBJ_NAME_LEN + 64 ||
+      cfg->log_block_size % cfg->phys_erase_block ||
+      cfg->log_block_size % cfg->log_page_size ||
+      cfg->log_block_size < 2 * cfg->log_page_size ||
+      cfg->phys_size % cfg->log_block_size) {
+    return -EINVAL;
+  }
 
-  fs_desc->config.phys_size = CONFIG_RAM_SEC_SIZE * CONFIG_RAM_N_SECS;
-  fs_desc->config.phys_addr = 0;
-  fs_desc->config.phys_erase_block = 4096;
-  fs_desc->config.log_block_size = 4096;
-  fs_desc->config.log_page_size = 256;
+#if CONFIG_SPIFFS_VFS_SNAPSHOT
+  fs_desc->config.phys_size -= fs_desc->config.phys_erase_block;
+  fs_desc->config.snapshot_load_f = _snapshot_load;
+  fs_desc->config.snapshot_store_f = _snapshot_store;
+#endif
+#if CONFIG_SPIFFS_VFS_INDEX_SIZE
+  fs_desc->config.name_lookup_f = _index_lookup;
+#endif
 
   return 0;
 }
@@ -83,7 +480,7 @@ static int _format(vfs_mount_t *mountp) {
 
   int res = prepare(fs_desc);
   if (res) {
-    return -ENODEV;
+    return res;
   }
 
   s32_t ret = SPIFFS_mount(&fs_desc->fs, &fs_desc->config, fs_desc->work,
@@ -96,6 +493,10 @@ static int _format(vfs_mount_t *mountp) {
   }
   LOG_DBG("spiffs: format: formatting fs\n");
   ret = SPIFFS_format(&fs_desc->fs);
+#if CONFIG_SPIFFS_VFS_SNAPSHOT
+  /* the unmount above may just have written a summary of the old content */
+  _snapshot_invalidate(&fs_desc->fs);
+#endif
   return spiffs_err_to_errno(ret);
 }
 
@@ -111,12 +512,28 @@ static int _mount(vfs_mount_t *mountp) {
 
   int res = prepare(fs_desc);
   if (res) {
-    return -ENODEV;
+    return res;
   }
 
+#if SPIFFS_CHECK_INCREMENTAL
+  fs_desc->check_status.running = false;
+  fs_desc->check_pending = CONFIG_SPIFFS_VFS_CHECK_ON_MOUNT;
+#endif
   s32_t ret = SPIFFS_mount(&fs_desc->fs, &fs_desc->config, fs_desc->work,
                            fs_desc->fd_space, SPIFFS_FS_FD_SPACE_SIZE,
                            fs_desc->cache, SPIFFS_FS_CACHE_SIZE, NULL);
+#if CONFIG_SPIFFS_VFS_INDEX_SIZE
+  if (ret == SPIFFS_OK) {
+    _index_build(fs_desc);
+  }
+#endif
+#if SPIFFS_CHECK_INCREMENTAL
+  /* instead of blocking the mount, the check runs in later steps */
+  if (ret == SPIFFS_OK && fs_desc->check_pending) {
+    LOG_DBG("spiffs: mount: not clean, starting check\n");
+    _check_start(fs_desc);
+  }
+#endif
 
   return spiffs_err_to_errno(ret);
 }
@@ -125,6 +542,12 @@ static int _umount(vfs_mount_t *mountp) {
   spiffs_desc_t *fs_desc = mountp->private_data;
 
   SPIFFS_unmount(&fs_desc->fs);
+#if CONFIG_SPIFFS_VFS_INDEX_SIZE
+  _index_clear(&fs_desc->index);
+#endif
+#if SPIFFS_CHECK_INCREMENTAL
+  fs_desc->check_status.running = false;
+#endif
 
   return 0;
 }
@@ -142,6 +565,108 @@ static int _rename(vfs_mount_t *mountp, const char *from_path,
   return spiffs_err_to_errno(SPIFFS_rename(&fs_desc->fs, from_path, to_path));
 }
 
+static int _gc(vfs_mount_t *mountp, const vfs_gc_t *gc) {
+  spiffs_desc_t *fs_desc = mountp->private_data;
+  spiffs *fs = &fs_desc->fs;
+  u32_t total, used;
+  int work = 0;
+
+#if SPIFFS_CHECK_INCREMENTAL && CONFIG_SPIFFS_VFS_CHECK_GC_BLOCKS
+  if (fs_desc->check_status.running) {
+    int res = spiffs_vfs_check(mountp, CONFIG_SPIFFS_VFS_CHECK_GC_BLOCKS);
+    if (res < 0) {
+      return res;
+    }
+    work++;
+  }
+#endif
+
+  s32_t ret = SPIFFS_info(fs, &total, &used);
+  if (ret < 0) {
+    return spiffs_err_to_errno(ret);
+  }
+
+  /* cheap: erase blocks that only hold deleted pages */
+  u32_t deleted = fs->stats_p_deleted;
+  ret = SPIFFS_gc_quick(fs, 0);
+  if (ret < 0 && ret != SPIFFS_ERR_NO_DELETED_BLOCKS) {
+    return spiffs_err_to_errno(ret);
+  }
+  work += (fs->stats_p_deleted != deleted);
+
+  /* expensive: move live pages out of partially deleted blocks so the
+   * next writes of up to `threshold` bytes do not need to run the gc */
+  if (total - used < gc->threshold || fs->free_blocks <= 2) {
+    u32_t size = gc->threshold;
+    if (gc->budget && size > gc->budget) {
+      size = gc->budget;
+    }
+    u32_t runs = fs->stats_gc_runs;
+    ret = SPIFFS_gc(fs, size);
+    if (ret < 0 && ret != SPIFFS_ERR_FULL) {
+      return spiffs_err_to_errno(ret);
+    }
+    work += (fs->stats_gc_runs != runs);
+  }
+
+  return work;
+}
+
+typedef struct {
+  spiffs_file fh;
+#if SPIFFS_IX_MAP
+  spiffs_page_ix *map_buf; /**< pooled, NULL while the file is not mapped */
+  u32_t map_len;           /**< file bytes covered by the map */
+  spiffs_ix_map map;
+#endif
+} _spiffs_vfs_file_t;
+
+static _spiffs_vfs_file_t *_get_spiffs_file(vfs_file_t *filp) {
+  return filp->private_data.ptr;
+}
+
+#if SPIFFS_IX_MAP
+static mem_pool_t _map_pool;
+
+/* failing to map only costs speed, the file stays usable */
+static void _map(spiffs *fs, _spiffs_vfs_file_t *f) {
+  u32_t entries = CONFIG_SPIFFS_VFS_IX_MAP_SIZE / sizeof(spiffs_page_ix);
+  spiffs_stat stat;
+
+  if (SPIFFS_fstat(fs, f->fh, &stat) < 0) {
+    return;
+  }
+  /* small files only need a small window, empty ones get the whole buffer
+   * to grow into */
+  u32_t needed = SPIFFS_bytes_to_ix_map_entries(fs, stat.size);
+  if (stat.size && needed < entries) {
+    entries = needed;
+  }
+
+  f->map_buf = mem_pool_alloc(&_map_pool);
+  if (f->map_buf == NULL) {
+    return;
+  }
+  f->map_len = SPIFFS_ix_map_entries_to_bytes(fs, entries - 1);
+  if (SPIFFS_ix_map(fs, f->fh, &f->map, 0, f->map_len, f->map_buf) < 0) {
+    mem_pool_free(&_map_pool, f->map_buf);
+    f->map_buf = NULL;
+  }
+}
+
+/* move the window of a mapped file so that it starts at pos */
+static void _map_follow(spiffs *fs, _spiffs_vfs_file_t *f, s32_t pos) {
+  if (f->map_buf == NULL || pos < 0) {
+    return;
+  }
+  if ((u32_t)pos >= f->map.offset && (u32_t)pos - f->map.offset < f->map_len) {
+    return;
+  }
+  u32_t page = SPIFFS_ix_map_entries_to_bytes(fs, 1);
+  (void)SPIFFS_ix_remap(fs, f->fh, ((u32_t)pos / page) * page);
+}
+#endif /* SPIFFS_IX_MAP */
+
 static int _open(vfs_file_t *filp, const char *name, int flags, mode_t mode) {
   spiffs_desc_t *fs_desc = filp->mp->private_data;
   LOG_DBG("spiffs: open: private_data = %p\n", filp->mp->private_data);
@@ -174,7 +699,14 @@ static int _open(vfs_file_t *filp, const char *name, int flags, mode_t mode) {
 
   s32_t ret = SPIFFS_open(&fs_desc->fs, name, s_flags, mode);
   if (ret >= 0) {
-    filp->private_data.value = ret;
+    _spiffs_vfs_file_t *f = _get_spiffs_file(filp);
+    f->fh = ret;
+#if SPIFFS_IX_MAP
+    f->map_buf = NULL;
+    if (flags & VFS_O_RANDOM) {
+      _map(&fs_desc->fs, f);
+    }
+#endif
     return ret;
   } else {
     return spiffs_err_to_errno(ret);
@@ -183,27 +715,37 @@ static int _open(vfs_file_t *filp, const char *name, int flags, mode_t mode) {
 
 static int _close(vfs_file_t *filp) {
   spiffs_desc_t *fs_desc = filp->mp->private_data;
-
-  return spiffs_err_to_errno(
-      SPIFFS_close(&fs_desc->fs, filp->private_data.value));
+  _spiffs_vfs_file_t *f = _get_spiffs_file(filp);
+
+  /* closing also drops the index map */
+  s32_t ret = SPIFFS_close(&fs_desc->fs, f->fh);
+#if SPIFFS_IX_MAP
+  if (f->map_buf) {
+    mem_pool_free(&_map_pool, f->map_buf);
+    f->map_buf = NULL;
+  }
+#endif
+  return spiffs_err_to_errno(ret);
 }
 
 static ssize_t _write(vfs_file_t *filp, const void *src, size_t nbytes) {
   spiffs_desc_t *fs_desc = filp->mp->private_data;
+  _spiffs_vfs_file_t *f = _get_spiffs_file(filp);
 
-  return spiffs_err_to_errno(SPIFFS_write(
-      &fs_desc->fs, filp->private_data.value, (void *)src, nbytes));
+  return spiffs_err_to_errno(
+      SPIFFS_write(&fs_desc->fs, f->fh, (void *)src, nbytes));
 }
 
 static ssize_t _read(vfs_file_t *filp, void *dest, size_t nbytes) {
   spiffs_desc_t *fs_desc = filp->mp->private_data;
+  _spiffs_vfs_file_t *f = _get_spiffs_file(filp);
 
-  return spiffs_err_to_errno(
-      SPIFFS_read(&fs_desc->fs, filp->private_data.value, dest, nbytes));
+  return spiffs_err_to_errno(SPIFFS_read(&fs_desc->fs, f->fh, dest, nbytes));
 }
 
 static off_t _lseek(vfs_file_t *filp, off_t off, int whence) {
   spiffs_desc_t *fs_desc = filp->mp->private_data;
+  _spiffs_vfs_file_t *f = _get_spiffs_file(filp);
 
   int s_whence = 0;
   if (whence == SEEK_SET) {
@@ -214,14 +756,17 @@ static off_t _lseek(vfs_file_t *filp, off_t off, int whence) {
     s_whence = SPIFFS_SEEK_END;
   }
 
-  return spiffs_err_to_errno(
-      SPIFFS_lseek(&fs_desc->fs, filp->private_data.value, off, s_whence));
+  s32_t ret = SPIFFS_lseek(&fs_desc->fs, f->fh, off, s_whence);
+#if SPIFFS_IX_MAP
+  _map_follow(&fs_desc->fs, f, ret);
+#endif
+  return spiffs_err_to_errno(ret);
 }
 
 static int _fsync(vfs_file_t *filp) {
   spiffs_desc_t *fs_desc = filp->mp->private_data;
 
-  int ret = SPIFFS_fflush(&fs_desc->fs, filp->private_data.value);
+  int ret = SPIFFS_fflush(&fs_desc->fs, _get_spiffs_file(filp)->fh);
 
   return spiffs_err_to_errno(ret);
 }
@@ -231,7 +776,7 @@ static int _fstat(vfs_file_t *filp, struct stat *buf) {
   spiffs_stat stat;
   s32_t ret;
 
-  ret = SPIFFS_fstat(&fs_desc->fs, filp->private_data.value, &stat);
+  ret = SPIFFS_fstat(&fs_desc->fs, _get_spiffs_file(filp)->fh, &stat);
 
   if (ret < 0) {
     return ret;
@@ -246,17 +791,50 @@ static int _fstat(vfs_file_t *filp, struct stat *buf) {
   return spiffs_err_to_errno(ret);
 }
 
-static spiffs_DIR *_get_spifs_dir(vfs_DIR *dirp) {
+/* spiffs has no directories, a directory is listed as all the names that
+ * start with its path followed by `/` */
+typedef struct {
+  spiffs_DIR d;
+  uint16_t pos; /**< next entry of the name index */
+  uint8_t indexed;
+  uint8_t prefix_len;
+  char prefix[CONFIG_SPIFFS_VFS_DIR_PREFIX_MAX];
+} _spiffs_vfs_dir_t;
+
+static _spiffs_vfs_dir_t *_get_spifs_dir(vfs_DIR *dirp) {
   /* the private buffer is part of a union that also contains a
    * void pointer, hence, it is naturally aligned */
-  return (spiffs_DIR *)(uintptr_t)&dirp->private_data.buffer[0];
+  return (_spiffs_vfs_dir_t *)(uintptr_t)&dirp->private_data.buffer[0];
 }
 
 static int _opendir(vfs_DIR *dirp, const char *dirname) {
   spiffs_desc_t *fs_desc = dirp->mp->private_data;
-  spiffs_DIR *d = _get_spifs_dir(dirp);
+  _spiffs_vfs_dir_t *dir = _get_spifs_dir(dirp);
 
-  spiffs_DIR *res = SPIFFS_opendir(&fs_desc->fs, dirname, d);
+  size_t len = strlen(dirname);
+  if (len && dirname[len - 1] == '/') {
+    len--;
+  }
+  if (len + 1 > sizeof(dir->prefix)) {
+    return -ENAMETOOLONG;
+  }
+  memcpy(dir->prefix, dirname, len);
+  dir->prefix[len] = '/';
+  dir->prefix_len = len + 1;
+
+#if CONFIG_SPIFFS_VFS_INDEX_SIZE
+  spiffs_lock(&fs_desc->fs);
+  if (fs_desc->index.valid) {
+    dir->indexed = 1;
+    dir->pos = _index_name_pos(&fs_desc->index, dir->prefix, dir->prefix_len);
+  }
+  spiffs_unlock(&fs_desc->fs);
+  if (dir->indexed) {
+    return 0;
+  }
+#endif
+
+  spiffs_DIR *res = SPIFFS_opendir(&fs_desc->fs, dirname, &dir->d);
   if (res == NULL) {
     return -ENOENT;
   }
@@ -264,14 +842,48 @@ static int _opendir(vfs_DIR *dirp, const char *dirname) {
   return 0;
 }
 
+#if CONFIG_SPIFFS_VFS_INDEX_SIZE
+static int _readdir_indexed(vfs_DIR *dirp, vfs_dirent_t *entry) {
+  spiffs_desc_t *fs_desc = dirp->mp->private_data;
+  spiffs_vfs_index_t *index = &fs_desc->index;
+  _spiffs_vfs_dir_t *dir = _get_spifs_dir(dirp);
+  int ret = 0;
+
+  spiffs_lock(&fs_desc->fs);
+  if (!index->valid) {
+    /* dropped while listing, the position is meaningless now */
+    ret = -EIO;
+  } else if (dir->pos < index->count &&
+             strncmp(index->by_name[dir->pos]->name, dir->prefix,
+                     dir->prefix_len) == 0) {
+    spiffs_vfs_index_entry_t *e = index->by_name[dir->pos++];
+    entry->d_ino = e->obj_id;
+    strncpy(entry->d_name, e->name + dir->prefix_len, VFS_NAME_MAX);
+    ret = 1;
+  }
+  spiffs_unlock(&fs_desc->fs);
+
+  return ret;
+}
+#endif
+
 static int _readdir(vfs_DIR *dirp, vfs_dirent_t *entry) {
-  spiffs_DIR *d = _get_spifs_dir(dirp);
+  _spiffs_vfs_dir_t *dir = _get_spifs_dir(dirp);
   struct spiffs_dirent e;
   struct spiffs_dirent *ret;
 
-  ret = SPIFFS_readdir(d, &e);
+#if CONFIG_SPIFFS_VFS_INDEX_SIZE
+  if (dir->indexed) {
+    return _readdir_indexed(dirp, entry);
+  }
+#endif
+
+  do {
+    ret = SPIFFS_readdir(&dir->d, &e);
+  } while (ret && strncmp((char *)e.name, dir->prefix, dir->prefix_len) != 0);
+
   if (ret == NULL) {
-    s32_t err = SPIFFS_errno(d->fs);
+    s32_t err = SPIFFS_errno(dir->d.fs);
     if (err != SPIFFS_OK && err > SPIFFS_ERR_INTERNAL) {
       LOG_DBG("spiffs: readdir: err=%d", err);
       return -EIO;
@@ -280,8 +892,8 @@ static int _readdir(vfs_DIR *dirp, vfs_dirent_t *entry) {
 
   if (ret) {
     entry->d_ino = e.obj_id;
-    // +1 to skip the leading `/`
-    strncpy(entry->d_name, (char *)e.name + 1, VFS_NAME_MAX);
+    // skip the directory and the `/` following it
+    strncpy(entry->d_name, (char *)e.name + dir->prefix_len, VFS_NAME_MAX);
     return 1;
   } else {
     return 0;
@@ -289,9 +901,49 @@ static int _readdir(vfs_DIR *dirp, vfs_dirent_t *entry) {
 }
 
 static int _closedir(vfs_DIR *dirp) {
-  spiffs_DIR *d = _get_spifs_dir(dirp);
+  _spiffs_vfs_dir_t *dir = _get_spifs_dir(dirp);
 
-  return spiffs_err_to_errno(SPIFFS_closedir(d));
+  if (dir->indexed) {
+    return 0;
+  }
+  return spiffs_err_to_errno(SPIFFS_closedir(&dir->d));
+}
+
+/* a file, or a directory while names below it exist. Opening the path, like
+ * vfs_sysop_stat_from_fstat() does, would list any missing one as directory */
+static int _stat(vfs_mount_t *mountp, const char *restrict path,
+                 struct stat *restrict buf) {
+  spiffs_desc_t *fs_desc = mountp->private_data;
+  spiffs_stat stat;
+
+  s32_t ret = SPIFFS_stat(&fs_desc->fs, path, &stat);
+  if (ret == SPIFFS_OK) {
+    buf->st_ino = stat.obj_id;
+    buf->st_size = stat.size;
+    buf->st_mode = S_IFREG;
+    return 0;
+  }
+  if (ret != SPIFFS_ERR_NOT_FOUND) {
+    return spiffs_err_to_errno(ret);
+  }
+
+  vfs_DIR dir = {.mp = mountp};
+  vfs_dirent_t entry;
+  int res = _opendir(&dir, path);
+  if (res < 0) {
+    return res;
+  }
+  res = _readdir(&dir, &entry);
+  _closedir(&dir);
+  if (res < 0) {
+    return res;
+  }
+  /* the root exists even when empty */
+  if (res == 0 && path[strspn(path, "/")] != '\0') {
+    return -ENOENT;
+  }
+  buf->st_mode = S_IFDIR;
+  return 0;
 }
 
 static int spiffs_err_to_errno(s32_t err) {
@@ -383,7 +1035,25 @@ static int spiffs_err_to_errno(s32_t err) {
   return (int)err;
 }
 
-int spiffs_vfs_init(void) { return 0; }
+int spiffs_vfs_init(void) {
+  int ret = 0;
+
+#if SPIFFS_IX_MAP
+  if ((ret = mem_pool_create(&_map_pool, "spiffs_map",
+                             CONFIG_SPIFFS_VFS_IX_MAP_SIZE, sizeof(void *), 0,
+                             0))) {
+    return ret;
+  }
+#endif
+#if CONFIG_SPIFFS_VFS_INDEX_SIZE
+  if ((ret = mem_pool_create(&_index_pool, "spiffs_index",
+                             sizeof(spiffs_vfs_index_entry_t), sizeof(void *),
+                             0, 0))) {
+    return ret;
+  }
+#endif
+  return ret;
+}
 
 int spiffs_vfs_desc_init(spiffs_desc_t *desc) {
   int ret = 0;
@@ -391,6 +1061,9 @@ int spiffs_vfs_desc_init(spiffs_desc_t *desc) {
   if ((ret = mutex_init(&desc->lock))) {
     return ret;
   }
+#if CONFIG_SPIFFS_VFS_SNAPSHOT
+  desc->snapshot_gen = 0;
+#endif
   return 0;
 }
 
@@ -400,7 +1073,8 @@ static const vfs_file_system_ops_t spiffs_fs_ops = {
     .umount = _umount,
     .unlink = _unlink,
     .rename = _rename,
-    .stat = vfs_sysop_stat_from_fstat,
+    .stat = _stat,
+    .gc = _gc,
 };
 
 static const vfs_file_ops_t spiffs_file_ops = {
@@ -423,4 +1097,5 @@ const vfs_file_system_t spiffs_file_system = {
     .fs_op = &spiffs_fs_ops,
     .f_op = &spiffs_file_ops,
     .d_op = &spiffs_dir_ops,
+    .file_size = sizeof(_spiffs_vfs_file_t),
 };
\ No newline at end of file
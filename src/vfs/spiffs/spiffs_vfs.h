@@ -1,37 +1,76 @@
 #ifndef UC_VFS_SPIFFS_VFS_H
 #define UC_VFS_SPIFFS_VFS_H
 
+#include <stdbool.h>
+
 #include "mutex.h"
 #include "ramdisk.h"
 
 #include "spiffs.h"
 #include "spiffs_config.h"
+#include "spiffs_vfs_config.h"
 #include "vfs.h"
 
 #define CONFIG_PAGE_SIZE (64)
 #define CONFIG_PAGES_PER_SEC (CONFIG_RAM_SEC_SIZE / CONFIG_PAGE_SIZE)
 
-/** Size of the buffer needed for directory */
-#define SPIFFS_DIR_SIZE (12)
+/** Size of the buffer needed for directory, spiffs_DIR plus listing state */
+#define SPIFFS_DIR_SIZE (16 + 4 + CONFIG_SPIFFS_VFS_DIR_PREFIX_MAX)
 
 #if (VFS_DIR_BUFFER_SIZE < SPIFFS_DIR_SIZE)
 #error "VFS_DIR_BUFFER_SIZE too small"
 #endif
 
-#ifndef SPIFFS_FS_CACHE_SIZE
-#if SPIFFS_CACHE || defined(DOXYGEN)
-#define SPIFFS_FS_CACHE_SIZE (512)
-#else
-#define SPIFFS_FS_CACHE_SIZE (0)
-#endif /* SPIFFS_CACHE */
-#endif /* SPIFFS_FS_CACHE_SIZE */
+#if SPIFFS_CHECK_INCREMENTAL || defined(DOXYGEN)
+#ifndef CONFIG_SPIFFS_VFS_CHECK_GC_BLOCKS
+/**
+ * Blocks checked per vfs_gc() pass while a consistency check is in progress,
+ * 0 leaves it to the application
+ */
+#define CONFIG_SPIFFS_VFS_CHECK_GC_BLOCKS (8)
+#endif
+
+#ifndef CONFIG_SPIFFS_VFS_CHECK_ON_MOUNT
+/**
+ * Start a consistency check on mount unless the previous umount was clean,
+ * which is only known with CONFIG_SPIFFS_VFS_SNAPSHOT
+ */
+#define CONFIG_SPIFFS_VFS_CHECK_ON_MOUNT (1)
+#endif
 
-#ifndef SPIFFS_FS_WORK_SIZE
-#define SPIFFS_FS_WORK_SIZE (512)
+/** Progress of the consistency check of a mount */
+typedef struct {
+  bool running;      /**< a check is in progress */
+  uint8_t pass;      /**< spiffs_check_type of the pass in progress */
+  uint16_t progress; /**< 0 to 256 */
+  uint32_t steps;    /**< steps of the check in progress or the last one */
+  uint32_t restarts; /**< page ranges rescanned */
+  bool repaired;     /**< the check repaired something */
+  int err;           /**< error of the last step, 0 if none */
+} spiffs_vfs_check_status_t;
 #endif
 
-#ifndef SPIFFS_FS_FD_SPACE_SIZE
-#define SPIFFS_FS_FD_SPACE_SIZE (4 * 32)
+#if CONFIG_SPIFFS_VFS_INDEX_SIZE || defined(DOXYGEN)
+typedef struct {
+  spiffs_obj_id obj_id;
+  spiffs_page_ix pix; /**< object index header page */
+  char name[SPIFFS_OBJ_NAME_LEN];
+} spiffs_vfs_index_entry_t;
+
+/**
+ * @brief   name index of a mount
+ *
+ * Both arrays point to the same entries, one sorted by name for lookups and
+ * prefix listings, the other by object id for the file callbacks of spiffs.
+ * Protected by the lock of the descriptor.
+ */
+typedef struct {
+  spiffs_vfs_index_entry_t *by_name[CONFIG_SPIFFS_VFS_INDEX_SIZE];
+  spiffs_vfs_index_entry_t *by_id[CONFIG_SPIFFS_VFS_INDEX_SIZE];
+  uint16_t count;
+  /** set while the index mirrors the file system */
+  bool valid;
+} spiffs_vfs_index_t;
 #endif
 
 typedef struct spiffs_desc {
@@ -43,6 +82,22 @@ typedef struct spiffs_desc {
 #endif
   spiffs_config config;
   mutex_t lock;
+#if CONFIG_SPIFFS_VFS_INDEX_SIZE || defined(DOXYGEN)
+  spiffs_vfs_index_t index;
+#endif
+#if SPIFFS_CHECK_INCREMENTAL || defined(DOXYGEN)
+  spiffs_check_state check;
+  /** bitmap of the page pass, at most one logical page */
+  uint8_t check_map[SPIFFS_FS_WORK_SIZE / 2];
+  spiffs_vfs_check_status_t check_status;
+  /** cleared when the mount finds a summary of a clean umount */
+  bool check_pending;
+#endif
+#if CONFIG_SPIFFS_VFS_SNAPSHOT || defined(DOXYGEN)
+  /** generation of the last summary written or taken, 0 before the first.
+   * A summary of another generation, e.g. of a replaced image, is stale. */
+  uint32_t snapshot_gen;
+#endif
 #if (SPIFFS_HAL_CALLBACK_EXTRA == 1) || defined(DOXYGEN)
   ramdisk_t *disk;
 #endif
@@ -62,4 +117,30 @@ int spiffs_vfs_init(void);
 
 int spiffs_vfs_desc_init(spiffs_desc_t *desc);
 
+#if SPIFFS_CHECK_INCREMENTAL || defined(DOXYGEN)
+/**
+ * @brief   Start a consistency check of a mounted file system
+ *
+ * The check runs in steps of spiffs_vfs_check() calls, or of vfs_gc() passes
+ * with CONFIG_SPIFFS_VFS_CHECK_GC_BLOCKS. A check in progress starts over.
+ *
+ * @return  0 on success, negative errno on failure
+ */
+int spiffs_vfs_check_start(vfs_mount_t *mountp);
+
+/**
+ * @brief   Run the consistency check over at most @p max_blocks blocks
+ *
+ * The file system stays usable between two calls. Writes in between make the
+ * page pass rescan its current range, see SPIFFS_CHECK_MAX_RESTARTS.
+ *
+ * @return  1 while there is work left, 0 once no check is in progress,
+ *          negative errno on failure, which also ends the check
+ */
+int spiffs_vfs_check(vfs_mount_t *mountp, unsigned max_blocks);
+
+int spiffs_vfs_check_status(vfs_mount_t *mountp,
+                            spiffs_vfs_check_status_t *status);
+#endif
+
 #endif /* UC_VFS_SPIFFS_VFS_H */
\ No newline at end of file
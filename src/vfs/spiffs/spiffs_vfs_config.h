@@ -0,0 +1,79 @@
+#ifndef UC_VFS_SPIFFS_VFS_CONFIG_H
+#define UC_VFS_SPIFFS_VFS_CONFIG_H
+
+/*
+ * Defaults of the SPIFFS glue. Kept apart from spiffs_vfs.h, the host image
+ * builder in tools/mkimage formats with them as well.
+ */
+
+#include "spiffs_config.h"
+
+#ifndef CONFIG_SPIFFS_VFS_INDEX_SIZE
+/**
+ * Number of files the in-RAM name index of a mount can hold, mounts with
+ * more files fall back to scanning the object lookup pages. 0 disables the
+ * index.
+ */
+#define CONFIG_SPIFFS_VFS_INDEX_SIZE (128)
+#endif
+
+#if CONFIG_SPIFFS_VFS_INDEX_SIZE && !SPIFFS_NAME_LOOKUP
+#error "CONFIG_SPIFFS_VFS_INDEX_SIZE requires SPIFFS_NAME_LOOKUP"
+#endif
+
+#ifndef CONFIG_SPIFFS_VFS_DIR_PREFIX_MAX
+/** Longest directory name that can be listed, including the trailing `/` */
+#define CONFIG_SPIFFS_VFS_DIR_PREFIX_MAX (24)
+#endif
+
+#ifndef CONFIG_SPIFFS_VFS_ERASE_BLOCK_SIZE
+/**
+ * Default erase block, used as logical block size unless
+ * spiffs_desc_t::config presets one. A mount may preset phys_erase_block,
+ * log_block_size and log_page_size before format and mount.
+ */
+#define CONFIG_SPIFFS_VFS_ERASE_BLOCK_SIZE (4096)
+#endif
+
+#ifndef CONFIG_SPIFFS_VFS_PAGE_SIZE
+/** Default logical page, at most half of SPIFFS_FS_WORK_SIZE */
+#define CONFIG_SPIFFS_VFS_PAGE_SIZE (256)
+#endif
+
+#ifndef CONFIG_SPIFFS_VFS_IX_MAP_SIZE
+/**
+ * Size in bytes of the index map buffer attached to files opened with
+ * VFS_O_RANDOM, each 2 byte entry maps one data page
+ */
+#define CONFIG_SPIFFS_VFS_IX_MAP_SIZE (2048)
+#endif
+
+#ifndef SPIFFS_FS_CACHE_SIZE
+#if SPIFFS_CACHE || defined(DOXYGEN)
+#define SPIFFS_FS_CACHE_SIZE (512)
+#else
+#define SPIFFS_FS_CACHE_SIZE (0)
+#endif /* SPIFFS_CACHE */
+#endif /* SPIFFS_FS_CACHE_SIZE */
+
+#ifndef SPIFFS_FS_WORK_SIZE
+#define SPIFFS_FS_WORK_SIZE (512)
+#endif
+
+#ifndef SPIFFS_FS_FD_SPACE_SIZE
+#define SPIFFS_FS_FD_SPACE_SIZE (4 * 32)
+#endif
+
+#ifndef CONFIG_SPIFFS_VFS_SNAPSHOT
+/**
+ * Reserve the last erase block of the disk for a summary of the object
+ * lookup scan, written on umount and consumed by the next mount
+ */
+#define CONFIG_SPIFFS_VFS_SNAPSHOT (SPIFFS_MOUNT_SNAPSHOT)
+#endif
+
+#if CONFIG_SPIFFS_VFS_SNAPSHOT && !SPIFFS_MOUNT_SNAPSHOT
+#error "CONFIG_SPIFFS_VFS_SNAPSHOT requires SPIFFS_MOUNT_SNAPSHOT"
+#endif
+
+#endif /* UC_VFS_SPIFFS_VFS_CONFIG_H */
@@ -0,0 +1,382 @@
+#include <fcntl.h>
+#include <string.h>
+
+#include "common.h"
+#include "errno.h"
+#include "logging.h"
+#include "mem.h"
+#include "memops.h"
+#include "printf.h"
+#include "stream.h"
+
+LOG_MODULE_REGISTER(stream, LOG_LEVEL_INF);
+
+static mem_pool_t _stream_pool;
+
+static int _parse_mode(const char *mode) {
+  int flags;
+
+  switch (*mode++) {
+  case 'r':
+    flags = O_RDONLY;
+    break;
+  case 'w':
+    flags = O_WRONLY | O_CREAT | O_TRUNC;
+    break;
+  case 'a':
+    flags = O_WRONLY | O_CREAT | O_APPEND;
+    break;
+  default:
+    return -EINVAL;
+  }
+  for (; *mode; mode++) {
+    if (*mode == '+') {
+      flags = (flags & ~O_ACCMODE) | O_RDWR;
+    } else if (*mode != 'b') {
+      return -EINVAL;
+    }
+  }
+  return flags;
+}
+
+static inline bool _can_write(const vfs_stream_t *s) {
+  return (s->flags & O_ACCMODE) != O_RDONLY;
+}
+
+static inline bool _can_read(const vfs_stream_t *s) {
+  return (s->flags & O_ACCMODE) != O_WRONLY;
+}
+
+static int _write_all(vfs_stream_t *s, const uint8_t *src, size_t count) {
+  while (count) {
+    ssize_t res = vfs_write(s->fd, src, count);
+    if (res <= 0) {
+      /* a driver that accepts nothing is out of space */
+      s->err = res ? (int)res : -ENOSPC;
+      LOG_DBG("write fd %d: %d", s->fd, s->err);
+      return s->err;
+    }
+    src += res;
+    count -= res;
+  }
+  return 0;
+}
+
+/* hands pending writes to the driver, or gives unread read-ahead back */
+static int _flush(vfs_stream_t *s) {
+  int res = 0;
+
+  if (s->reading) {
+    size_t ahead = s->len - s->pos;
+    if (ahead && (res = vfs_lseek(s->fd, -(off_t)ahead, SEEK_CUR)) < 0) {
+      s->err = res;
+    }
+    s->reading = 0;
+  } else if (s->len) {
+    res = _write_all(s, s->buf, s->len);
+  }
+  s->len = 0;
+  s->pos = 0;
+  return (res < 0) ? res : 0;
+}
+
+static int _put(vfs_stream_t *s, const uint8_t *src, size_t count) {
+  while (count) {
+    if (s->len == 0 && (count >= s->size || s->mode == VFS_IONBF)) {
+      /* nothing to merge with, skip the copy */
+      return _write_all(s, src, count);
+    }
+    size_t n = MIN(s->size - s->len, count);
+    vfs_memcpy(&s->buf[s->len], src, n);
+    s->len += n;
+    src += n;
+    count -= n;
+    if (s->len == s->size) {
+      int res = _flush(s);
+      if (res < 0) {
+        return res;
+      }
+    }
+  }
+  return 0;
+}
+
+static int _prep_write(vfs_stream_t *s) {
+  if (s == NULL) {
+    return -EFAULT;
+  }
+  if (s->fd < 0) {
+    return -EBADF;
+  }
+  if (s->err) {
+    return s->err;
+  }
+  if (!_can_write(s)) {
+    return -EBADF;
+  }
+  if (s->reading) {
+    return _flush(s);
+  }
+  return 0;
+}
+
+/* end of a write call, applies the line and unbuffered modes */
+static int _end_write(vfs_stream_t *s) {
+  if (s->mode == VFS_IONBF || (s->mode == VFS_IOLBF && s->nl)) {
+    return _flush(s);
+  }
+  return 0;
+}
+
+static vfs_stream_t *_stream_new(int fd, int flags) {
+  vfs_stream_t *s = mem_pool_alloc(&_stream_pool);
+  if (s == NULL) {
+    LOG_DBG("no memory for stream on fd %d", fd);
+    return NULL;
+  }
+  s->fd = fd;
+  s->flags = flags;
+  s->mode = VFS_IOFBF;
+  s->reading = 0;
+  s->nl = 0;
+  s->err = 0;
+  s->buf = s->_buf;
+  s->size = sizeof(s->_buf);
+  s->len = 0;
+  s->pos = 0;
+
+  int res = vfs_file_set_stream(fd, s);
+  if (res < 0) {
+    LOG_DBG("attach fd %d: %d", fd, res);
+    mem_pool_free(&_stream_pool, s);
+    return NULL;
+  }
+  return s;
+}
+
+vfs_stream_t *vfs_fopen(const char *name, const char *mode) {
+  if (name == NULL || mode == NULL) {
+    return NULL;
+  }
+  int flags = _parse_mode(mode);
+  if (flags < 0) {
+    LOG_DBG("bad mode \"%s\"", mode);
+    return NULL;
+  }
+  int fd = vfs_open(name, flags, 0);
+  if (fd < 0) {
+    LOG_DBG("open %s: %d", name, fd);
+    return NULL;
+  }
+  vfs_stream_t *s = _stream_new(fd, flags);
+  if (s == NULL) {
+    vfs_close(fd);
+  }
+  return s;
+}
+
+vfs_stream_t *vfs_fdopen(int fd, const char *mode) {
+  if (mode == NULL) {
+    return NULL;
+  }
+  const vfs_file_t *filp = vfs_file_get(fd);
+  int flags = _parse_mode(mode);
+  if (filp == NULL || flags < 0) {
+    return NULL;
+  }
+  /* the stream may not grant more than the fd was opened for */
+  int acc = filp->flags & O_ACCMODE;
+  if ((flags & O_ACCMODE) != acc && acc != O_RDWR) {
+    return NULL;
+  }
+  return _stream_new(fd, flags & O_ACCMODE);
+}
+
+int vfs_fclose(vfs_stream_t *s) {
+  if (s == NULL) {
+    return -EFAULT;
+  }
+  int res = 0;
+  if (s->fd >= 0) {
+    /* vfs_close() flushes through vfs_stream_detach() */
+    res = vfs_close(s->fd);
+  }
+  mem_pool_free(&_stream_pool, s);
+  return res;
+}
+
+int vfs_stream_detach(vfs_stream_t *s) {
+  int res = (s->err == 0) ? _flush(s) : s->err;
+  s->fd = -1;
+  return res;
+}
+
+int vfs_fflush(vfs_stream_t *s) {
+  if (s == NULL) {
+    return -EFAULT;
+  }
+  if (s->fd < 0) {
+    return -EBADF;
+  }
+  if (s->err) {
+    return s->err;
+  }
+  return _flush(s);
+}
+
+int vfs_setvbuf(vfs_stream_t *s, void *buf, int mode, size_t size) {
+  if (s == NULL) {
+    return -EFAULT;
+  }
+  if (mode != VFS_IOFBF && mode != VFS_IOLBF && mode != VFS_IONBF) {
+    return -EINVAL;
+  }
+  if (s->len) {
+    /* only allowed before the first read or write */
+    return -EBUSY;
+  }
+  if (buf == NULL) {
+    buf = s->_buf;
+    if (size == 0 || size > sizeof(s->_buf)) {
+      size = sizeof(s->_buf);
+    }
+  } else if (size == 0) {
+    return -EINVAL;
+  }
+  s->buf = buf;
+  s->size = size;
+  s->mode = mode;
+  return 0;
+}
+
+int vfs_fileno(const vfs_stream_t *s) { return s ? s->fd : -EFAULT; }
+
+int vfs_ferror(const vfs_stream_t *s) { return s ? s->err : -EFAULT; }
+
+ssize_t vfs_fwrite(vfs_stream_t *s, const void *src, size_t count) {
+  if (src == NULL) {
+    return -EFAULT;
+  }
+  int res = _prep_write(s);
+  if (res < 0) {
+    return res;
+  }
+  s->nl = (s->mode == VFS_IOLBF) && memchr(src, '\n', count) != NULL;
+  if ((res = _put(s, src, count)) < 0 || (res = _end_write(s)) < 0) {
+    return res;
+  }
+  return count;
+}
+
+int vfs_fputc(vfs_stream_t *s, int c) {
+  uint8_t ch = c;
+  ssize_t res = vfs_fwrite(s, &ch, 1);
+  return (res < 0) ? res : ch;
+}
+
+int vfs_fputs(vfs_stream_t *s, const char *str) {
+  if (str == NULL) {
+    return -EFAULT;
+  }
+  ssize_t res = vfs_fwrite(s, str, strlen(str));
+  return (res < 0) ? res : 0;
+}
+
+static void _out_stream(char character, void *arg) {
+  vfs_stream_t *s = arg;
+
+  if (s->err) {
+    return;
+  }
+  s->buf[s->len++] = character;
+  if (character == '\n') {
+    s->nl = 1;
+  }
+  if (s->len == s->size) {
+    _flush(s);
+  }
+}
+
+int vfs_vfprintf(vfs_stream_t *s, const char *format, va_list va) {
+  if (format == NULL) {
+    return -EFAULT;
+  }
+  int res = _prep_write(s);
+  if (res < 0) {
+    return res;
+  }
+  /* unbuffered streams still format into the buffer and write once */
+  s->nl = 0;
+  int ret = vfctprintf(_out_stream, s, format, va);
+  if (s->err) {
+    return s->err;
+  }
+  if ((res = _end_write(s)) < 0) {
+    return res;
+  }
+  return ret;
+}
+
+int vfs_fprintf(vfs_stream_t *s, const char *format, ...) {
+  va_list va;
+  va_start(va, format);
+  int ret = vfs_vfprintf(s, format, va);
+  va_end(va);
+  return ret;
+}
+
+ssize_t vfs_fread(vfs_stream_t *s, void *dest, size_t count) {
+  if (s == NULL || dest == NULL) {
+    return -EFAULT;
+  }
+  if (s->fd < 0 || !_can_read(s)) {
+    return -EBADF;
+  }
+  if (s->err) {
+    return s->err;
+  }
+  if (!s->reading) {
+    int res = _flush(s);
+    if (res < 0) {
+      return res;
+    }
+    s->reading = 1;
+  }
+
+  uint8_t *dst = dest;
+  size_t done = 0;
+  while (done < count) {
+    size_t ahead = s->len - s->pos;
+    if (ahead) {
+      size_t n = MIN(ahead, count - done);
+      vfs_memcpy(&dst[done], &s->buf[s->pos], n);
+      s->pos += n;
+      done += n;
+      continue;
+    }
+    ssize_t res;
+    if (count - done >= s->size || s->mode == VFS_IONBF) {
+      res = vfs_read(s->fd, &dst[done], count - done);
+      if (res > 0) {
+        done += res;
+      }
+    } else {
+      res = vfs_read(s->fd, s->buf, s->size);
+      s->len = (res > 0) ? (size_t)res : 0;
+      s->pos = 0;
+    }
+    if (res < 0) {
+      s->err = res;
+      return done ? (ssize_t)done : res;
+    }
+    if (res == 0) {
+      break;
+    }
+  }
+  return done;
+}
+
+int vfs_stream_init(void) {
+  return mem_pool_create(&_stream_pool, "vfs_stream", sizeof(vfs_stream_t),
+                         sizeof(void *), 0, 0);
+}
@@ -0,0 +1,63 @@
+#ifndef UC_VFS_STREAM_H
+#define UC_VFS_STREAM_H
+
+#include <stdarg.h>
+
+#include "inttypes.h"
+#include "vfs.h"
+
+#ifndef CONFIG_VFS_STREAM_BUF_SIZE
+/** Size of the buffer every stream gets unless vfs_setvbuf() replaces it */
+#define CONFIG_VFS_STREAM_BUF_SIZE (256)
+#endif
+
+/** Buffering modes for vfs_setvbuf() */
+#define VFS_IOFBF (0) /**< flush when the buffer is full */
+#define VFS_IOLBF (1) /**< also flush after every call that wrote a '\n' */
+#define VFS_IONBF (2) /**< hand every call straight to vfs_write() */
+
+/**
+ * @brief   buffered stream on top of a VFS file descriptor
+ *
+ * Small writes are collected in the buffer and reach the driver as one
+ * vfs_write() when the buffer fills up, on vfs_fflush(), vfs_fsync() on the
+ * underlying fd and on close. Reads go through the same buffer, so switching
+ * between reading and writing is allowed at any time.
+ *
+ * A stream is not locked, it must not be shared between tasks.
+ */
+typedef struct vfs_stream {
+  int fd;
+  int flags;       /**< open flags of fd */
+  uint8_t mode;    /**< VFS_IOFBF, VFS_IOLBF or VFS_IONBF */
+  uint8_t reading; /**< buffer holds read-ahead instead of pending writes */
+  uint8_t nl;      /**< a '\n' went into the buffer during the current call */
+  int err;         /**< first error, sticky until vfs_fclose() */
+  uint8_t *buf;
+  size_t size;
+  size_t len; /**< bytes of pending writes or of read-ahead in buf */
+  size_t pos; /**< read position inside the read-ahead */
+  uint8_t _buf[CONFIG_VFS_STREAM_BUF_SIZE];
+} vfs_stream_t;
+
+vfs_stream_t *vfs_fopen(const char *name, const char *mode);
+vfs_stream_t *vfs_fdopen(int fd, const char *mode);
+int vfs_fclose(vfs_stream_t *s);
+int vfs_fflush(vfs_stream_t *s);
+int vfs_setvbuf(vfs_stream_t *s, void *buf, int mode, size_t size);
+int vfs_fileno(const vfs_stream_t *s);
+int vfs_ferror(const vfs_stream_t *s);
+
+ssize_t vfs_fwrite(vfs_stream_t *s, const void *src, size_t count);
+int vfs_fputc(vfs_stream_t *s, int c);
+int vfs_fputs(vfs_stream_t *s, const char *str);
+int vfs_fprintf(vfs_stream_t *s, const char *format, ...);
+int vfs_vfprintf(vfs_stream_t *s, const char *format, va_list va);
+
+ssize_t vfs_fread(vfs_stream_t *s, void *dest, size_t count);
+
+/* called by the fd layer */
+int vfs_stream_detach(vfs_stream_t *s);
+int vfs_stream_init(void);
+
+#endif /* UC_VFS_STREAM_H */
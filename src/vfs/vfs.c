@@ -5,7 +5,9 @@
 #include "common.h"
 #include "errno.h"
 #include "logging.h"
+#include "mem.h"
 #include "mutex.h"
+#include "stream.h"
 #include "vfs.h"
 
 LOG_MODULE_REGISTER(vfs, LOG_LEVEL_INF);
@@ -13,11 +15,22 @@ LOG_MODULE_REGISTER(vfs, LOG_LEVEL_INF);
 static vfs_file_t _vfs_open_files[VFS_MAX_OPEN_FILES];
 static clist_node_t _vfs_mounts_list;
 
+/* per-file driver state, one pool per size class */
+typedef struct {
+  size_t size; /**< block size, 0 while the slot is unused */
+  mem_pool_t pool;
+} _file_pool_t;
+
+static _file_pool_t _file_pools[CONFIG_VFS_FILE_POOLS];
+
 static inline int _allocate_fd(int fd);
 static inline void _free_fd(int fd);
 static inline int _init_fd(int fd, const vfs_file_ops_t *f_op,
                            vfs_mount_t *mountp, int flags, void *private_data);
 
+static void *_file_data_alloc(const vfs_file_system_t *fs);
+static void _file_data_free(const vfs_file_system_t *fs, void *data);
+
 static inline int _find_mount(vfs_mount_t **mountpp, const char *name,
                               const char **rel_path);
 
@@ -32,12 +45,22 @@ int vfs_close(int fd) {
     return res;
   }
   vfs_file_t *filp = &_vfs_open_files[fd];
+  if (filp->stream != NULL) {
+    /* push out whatever the stream still buffers while the fd is usable */
+    res = vfs_stream_detach(filp->stream);
+    filp->stream = NULL;
+  }
   if (filp->f_op->close != NULL) {
     /* We will invalidate the fd regardless of the outcome of the file
      * system driver close() call below */
-    res = filp->f_op->close(filp);
+    int err = filp->f_op->close(filp);
+    res = (res < 0) ? res : err;
   }
+  /* the slot may be reused as soon as it is freed */
+  const vfs_file_system_t *fs = filp->mp->fs;
+  void *data = filp->private_data.ptr;
   _free_fd(fd);
+  _file_data_free(fs, data);
   return res;
 }
 
@@ -105,10 +128,15 @@ int vfs_open(const char *name, int flags, mode_t mode) {
     return res;
   }
   mutex_lock(&_open_mutex);
-  int fd = _init_fd(VFS_ANY_FD, mountp->fs->f_op, mountp, flags, NULL);
+  void *data = _file_data_alloc(mountp->fs);
+  int fd = -ENOMEM;
+  if (data || mountp->fs->file_size == 0) {
+    fd = _init_fd(VFS_ANY_FD, mountp->fs->f_op, mountp, flags, data);
+  }
   mutex_unlock(&_open_mutex);
   if (fd < 0) {
     LOG_DBG("vfs_open: _init_fd: ERR %d!\n", fd);
+    _file_data_free(mountp->fs, data);
     /* remember to decrement the open_files count */
     mountp->open_files--;
     return fd;
@@ -121,6 +149,7 @@ int vfs_open(const char *name, int flags, mode_t mode) {
       LOG_DBG("vfs_open: open: ERR %d!\n", res);
       /* clean up */
       _free_fd(fd);
+      _file_data_free(mountp->fs, data);
       return res;
     }
   }
@@ -228,6 +257,9 @@ int vfs_fsync(int fd) {
     /* File not open for writing */
     return -EBADF;
   }
+  if (filp->stream != NULL && (res = vfs_fflush(filp->stream)) < 0) {
+    return res;
+  }
   if (filp->f_op->fsync == NULL) {
     /* driver does not implement fsync() */
     return -EINVAL;
@@ -602,6 +634,33 @@ int vfs_stat(const char *restrict path, struct stat *restrict buf) {
   return res;
 }
 
+int vfs_gc(vfs_mount_t *mountp, const vfs_gc_t *gc) {
+  if ((mountp == NULL) || (mountp->fs == NULL) || (gc == NULL)) {
+    return -EINVAL;
+  }
+  if ((mountp->fs->fs_op == NULL) || (mountp->fs->fs_op->gc == NULL)) {
+    /* gc not supported */
+    return -ENOTSUP;
+  }
+  mutex_lock(&_mount_mutex);
+  if (clist_find(&_vfs_mounts_list, &mountp->list_entry) == NULL) {
+    mutex_unlock(&_mount_mutex);
+    LOG_DBG("vfs_gc: not mounted\n");
+    return -EINVAL;
+  }
+  /* hold the mount like an open file so it can't be unmounted under us */
+  mountp->open_files++;
+  mutex_unlock(&_mount_mutex);
+
+  int res = mountp->fs->fs_op->gc(mountp, gc);
+  if (res < 0) {
+    LOG_DBG("vfs_gc: ERR %d!\n", res);
+  }
+  /* remember to decrement the open_files count */
+  mountp->open_files--;
+  return res;
+}
+
 int vfs_normalize_path(char *buf, const char *path, size_t buflen) {
   size_t len = 0;
   int npathcomp = 0;
@@ -677,6 +736,19 @@ const vfs_file_t *vfs_file_get(int fd) {
   }
 }
 
+int vfs_file_set_stream(int fd, struct vfs_stream *stream) {
+  int res = _fd_is_valid(fd);
+  if (res < 0) {
+    return res;
+  }
+  vfs_file_t *filp = &_vfs_open_files[fd];
+  if (stream != NULL && filp->stream != NULL) {
+    return -EBUSY;
+  }
+  filp->stream = stream;
+  return 0;
+}
+
 static inline int _allocate_fd(int fd) {
   if (fd < 0) {
     for (fd = 0; fd < VFS_MAX_OPEN_FILES; ++fd) {
@@ -715,10 +787,57 @@ static inline int _init_fd(int fd, const vfs_file_ops_t *f_op,
   filp->f_op = f_op;
   filp->flags = flags;
   filp->pos = 0;
+  filp->stream = NULL;
   filp->private_data.ptr = private_data;
   return fd;
 }
 
+/* called with _open_mutex held, the slots are only ever filled in */
+static mem_pool_t *_file_pool(size_t size) {
+  size = ROUND_UP(size, CONFIG_VFS_FILE_POOL_ALIGN);
+  for (unsigned i = 0; i < CONFIG_VFS_FILE_POOLS; i++) {
+    _file_pool_t *p = &_file_pools[i];
+    if (p->size == size) {
+      return &p->pool;
+    }
+    if (p->size == 0) {
+      if (mem_pool_create(&p->pool, "vfs_file", size, sizeof(void *), 0, 0)) {
+        return NULL;
+      }
+      p->size = size;
+      return &p->pool;
+    }
+  }
+  LOG_DBG("vfs: no pool left for %u byte files\n", (unsigned)size);
+  return NULL;
+}
+
+static void *_file_data_alloc(const vfs_file_system_t *fs) {
+  if (fs->file_size == 0) {
+    return NULL;
+  }
+  mem_pool_t *pool = _file_pool(fs->file_size);
+  void *data = pool ? mem_pool_alloc(pool) : NULL;
+  if (data) {
+    /* drivers may look at the state of other open files */
+    memset(data, 0, fs->file_size);
+  }
+  return data;
+}
+
+static void _file_data_free(const vfs_file_system_t *fs, void *data) {
+  if (data == NULL) {
+    return;
+  }
+  size_t size = ROUND_UP(fs->file_size, CONFIG_VFS_FILE_POOL_ALIGN);
+  for (unsigned i = 0; i < CONFIG_VFS_FILE_POOLS; i++) {
+    if (_file_pools[i].size == size) {
+      mem_pool_free(&_file_pools[i].pool, data);
+      return;
+    }
+  }
+}
+
 static inline int _find_mount(vfs_mount_t **mountpp, const char *name,
                               const char **rel_path) {
   size_t longest_match = 0;
@@ -816,6 +935,13 @@ int vfs_sysop_stat_from_fstat(vfs_mount_t *mountp, const char *restrict path,
                               struct stat *restrict buf) {
   const vfs_file_ops_t *f_op = mountp->fs->f_op;
 
+  mutex_lock(&_open_mutex);
+  void *data = _file_data_alloc(mountp->fs);
+  mutex_unlock(&_open_mutex);
+  if (data == NULL && mountp->fs->file_size) {
+    return -ENOMEM;
+  }
+
   union {
     vfs_file_t file;
     vfs_DIR dir;
@@ -825,27 +951,32 @@ int vfs_sysop_stat_from_fstat(vfs_mount_t *mountp, const char *restrict path,
               .mp = mountp,
               /* As per definition of the `vfsfile_ops::open` field */
               .f_op = f_op,
-              .private_data = {.ptr = NULL},
+              .private_data = {.ptr = data},
               .pos = 0,
           },
   };
 
   int err = f_op->open(&filedir.file, path, 0, 0);
   if (err < 0) {
+    /* the directory handle overlays the file one, data is still ours */
     if (_is_dir(mountp, &filedir.dir, path)) {
       buf->st_mode = S_IFDIR;
-      return 0;
+      err = 0;
     }
-    return err;
+  } else {
+    err = f_op->fstat(&filedir.file, buf);
+    f_op->close(&filedir.file);
   }
-  err = f_op->fstat(&filedir.file, buf);
-  f_op->close(&filedir.file);
+  _file_data_free(mountp->fs, data);
   return err;
 }
 
 int vfs_init() {
   int ret = 0;
 
+  if ((ret = mem_init())) {
+    return ret;
+  }
   if ((ret = mutex_init(&_mount_mutex))) {
     return ret;
   }
@@ -855,5 +986,8 @@ int vfs_init() {
   if ((ret = ramdisk_init())) {
     return ret;
   }
+  if ((ret = vfs_stream_init())) {
+    return ret;
+  }
   return ret;
 }
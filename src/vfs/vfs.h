@@ -19,27 +19,9 @@
 #ifdef MODULE_FATFS_VFS
 #include "fatfs/ffconf.h"
 
-#if FF_FS_TINY
-#define _FATFS_FILE_CACHE (0)
-#else
-#define _FATFS_FILE_CACHE FF_MAX_SS
-#endif
-
-#if FF_USE_FASTSEEK
-#if (__SIZEOF_POINTER__ == 8)
-#define _FATFS_FILE_SEEK_PTR (8)
-#else
-#define _FATFS_FILE_SEEK_PTR (4)
-#endif
-#else
-#define _FATFS_FILE_SEEK_PTR (0)
-#endif
-
 #if FF_FS_EXFAT
-#define _FATFS_FILE_EXFAT (48)
 #define _FATFS_DIR_EXFAT (32)
 #else
-#define _FATFS_FILE_EXFAT (0)
 #define _FATFS_DIR_EXFAT (0)
 #endif
 
@@ -55,35 +37,25 @@
 
 #if (__SIZEOF_POINTER__ == 8)
 #define FATFS_VFS_DIR_BUFFER_SIZE (64 + _FATFS_DIR_LFN + _FATFS_DIR_EXFAT)
-#define FATFS_VFS_FILE_BUFFER_SIZE                                             \
-  (64 + VFS_NAME_MAX + _FATFS_FILE_CACHE + _FATFS_FILE_SEEK_PTR +              \
-   _FATFS_FILE_EXFAT)
 #else
 #define FATFS_VFS_DIR_BUFFER_SIZE (44 + _FATFS_DIR_LFN + _FATFS_DIR_EXFAT)
-#define FATFS_VFS_FILE_BUFFER_SIZE                                             \
-  (44 + VFS_NAME_MAX + _FATFS_FILE_CACHE + _FATFS_FILE_SEEK_PTR +              \
-   _FATFS_FILE_EXFAT)
 #endif
 #else
 #define FATFS_VFS_DIR_BUFFER_SIZE (1)
-#define FATFS_VFS_FILE_BUFFER_SIZE (1)
 #endif
 
 #ifdef MODULE_LITTLEFS2
 #if (__SIZEOF_POINTER__ == 8)
 #define LITTLEFS2_VFS_DIR_BUFFER_SIZE (56)
-#define LITTLEFS2_VFS_FILE_BUFFER_SIZE (104)
 #else
 #define LITTLEFS2_VFS_DIR_BUFFER_SIZE (52)
-#define LITTLEFS2_VFS_FILE_BUFFER_SIZE (84)
 #endif
 #else
 #define LITTLEFS2_VFS_DIR_BUFFER_SIZE (1)
-#define LITTLEFS2_VFS_FILE_BUFFER_SIZE (1)
 #endif
 
 #ifndef VFS_MAX_OPEN_FILES
-#define VFS_MAX_OPEN_FILES (16)
+#define VFS_MAX_OPEN_FILES (32)
 #endif
 
 #ifndef VFS_DIR_BUFFER_SIZE
@@ -92,9 +64,17 @@
   MAX(FATFS_VFS_DIR_BUFFER_SIZE, LITTLEFS2_VFS_DIR_BUFFER_SIZE)
 #endif
 
-#ifndef VFS_FILE_BUFFER_SIZE
-#define VFS_FILE_BUFFER_SIZE                                                   \
-  MAX(FATFS_VFS_FILE_BUFFER_SIZE, LITTLEFS2_VFS_FILE_BUFFER_SIZE)
+#ifndef CONFIG_VFS_FILE_POOLS
+/**
+ * Number of pools the per-file driver state is allocated from, one for each
+ * distinct vfs_file_system_t::file_size rounded up to
+ * CONFIG_VFS_FILE_POOL_ALIGN
+ */
+#define CONFIG_VFS_FILE_POOLS (4)
+#endif
+
+#ifndef CONFIG_VFS_FILE_POOL_ALIGN
+#define CONFIG_VFS_FILE_POOL_ALIGN (16)
 #endif
 
 #ifndef VFS_NAME_MAX
@@ -103,6 +83,14 @@
 
 #define VFS_ANY_FD (-1)
 
+/**
+ * @brief   open() hint: the file will mostly be accessed at random offsets
+ *
+ * Drivers that keep per-file lookup structures for random access set them up
+ * for files opened with this flag, the others ignore it.
+ */
+#define VFS_O_RANDOM (1 << 24)
+
 typedef struct vfs_file_ops vfs_file_ops_t;
 
 typedef struct vfs_dir_ops vfs_dir_ops_t;
@@ -111,15 +99,31 @@ typedef struct vfs_file_system_ops vfs_file_system_ops_t;
 
 typedef struct vfs_mount_struct vfs_mount_t;
 
+struct vfs_stream;
+
 extern const vfs_file_ops_t mtd_vfs_ops;
 
 #define VFS_FS_FLAG_WANT_ABS_PATH (1 << 0)
 
+/** Background maintenance request passed to vfs_file_system_ops::gc */
+typedef struct {
+  /** free space (bytes) the driver should try to keep reclaimed */
+  size_t threshold;
+  /** upper bound of bytes a single pass may relocate, 0 means no limit */
+  size_t budget;
+} vfs_gc_t;
+
 typedef struct {
   const vfs_file_ops_t *f_op;
   const vfs_dir_ops_t *d_op;
   const vfs_file_system_ops_t *fs_op;
   const uint32_t flags;
+  /**
+   * size of the per-file state the VFS allocates before calling
+   * vfs_file_ops::open and hands over in vfs_file_t::private_data.ptr,
+   * 0 if the driver does not need any
+   */
+  const size_t file_size;
 } vfs_file_system_t;
 
 struct vfs_mount_struct {
@@ -138,10 +142,11 @@ typedef struct {
   int flags;
   off_t pos;
   OS_TCB *p_tcb;
+  /** buffered stream on top of this fd, flushed by vfs_fsync and vfs_close */
+  struct vfs_stream *stream;
   union {
     void *ptr;
     int value;
-    uint8_t buffer[VFS_FILE_BUFFER_SIZE];
   } private_data;
 } vfs_file_t;
 
@@ -188,6 +193,8 @@ struct vfs_file_system_ops {
   int (*rmdir)(vfs_mount_t *mountp, const char *name);
   int (*stat)(vfs_mount_t *mountp, const char *restrict path,
               struct stat *restrict buf);
+  /* returns > 0 if some work was done, 0 if there was nothing to do */
+  int (*gc)(vfs_mount_t *mountp, const vfs_gc_t *gc);
 };
 
 int vfs_open(const char *name, int flags, mode_t mode);
@@ -209,11 +216,13 @@ int vfs_unlink(const char *name);
 int vfs_mkdir(const char *name, mode_t mode);
 int vfs_rmdir(const char *name);
 int vfs_stat(const char *restrict path, struct stat *restrict buf);
+int vfs_gc(vfs_mount_t *mountp, const vfs_gc_t *gc);
 
 int vfs_normalize_path(char *buf, const char *path, size_t buflen);
 ssize_t vfs_readline(int fd, char *dest, size_t count);
 
 const vfs_file_t *vfs_file_get(int fd);
+int vfs_file_set_stream(int fd, struct vfs_stream *stream);
 
 int vfs_sysop_stat_from_fstat(vfs_mount_t *mountp, const char *restrict path,
                               struct stat *restrict buf);
@@ -0,0 +1,8 @@
+#ifndef UC_VFS_MKIMAGE_CPU_H
+#define UC_VFS_MKIMAGE_CPU_H
+
+/* the VFS headers take their integer types from uC-CPU, here libc has them */
+#include <stddef.h>
+#include <stdint.h>
+
+#endif
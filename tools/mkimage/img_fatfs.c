@@ -0,0 +1,142 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ff.h"
+
+#include "diskio.h"
+
+#include "mkimage.h"
+
+#define VOLUME "0:"
+
+static FATFS _fs;
+
+static int _err(const char *what, const char *path, FRESULT res) {
+  if (res == FR_OK) {
+    return 0;
+  }
+  fprintf(stderr, "fatfs: %s %s=%d\n", what, path, (int)res);
+  switch (res) {
+  case FR_DENIED:
+    /* also a full directory or volume */
+    return -ENOSPC;
+  case FR_EXIST:
+    return -EEXIST;
+  case FR_INVALID_NAME:
+    return -EINVAL;
+  default:
+    return -EIO;
+  }
+}
+
+/* "/dir/file" on the volume */
+static const char *_path(char *buf, size_t size, const char *path) {
+  snprintf(buf, size, VOLUME "%s", path);
+  return buf;
+}
+
+static int _format(const image_opts_t *opts) {
+  static BYTE work[FF_MAX_SS];
+  /* as vfs_format() does it */
+  const MKFS_PARM param = {
+      .fmt = FF_FS_EXFAT ? FM_EXFAT : FM_FAT,
+      .au_size = opts->au_size,
+  };
+
+  int ret = _err("mkfs", VOLUME, f_mkfs(VOLUME, &param, work, sizeof(work)));
+  if (ret == 0) {
+    ret = _err("mount", VOLUME, f_mount(&_fs, VOLUME, 1));
+  }
+  return ret;
+}
+
+static int _mkdir(const char *path) {
+  char buf[256];
+
+  return _err("mkdir", path, f_mkdir(_path(buf, sizeof(buf), path)));
+}
+
+static int _write(const char *path, const uint8_t *data, size_t len) {
+  char buf[256];
+  FIL fp;
+  UINT n = 0;
+
+  FRESULT res = f_open(&fp, _path(buf, sizeof(buf), path),
+                       FA_WRITE | FA_CREATE_NEW);
+  if (res != FR_OK) {
+    return _err("open", path, res);
+  }
+  res = f_write(&fp, data, len, &n);
+  FRESULT cres = f_close(&fp);
+  if (res == FR_OK && n < len) {
+    res = FR_DENIED;
+  }
+  return _err("write", path, res != FR_OK ? res : cres);
+}
+
+static int _finish(void) {
+  return _err("unmount", VOLUME, f_unmount(VOLUME));
+}
+
+const image_fs_t image_fatfs = {
+    .name = "fat",
+    .fill = 0x00,
+    .format = _format,
+    .mkdir = _mkdir,
+    .write = _write,
+    .finish = _finish,
+};
+
+/* one volume, the whole image */
+
+DSTATUS disk_status(BYTE pdrv) { return pdrv ? STA_NOINIT : 0; }
+
+DSTATUS disk_initialize(BYTE pdrv) { return pdrv ? STA_NOINIT : 0; }
+
+DRESULT disk_read(BYTE pdrv, BYTE *buff, LBA_t sector, UINT count) {
+  if (pdrv || sector + count > CONFIG_RAM_N_SECS) {
+    return RES_PARERR;
+  }
+  memcpy(buff, &image[sector * CONFIG_RAM_SEC_SIZE],
+         count * CONFIG_RAM_SEC_SIZE);
+  return RES_OK;
+}
+
+DRESULT disk_write(BYTE pdrv, const BYTE *buff, LBA_t sector, UINT count) {
+  if (pdrv || sector + count > CONFIG_RAM_N_SECS) {
+    return RES_PARERR;
+  }
+  memcpy(&image[sector * CONFIG_RAM_SEC_SIZE], buff,
+         count * CONFIG_RAM_SEC_SIZE);
+  return RES_OK;
+}
+
+DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void *buff) {
+  switch (cmd) {
+  case CTRL_SYNC:
+  case CTRL_TRIM:
+    return RES_OK;
+  case GET_SECTOR_COUNT:
+    *(LBA_t *)buff = CONFIG_RAM_N_SECS;
+    return RES_OK;
+  case GET_SECTOR_SIZE:
+    *(WORD *)buff = CONFIG_RAM_SEC_SIZE;
+    return RES_OK;
+  case GET_BLOCK_SIZE:
+    *(DWORD *)buff = 1;
+    return RES_OK;
+  default:
+    return RES_PARERR;
+  }
+}
+
+/* single threaded */
+
+int ff_mutex_create(int vol) { return 1; }
+
+void ff_mutex_delete(int vol) {}
+
+int ff_mutex_take(int vol) { return 1; }
+
+void ff_mutex_give(int vol) {}
@@ -0,0 +1,117 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "lfs.h"
+#include "littlefs_vfs_config.h"
+
+#include "mkimage.h"
+
+#define CACHE_SIZE (CONFIG_PAGE_SIZE * CONFIG_LITTLEFS2_CACHE_PAGES)
+
+static lfs_t _lfs;
+static struct lfs_config _cfg;
+
+/* LFS_NO_MALLOC, littlefs gets every buffer */
+static uint8_t _read_buf[CACHE_SIZE];
+static uint8_t _prog_buf[CACHE_SIZE];
+static uint8_t _file_buf[CACHE_SIZE];
+static uint8_t _lookahead_buf[CONFIG_LITTLEFS2_LOOKAHEAD_SIZE];
+
+static int _err(const char *what, const char *path, int res) {
+  if (res < 0) {
+    fprintf(stderr, "littlefs: %s %s=%d\n", what, path, res);
+  }
+  /* LFS_ERR_* are errno values */
+  return res < 0 ? res : 0;
+}
+
+static int _dev_read(const struct lfs_config *c, lfs_block_t block,
+                     lfs_off_t off, void *buffer, lfs_size_t size) {
+  memcpy(buffer, &image[block * c->block_size + off], size);
+  return 0;
+}
+
+static int _dev_prog(const struct lfs_config *c, lfs_block_t block,
+                     lfs_off_t off, const void *buffer, lfs_size_t size) {
+  memcpy(&image[block * c->block_size + off], buffer, size);
+  return 0;
+}
+
+/* like the trim of the firmware, erased blocks read as the disk fill */
+static int _dev_erase(const struct lfs_config *c, lfs_block_t block) {
+  memset(&image[block * c->block_size], image_littlefs.fill, c->block_size);
+  return 0;
+}
+
+static int _dev_sync(const struct lfs_config *c) { return 0; }
+
+static int _format(const image_opts_t *opts) {
+  lfs_size_t block_size =
+      opts->block_size ? opts->block_size
+                       : CONFIG_SECTORS_PER_BLOCK * CONFIG_RAM_SEC_SIZE;
+
+  if (block_size % CONFIG_RAM_SEC_SIZE || IMAGE_SIZE / block_size < 2) {
+    fprintf(stderr, "littlefs: block size %u\n", (unsigned)block_size);
+    return -EINVAL;
+  }
+  _cfg.read = _dev_read;
+  _cfg.prog = _dev_prog;
+  _cfg.erase = _dev_erase;
+  _cfg.sync = _dev_sync;
+  _cfg.block_size = block_size;
+  _cfg.block_count = IMAGE_SIZE / block_size;
+  _cfg.read_size = CONFIG_PAGE_SIZE;
+  _cfg.prog_size = CONFIG_PAGE_SIZE;
+  _cfg.cache_size = CACHE_SIZE;
+  _cfg.lookahead_size = CONFIG_LITTLEFS2_LOOKAHEAD_SIZE;
+  _cfg.read_buffer = _read_buf;
+  _cfg.prog_buffer = _prog_buf;
+  _cfg.lookahead_buffer = _lookahead_buf;
+  _cfg.block_cycles = CONFIG_LITTLEFS2_BLOCK_CYCLES;
+  _cfg.metadata_max = CONFIG_LITTLEFS2_METADATA_MAX;
+  _cfg.compact_thresh = CONFIG_LITTLEFS2_COMPACT_THRESH;
+  /* same as the mount, inlined files must fit the metadata log */
+  lfs_size_t mdir = _cfg.metadata_max ? _cfg.metadata_max : block_size;
+  _cfg.inline_max = CONFIG_PAGE_SIZE < mdir / 8 ? CONFIG_PAGE_SIZE : mdir / 8;
+
+  int ret = _err("format", "/", lfs_format(&_lfs, &_cfg));
+  if (ret == 0) {
+    ret = _err("mount", "/", lfs_mount(&_lfs, &_cfg));
+  }
+  return ret;
+}
+
+static int _mkdir(const char *path) {
+  return _err("mkdir", path, lfs_mkdir(&_lfs, path));
+}
+
+static int _write(const char *path, const uint8_t *data, size_t len) {
+  const struct lfs_file_config fcfg = {.buffer = _file_buf};
+  lfs_file_t file;
+
+  int ret = lfs_file_opencfg(&_lfs, &file, path,
+                             LFS_O_WRONLY | LFS_O_CREAT | LFS_O_EXCL, &fcfg);
+  if (ret < 0) {
+    return _err("open", path, ret);
+  }
+  lfs_ssize_t n = lfs_file_write(&_lfs, &file, data, len);
+  ret = lfs_file_close(&_lfs, &file);
+  if (n >= 0 && (size_t)n < len) {
+    n = LFS_ERR_NOSPC;
+  }
+  return _err("write", path, n < 0 ? (int)n : ret);
+}
+
+static int _finish(void) {
+  return _err("unmount", "/", lfs_unmount(&_lfs));
+}
+
+const image_fs_t image_littlefs = {
+    .name = "littlefs",
+    .fill = 0xFF,
+    .format = _format,
+    .mkdir = _mkdir,
+    .write = _write,
+    .finish = _finish,
+};
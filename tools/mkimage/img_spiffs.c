@@ -0,0 +1,136 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "spiffs.h"
+#include "spiffs_vfs_config.h"
+
+#include "mkimage.h"
+
+#define FD_SPACE_SIZE (4 * 64)
+#define CACHE_SIZE (4 * 1024)
+
+static spiffs _fs;
+static spiffs_config _cfg;
+static u8_t *_work;
+static u8_t _fd_space[FD_SPACE_SIZE];
+static u8_t _cache[CACHE_SIZE];
+
+static int _err(const char *what, const char *path, s32_t res) {
+  if (res >= 0) {
+    return 0;
+  }
+  fprintf(stderr, "spiffs: %s %s=%d\n", what, path, (int)res);
+  switch (res) {
+  case SPIFFS_ERR_FULL:
+    return -ENOSPC;
+  case SPIFFS_ERR_CONFLICTING_NAME:
+    return -EEXIST;
+  case SPIFFS_ERR_NAME_TOO_LONG:
+    return -ENAMETOOLONG;
+  default:
+    return -EIO;
+  }
+}
+
+static s32_t _dev_read(struct spiffs_t *fs, u32_t addr, u32_t size, u8_t *dst) {
+  memcpy(dst, &image[addr], size);
+  return SPIFFS_OK;
+}
+
+/* plain stores like the ramdisk, not NOR flash semantics */
+static s32_t _dev_write(struct spiffs_t *fs, u32_t addr, u32_t size,
+                        u8_t *src) {
+  memcpy(&image[addr], src, size);
+  return SPIFFS_OK;
+}
+
+static s32_t _dev_erase(struct spiffs_t *fs, u32_t addr, u32_t size) {
+  memset(&image[addr], 0xFF, size);
+  return SPIFFS_OK;
+}
+
+static s32_t _mount(void) {
+  return SPIFFS_mount(&_fs, &_cfg, _work, _fd_space, sizeof(_fd_space),
+                      _cache, sizeof(_cache), NULL);
+}
+
+static int _format(const image_opts_t *opts) {
+  _cfg.hal_read_f = _dev_read;
+  _cfg.hal_write_f = _dev_write;
+  _cfg.hal_erase_f = _dev_erase;
+  _cfg.phys_size = IMAGE_SIZE;
+  _cfg.phys_addr = 0;
+  _cfg.phys_erase_block = opts->block_size ? opts->block_size
+                                           : CONFIG_SPIFFS_VFS_ERASE_BLOCK_SIZE;
+  _cfg.log_block_size = _cfg.phys_erase_block;
+  _cfg.log_page_size =
+      opts->page_size ? opts->page_size : CONFIG_SPIFFS_VFS_PAGE_SIZE;
+  if (_cfg.log_block_size % _cfg.log_page_size ||
+      _cfg.log_block_size < 2 * _cfg.log_page_size ||
+      _cfg.phys_size % _cfg.log_block_size) {
+    fprintf(stderr, "spiffs: block size %u, page size %u\n",
+            (unsigned)_cfg.log_block_size, (unsigned)_cfg.log_page_size);
+    return -EINVAL;
+  }
+#if CONFIG_SPIFFS_VFS_SNAPSHOT
+  /* the mount summary lives behind the file system, left erased here */
+  _cfg.phys_size -= _cfg.phys_erase_block;
+#endif
+
+  if ((_work = malloc(2 * _cfg.log_page_size)) == NULL) {
+    return -ENOMEM;
+  }
+  /* SPIFFS_format() takes the configuration of a failed mount */
+  if (_mount() == SPIFFS_OK) {
+    SPIFFS_unmount(&_fs);
+  }
+  int ret = _err("format", "/", SPIFFS_format(&_fs));
+  if (ret == 0) {
+    ret = _err("mount", "/", _mount());
+  }
+  return ret;
+}
+
+/* directories only exist as name prefixes */
+static int _mkdir(const char *path) { return 0; }
+
+static int _write(const char *path, const uint8_t *data, size_t len) {
+  if (strlen(path) >= SPIFFS_OBJ_NAME_LEN) {
+    fprintf(stderr, "spiffs: %s: name longer than %u\n", path,
+            (unsigned)SPIFFS_OBJ_NAME_LEN - 1);
+    return -ENAMETOOLONG;
+  }
+  spiffs_file fh = SPIFFS_open(&_fs, path,
+                               SPIFFS_O_WRONLY | SPIFFS_O_CREAT |
+                                   SPIFFS_O_EXCL,
+                               0);
+  if (fh < 0) {
+    return _err("open", path, fh);
+  }
+  s32_t n = SPIFFS_write(&_fs, fh, (void *)data, len);
+  s32_t ret = SPIFFS_close(&_fs, fh);
+  return _err("write", path, n < 0 ? n : ret);
+}
+
+static int _finish(void) {
+  SPIFFS_unmount(&_fs);
+  free(_work);
+  return 0;
+}
+
+const image_fs_t image_spiffs = {
+    .name = "spiffs",
+    .fill = 0xFF,
+    .format = _format,
+    .mkdir = _mkdir,
+    .write = _write,
+    .finish = _finish,
+};
+
+/* single threaded */
+
+void spiffs_lock(struct spiffs_t *fs) {}
+
+void spiffs_unlock(struct spiffs_t *fs) {}
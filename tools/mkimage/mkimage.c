@@ -0,0 +1,244 @@
+/*
+ * Builds a pre-populated file system image for the ramdisks on the host, from
+ * the same FatFs, littlefs and SPIFFS sources as the firmware. The image is
+ * given to ramdisk_load() at boot instead of formatting and writing every
+ * file through the VFS.
+ */
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mkimage.h"
+
+#define PATH_MAX_LEN (256)
+
+uint8_t image[IMAGE_SIZE];
+
+typedef struct {
+  unsigned files;
+  unsigned dirs;
+  size_t bytes;
+} _totals_t;
+
+static const image_fs_t *const _fs_list[] = {
+    &image_fatfs,
+    &image_littlefs,
+    &image_spiffs,
+};
+
+static void _usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s -t fat|littlefs|spiffs -o IMAGE [-c FILE.c] [-s SYMBOL]\n"
+          "          [-a AU_SIZE] [-b BLOCK_SIZE] [-p PAGE_SIZE] DIR\n"
+          "\n"
+          "Formats a %u x %u byte ramdisk image and copies DIR into it.\n"
+          "  -c  also write the image as a C array for ramdisk_load()\n"
+          "  -a  FAT cluster size, -b littlefs block or SPIFFS erase block,\n"
+          "      -p SPIFFS page, the firmware defaults otherwise\n",
+          prog, (unsigned)CONFIG_RAM_N_SECS, (unsigned)CONFIG_RAM_SEC_SIZE);
+}
+
+static int _read_file(const char *host, uint8_t **data, size_t *len) {
+  FILE *f = fopen(host, "rb");
+  if (f == NULL) {
+    return -errno;
+  }
+  int ret = 0;
+  if (fseek(f, 0, SEEK_END) || (*len = ftell(f), fseek(f, 0, SEEK_SET))) {
+    ret = -errno;
+  } else if ((*data = malloc(*len ? *len : 1)) == NULL) {
+    ret = -ENOMEM;
+  } else if (fread(*data, 1, *len, f) != *len) {
+    free(*data);
+    ret = -EIO;
+  }
+  fclose(f);
+  return ret;
+}
+
+/* sorted, the same tree gives the same image */
+static int _add_dir(const image_fs_t *fs, const char *host, const char *path,
+                    _totals_t *t) {
+  struct dirent **names;
+  int ret = 0;
+
+  int n = scandir(host, &names, NULL, alphasort);
+  if (n < 0) {
+    ret = -errno;
+    fprintf(stderr, "%s: %s\n", host, strerror(-ret));
+    return ret;
+  }
+  for (int i = 0; i < n; i++) {
+    const char *name = names[i]->d_name;
+    char host_path[PATH_MAX_LEN];
+    char fs_path[PATH_MAX_LEN];
+    struct stat st;
+
+    if (ret || strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+      continue;
+    }
+    if ((size_t)snprintf(host_path, sizeof(host_path), "%s/%s", host, name) >=
+            sizeof(host_path) ||
+        (size_t)snprintf(fs_path, sizeof(fs_path), "%s/%s", path, name) >=
+            sizeof(fs_path)) {
+      fprintf(stderr, "%s/%s: path too long\n", host, name);
+      ret = -ENAMETOOLONG;
+    } else if (stat(host_path, &st)) {
+      ret = -errno;
+      fprintf(stderr, "%s: %s\n", host_path, strerror(-ret));
+    } else if (S_ISDIR(st.st_mode)) {
+      if ((ret = fs->mkdir(fs_path)) == 0) {
+        t->dirs++;
+        ret = _add_dir(fs, host_path, fs_path, t);
+      }
+    } else if (S_ISREG(st.st_mode)) {
+      uint8_t *data = NULL;
+      size_t len = 0;
+      if ((ret = _read_file(host_path, &data, &len))) {
+        fprintf(stderr, "%s: %s\n", host_path, strerror(-ret));
+      } else {
+        ret = fs->write(fs_path, data, len);
+        free(data);
+        t->files++;
+        t->bytes += len;
+      }
+    }
+  }
+  for (int i = 0; i < n; i++) {
+    free(names[i]);
+  }
+  free(names);
+  return ret;
+}
+
+static int _write_raw(const char *out) {
+  FILE *f = fopen(out, "wb");
+  if (f == NULL) {
+    return -errno;
+  }
+  int ret = fwrite(image, 1, sizeof(image), f) == sizeof(image) ? 0 : -EIO;
+  if (fclose(f) && ret == 0) {
+    ret = -errno;
+  }
+  return ret;
+}
+
+/* trailing sectors of the fill value are left to the pad of ramdisk_load() */
+static size_t _used_size(uint8_t fill) {
+  size_t end = sizeof(image);
+
+  while (end && image[end - 1] == fill) {
+    end--;
+  }
+  return (end + CONFIG_RAM_SEC_SIZE - 1) / CONFIG_RAM_SEC_SIZE *
+         CONFIG_RAM_SEC_SIZE;
+}
+
+static int _write_c(const char *out, const char *sym, const image_fs_t *fs) {
+  size_t size = _used_size(fs->fill);
+  FILE *f = fopen(out, "w");
+  if (f == NULL) {
+    return -errno;
+  }
+
+  fprintf(f,
+          "/* generated by mkimage, %s image of %u sectors of %u bytes */\n"
+          "#include <stddef.h>\n"
+          "#include <stdint.h>\n\n",
+          fs->name, (unsigned)CONFIG_RAM_N_SECS,
+          (unsigned)CONFIG_RAM_SEC_SIZE);
+  fprintf(f, "const uint8_t %s[%zu] __attribute__((aligned(4))) = {", sym,
+          size ? size : 1);
+  for (size_t i = 0; i < size; i++) {
+    fprintf(f, "%s0x%02x,", i % 12 ? " " : "\n    ", image[i]);
+  }
+  fprintf(f,
+          "\n};\n\n"
+          "const size_t %s_size = %zu;\n"
+          "/* the rest of the disk, the pad of ramdisk_load() */\n"
+          "const uint8_t %s_pad = 0x%02x;\n",
+          sym, size, sym, fs->fill);
+
+  int ret = ferror(f) ? -EIO : 0;
+  if (fclose(f) && ret == 0) {
+    ret = -errno;
+  }
+  return ret;
+}
+
+int main(int argc, char **argv) {
+  const image_fs_t *fs = NULL;
+  const char *out = NULL;
+  const char *c_out = NULL;
+  const char *sym = "fs_image";
+  image_opts_t opts = {0};
+  _totals_t t = {0};
+  int opt;
+
+  while ((opt = getopt(argc, argv, "t:o:c:s:a:b:p:h")) != -1) {
+    switch (opt) {
+    case 't':
+      for (size_t i = 0; i < sizeof(_fs_list) / sizeof(_fs_list[0]); i++) {
+        if (strcmp(optarg, _fs_list[i]->name) == 0) {
+          fs = _fs_list[i];
+        }
+      }
+      break;
+    case 'o':
+      out = optarg;
+      break;
+    case 'c':
+      c_out = optarg;
+      break;
+    case 's':
+      sym = optarg;
+      break;
+    case 'a':
+      opts.au_size = strtoul(optarg, NULL, 0);
+      break;
+    case 'b':
+      opts.block_size = strtoul(optarg, NULL, 0);
+      break;
+    case 'p':
+      opts.page_size = strtoul(optarg, NULL, 0);
+      break;
+    default:
+      _usage(argv[0]);
+      return 2;
+    }
+  }
+  if (fs == NULL || out == NULL || optind != argc - 1) {
+    _usage(argv[0]);
+    return 2;
+  }
+
+  memset(image, fs->fill, sizeof(image));
+  int ret = fs->format(&opts);
+  if (ret == 0) {
+    ret = _add_dir(fs, argv[optind], "", &t);
+    int fret = fs->finish();
+    ret = ret ? ret : fret;
+  }
+  if (ret) {
+    fprintf(stderr, "%s: %s\n", fs->name, strerror(-ret));
+    return 1;
+  }
+
+  if ((ret = _write_raw(out))) {
+    fprintf(stderr, "%s: %s\n", out, strerror(-ret));
+    return 1;
+  }
+  if (c_out && (ret = _write_c(c_out, sym, fs))) {
+    fprintf(stderr, "%s: %s\n", c_out, strerror(-ret));
+    return 1;
+  }
+  printf("%s: %u files, %u directories, %zu bytes, %zu of %zu image bytes "
+         "used\n",
+         fs->name, t.files, t.dirs, t.bytes, _used_size(fs->fill),
+         sizeof(image));
+  return 0;
+}
@@ -0,0 +1,41 @@
+#ifndef UC_VFS_MKIMAGE_H
+#define UC_VFS_MKIMAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ramdisk.h"
+
+#define IMAGE_SIZE (CONFIG_RAM_SEC_SIZE * CONFIG_RAM_N_SECS)
+
+/** the disk as the firmware sees it, offset 0 is the first ramdisk sector */
+extern uint8_t image[IMAGE_SIZE];
+
+/** geometry options, 0 selects the default of the firmware */
+typedef struct {
+  uint32_t au_size;    /**< FAT cluster size */
+  uint32_t block_size; /**< littlefs block, SPIFFS erase block */
+  uint32_t page_size;  /**< SPIFFS logical page */
+} image_opts_t;
+
+/**
+ * @brief   file system backend of mkimage
+ *
+ * Paths are absolute inside the file system, "/dir/file". Errors are
+ * negative errno values, the backend reports the native code on stderr.
+ */
+typedef struct {
+  const char *name;
+  uint8_t fill; /**< content of the image before formatting */
+  int (*format)(const image_opts_t *opts);
+  int (*mkdir)(const char *path);
+  int (*write)(const char *path, const uint8_t *data, size_t len);
+  /** flush and unmount, the image is complete afterwards */
+  int (*finish)(void);
+} image_fs_t;
+
+extern const image_fs_t image_fatfs;
+extern const image_fs_t image_littlefs;
+extern const image_fs_t image_spiffs;
+
+#endif